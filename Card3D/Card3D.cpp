@@ -249,6 +249,9 @@ public:
                         double& winScaleV,
                         double& winRoll) const;
 
+    // are some of the values used by getValueAtTime() animated?
+    bool getIsAnimating() const;
+
     static void getMatrix(const Matrix4x4& pos,
                           CameraProjectionModeEnum projectionMode,
                           double focalLength,
@@ -481,6 +484,13 @@ CameraParam::getValueAtTime(double time,
     winRoll = _camWinRoll->getValueAtTime(time);
 }
 
+bool
+CameraParam::getIsAnimating() const
+{
+    return ( _camProjectionMode->getIsAnimating() || _camFocalLength->getIsAnimating() || _camHAperture->getIsAnimating() ||
+             _camWinTranslate->getIsAnimating() || _camWinScale->getIsAnimating() || _camWinRoll->getIsAnimating() );
+}
+
 void
 CameraParam::getMatrix(const Matrix4x4& pos,
                        const CameraProjectionModeEnum projectionMode,
@@ -723,6 +733,9 @@ public:
 
     void getMatrix(double time, Matrix4x4* mat) const;
 
+    // are some of the values used by getMatrix() or by the projection animated?
+    bool getIsAnimating() const;
+
     static void define(ImageEffectDescriptor &desc,
                        PageParamDescriptor *page,
                        GroupParamDescriptor *group,
@@ -1394,6 +1407,26 @@ PosMatParam::define(ImageEffectDescriptor &desc,
     }
 }
 
+bool
+PosMatParam::getIsAnimating() const
+{
+    if ( _useMatrix->getIsAnimating() || _transformOrder->getIsAnimating() || _rotationOrder->getIsAnimating() ||
+         _translate->getIsAnimating() || _rotate->getIsAnimating() || _scale->getIsAnimating() ||
+         _uniformScale->getIsAnimating() || _skew->getIsAnimating() || _pivot->getIsAnimating() ||
+         ( _projection && _projection->getIsAnimating() ) ) {
+        return true;
+    }
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            if ( _matrix[i][j]->getIsAnimating() ) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
 void
 PosMatParam::getMatrix(const double t, Matrix4x4* mat) const
 {
@@ -1586,6 +1619,22 @@ PosMatParam::changedParam(const InstanceChangedArgs &args,
 ////////////////////////////////////////////////////////////////////////////////
 
 
+// the values the matrix of a card depends on, at one time, see Card3DPlugin::getCardMatrix()
+struct Card3DValues
+{
+    Matrix4x4 axis;
+    Matrix4x4 cam;
+    CameraProjectionModeEnum camProjectionMode;
+    double camFocal;
+    double camHAperture; // only the ratio focal/haperture matters for card3d
+    double camWinTranslate[2];
+    double camWinScale[2];
+    double camWinRoll;
+    Matrix4x4 card;
+    double lensInFocal;
+    double lensInHAperture;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class Card3DPlugin
@@ -1674,6 +1723,14 @@ private:
     virtual void getClipPreferences(ClipPreferencesSetter &clipPreferences) OVERRIDE FINAL;
     virtual bool isIdentity(double time) OVERRIDE FINAL;
     virtual bool getInverseTransformCanonical(double time, int view, double amount, bool invert, Matrix3x3* invtransform) const OVERRIDE FINAL;
+    virtual void getInverseTransformsCanonical(const double* times, const double* amounts, size_t n, int view, bool invert, Matrix3x3* invtransforms, bool* success) const OVERRIDE FINAL;
+    void getCardMatrix(double time, int view, Matrix3x3* mat) const;
+    void getAxisValues(double time, int view, Card3DValues* values) const;
+    void getCamValues(double time, int view, Card3DValues* values) const;
+    void getLensValues(double time, Card3DValues* values) const;
+    static void composeCardMatrix(const Card3DValues& values, Matrix3x3* mat);
+    bool getFormatMatrices(double time, Matrix3x3* N, Matrix3x3* D, bool* timeDependent) const;
+    bool composeInverseTransform(const Matrix3x3& mat, const Matrix3x3& N, const Matrix3x3& D, bool invert, Matrix3x3* invtransform) const;
 
     virtual void changedParam(const InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
 
@@ -1852,7 +1909,88 @@ Card3DPlugin::getInverseTransformCanonical(double time,
                                               bool invert,
                                               Matrix3x3* invtransform) const
 {
-    Matrix4x4 axis;
+    Matrix3x3 N, D;
+    bool timeDependent;
+    if ( !getFormatMatrices(time, &N, &D, &timeDependent) ) {
+        return false;
+    }
+    Matrix3x3 mat;
+    getCardMatrix(time, view, &mat);
+
+    return composeInverseTransform(mat, N, D, invert, invtransform);
+}
+
+// The normalization matrices only depend on time when the source has no format, and the parts of the card matrix
+// whose parameters are not animated are fetched once, so that they are usually computed once for all the samples.
+// The cameras of the Nuke camera extension do not tell whether they are animated, and are fetched at each time.
+void
+Card3DPlugin::getInverseTransformsCanonical(const double* times,
+                                            const double* /*amounts*/,
+                                            size_t n,
+                                            int view,
+                                            bool invert,
+                                            Matrix3x3* invtransforms,
+                                            bool* success) const
+{
+    const bool axisAnimated = _axisCamera ? _axisCamera->isConnected() : _axisPosMat->getIsAnimating();
+    const bool camAnimated = _camCamera ? _camCamera->isConnected() : ( _camEnable->getIsAnimating() || _camPosMat->getIsAnimating() );
+    const bool cardAnimated = _card.getIsAnimating();
+    const bool lensAnimated = _lensInFocal->getIsAnimating() || _lensInHAperture->getIsAnimating();
+    Matrix3x3 N, D, mat;
+    Card3DValues values;
+    bool hasFormat = false;
+    bool timeDependent = true;
+    for (size_t i = 0; i < n; ++i) {
+        const bool first = (i == 0);
+        const bool newTime = first || (times[i] != times[i - 1]);
+        if ( first || (timeDependent && newTime) ) {
+            hasFormat = getFormatMatrices(times[i], &N, &D, &timeDependent);
+        }
+        bool changed = first;
+        if ( first || (axisAnimated && newTime) ) {
+            getAxisValues(times[i], view, &values);
+            changed = true;
+        }
+        if ( first || (camAnimated && newTime) ) {
+            getCamValues(times[i], view, &values);
+            changed = true;
+        }
+        if ( first || (cardAnimated && newTime) ) {
+            _card.getMatrix(times[i], &values.card);
+            changed = true;
+        }
+        if ( first || (lensAnimated && newTime) ) {
+            getLensValues(times[i], &values);
+            changed = true;
+        }
+        if (changed) {
+            composeCardMatrix(values, &mat);
+        }
+        success[i] = hasFormat && composeInverseTransform(mat, N, D, invert, &invtransforms[i]);
+    }
+}
+
+// the direct transform of the card, in normalized coordinates
+void
+Card3DPlugin::getCardMatrix(double time,
+                            int view,
+                            Matrix3x3* mat) const
+{
+    Card3DValues values;
+    getAxisValues(time, view, &values);
+    getCamValues(time, view, &values);
+    _card.getMatrix(time, &values.card);
+    getLensValues(time, &values);
+    composeCardMatrix(values, mat);
+}
+
+void
+Card3DPlugin::getAxisValues(double time,
+                            int view,
+                            Card3DValues* values) const
+{
+    Matrix4x4& axis = values->axis;
+    axis = Matrix4x4();
     if (_axisCamera) {
         if (_axisCamera->isConnected()) {
             _axisCamera->getParameter(kNukeOfxCameraParamPositionMatrix, time, view, &axis(0,0), 16);
@@ -1862,66 +2000,87 @@ Card3DPlugin::getInverseTransformCanonical(double time,
     } else {
         _axisPosMat->getMatrix(time, &axis);
     }
-    Matrix4x4 cam;
-    CameraProjectionModeEnum camProjectionMode = eCameraProjectionModePerspective;
-    double camFocal = 1.;
-    double camHAperture = 1.; // only the ratio focal/haperture matters for card3d
-    double camWinTranslate[2] = {0., 0.};
-    double camWinScale[2] = {1., 1.};
-    double camWinRoll = 0.;
+}
+
+void
+Card3DPlugin::getCamValues(double time,
+                           int view,
+                           Card3DValues* values) const
+{
+    Matrix4x4& cam = values->cam;
+    cam = Matrix4x4();
+    values->camProjectionMode = eCameraProjectionModePerspective;
+    values->camFocal = 1.;
+    values->camHAperture = 1.;
+    values->camWinTranslate[0] = values->camWinTranslate[1] = 0.;
+    values->camWinScale[0] = values->camWinScale[1] = 1.;
+    values->camWinRoll = 0.;
     if (_camCamera) {
         if (_camCamera->isConnected()) {
             _camCamera->getParameter(kNukeOfxCameraParamPositionMatrix, time, view, &cam(0,0), 16);
             double projectionMode;
             _camCamera->getParameter(kNukeOfxCameraParamProjectionMode, time, view, &projectionMode, 1);
-            camProjectionMode = (CameraProjectionModeEnum)((int)projectionMode);
-            _camCamera->getParameter(kNukeOfxCameraParamFocalLength, time, view, &camFocal, 1);
-            _camCamera->getParameter(kNukeOfxCameraParamHorizontalAperture, time, view, &camHAperture, 1);
-            _camCamera->getParameter(kNukeOfxCameraParamWindowTranslate, time, view, camWinTranslate, 2);
-            _camCamera->getParameter(kNukeOfxCameraParamWindowScale, time, view, camWinScale, 2);
-            _camCamera->getParameter(kNukeOfxCameraParamWindowRoll, time, view, &camWinRoll, 1);
+            values->camProjectionMode = (CameraProjectionModeEnum)((int)projectionMode);
+            _camCamera->getParameter(kNukeOfxCameraParamFocalLength, time, view, &values->camFocal, 1);
+            _camCamera->getParameter(kNukeOfxCameraParamHorizontalAperture, time, view, &values->camHAperture, 1);
+            _camCamera->getParameter(kNukeOfxCameraParamWindowTranslate, time, view, values->camWinTranslate, 2);
+            _camCamera->getParameter(kNukeOfxCameraParamWindowScale, time, view, values->camWinScale, 2);
+            _camCamera->getParameter(kNukeOfxCameraParamWindowRoll, time, view, &values->camWinRoll, 1);
         }
     } else if (_camEnable->getValueAtTime(time)) {
         _camPosMat->getMatrix(time, &cam);
-        _camPosMat->getProjection().getValueAtTime(time, camProjectionMode, camFocal, camHAperture, camWinTranslate[0], camWinTranslate[1], camWinScale[0], camWinScale[1], camWinRoll);
+        _camPosMat->getProjection().getValueAtTime(time, values->camProjectionMode, values->camFocal, values->camHAperture, values->camWinTranslate[0], values->camWinTranslate[1], values->camWinScale[0], values->camWinScale[1], values->camWinRoll);
     } else {
         cam(0,0) = cam(1,1) = cam(2,2) = cam(3,3) = 1.;
     }
-    Matrix4x4 card;
-    _card.getMatrix(time, &card);
+}
 
+void
+Card3DPlugin::getLensValues(double time,
+                            Card3DValues* values) const
+{
+    values->lensInFocal = _lensInFocal->getValueAtTime(time);
+    values->lensInHAperture = _lensInHAperture->getValueAtTime(time);
+}
 
+void
+Card3DPlugin::composeCardMatrix(const Card3DValues& values,
+                                Matrix3x3* mat)
+{
     // compose matrices
     Matrix4x4 invCam;
-    if ( !cam.inverse(&invCam) ) {
+    if ( !values.cam.inverse(&invCam) ) {
         invCam(0,0) = invCam(1,1) = invCam(2,2) = invCam(3,3) = 1.;
     }
-    Matrix4x4 pos = invCam * axis * card;
+    Matrix4x4 pos = invCam * values.axis * values.card;
 
     // apply camera params
-    Matrix3x3 mat;
-    CameraParam::getMatrix(pos, camProjectionMode, camFocal, camHAperture, camWinTranslate[0], camWinTranslate[1], camWinScale[0], camWinScale[1], camWinRoll, &mat);
-
-    double lensInFocal = _lensInFocal->getValueAtTime(time);
-    double lensInHAperture = _lensInHAperture->getValueAtTime(time);
-    double a = lensInHAperture / (std::max)(1e-8, lensInFocal);
-    mat(0,0) *= a;
-    mat(1,0) *= a;
-    mat(2,0) *= a;
-    mat(0,1) *= a;
-    mat(1,1) *= a;
-    mat(2,1) *= a;
-
-    // mat is the direct transform, from source coords to output coords.
-    // it is normalized for coordinates in (-0.5,0.5)x(-0.5*h/w,0.5*h/w) with y from to to bottom
+    CameraParam::getMatrix(pos, values.camProjectionMode, values.camFocal, values.camHAperture, values.camWinTranslate[0], values.camWinTranslate[1], values.camWinScale[0], values.camWinScale[1], values.camWinRoll, mat);
+
+    double a = values.lensInHAperture / (std::max)(1e-8, values.lensInFocal);
+    (*mat)(0,0) *= a;
+    (*mat)(1,0) *= a;
+    (*mat)(2,0) *= a;
+    (*mat)(0,1) *= a;
+    (*mat)(1,1) *= a;
+    (*mat)(2,1) *= a;
+}
 
+// the matrices that normalize the source and denormalize the output, see getCardMatrix()
+bool
+Card3DPlugin::getFormatMatrices(double time,
+                                Matrix3x3* N,
+                                Matrix3x3* D,
+                                bool* timeDependent) const
+{
     // get the input format (Natron only) or the input RoD (others)
     OfxRectD srcFormatCanonical;
     {
         OfxRectI srcFormat;
         _srcClip->getFormat(srcFormat);
         double par = _srcClip->getPixelAspectRatio();
-        if ( OFX::Coords::rectIsEmpty(srcFormat) ) {
+        *timeDependent = OFX::Coords::rectIsEmpty(srcFormat);
+        if (*timeDependent) {
             // no format is available, use the RoD instead
             srcFormatCanonical = _srcClip->getRegionOfDefinition(time);
         } else {
@@ -1937,32 +2096,45 @@ Card3DPlugin::getInverseTransformCanonical(double time,
     OfxRectD dstFormatCanonical;
     OFX::Coords::toCanonical(dstFormat, rs1, dstPar, &dstFormatCanonical);
 
-    Matrix3x3 N; // normalize source
+    // normalize source
     {
         double w = srcFormatCanonical.x2 - srcFormatCanonical.x1;
         //double h = srcFormatCanonical.y2 - srcFormatCanonical.y1;
         if (w == 0.) {
             return false;
         }
-        N(0,0) = 1./w;
-        N(0,2) = -(srcFormatCanonical.x1 + srcFormatCanonical.x2) / (2. * w);
-        N(1,1) = 1./w;
-        N(1,2) = -(srcFormatCanonical.y1 + srcFormatCanonical.y2) / (2. * w);
-        N(2,2) = 1.;
+        (*N)(0,0) = 1./w;
+        (*N)(0,2) = -(srcFormatCanonical.x1 + srcFormatCanonical.x2) / (2. * w);
+        (*N)(1,1) = 1./w;
+        (*N)(1,2) = -(srcFormatCanonical.y1 + srcFormatCanonical.y2) / (2. * w);
+        (*N)(2,2) = 1.;
     }
 
-    Matrix3x3 D; // denormalize output
+    // denormalize output
     {
         double w = dstFormatCanonical.x2 - dstFormatCanonical.x1;
         //double h = dstFormatCanonical.y2 - dstFormatCanonical.y1;
-        D(0,0) = -w;
-        D(0,2) = (dstFormatCanonical.x1 + dstFormatCanonical.x2) / 2.;
-        D(1,1) = -w;
-        D(1,2) = (dstFormatCanonical.y1 + dstFormatCanonical.y2) / 2.;
-        D(2,2) = 1.;
+        (*D)(0,0) = -w;
+        (*D)(0,2) = (dstFormatCanonical.x1 + dstFormatCanonical.x2) / 2.;
+        (*D)(1,1) = -w;
+        (*D)(1,2) = (dstFormatCanonical.y1 + dstFormatCanonical.y2) / 2.;
+        (*D)(2,2) = 1.;
     }
 
-    mat = D * mat * N;
+    return true;
+}
+
+bool
+Card3DPlugin::composeInverseTransform(const Matrix3x3& card,
+                                      const Matrix3x3& N,
+                                      const Matrix3x3& D,
+                                      bool invert,
+                                      Matrix3x3* invtransform) const
+{
+    // card is the direct transform, from source coords to output coords.
+    // it is normalized for coordinates in (-0.5,0.5)x(-0.5*h/w,0.5*h/w) with y from to to bottom
+    Matrix3x3 mat = D * card * N;
+
 
     if (invert) {
         (*invtransform) = mat;
@@ -1973,7 +2145,7 @@ Card3DPlugin::getInverseTransformCanonical(double time,
     }
 
     return true;
-} // Card3DPlugin::getInverseTransformCanonical
+} // Card3DPlugin::composeInverseTransform
 
 
 void
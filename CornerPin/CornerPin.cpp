@@ -186,6 +186,24 @@ static const char* const kParamFrom[4] = {
 
 static bool gHostSupportsDefaultCoordinateSystem = true; // for kParamDefaultsNormalised
 
+// the values of the parameters of a CornerPinPlugin at one time
+struct CornerPinValues
+{
+    bool enable[4];
+    OfxPointD from[4];
+    OfxPointD to[4];
+    double transformAmount;
+    Matrix3x3 extraMatrix;
+};
+
+// the parameters of a CornerPinPlugin at a set of times, see Transform3x3Plugin::getTransformParams()
+class CornerPinParamsBatch
+    : public Transform3x3Plugin::TransformParams
+{
+public:
+    std::vector<CornerPinValues> values;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class CornerPinPlugin
@@ -255,6 +273,18 @@ private:
         return ret;
     }
 
+    // the extra matrix at each time, fetched once if it is not animated
+    void getExtraMatrices(const double* times,
+                          size_t n,
+                          CornerPinValues* values) const
+    {
+        const bool animated = _extraMatrixRow1->getIsAnimating() || _extraMatrixRow2->getIsAnimating() || _extraMatrixRow3->getIsAnimating();
+
+        for (size_t i = 0; i < n; ++i) {
+            values[i].extraMatrix = (i > 0 && ( !animated || times[i] == times[i - 1]) ) ? values[i - 1].extraMatrix : getExtraMatrix(times[i]);
+        }
+    }
+
     bool getHomography(OfxTime time, const OfxPointD & scale,
                        bool inverseTransform,
                        const Point3D & p1,
@@ -264,6 +294,8 @@ private:
                        Matrix3x3 & m);
     virtual bool isIdentity(double time) OVERRIDE FINAL;
     virtual bool getInverseTransformCanonical(double time, int view, double amount, bool invert, Matrix3x3* invtransform) const OVERRIDE FINAL;
+    virtual TransformParams* getTransformParams(const double* times, size_t n, int view) const OVERRIDE FINAL;
+    virtual bool getInverseTransformCanonicalFromParams(const TransformParams& params, size_t i, double amount, bool invert, Matrix3x3* invtransform) const OVERRIDE FINAL;
     virtual void changedParam(const InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
 
     /** @brief called when a clip has just been changed in some way (a rewire maybe) */
@@ -284,29 +316,66 @@ private:
 
 bool
 CornerPinPlugin::getInverseTransformCanonical(OfxTime time,
-                                              int /*view*/,
+                                              int view,
                                               double amount,
                                               bool invert,
                                               Matrix3x3* invtransform) const
 {
+    auto_ptr<TransformParams> params( getTransformParams(&time, 1, view) );
+
+    return getInverseTransformCanonicalFromParams(*params, 0, amount, invert, invtransform);
+}
+
+Transform3x3Plugin::TransformParams*
+CornerPinPlugin::getTransformParams(const double* times,
+                                    size_t n,
+                                    int /*view*/) const
+{
+    auto_ptr<CornerPinParamsBatch> batch(new CornerPinParamsBatch);
+
+    batch->values.resize(n);
+    CornerPinValues* values = n ? &batch->values.front() : NULL;
+    for (int j = 0; j < 4; ++j) {
+        ofxsGetValuesAtTimes(_enable[j], times, n, values, &CornerPinValues::enable, j);
+        ofxsGetValuesAtTimes(_from[j], times, n, values, &CornerPinValues::from, j);
+        ofxsGetValuesAtTimes(_to[j], times, n, values, &CornerPinValues::to, j);
+    }
+    ofxsGetValuesAtTimes(_transformAmount, times, n, values, &CornerPinValues::transformAmount);
+    getExtraMatrices(times, n, values);
+
+    return batch.release();
+}
+
+bool
+CornerPinPlugin::getInverseTransformCanonicalFromParams(const TransformParams& params,
+                                                        size_t sample,
+                                                        double amount,
+                                                        bool invert,
+                                                        Matrix3x3* invtransform) const
+{
+    assert( dynamic_cast<const CornerPinParamsBatch*>(&params) );
+    const CornerPinParamsBatch& batch = static_cast<const CornerPinParamsBatch&>(params);
+    assert( sample < batch.values.size() );
+    const CornerPinValues& values = batch.values[sample];
     // in this new version, both from and to are enabled/disabled at the same time
-    bool enable[4];
+    const bool* enable = values.enable;
     Point3D p[2][4];
     int f = invert ? 0 : 1;
     int t = invert ? 1 : 0;
     int k = 0;
 
     for (int i = 0; i < 4; ++i) {
-        _enable[i]->getValueAtTime(time, enable[i]);
         if (enable[i]) {
-            _from[i]->getValueAtTime(time, p[f][k].x, p[f][k].y);
-            _to[i]->getValueAtTime(time, p[t][k].x, p[t][k].y);
+            p[f][k].x = values.from[i].x;
+            p[f][k].y = values.from[i].y;
+            p[t][k].x = values.to[i].x;
+            p[t][k].y = values.to[i].y;
             ++k;
         }
         p[0][i].z = p[1][i].z = 1.;
     }
 
-    amount *= _transformAmount->getValueAtTime(time);
+    amount *= values.transformAmount;
 
     if (amount != 1.) {
         int k = 0;
@@ -326,7 +395,7 @@ CornerPinPlugin::getInverseTransformCanonical(OfxTime time,
     assert(0 <= k && k <= 4);
     if (k == 0) {
         // no points, only apply extraMat;
-        *invtransform = getExtraMatrix(time);
+        *invtransform = values.extraMatrix;
 
         return true;
     }
@@ -356,11 +425,10 @@ CornerPinPlugin::getInverseTransformCanonical(OfxTime time,
         homo3x3 *= -1;
     }
 
-    Matrix3x3 extraMat = getExtraMatrix(time);
-    *invtransform = homo3x3 * extraMat;
+    *invtransform = homo3x3 * values.extraMatrix;
 
     return true;
-} // CornerPinPlugin::getInverseTransformCanonical
+} // CornerPinPlugin::getInverseTransformCanonicalFromParams
 
 // overridden is identity
 bool
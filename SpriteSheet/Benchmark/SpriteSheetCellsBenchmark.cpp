@@ -0,0 +1,158 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * SpriteSheetCellsBenchmark: compare the direct frame-to-cell computation of the SpriteSheet plugin, which runs in
+ * getRegionsOfInterest and in render, with a lookup in a table of the cells of one animation period.
+ * It also counts the host parameter fetches: the plugin used to read the eleven sprite parameters in each of these
+ * actions, and now reads them once while none of them is animated.
+ * Usage: SpriteSheetCellsBenchmark [frames] [period]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+
+#include "../SpriteSheetCells.h"
+
+using namespace OFX;
+
+namespace {
+const int kParamFetchesPerAction = 11; // the parameters read by SpriteSheetPlugin::getSpriteParams
+const int kActionsPerFrame = 2;        // getRegionsOfInterest and render
+
+// a grid sheet that plays period sprites forward and backward
+SpriteSheetParams
+makeParams(int period)
+{
+    SpriteSheetParams p;
+    const int columns = 64;
+    const int rows = (period + columns - 1) / columns;
+
+    p.rodPixel.x1 = p.rodPixel.y1 = 0;
+    p.rodPixel.x2 = columns * 32;
+    p.rodPixel.y2 = rows * 32;
+    p.spriteSize.x = p.spriteSize.y = 32;
+    p.spriteRange.x = 0;
+    p.spriteRange.y = period - 1;
+    p.frameOffset = 3;
+    p.frameSeparation = 1;
+    p.readingDirection = eReadingDirectionHorizontalForwardS;
+    p.playbackMode = ePlaybackModeNormalReverse;
+    p.loopOffset = 0;
+    p.repeatRange.x = p.repeatRange.y = 0;
+    p.repeatCount = 0;
+    p.spritesCut.x = p.spritesCut.y = 1;
+    p.scale = 1;
+    p.animated = false;
+
+    return p;
+}
+
+bool
+sameCell(const SpriteCell& a,
+         const SpriteCell& b)
+{
+    return (a.rect.x1 == b.rect.x1 && a.rect.y1 == b.rect.y1 && a.rect.x2 == b.rect.x2 && a.rect.y2 == b.rect.y2 &&
+            a.window.x1 == b.window.x1 && a.window.y1 == b.window.y1 && a.window.x2 == b.window.x2 && a.window.y2 == b.window.y2);
+}
+
+double
+elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+int
+main(int argc,
+     char* argv[])
+{
+    const int frames = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+    const int period = (argc > 2) ? std::atoi(argv[2]) : 240;
+    if ( (frames <= 0) || (period <= 0) || (period > kSpriteIndexMaxPeriod) ) {
+        std::fprintf(stderr, "usage: %s [frames] [period <= %d]\n", argv[0], kSpriteIndexMaxPeriod);
+
+        return 1;
+    }
+    const SpriteSheetParams p = makeParams(period);
+    long long checksum = 0;
+
+    // the direct computation, once per action
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int t = 0; t < frames; ++t) {
+        for (int a = 0; a < kActionsPerFrame; ++a) {
+            SpriteCell cell;
+            bool reversed;
+            const int phase = getSpritePhase(t, p, &reversed);
+            getSpriteCell(phase, reversed, p, &cell);
+            checksum += cell.rect.x1 + cell.rect.y1;
+        }
+    }
+    const double directMs = elapsedMs(start);
+
+    // a table of the cells of one period, including its build
+    start = std::chrono::steady_clock::now();
+    const bool backAndForth = (p.playbackMode == ePlaybackModeNormalReverse || p.playbackMode == ePlaybackModeNormalReverseMerge);
+    std::vector<SpriteCell> table(backAndForth ? 2 * period : period);
+    for (int phase = 0; phase < period; ++phase) {
+        getSpriteCell(phase, false, p, &table[phase]);
+        if (backAndForth) {
+            getSpriteCell(phase, true, p, &table[period + phase]);
+        }
+    }
+    for (int t = 0; t < frames; ++t) {
+        for (int a = 0; a < kActionsPerFrame; ++a) {
+            bool reversed;
+            const int phase = getSpritePhase(t, p, &reversed);
+            const SpriteCell& cell = table[reversed ? period + phase : phase];
+            checksum -= cell.rect.x1 + cell.rect.y1;
+        }
+    }
+    const double tableMs = elapsedMs(start);
+
+    // both paths give the same cells
+    for (int t = -2 * period; t < 2 * period; ++t) {
+        SpriteCell direct;
+        bool reversed;
+        const int phase = getSpritePhase(t, p, &reversed);
+        getSpriteCell(phase, reversed, p, &direct);
+        if ( !sameCell(direct, table[reversed ? period + phase : phase]) ) {
+            std::fprintf(stderr, "frame %d: the table differs from the direct computation\n", t);
+
+            return 1;
+        }
+    }
+    if (checksum != 0) {
+        std::fprintf(stderr, "the checksums differ\n");
+
+        return 1;
+    }
+
+    std::printf("%d frames, period %d\n", frames, period);
+    std::printf("direct: %8.2f ms, %.1f ns per frame\n", directMs, 1e6 * directMs / frames);
+    std::printf("table:  %8.2f ms, %.1f ns per frame\n", tableMs, 1e6 * tableMs / frames);
+    std::printf("host parameter fetches: %d per frame before, %d in total now (none is animated), %d per frame when animated\n",
+                kParamFetchesPerAction * kActionsPerFrame, kParamFetchesPerAction, kParamFetchesPerAction * kActionsPerFrame);
+
+    return 0;
+} // main
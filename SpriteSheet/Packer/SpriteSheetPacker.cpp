@@ -0,0 +1,842 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * SpriteSheetPacker: pack a sequence of PNG frames into one sprite sheet and its atlas metadata, the reverse of the
+ * SpriteSheet plugin.
+ * The frames are laid out on a uniform grid, in one of the reading directions of the plugin, or packed with the
+ * MaxRects algorithm, and may be trimmed to their visible pixels. The sheet can be read back by the plugin, either
+ * as a grid (Sprite Size, Reading Direction, a sprite range starting at 0) or through the metadata (Atlas File).
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "tinythread.h"
+
+#include "../SpriteSheetAtlas.h"
+#include "../SpriteSheetGrid.h"
+#include "../SpriteSheetPng.h"
+
+using namespace OFX;
+using std::string;
+using std::vector;
+
+namespace {
+struct PackerOptions
+{
+    vector<string> inputs;
+    string output;
+    string metadata;
+    bool maxRects;
+    int columns;                     // grid: sprites per line, or 0 for a square sheet
+    ReadingDirectionEnum readingDirection;
+    bool trim;
+    int padding;                     // MaxRects: transparent pixels between the frames
+    int maxWidth;                    // MaxRects: width of the sheet, or 0 to find the smallest sheet
+    unsigned int threads;
+    bool verify;
+};
+
+struct PackerFrame
+{
+    string path;
+    string name;                     // the key of the frame in the metadata
+    SpriteSheetPngImage image;
+    OfxRectI visible;                // the pixels to pack, top-left origin (the whole frame if not trimmed)
+    SpriteAtlasFrame frame;          // where the visible pixels are packed
+    string error;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// parallel loop
+
+struct ParallelJob
+{
+    void (*work)(size_t i, void* data);
+    void* data;
+    size_t count;
+    size_t next;
+    tthread::mutex mutex;
+};
+
+static void
+parallelWorker(void* arg)
+{
+    ParallelJob* job = (ParallelJob*)arg;
+
+    for (;;) {
+        size_t i;
+        {
+            tthread::lock_guard<tthread::mutex> lock(job->mutex);
+            if (job->next >= job->count) {
+                return;
+            }
+            i = job->next++;
+        }
+        job->work(i, job->data);
+    }
+}
+
+// call work(i, data) for each i in [0, count), on at most nThreads threads
+static void
+parallelFor(size_t count,
+            unsigned int nThreads,
+            void (*work)(size_t i, void* data),
+            void* data)
+{
+    ParallelJob job;
+
+    job.work = work;
+    job.data = data;
+    job.count = count;
+    job.next = 0;
+    nThreads = (unsigned int)std::min( (size_t)std::max(nThreads, 1U), std::max(count, (size_t)1) );
+    vector<tthread::thread*> threads;
+    for (unsigned int t = 1; t < nThreads; ++t) {
+        threads.push_back( new tthread::thread(parallelWorker, &job) );
+    }
+    parallelWorker(&job);
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t]->join();
+        delete threads[t];
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loading and trimming
+
+struct LoadJob
+{
+    vector<PackerFrame>* frames;
+    bool trim;
+};
+
+static void
+loadFrame(size_t i,
+          void* data)
+{
+    LoadJob* job = (LoadJob*)data;
+    PackerFrame& f = (*job->frames)[i];
+
+    if ( !spriteSheetPngRead(f.path, &f.image, &f.error) ) {
+        return;
+    }
+    const int w = f.image.width;
+    const int h = f.image.height;
+    f.visible.x1 = f.visible.y1 = 0;
+    f.visible.x2 = w;
+    f.visible.y2 = h;
+    if (!job->trim) {
+        return;
+    }
+    // the bounding box of the pixels with a non-zero alpha
+    int x1 = w, y1 = h, x2 = 0, y2 = 0;
+    for (int y = 0; y < h; ++y) {
+        const unsigned short* row = &f.image.rgba[(size_t)y * w * 4];
+        int first = 0;
+        while ( first < w && row[first * 4 + 3] == 0 ) {
+            ++first;
+        }
+        if (first == w) {
+            continue;
+        }
+        int last = w - 1;
+        while (row[last * 4 + 3] == 0) {
+            --last;
+        }
+        x1 = std::min(x1, first);
+        x2 = std::max(x2, last + 1);
+        y1 = std::min(y1, y);
+        y2 = y + 1;
+    }
+    if (x1 >= x2) {
+        // fully transparent
+        f.visible.x1 = f.visible.y1 = f.visible.x2 = f.visible.y2 = 0;
+    } else {
+        f.visible.x1 = x1;
+        f.visible.y1 = y1;
+        f.visible.x2 = x2;
+        f.visible.y2 = y2;
+    }
+} // loadFrame
+
+////////////////////////////////////////////////////////////////////////////////
+// layouts
+
+// Lay the frames out on a uniform grid, in the order of the SpriteSheet reading direction.
+// All the cells have the size of the union of the visible rectangles, and each frame is cropped to that rectangle,
+// so that the cells can be read back with a single Sprite Size.
+static void
+layoutGrid(const PackerOptions& options,
+           vector<PackerFrame>* frames,
+           OfxPointI* spriteSize,
+           int* width,
+           int* height)
+{
+    OfxRectI box = { 0, 0, 0, 0 };
+    bool empty = true;
+
+    for (size_t i = 0; i < frames->size(); ++i) {
+        const OfxRectI& v = (*frames)[i].visible;
+        if ( (v.x1 >= v.x2) || (v.y1 >= v.y2) ) {
+            continue;
+        }
+        if (empty) {
+            box = v;
+            empty = false;
+        } else {
+            box.x1 = std::min(box.x1, v.x1);
+            box.y1 = std::min(box.y1, v.y1);
+            box.x2 = std::max(box.x2, v.x2);
+            box.y2 = std::max(box.y2, v.y2);
+        }
+    }
+    if (empty) {
+        box.x2 = box.y2 = 1;
+    }
+    const int n = (int)frames->size();
+    const int columns = options.columns > 0 ? options.columns : std::max( 1, (int)std::ceil( std::sqrt( (double)n ) ) );
+    const int lines = (n + columns - 1) / columns;
+    const bool verticalRead = (options.readingDirection == eReadingDirectionVerticalForward || options.readingDirection == eReadingDirectionVerticalBackward ||
+                               options.readingDirection == eReadingDirectionVerticalForwardS || options.readingDirection == eReadingDirectionVerticalBackwardS);
+    spriteSize->x = box.x2 - box.x1;
+    spriteSize->y = box.y2 - box.y1;
+    *width = (verticalRead ? lines : columns) * spriteSize->x;
+    *height = (verticalRead ? columns : lines) * spriteSize->y;
+    const OfxRectI rodPixel = { 0, 0, *width, *height };
+    const OfxPointI spritesCut = { 1, 1 };
+    for (int i = 0; i < n; ++i) {
+        PackerFrame& f = (*frames)[i];
+        OfxRectI cell;
+        spriteSheetGridCell(i, options.readingDirection, rodPixel, *spriteSize, 0, spritesCut, &cell);
+        f.frame.x = cell.x1;
+        f.frame.y = *height - cell.y2; // the metadata has its origin at the top-left of the sheet
+        f.frame.offsetX = box.x1;
+        f.frame.offsetY = box.y1;
+        f.frame.w = std::max(0, std::min(box.x2, f.image.width) - box.x1);
+        f.frame.h = std::max(0, std::min(box.y2, f.image.height) - box.y1);
+        f.frame.sourceW = f.image.width;
+        f.frame.sourceH = f.image.height;
+    }
+} // layoutGrid
+
+struct PackRect
+{
+    int x, y, w, h;
+};
+
+// MaxRects bin packing (Jukka Jylänki, "A Thousand Ways to Pack the Bin"), with the best short side fit rule,
+// and without rotation since the plugin does not read rotated frames
+class MaxRectsBin
+{
+public:
+    MaxRectsBin(int width,
+                int height)
+    {
+        PackRect r = { 0, 0, width, height };
+
+        _free.push_back(r);
+    }
+
+    bool insert(int w,
+                int h,
+                int* x,
+                int* y)
+    {
+        int best = -1;
+        int bestShort = 0, bestLong = 0;
+
+        for (size_t i = 0; i < _free.size(); ++i) {
+            const PackRect& r = _free[i];
+            if ( (w > r.w) || (h > r.h) ) {
+                continue;
+            }
+            const int shortSide = std::min(r.w - w, r.h - h);
+            const int longSide = std::max(r.w - w, r.h - h);
+            if ( (best < 0) || (shortSide < bestShort) || ( (shortSide == bestShort) && (longSide < bestLong) ) ||
+                 ( (shortSide == bestShort) && (longSide == bestLong) && (r.y < _free[best].y) ) ) {
+                best = (int)i;
+                bestShort = shortSide;
+                bestLong = longSide;
+            }
+        }
+        if (best < 0) {
+            return false;
+        }
+        const PackRect used = { _free[best].x, _free[best].y, w, h };
+        split(used);
+        prune();
+        *x = used.x;
+        *y = used.y;
+
+        return true;
+    }
+
+private:
+    // replace the free rectangles that intersect used by the maximal free rectangles around it
+    void split(const PackRect& used)
+    {
+        vector<PackRect> next;
+
+        for (size_t i = 0; i < _free.size(); ++i) {
+            const PackRect f = _free[i];
+            if ( (used.x >= f.x + f.w) || (used.x + used.w <= f.x) || (used.y >= f.y + f.h) || (used.y + used.h <= f.y) ) {
+                next.push_back(f);
+                continue;
+            }
+            if (used.x > f.x) {
+                const PackRect r = { f.x, f.y, used.x - f.x, f.h };
+                next.push_back(r);
+            }
+            if (used.x + used.w < f.x + f.w) {
+                const PackRect r = { used.x + used.w, f.y, f.x + f.w - (used.x + used.w), f.h };
+                next.push_back(r);
+            }
+            if (used.y > f.y) {
+                const PackRect r = { f.x, f.y, f.w, used.y - f.y };
+                next.push_back(r);
+            }
+            if (used.y + used.h < f.y + f.h) {
+                const PackRect r = { f.x, used.y + used.h, f.w, f.y + f.h - (used.y + used.h) };
+                next.push_back(r);
+            }
+        }
+        _free.swap(next);
+    }
+
+    // remove the free rectangles contained in another one
+    void prune()
+    {
+        vector<bool> contained(_free.size(), false);
+
+        for (size_t i = 0; i < _free.size(); ++i) {
+            for (size_t j = 0; j < _free.size() && !contained[i]; ++j) {
+                if ( (i == j) || contained[j] ) {
+                    continue;
+                }
+                const PackRect& a = _free[i];
+                const PackRect& b = _free[j];
+                if ( (a.x >= b.x) && (a.y >= b.y) && (a.x + a.w <= b.x + b.w) && (a.y + a.h <= b.y + b.h) ) {
+                    contained[i] = true;
+                }
+            }
+        }
+        size_t k = 0;
+        for (size_t i = 0; i < _free.size(); ++i) {
+            if (!contained[i]) {
+                _free[k++] = _free[i];
+            }
+        }
+        _free.resize(k);
+    }
+
+    vector<PackRect> _free;
+};
+
+struct MaxRectsOrder
+{
+    const vector<PackerFrame>* frames;
+
+    bool operator()(size_t a,
+                    size_t b) const
+    {
+        const OfxRectI& va = (*frames)[a].visible;
+        const OfxRectI& vb = (*frames)[b].visible;
+        const int la = std::max(va.x2 - va.x1, va.y2 - va.y1);
+        const int lb = std::max(vb.x2 - vb.x1, vb.y2 - vb.y1);
+        if (la != lb) {
+            return la > lb;
+        }
+        if (va.y2 - va.y1 != vb.y2 - vb.y1) {
+            return va.y2 - va.y1 > vb.y2 - vb.y1;
+        }
+
+        return a < b;
+    }
+};
+
+// pack the visible rectangles in a bin of the given width, returns the height of the sheet
+static int
+packMaxRects(const vector<size_t>& order,
+             int width,
+             int padding,
+             vector<PackerFrame>* frames,
+             int* usedWidth)
+{
+    int totalHeight = 0;
+
+    for (size_t i = 0; i < frames->size(); ++i) {
+        totalHeight += (*frames)[i].visible.y2 - (*frames)[i].visible.y1 + padding;
+    }
+    // the padding is only needed between the frames, not on the right and bottom borders of the sheet
+    MaxRectsBin bin(width + padding, totalHeight);
+    int usedHeight = 0;
+    *usedWidth = 0;
+    for (size_t k = 0; k < order.size(); ++k) {
+        PackerFrame& f = (*frames)[order[k]];
+        const int w = f.visible.x2 - f.visible.x1;
+        const int h = f.visible.y2 - f.visible.y1;
+        f.frame.x = f.frame.y = 0;
+        if ( (w <= 0) || (h <= 0) ) {
+            continue;
+        }
+        if ( !bin.insert(w + padding, h + padding, &f.frame.x, &f.frame.y) ) {
+            return -1;
+        }
+        *usedWidth = std::max(*usedWidth, f.frame.x + w);
+        usedHeight = std::max(usedHeight, f.frame.y + h);
+    }
+
+    return usedHeight;
+}
+
+static bool
+layoutMaxRects(const PackerOptions& options,
+               vector<PackerFrame>* frames,
+               int* width,
+               int* height,
+               string* error)
+{
+    vector<size_t> order( frames->size() );
+    long long area = 0;
+    int widest = 1;
+
+    for (size_t i = 0; i < frames->size(); ++i) {
+        PackerFrame& f = (*frames)[i];
+        order[i] = i;
+        const int w = f.visible.x2 - f.visible.x1;
+        const int h = f.visible.y2 - f.visible.y1;
+        area += (long long)(w + options.padding) * (h + options.padding);
+        widest = std::max(widest, w);
+        f.frame.offsetX = f.visible.x1;
+        f.frame.offsetY = f.visible.y1;
+        f.frame.w = w;
+        f.frame.h = h;
+        f.frame.sourceW = f.image.width;
+        f.frame.sourceH = f.image.height;
+    }
+    MaxRectsOrder less = { frames };
+    std::sort(order.begin(), order.end(), less);
+
+    if (options.maxWidth > 0) {
+        if (widest > options.maxWidth) {
+            *error = "a frame is wider than --max-width";
+
+            return false;
+        }
+        *height = packMaxRects(order, options.maxWidth, options.padding, frames, width);
+    } else {
+        // try a few widths around the square root of the total area, and keep the smallest sheet
+        const int side = (int)std::ceil( std::sqrt( (double)area ) );
+        int bestWidth = 0;
+        long long bestArea = -1;
+        for (int k = 0; k <= 8; ++k) {
+            const int w = std::max( widest, side * (8 + k) / 8 );
+            int usedWidth;
+            const int usedHeight = packMaxRects(order, w, options.padding, frames, &usedWidth);
+            if (usedHeight < 0) {
+                continue;
+            }
+            const long long a = (long long)usedWidth * usedHeight;
+            if ( (bestArea < 0) || (a < bestArea) ) {
+                bestArea = a;
+                bestWidth = w;
+            }
+        }
+        *height = packMaxRects(order, bestWidth, options.padding, frames, width);
+    }
+    if (*height < 0) {
+        *error = "the frames do not fit in the sheet";
+
+        return false;
+    }
+    *width = std::max(*width, 1);
+    *height = std::max(*height, 1);
+
+    return true;
+} // layoutMaxRects
+
+////////////////////////////////////////////////////////////////////////////////
+// compositing
+
+struct CompositeJob
+{
+    const vector<PackerFrame>* frames;
+    SpriteSheetPngImage* sheet;
+};
+
+// copy the packed pixels of a frame to the sheet. The frames do not overlap, so that they can be copied in parallel.
+static void
+compositeFrame(size_t i,
+               void* data)
+{
+    CompositeJob* job = (CompositeJob*)data;
+    const PackerFrame& f = (*job->frames)[i];
+    SpriteSheetPngImage& sheet = *job->sheet;
+
+    for (int y = 0; y < f.frame.h; ++y) {
+        const unsigned short* src = &f.image.rgba[( (size_t)(f.frame.offsetY + y) * f.image.width + f.frame.offsetX ) * 4];
+        unsigned short* dst = &sheet.rgba[( (size_t)(f.frame.y + y) * sheet.width + f.frame.x ) * 4];
+        std::memcpy( dst, src, (size_t)f.frame.w * 4 * sizeof(unsigned short) );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// verification
+
+struct VerifyJob
+{
+    const PackerOptions* options;
+    const vector<PackerFrame>* frames;
+    SpriteAtlasPtr atlas;
+    SpriteSheetPixelsPtr sheet;
+    OfxPointI spriteSize;            // grid only
+    OfxPointI spriteOffset;          // grid only: the top-left of the cells in the frames
+    vector<string>* errors;
+};
+
+static const unsigned short*
+pixelAt(const SpriteSheetPixels& p,
+        int x,
+        int y)
+{
+    return &( (const unsigned short*)&p.pixels[0] )[( (size_t)y * p.width + x ) * 4];
+}
+
+// Read a frame back from the sheet and the metadata as the SpriteSheet plugin does, and compare it with the frame
+// file read as the plugin would read it as a Sheet File (premultiplied 16-bit RGBA, bottom row first).
+static void
+verifyFrame(size_t i,
+            void* data)
+{
+    VerifyJob* job = (VerifyJob*)data;
+    const PackerFrame& pf = (*job->frames)[i];
+    string& error = (*job->errors)[i];
+    const SpriteSheetPixels& sheet = *job->sheet;
+    SpriteSheetPixelsPtr original = spriteSheetPngLoad(pf.path, 0, eBitDepthUShort, 4, &error);
+
+    if (!original) {
+        return;
+    }
+    static const unsigned short transparent[4] = { 0, 0, 0, 0 };
+    const int ow = original->width;
+    const int oh = original->height;
+
+    // through the atlas metadata: the trimmed frame is put back at its place in the untrimmed sprite
+    const SpriteAtlasFrame& f = job->atlas->frames[i];
+    if ( (f.sourceW != ow) || (f.sourceH != oh) ) {
+        error = pf.path + ": wrong source size in the metadata";
+
+        return;
+    }
+    const int wx1 = f.x;
+    const int wy1 = sheet.height - (f.y + f.h);
+    const int dx = wx1 - f.offsetX;
+    const int dy = wy1 - (f.sourceH - (f.offsetY + f.h));
+    for (int y = 0; y < oh && error.empty(); ++y) {
+        for (int x = 0; x < ow; ++x) {
+            const int sx = dx + x;
+            const int sy = dy + y;
+            const bool inside = sx >= wx1 && sx < wx1 + f.w && sy >= wy1 && sy < wy1 + f.h;
+            const unsigned short* a = inside ? pixelAt(sheet, sx, sy) : transparent;
+            if (std::memcmp( a, pixelAt(*original, x, y), 4 * sizeof(unsigned short) ) != 0) {
+                error = pf.path + ": differs when read through the metadata";
+                break;
+            }
+        }
+    }
+
+    // through the grid: the cell is the frame cropped to the sprite size
+    if ( job->options->maxRects || !error.empty() ) {
+        return;
+    }
+    const OfxRectI rodPixel = { 0, 0, sheet.width, sheet.height };
+    const OfxPointI spritesCut = { 1, 1 };
+    OfxRectI cell;
+    spriteSheetGridCell( (int)i, job->options->readingDirection, rodPixel, job->spriteSize, 0, spritesCut, &cell );
+    // the bottom row of the cell, in the frame
+    const int oy = oh - (job->spriteOffset.y + job->spriteSize.y);
+    for (int y = 0; y < job->spriteSize.y && error.empty(); ++y) {
+        for (int x = 0; x < job->spriteSize.x; ++x) {
+            const int fx = job->spriteOffset.x + x;
+            const int fy = oy + y;
+            const unsigned short* expected = (fx >= 0 && fx < ow && fy >= 0 && fy < oh) ? pixelAt(*original, fx, fy) : transparent;
+            if (std::memcmp( pixelAt(sheet, cell.x1 + x, cell.y1 + y), expected, 4 * sizeof(unsigned short) ) != 0) {
+                error = pf.path + ": differs when read from the grid";
+                break;
+            }
+        }
+    }
+} // verifyFrame
+
+////////////////////////////////////////////////////////////////////////////////
+// command line
+
+static void
+usage()
+{
+    std::fprintf(stderr,
+                 "usage: SpriteSheetPacker [options] -o sheet.png frame0.png frame1.png ...\n"
+                 "Pack a sequence of PNG frames into a sprite sheet, and write its atlas metadata (TexturePacker JSON hash)\n"
+                 "next to it. The sheet can be read back by the SpriteSheet plugin.\n"
+                 "  -o, --output FILE            the sheet PNG file\n"
+                 "  --metadata FILE              the metadata file (default: the sheet file with a .json extension)\n"
+                 "  --grid                       lay the frames out on a uniform grid (default)\n"
+                 "  --maxrects                   pack the frames with MaxRects\n"
+                 "  --columns N                  grid: sprites per line (default: a square sheet)\n"
+                 "  --reading-direction DIR      grid: horizontal, horizontal-backward, vertical or vertical-backward,\n"
+                 "                               with an -s suffix for the S-shaped orders (default: horizontal)\n"
+                 "  --trim                       pack only the visible pixels of the frames\n"
+                 "  --padding N                  maxrects: transparent pixels between the frames (default: 0)\n"
+                 "  --max-width N                maxrects: width of the sheet (default: the smallest sheet)\n"
+                 "  --threads N                  number of threads (default: the number of cores)\n"
+                 "  --verify                     read the sheet back as the plugin does, and compare it with the frames\n");
+}
+
+static bool
+parseReadingDirection(const string& s,
+                      ReadingDirectionEnum* d)
+{
+    static const char* const names[8] = {
+        "horizontal", "horizontal-backward", "vertical", "vertical-backward",
+        "horizontal-s", "horizontal-backward-s", "vertical-s", "vertical-backward-s"
+    };
+
+    for (int i = 0; i < 8; ++i) {
+        if (s == names[i]) {
+            *d = (ReadingDirectionEnum)i;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static string
+baseName(const string& path)
+{
+    const size_t slash = path.find_last_of("/\\");
+
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+static bool
+parseArguments(int argc,
+               char* argv[],
+               PackerOptions* options)
+{
+    options->maxRects = false;
+    options->columns = 0;
+    options->readingDirection = eReadingDirectionHorizontalForward;
+    options->trim = false;
+    options->padding = 0;
+    options->maxWidth = 0;
+    options->threads = tthread::thread::hardware_concurrency();
+    options->verify = false;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if ( (arg == "-o") || (arg == "--output") ) {
+            if (!hasValue) {
+                return false;
+            }
+            options->output = argv[++i];
+        } else if (arg == "--metadata") {
+            if (!hasValue) {
+                return false;
+            }
+            options->metadata = argv[++i];
+        } else if (arg == "--grid") {
+            options->maxRects = false;
+        } else if (arg == "--maxrects") {
+            options->maxRects = true;
+        } else if (arg == "--columns") {
+            if (!hasValue) {
+                return false;
+            }
+            options->columns = std::atoi(argv[++i]);
+        } else if (arg == "--reading-direction") {
+            if ( !hasValue || !parseReadingDirection(argv[++i], &options->readingDirection) ) {
+                return false;
+            }
+        } else if (arg == "--trim") {
+            options->trim = true;
+        } else if (arg == "--padding") {
+            if (!hasValue) {
+                return false;
+            }
+            options->padding = std::max(0, std::atoi(argv[++i]) );
+        } else if (arg == "--max-width") {
+            if (!hasValue) {
+                return false;
+            }
+            options->maxWidth = std::max(0, std::atoi(argv[++i]) );
+        } else if (arg == "--threads") {
+            if (!hasValue) {
+                return false;
+            }
+            options->threads = (unsigned int)std::max(1, std::atoi(argv[++i]) );
+        } else if (arg == "--verify") {
+            options->verify = true;
+        } else if ( (arg.size() > 1) && (arg[0] == '-') ) {
+            return false;
+        } else {
+            options->inputs.push_back(arg);
+        }
+    }
+    if ( options->output.empty() || options->inputs.empty() ) {
+        return false;
+    }
+    if ( options->metadata.empty() ) {
+        const size_t dot = options->output.find_last_of('.');
+        const size_t slash = options->output.find_last_of("/\\");
+        const bool hasExtension = dot != string::npos && (slash == string::npos || dot > slash);
+        options->metadata = (hasExtension ? options->output.substr(0, dot) : options->output) + ".json";
+    }
+    options->threads = std::max(options->threads, 1U);
+
+    return true;
+} // parseArguments
+} // namespace
+
+int
+main(int argc,
+     char* argv[])
+{
+    PackerOptions options;
+
+    if ( !parseArguments(argc, argv, &options) ) {
+        usage();
+
+        return 2;
+    }
+
+    // load and trim the frames
+    vector<PackerFrame> frames( options.inputs.size() );
+    for (size_t i = 0; i < frames.size(); ++i) {
+        frames[i].path = options.inputs[i];
+        frames[i].name = baseName(options.inputs[i]);
+        for (size_t j = 0; j < i; ++j) {
+            if (frames[j].name == frames[i].name) {
+                // the keys of a JSON hash must be unique
+                char suffix[32];
+                std::snprintf(suffix, sizeof(suffix), "#%u", (unsigned int)i);
+                frames[i].name += suffix;
+                break;
+            }
+        }
+    }
+    LoadJob loadJob = { &frames, options.trim };
+    parallelFor(frames.size(), options.threads, loadFrame, &loadJob);
+    int bitDepth = 8;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if ( !frames[i].error.empty() ) {
+            std::fprintf( stderr, "SpriteSheetPacker: %s\n", frames[i].error.c_str() );
+
+            return 1;
+        }
+        bitDepth = std::max(bitDepth, frames[i].image.bitDepth);
+    }
+
+    // lay them out
+    SpriteSheetPngImage sheet;
+    OfxPointI spriteSize = { 0, 0 };
+    if (options.maxRects) {
+        string error;
+        if ( !layoutMaxRects(options, &frames, &sheet.width, &sheet.height, &error) ) {
+            std::fprintf( stderr, "SpriteSheetPacker: %s\n", error.c_str() );
+
+            return 1;
+        }
+    } else {
+        layoutGrid(options, &frames, &spriteSize, &sheet.width, &sheet.height);
+    }
+
+    // composite and write the sheet. The sheet is written at 16 bits if any frame is, so that no value is rounded.
+    sheet.bitDepth = bitDepth;
+    sheet.rgba.assign( (size_t)sheet.width * sheet.height * 4, 0 );
+    CompositeJob compositeJob = { &frames, &sheet };
+    parallelFor(frames.size(), options.threads, compositeFrame, &compositeJob);
+    SpriteAtlas atlas;
+    atlas.width = sheet.width;
+    atlas.height = sheet.height;
+    atlas.maxSourceW = atlas.maxSourceH = 0;
+    vector<string> names;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        atlas.frames.push_back(frames[i].frame);
+        names.push_back(frames[i].name);
+        // the pixels are in the sheet now
+        vector<unsigned short>().swap(frames[i].image.rgba);
+    }
+    string error;
+    if ( !spriteSheetPngWrite(options.output, sheet, &error) ||
+         !spriteAtlasWrite(options.metadata, atlas, names, baseName(options.output), bitDepth, &error) ) {
+        std::fprintf( stderr, "SpriteSheetPacker: %s\n", error.c_str() );
+
+        return 1;
+    }
+    std::printf("%s: %d frames, %dx%d, %d bits\n", options.output.c_str(), (int)frames.size(), sheet.width, sheet.height, bitDepth);
+    if (!options.verify) {
+        return 0;
+    }
+
+    // read everything back through the code of the plugin
+    vector<string> errors( frames.size() );
+    VerifyJob verifyJob;
+    verifyJob.options = &options;
+    verifyJob.frames = &frames;
+    verifyJob.atlas = spriteAtlasLoad(options.metadata, &error);
+    verifyJob.sheet = spriteSheetPngLoad(options.output, 0, eBitDepthUShort, 4, &error);
+    verifyJob.errors = &errors;
+    if ( !verifyJob.atlas || !verifyJob.sheet || ( verifyJob.atlas->frames.size() != frames.size() ) ) {
+        std::fprintf( stderr, "SpriteSheetPacker: verification failed: %s\n", error.empty() ? "wrong frame count" : error.c_str() );
+
+        return 1;
+    }
+    if (!options.maxRects) {
+        // all the frames have the same offset and cell size in a grid
+        verifyJob.spriteOffset.x = frames[0].frame.offsetX;
+        verifyJob.spriteOffset.y = frames[0].frame.offsetY;
+        verifyJob.spriteSize = spriteSize;
+    }
+    parallelFor(frames.size(), options.threads, verifyFrame, &verifyJob);
+    int failed = 0;
+    for (size_t i = 0; i < errors.size(); ++i) {
+        if ( !errors[i].empty() ) {
+            std::fprintf( stderr, "SpriteSheetPacker: %s\n", errors[i].c_str() );
+            ++failed;
+        }
+    }
+    if (failed) {
+        std::fprintf(stderr, "SpriteSheetPacker: verification failed for %d frames\n", failed);
+
+        return 1;
+    }
+    std::printf("verified: all the frames read back bit-exactly\n");
+
+    return 0;
+} // main
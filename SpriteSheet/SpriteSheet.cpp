@@ -23,13 +23,23 @@
 
 #include <cmath>
 #include <cfloat> // DBL_MAX
+#include <cstdio> // snprintf
+#include <cstring> // memcpy, memset
 #include <algorithm>
+#include <map>
+#include <vector>
 
 #include "ofxsProcessing.H"
 #include "ofxsCoords.h"
 #include "ofxsMacros.h"
 #include "ofxsThreadSuite.h"
 
+#include "SpriteSheetAtlas.h"
+#include "SpriteSheetCache.h"
+#include "SpriteSheetCells.h"
+#include "SpriteSheetGrid.h"
+#include "SpriteSheetPng.h"
+
 using namespace OFX;
 
 OFXS_NAMESPACE_ANONYMOUS_ENTER
@@ -91,24 +101,44 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kParamSpritesCut "spritesCut"
 #define kParamSpritesCutLabel "Sprites Cut", "Cut the sprite sheet and read it separately."
 
-enum ReadingDirectionEnum
-{
-    eReadingDirectionHorizontalForward,
-    eReadingDirectionHorizontalBackward,
-    eReadingDirectionVerticalForward,
-    eReadingDirectionVerticalBackward,
-    eReadingDirectionHorizontalForwardS,
-    eReadingDirectionHorizontalBackwardS,
-    eReadingDirectionVerticalForwardS,
-    eReadingDirectionVerticalBackwardS
-};
+#define kParamScale "scale"
+#define kParamScaleLabel "Scale", "Integer scale factor of the output. Each sprite pixel becomes a block of Scale x Scale pixels, as with a nearest-neighbour (Impulse) upscale, without the cost of an extra Transform."
 
-enum PlaybackModeEnum
-{
-    ePlaybackModeNormal,
-    ePlaybackModeNormalReverse,
-    ePlaybackModeNormalReverseMerge
-};
+#define kParamIndexedColours "indexedColours"
+#define kParamIndexedColoursLabel "Indexed Colours", "Convert the sheet once to an 8-bit index image and a palette of at most 256 colours, and read the sprites through the palette. The sheet is then only fetched again when the source clip, the render scale or the bit depth change, or when Rebuild Index is pressed (e.g. after changing the source upstream, which the plugin is not notified of). Sheets with more than 256 colours are read directly."
+
+#define kParamIndexRebuild "indexRebuild"
+#define kParamIndexRebuildLabel "Rebuild Index", "Scan the sheet again for Indexed Colours and Trim To Alpha, and hash it again for the Sprite Cache. The plugin is notified when the source clip is reconnected, but not when the source changes upstream: press it after such a change."
+
+#define kParamPaletteRow "paletteRow"
+#define kParamPaletteRowLabel "Palette Row", "With Indexed Colours, when the Palette input is connected, the colours found in the top row of the Palette image are replaced by the colours of this row (counted from the top, starting at 0). A palette image with several rows thus holds several palette-swapped variants of the sprites."
+
+#define kClipPalette "Palette"
+
+#define kParamTrimToAlpha "trimToAlpha"
+#define kParamTrimToAlphaLabel "Trim To Alpha", "Scan the sheet once for the bounding box of the non-transparent pixels of each sprite, and shrink the region of definition of each frame to it, so that the following effects only process the visible pixels. The sheet is scanned again when the source clip or the sprite parameters change, or when Rebuild Index is pressed."
+
+#define kIndexedSheetMaxColours 256
+#define kIndexedSheetHashSize 1024 // must be a power of two, larger than kIndexedSheetMaxColours
+
+#define kParamSpriteCache "spriteCache"
+#define kParamSpriteCacheLabel "Sprite Cache", "Keep the extracted sprites in a cache shared by all the SpriteSheet instances, so that a frame showing a sprite that was already extracted does not extract it again. The sheet content is hashed from the first render of the whole sheet, and the sprites are cached under that hash. The sheet is hashed again when the source clip changes, or when Rebuild Index is pressed (e.g. after changing the source upstream, which the plugin is not notified of)."
+
+#define kParamSpriteCacheSize "spriteCacheSize"
+#define kParamSpriteCacheSizeLabel "Cache Size (MB)", "Memory budget of the sprite cache, shared by all the SpriteSheet instances. The default applies when the plugin is loaded, then the last value changed in any instance. The least recently used sprites are dropped first."
+#define kParamSpriteCacheSizeDefault 256
+
+#define kParamSpriteCacheStats "spriteCacheStats"
+#define kParamSpriteCacheStatsLabel "Cache Statistics", "Show the number of hits and misses of the sprite cache, and its memory use."
+
+#define kParamAtlasFile "atlasFile"
+#define kParamAtlasFileLabel "Atlas File", "Sprite atlas metadata file (TexturePacker or Aseprite JSON, hash or array layout). When set, the sprites are read from the frame rectangles of the atlas instead of the uniform grid, and the sprite index is the frame index in the file. Trimmed frames are restored to their untrimmed size. Sprite Size, Reading Direction and Sprites Cut are ignored."
+
+#define kParamAtlasReload "atlasReload"
+#define kParamAtlasReloadLabel "Reload Files", "Read the atlas file and the sheet file again if they changed on disk."
+
+#define kParamSheetFile "sheetFile"
+#define kParamSheetFileLabel "Sheet File", "PNG file to read the sprite sheet from, instead of the Source input. The file is decoded once and shared by all the SpriteSheet instances that read it, and only the rows of the current sprite are copied at each render, so that the host does not have to provide the whole sheet at every frame. Colours are premultiplied by alpha, and are not linearized. Indexed Colours and Sprite Cache are not needed and not used with a sheet file."
 
 #ifdef OFX_EXTENSIONS_NATRON
 #define OFX_COMPONENTS_OK(c) ((c)== ePixelComponentAlpha || (c) == ePixelComponentXY || (c) == ePixelComponentRGB || (c) == ePixelComponentRGBA)
@@ -116,19 +146,42 @@ enum PlaybackModeEnum
 #define OFX_COMPONENTS_OK(c) ((c)== ePixelComponentAlpha || (c) == ePixelComponentRGB || (c) == ePixelComponentRGBA)
 #endif
 
+// the division operator, rounded towards minus infinity
+static inline
+int
+floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -( (b - 1 - a) / b );
+}
+
 class SpriteSheetProcessorBase
     : public ImageProcessor
 {
 protected:
     const Image *_srcImg;
     OfxRectI _cropRectPixel;
+    OfxRectI _srcWindowPixel;
+    int _scale;
+    const unsigned char *_indexPix; // if set, the source is read from this index image through _palette
+    OfxRectI _indexBounds;
+    const void *_palette;
+    const void *_srcPix; // if set, the source is read from these packed pixels instead of the src image
+    OfxRectI _srcPixBounds;
 
 public:
     SpriteSheetProcessorBase(ImageEffect &instance)
         : ImageProcessor(instance)
         , _srcImg(NULL)
+        , _scale(1)
+        , _indexPix(NULL)
+        , _palette(NULL)
+        , _srcPix(NULL)
     {
         _cropRectPixel.x1 = _cropRectPixel.y1 = _cropRectPixel.x2 = _cropRectPixel.y2 = 0;
+        _srcWindowPixel.x1 = _srcWindowPixel.y1 = kOfxFlagInfiniteMin;
+        _srcWindowPixel.x2 = _srcWindowPixel.y2 = kOfxFlagInfiniteMax;
+        _indexBounds.x1 = _indexBounds.y1 = _indexBounds.x2 = _indexBounds.y2 = 0;
+        _srcPixBounds = _indexBounds;
     }
 
     /** @brief set the src image */
@@ -137,9 +190,31 @@ public:
         _srcImg = v;
     }
 
-    void setValues(const OfxRectI& cropRectPixel)
+    /** @brief read the source from an 8-bit index image and a palette of source pixels, instead of the src image */
+    void setIndexedSrc(const unsigned char *indexPix,
+                       const OfxRectI& indexBounds,
+                       const void *palette)
+    {
+        _indexPix = indexPix;
+        _indexBounds = indexBounds;
+        _palette = palette;
+    }
+
+    /** @brief read the source from packed pixels (e.g. a cached sprite), instead of the src image */
+    void setSrcPixels(const void *srcPix,
+                      const OfxRectI& srcPixBounds)
+    {
+        _srcPix = srcPix;
+        _srcPixBounds = srcPixBounds;
+    }
+
+    void setValues(const OfxRectI& cropRectPixel,
+                   const OfxRectI& srcWindowPixel,
+                   int scale)
     {
         _cropRectPixel = cropRectPixel;
+        _srcWindowPixel = srcWindowPixel;
+        _scale = scale;
     }
 };
 
@@ -155,39 +230,529 @@ public:
     }
 
 private:
+    const PIX * getSrcPixelAddress(int x,
+                                   int y) const
+    {
+        if (_srcPix) {
+            return (const PIX *)_srcPix + ( (size_t)(y - _srcPixBounds.y1) * (_srcPixBounds.x2 - _srcPixBounds.x1) + (x - _srcPixBounds.x1) ) * nComponents;
+        }
+
+        return (const PIX *)_srcImg->getPixelAddress(x, y);
+    }
+
     void multiThreadProcessImages(const OfxRectI& procWindow, const OfxPointD& rs) OVERRIDE FINAL
     {
         unused(rs);
+        OfxRectI srcBounds = {0, 0, 0, 0};
+        if (_indexPix) {
+            Coords::rectIntersection(_indexBounds, _srcWindowPixel, &srcBounds);
+        } else if (_srcPix) {
+            Coords::rectIntersection(_srcPixBounds, _srcWindowPixel, &srcBounds);
+        } else if (_srcImg) {
+            // only read the sprite window of the source (the packed frame, for atlases)
+            Coords::rectIntersection(_srcImg->getBounds(), _srcWindowPixel, &srcBounds);
+        }
+        const PIX *palette = (const PIX *)_palette;
+        // this is a pure rectangular copy, optionally scaled up by an integer factor: the output pixel x reads
+        // the source pixel floorDiv(x, k) + crop.x1. The span of the window that maps inside the source bounds
+        // is the same for every row, and is copied in one go. Only the head and tail are cleared.
+        const int k = _scale;
+        const int x1 = std::max( procWindow.x1, std::min(procWindow.x2, (srcBounds.x1 - _cropRectPixel.x1) * k) );
+        const int x2 = std::max( x1, std::min(procWindow.x2, (srcBounds.x2 - _cropRectPixel.x1) * k) );
+        const size_t headBytes = (size_t)(x1 - procWindow.x1) * nComponents * sizeof(PIX);
+        const size_t spanBytes = (size_t)(x2 - x1) * nComponents * sizeof(PIX);
+        const size_t tailBytes = (size_t)(procWindow.x2 - x2) * nComponents * sizeof(PIX);
+        const PIX *prevDstPix = NULL;
+        int prevSrcY = 0;
+
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
                 break;
             }
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            const int srcY = floorDiv(y, k) + _cropRectPixel.y1;
+            if ( ( !_srcImg && !_indexPix && !_srcPix ) || (srcY < srcBounds.y1) || (srcBounds.y2 <= srcY) || (x1 == x2) ) {
+                // the whole row is outside of the source
+                std::memset(dstPix, 0, headBytes + spanBytes + tailBytes);
+                continue;
+            }
+            if ( prevDstPix && (srcY == prevSrcY) ) {
+                // same source row as the previous output row: replicate it
+                std::memcpy(dstPix, prevDstPix, headBytes + spanBytes + tailBytes);
+                continue;
+            }
 
-            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
-                const PIX *srcPix = _srcImg ? (const PIX*)_srcImg->getPixelAddress(x + _cropRectPixel.x1, y + _cropRectPixel.y1) : 0;
-                if (srcPix) {
-                    // inside of the rectangle
-                    for (int k = 0; k < nComponents; ++k) {
-                        dstPix[k] = srcPix[k];
+            if (headBytes) {
+                std::memset(dstPix, 0, headBytes);
+            }
+            if (_indexPix) {
+                // expand the indices through the palette
+                const int srcX1 = floorDiv(x1, k) + _cropRectPixel.x1;
+                const unsigned char *srcIndex = _indexPix + (size_t)(srcY - _indexBounds.y1) * (_indexBounds.x2 - _indexBounds.x1) + (srcX1 - _indexBounds.x1);
+                PIX *spanPix = (PIX *)( (unsigned char*)dstPix + headBytes );
+                int phase = x1 - floorDiv(x1, k) * k;
+                for (int x = x1; x < x2; ++x, spanPix += nComponents) {
+                    const PIX *colour = palette + (size_t)(*srcIndex) * nComponents;
+                    for (int c = 0; c < nComponents; ++c) {
+                        spanPix[c] = colour[c];
                     }
-                } else {
-                    for (int k = 0; k < nComponents; ++k) {
-                        dstPix[k] = 0;
+                    if (++phase == k) {
+                        phase = 0;
+                        ++srcIndex;
                     }
                 }
+            } else if (k == 1) {
+                const PIX *srcPix = getSrcPixelAddress(floorDiv(x1, k) + _cropRectPixel.x1, srcY);
+                assert(srcPix);
+                std::memcpy( (unsigned char*)dstPix + headBytes, srcPix, spanBytes );
+            } else {
+                // expand each source pixel to k output pixels
+                const PIX *srcPix = getSrcPixelAddress(floorDiv(x1, k) + _cropRectPixel.x1, srcY);
+                assert(srcPix);
+                PIX *spanPix = (PIX *)( (unsigned char*)dstPix + headBytes );
+                int phase = x1 - floorDiv(x1, k) * k;
+                for (int x = x1; x < x2; ++x, spanPix += nComponents) {
+                    for (int c = 0; c < nComponents; ++c) {
+                        spanPix[c] = srcPix[c];
+                    }
+                    if (++phase == k) {
+                        phase = 0;
+                        srcPix += nComponents;
+                    }
+                }
+            }
+            if (tailBytes) {
+                std::memset( (unsigned char*)dstPix + headBytes + spanBytes, 0, tailBytes );
             }
+            prevDstPix = dstPix;
+            prevSrcY = srcY;
         }
     } // multiThreadProcessImages
 };
 
-// the modulo oprator (always returns a positive number)
-static inline
-int
-mod(int a, int b)
+// a sheet read from a file, with the pixel accessors of Image
+class SpriteSheetPackedImage
 {
-    return a >= 0 ? a % b : ( b - std::abs ( a%b ) ) % b;
+public:
+    SpriteSheetPackedImage(const SpriteSheetPixels& pixels)
+        : _pixels(pixels)
+        , _pixelBytes( pixels.nComponents * (pixels.bitDepth == eBitDepthUByte ? 1 : (pixels.bitDepth == eBitDepthUShort ? 2 : 4)) )
+    {
+        _bounds.x1 = _bounds.y1 = 0;
+        _bounds.x2 = pixels.width;
+        _bounds.y2 = pixels.height;
+    }
+
+    const void* getPixelAddress(int x,
+                                int y) const
+    {
+        if ( (x < _bounds.x1) || (x >= _bounds.x2) || (y < _bounds.y1) || (y >= _bounds.y2) ) {
+            return NULL;
+        }
+
+        return &_pixels.pixels[( (size_t)y * _pixels.width + x ) * _pixelBytes];
+    }
+
+    const OfxRectI& getBounds() const { return _bounds; }
+
+    BitDepthEnum getPixelDepth() const { return (BitDepthEnum)_pixels.bitDepth; }
+
+    int getPixelComponentCount() const { return _pixels.nComponents; }
+
+private:
+    const SpriteSheetPixels& _pixels;
+    const int _pixelBytes;
+    OfxRectI _bounds;
+};
+
+// the bounding box of the pixels of rect with a non-zero alpha, or an empty rectangle at rect.x1,rect.y1
+template <class PIX, class SRC>
+static void
+getAlphaBounds(const SRC& src,
+               const OfxRectI& rect,
+               int nComponents,
+               OfxRectI *bounds)
+{
+    bounds->x1 = rect.x2;
+    bounds->y1 = rect.y2;
+    bounds->x2 = rect.x1;
+    bounds->y2 = rect.y1;
+    const int alpha = nComponents - 1; // also the only component of an Alpha image
+    for (int y = rect.y1; y < rect.y2; ++y) {
+        const PIX *srcPix = (const PIX*)src.getPixelAddress(rect.x1, y);
+        if (!srcPix) {
+            continue;
+        }
+        // only look for pixels that extend the current box
+        int x1 = rect.x1;
+        for (; x1 < rect.x2; ++x1, srcPix += nComponents) {
+            if (srcPix[alpha] != 0) {
+                break;
+            }
+        }
+        if (x1 == rect.x2) {
+            continue;
+        }
+        int x2 = rect.x2;
+        srcPix += (x2 - 1 - x1) * nComponents;
+        for (; x2 > x1 + 1 && x2 > bounds->x2; --x2, srcPix -= nComponents) {
+            if (srcPix[alpha] != 0) {
+                break;
+            }
+        }
+        bounds->x1 = std::min(bounds->x1, x1);
+        bounds->x2 = std::max(bounds->x2, x2);
+        bounds->y1 = std::min(bounds->y1, y);
+        bounds->y2 = y + 1;
+    }
+    if ( (bounds->x1 >= bounds->x2) || (bounds->y1 >= bounds->y2) ) {
+        bounds->x1 = bounds->x2 = rect.x1;
+        bounds->y1 = bounds->y2 = rect.y1;
+    }
+}
+
+// The bounding box of the non-transparent pixels of each cell of one animation period, in pixels at renderscale = 1.
+// It is built from a render of the whole sheet, and used by the RoD and RoI actions. Each render checks its cell.
+class SpriteSheetAlphaIndex
+{
+public:
+    SpriteSheetAlphaIndex()
+        : _valid(false)
+        , _hash(0)
+        , _renderScale()
+        , _params()
+        , _bounds()
+    {
+    }
+
+    // the alpha bounds of the cell at the given time, if the index was built for these parameters
+    bool getBounds(OfxTime time,
+                   const SpriteSheetParams& p,
+                   OfxRectI *bounds)
+    {
+        const int period = p.period();
+        if ( (period <= 0) || (period > kSpriteIndexMaxPeriod) ) {
+            return false;
+        }
+        bool reversed;
+        const int phase = getSpritePhase(time, p, &reversed);
+        const unsigned long long hash = p.cellsHash();
+
+        AutoMutex lock(_mutex);
+        if ( !_valid || (hash != _hash) || !p.sameCells(_params) ) {
+            return false;
+        }
+        *bounds = _bounds[reversed ? period + phase : phase];
+
+        return true;
+    }
+
+    // does the index have to be built from a render at this render scale?
+    bool needsBuild(const SpriteSheetParams& p,
+                    const OfxPointD& renderScale)
+    {
+        const int period = p.period();
+        if ( (period <= 0) || (period > kSpriteIndexMaxPeriod) ) {
+            return false;
+        }
+        const unsigned long long hash = p.cellsHash();
+
+        AutoMutex lock(_mutex);
+
+        // bounds found at a lower render scale are refined by the first render at a higher one
+        return ( !_valid || (hash != _hash) || !p.sameCells(_params) ||
+                 (_renderScale.x < renderScale.x) || (_renderScale.y < renderScale.y) );
+    }
+
+    // scan the cells in src (an Image or a SpriteSheetPackedImage), which must contain the whole sheet at the given render scale
+    template <class SRC>
+    void build(const SRC& src,
+               const OfxPointD& renderScale,
+               const SpriteSheetParams& p)
+    {
+        const int period = p.period();
+        const bool backAndForth = (p.playbackMode == ePlaybackModeNormalReverse || p.playbackMode == ePlaybackModeNormalReverseMerge);
+        std::vector<OfxRectI> bounds(backAndForth ? 2 * period : period);
+        std::map<OfxRectI, OfxRectI, RectLess> scanned; // cells are usually shared by many phases
+
+        for (size_t e = 0; e < bounds.size(); ++e) {
+            SpriteCell cell;
+            getSpriteCell( (int)e % period, (int)e >= period, p, &cell );
+            std::map<OfxRectI, OfxRectI, RectLess>::const_iterator it = scanned.find(cell.rect);
+            if ( it != scanned.end() ) {
+                bounds[e] = it->second;
+                continue;
+            }
+            getCellBounds(src, renderScale, cell, &bounds[e]);
+            scanned[cell.rect] = bounds[e];
+        }
+
+        AutoMutex lock(_mutex);
+        _bounds.swap(bounds);
+        _renderScale = renderScale;
+        _params = p;
+        _hash = p.cellsHash();
+        _valid = true;
+    } // build
+
+    void reset()
+    {
+        AutoMutex lock(_mutex);
+        _valid = false;
+    }
+
+private:
+    struct RectLess
+    {
+        bool operator()(const OfxRectI& a,
+                        const OfxRectI& b) const
+        {
+            if (a.x1 != b.x1) {
+                return a.x1 < b.x1;
+            }
+            if (a.y1 != b.y1) {
+                return a.y1 < b.y1;
+            }
+            if (a.x2 != b.x2) {
+                return a.x2 < b.x2;
+            }
+
+            return a.y2 < b.y2;
+        }
+    };
+
+    typedef MultiThread::AutoMutex AutoMutex;
+
+    // the alpha bounds of a cell, at renderscale = 1, from src at the given render scale
+    template <class SRC>
+    static void getCellBounds(const SRC& src,
+                              const OfxPointD& renderScale,
+                              const SpriteCell& cell,
+                              OfxRectI *b)
+    {
+        const int nComponents = src.getPixelComponentCount();
+        const bool hasAlpha = (nComponents == 4 || nComponents == 1); // RGBA or Alpha
+        // a pixel at a lower render scale may cover up to one more pixel at renderscale = 1 on each side
+        const int padX = renderScale.x < 1. ? (int)std::ceil(1. / renderScale.x) : 0;
+        const int padY = renderScale.y < 1. ? (int)std::ceil(1. / renderScale.y) : 0;
+        OfxRectI visible;
+
+        if ( !Coords::rectIntersection(cell.rect, cell.window, &visible) ) {
+            b->x1 = b->x2 = cell.rect.x1;
+            b->y1 = b->y2 = cell.rect.y1;
+
+            return;
+        }
+        *b = visible;
+        if (!hasAlpha) {
+            return;
+        }
+        OfxRectI rectPixel;
+        rectPixel.x1 = (int)std::floor(renderScale.x * visible.x1);
+        rectPixel.y1 = (int)std::floor(renderScale.y * visible.y1);
+        rectPixel.x2 = (int)std::ceil(renderScale.x * visible.x2);
+        rectPixel.y2 = (int)std::ceil(renderScale.y * visible.y2);
+        Coords::rectIntersection(rectPixel, src.getBounds(), &rectPixel);
+        OfxRectI boundsPixel;
+        switch ( src.getPixelDepth() ) {
+        case eBitDepthUByte:
+            getAlphaBounds<unsigned char>(src, rectPixel, nComponents, &boundsPixel);
+            break;
+        case eBitDepthUShort:
+            getAlphaBounds<unsigned short>(src, rectPixel, nComponents, &boundsPixel);
+            break;
+        case eBitDepthFloat:
+            getAlphaBounds<float>(src, rectPixel, nComponents, &boundsPixel);
+            break;
+        default:
+            boundsPixel = rectPixel;
+            break;
+        }
+        if ( (boundsPixel.x1 < boundsPixel.x2) && (boundsPixel.y1 < boundsPixel.y2) ) {
+            b->x1 = (int)std::floor(boundsPixel.x1 / renderScale.x) - padX;
+            b->y1 = (int)std::floor(boundsPixel.y1 / renderScale.y) - padY;
+            b->x2 = (int)std::ceil(boundsPixel.x2 / renderScale.x) + padX;
+            b->y2 = (int)std::ceil(boundsPixel.y2 / renderScale.y) + padY;
+            Coords::rectIntersection(*b, visible, b);
+        } else {
+            b->x1 = b->x2 = cell.rect.x1;
+            b->y1 = b->y2 = cell.rect.y1;
+        }
+    } // getCellBounds
+
+    MultiThread::Mutex _mutex;
+    bool _valid;
+    unsigned long long _hash;
+    OfxPointD _renderScale;
+    SpriteSheetParams _params;
+    std::vector<OfxRectI> _bounds;
+};
+
+// The sheet converted to 8-bit indices into a palette of source pixels.
+// A sheet with more than kIndexedSheetMaxColours colours is kept with an empty palette, so that it is not converted again.
+struct SpriteSheetIndexedSheet
+{
+    OfxRectI bounds; // pixel bounds of the index image
+    OfxPointD renderScale;
+    BitDepthEnum bitDepth;
+    int pixelBytes;
+    std::vector<unsigned char> indices; // one byte per pixel, rows from bounds.y1 to bounds.y2
+    std::vector<unsigned char> palette; // kIndexedSheetMaxColours source pixels, unused entries are black
+
+    // can this sheet be used for a render of the given sheet rectangle?
+    bool matches(const OfxRectI& sheetPixel,
+                 const OfxPointD& rs,
+                 BitDepthEnum depth,
+                 int nBytes) const
+    {
+        return (renderScale.x == rs.x && renderScale.y == rs.y &&
+                bitDepth == depth && pixelBytes == nBytes &&
+                bounds.x1 <= sheetPixel.x1 && bounds.y1 <= sheetPixel.y1 &&
+                sheetPixel.x2 <= bounds.x2 && sheetPixel.y2 <= bounds.y2);
+    }
+};
+
+typedef std::shared_ptr<const SpriteSheetIndexedSheet> SpriteSheetIndexedSheetPtr;
+
+// convert the src image to indices. Returns false if it has more than kIndexedSheetMaxColours colours.
+static bool
+buildIndexedSheet(const Image& src,
+                  SpriteSheetIndexedSheet *sheet)
+{
+    const OfxRectI& b = sheet->bounds;
+    const int w = b.x2 - b.x1;
+    const int pixelBytes = sheet->pixelBytes;
+    short table[kIndexedSheetHashSize];
+    int nColours = 0;
+
+    std::fill(table, table + kIndexedSheetHashSize, (short)-1);
+    sheet->indices.resize( (size_t)w * (b.y2 - b.y1) );
+    sheet->palette.assign(kIndexedSheetMaxColours * pixelBytes, 0);
+    for (int y = b.y1; y < b.y2; ++y) {
+        const unsigned char *srcPix = (const unsigned char*)src.getPixelAddress(b.x1, y);
+        if (!srcPix) {
+            return false;
+        }
+        unsigned char *index = &sheet->indices[(size_t)(y - b.y1) * w];
+        const unsigned char *prevPix = NULL;
+        for (int x = 0; x < w; ++x, srcPix += pixelBytes) {
+            // runs of the same colour are frequent in pixel art
+            if ( prevPix && (std::memcmp(srcPix, prevPix, pixelBytes) == 0) ) {
+                index[x] = index[x - 1];
+                continue;
+            }
+            unsigned int h = 2166136261U;
+            for (int k = 0; k < pixelBytes; ++k) {
+                h = (h ^ srcPix[k]) * 16777619U;
+            }
+            h &= kIndexedSheetHashSize - 1;
+            while ( (table[h] >= 0) && (std::memcmp(srcPix, &sheet->palette[table[h] * pixelBytes], pixelBytes) != 0) ) {
+                h = (h + 1) & (kIndexedSheetHashSize - 1);
+            }
+            if (table[h] < 0) {
+                if (nColours == kIndexedSheetMaxColours) {
+                    return false;
+                }
+                std::memcpy(&sheet->palette[nColours * pixelBytes], srcPix, pixelBytes);
+                table[h] = (short)nColours++;
+            }
+            index[x] = (unsigned char)table[h];
+            prevPix = srcPix;
+        }
+    }
+
+    return true;
+} // buildIndexedSheet
+
+// replace the palette colours found in the top row of the palette image by the colours of the given row.
+// The rows are counted from the top of the palette RoD (in pixels), whatever part of it the host gave.
+static void
+swapPalette(const Image& paletteImg,
+            const OfxRectI& paletteRoDPixel,
+            int row,
+            int pixelBytes,
+            std::vector<unsigned char> *palette)
+{
+    OfxRectI b;
+    if ( !Coords::rectIntersection(paletteImg.getBounds(), paletteRoDPixel, &b) ) {
+        return;
+    }
+    const unsigned char *fromPix = (const unsigned char*)paletteImg.getPixelAddress(b.x1, paletteRoDPixel.y2 - 1);
+    const unsigned char *toPix = (const unsigned char*)paletteImg.getPixelAddress(b.x1, paletteRoDPixel.y2 - 1 - row);
+
+    if (!fromPix || !toPix) {
+        return;
+    }
+    for (int i = 0; i < kIndexedSheetMaxColours; ++i) {
+        unsigned char *colour = &(*palette)[i * pixelBytes];
+        for (int x = 0; x < b.x2 - b.x1; ++x) {
+            if (std::memcmp(colour, fromPix + x * pixelBytes, pixelBytes) == 0) {
+                std::memcpy(colour, toPix + x * pixelBytes, pixelBytes);
+                break;
+            }
+        }
+    }
+}
+
+// the content of the sheet, as rendered at a given render scale, identified by a hash of its pixels
+struct SpriteSheetHash
+{
+    OfxRectI sheetPixel;
+    OfxPointD renderScale;
+    BitDepthEnum bitDepth;
+    int nComponents;
+    unsigned long long hash;
+
+    bool matches(const OfxRectI& sheet,
+                 const OfxPointD& rs,
+                 BitDepthEnum depth,
+                 int nComps) const
+    {
+        return (renderScale.x == rs.x && renderScale.y == rs.y &&
+                bitDepth == depth && nComponents == nComps &&
+                sheetPixel.x1 == sheet.x1 && sheetPixel.y1 == sheet.y1 &&
+                sheetPixel.x2 == sheet.x2 && sheetPixel.y2 == sheet.y2);
+    }
+};
+
+// hash the sheet rectangle of src
+static unsigned long long
+hashSheet(const Image& src,
+          const OfxRectI& sheetPixel,
+          int pixelBytes)
+{
+    unsigned long long h = spriteCacheHashSheet(&sheetPixel, sizeof(sheetPixel));
+    const size_t rowBytes = (size_t)(sheetPixel.x2 - sheetPixel.x1) * pixelBytes;
+
+    for (int y = sheetPixel.y1; y < sheetPixel.y2; ++y) {
+        const void *srcPix = src.getPixelAddress(sheetPixel.x1, y);
+        if (srcPix) {
+            h = spriteCacheHashSheet(srcPix, rowBytes, h);
+        }
+    }
+
+    return h;
+}
+
+// copy the rect of src to packed pixels
+static SpriteBufferPtr
+extractSprite(const Image& src,
+              const OfxRectI& rect,
+              int pixelBytes)
+{
+    const size_t rowBytes = (size_t)(rect.x2 - rect.x1) * pixelBytes;
+    std::shared_ptr<std::vector<unsigned char> > buffer = std::make_shared<std::vector<unsigned char> >(rowBytes * (rect.y2 - rect.y1));
+
+    for (int y = rect.y1; y < rect.y2; ++y) {
+        const void *srcPix = src.getPixelAddress(rect.x1, y);
+        if (!srcPix) {
+            return SpriteBufferPtr();
+        }
+        std::memcpy(&(*buffer)[(size_t)(y - rect.y1) * rowBytes], srcPix, rowBytes);
+    }
+
+    return buffer;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -211,6 +776,27 @@ public:
         , _repeatRange(NULL)
         , _repeatCount(NULL)
         , _spritesCut(NULL)
+        , _scale(NULL)
+        , _indexedColours(NULL)
+        , _paletteRow(NULL)
+        , _trimToAlpha(NULL)
+        , _spriteCache(NULL)
+        , _spriteCacheSize(NULL)
+        , _atlasFile(NULL)
+        , _sheetFile(NULL)
+        , _paletteClip(NULL)
+        , _paramsGeneration(0)
+        , _paramsKnown(false)
+        , _paramsAnimated(false)
+        , _paramsValues()
+        , _alphaIndex()
+        , _atlas()
+        , _sheetFilePath()
+        , _sheetFileSize()
+        , _sheetPixels()
+        , _indexedSheet()
+        , _sheetHashValid(false)
+        , _sheetHash()
     {
 
         _dstClip = fetchClip(kOfxImageEffectOutputClipName);
@@ -233,6 +819,19 @@ public:
         _repeatRange = fetchInt2DParam(kParamRepeatRange);
         _repeatCount = fetchIntParam(kParamRepeatCount);
         _spritesCut = fetchInt2DParam(kParamSpritesCut);
+        _scale = fetchIntParam(kParamScale);
+        _indexedColours = fetchBooleanParam(kParamIndexedColours);
+        _paletteRow = fetchIntParam(kParamPaletteRow);
+        _paletteClip = fetchClip(kClipPalette);
+        _trimToAlpha = fetchBooleanParam(kParamTrimToAlpha);
+        _spriteCache = fetchBooleanParam(kParamSpriteCache);
+        _spriteCacheSize = fetchIntParam(kParamSpriteCacheSize);
+        assert(_spriteCache && _spriteCacheSize);
+        _atlasFile = fetchStringParam(kParamAtlasFile);
+        _sheetFile = fetchStringParam(kParamSheetFile);
+        assert(_atlasFile && _sheetFile);
+
+        loadFiles();
     }
 
 private:
@@ -249,87 +848,62 @@ private:
     /* set up and run a processor */
     void setupAndProcess(SpriteSheetProcessorBase &, const RenderArguments &args);
 
-    //virtual void changedParam(const InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
     virtual void getClipPreferences(ClipPreferencesSetter &clipPreferences) OVERRIDE FINAL;
 
+    virtual void changedParam(const InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
+    virtual void changedClip(const InstanceChangedArgs &args, const std::string &clipName) OVERRIDE FINAL;
+
+    // the indexed sheet for the given sheet rectangle, if it was already converted
+    SpriteSheetIndexedSheetPtr getIndexedSheet(const OfxRectI& sheetPixel, const OfxPointD& renderScale, BitDepthEnum bitDepth, int pixelBytes);
+    void resetIndexedSheet();
+
+    // the content hash of the sheet, if it was already computed for this render scale and pixel format
+    bool getSheetHash(const OfxRectI& sheetPixel, const OfxPointD& renderScale, BitDepthEnum bitDepth, int nComponents, unsigned long long *hash);
+
+    // forget everything computed from the sheet content
+    void resetSheetIndices();
+
+    // does the next render have to read the whole sheet, to build an index?
+    bool needsWholeSheet(OfxTime time, const OfxPointD& renderScale, const SpriteSheetParams& p);
+
+    // the parameter values at the given time. They are only fetched from the host once if none of them is animated.
+    void getSpriteParams(OfxTime time, SpriteSheetParams *p);
+
+    // forget the parameter values kept by getSpriteParams
+    void resetSpriteParams();
+
+    // read the atlas file and the header of the sheet file
+    void loadFiles();
+
+    // is the sheet read from a file? sets the size of the sheet
+    bool getSheetFileSize(OfxPointI *size);
+
+    // the decoded sheet file for this render, or NULL
+    SpriteSheetPixelsPtr getSheetPixels(const OfxPointD& renderScale, BitDepthEnum bitDepth, int nComponents);
+
+    // the crop rectangle and source window at the given render scale
     void getCropRectangle(OfxTime time,
                           const OfxPointD& renderScale,
-                          const OfxRectI& rodPixel, // RoD in pixel at renderscale = 1
-                          const OfxPointI& spriteSize,
-                          const OfxPointI& spriteRange,
-                          int frameOffset,
-                          int frameSeparation,
-                          ReadingDirectionEnum readingDirection,
-                          PlaybackModeEnum playbackMode,
-                          int loopOffset,
-                          const OfxPointI& repeatRange,
-                          int repeatCount,
-                          const OfxPointI& spritesCut,
-        OfxRectI *cropRectPixel) const
-    {
-        bool verticalRead = (readingDirection == eReadingDirectionVerticalForward || readingDirection == eReadingDirectionVerticalBackward || readingDirection == eReadingDirectionVerticalForwardS || readingDirection == eReadingDirectionVerticalBackwardS);
-        bool backwardRead = (readingDirection == eReadingDirectionHorizontalBackward || readingDirection == eReadingDirectionVerticalBackward || readingDirection == eReadingDirectionHorizontalBackwardS || readingDirection == eReadingDirectionVerticalBackwardS);
-        bool sshapedRead = (readingDirection == eReadingDirectionHorizontalForwardS || readingDirection == eReadingDirectionHorizontalBackwardS || readingDirection == eReadingDirectionVerticalForwardS || readingDirection == eReadingDirectionVerticalBackwardS);
-        // number of sprites in the range
-        int n = std::abs(spriteRange.y - spriteRange.x) + 1;
-        int m = std::abs(repeatRange.y - repeatRange.x) + 1;
-        if (playbackMode == ePlaybackModeNormalReverseMerge) {
-            n -= 1;
-        }
-        // sprite index
-        int i = mod((int)std::floor(time) / frameSeparation + frameOffset, n + m * repeatCount);
-        if ((playbackMode == ePlaybackModeNormalReverse || playbackMode == ePlaybackModeNormalReverseMerge) && mod(((int)std::floor(time) / frameSeparation + frameOffset) / (n + m * repeatCount), 2) == 1) {
-            i = n + m * repeatCount - (playbackMode != ePlaybackModeNormalReverseMerge ? 1 : 0) - i;
-        }
-        i = mod(i + loopOffset, n + (playbackMode == ePlaybackModeNormalReverseMerge ? 1 : 0) + m * repeatCount);
-        int j = (i - std::min(repeatRange.x, spriteRange.y)) / m;
-        if (j < 0) {
-            j = 0;
-        }
-        i = i - std::min(j, repeatCount) * m;
-        if (spriteRange.x <= spriteRange.y) {
-            i = spriteRange.x + i;
+                          const SpriteSheetParams& p,
+                          OfxRectI *cropRectPixel,
+                          OfxRectI *srcWindowPixel)
+    {
+        SpriteCell cell;
+        bool reversed;
+        int phase = getSpritePhase(time, p, &reversed);
+        getSpriteCell(phase, reversed, p, &cell);
+        cropRectPixel->x1 = (int)(renderScale.x * cell.rect.x1);
+        cropRectPixel->y1 = (int)(renderScale.y * cell.rect.y1);
+        cropRectPixel->x2 = (int)(renderScale.x * cell.rect.x2);
+        cropRectPixel->y2 = (int)(renderScale.y * cell.rect.y2);
+        if (p.atlas) {
+            srcWindowPixel->x1 = (int)(renderScale.x * cell.window.x1);
+            srcWindowPixel->y1 = (int)(renderScale.y * cell.window.y1);
+            srcWindowPixel->x2 = (int)(renderScale.x * cell.window.x2);
+            srcWindowPixel->y2 = (int)(renderScale.y * cell.window.y2);
         } else {
-            i = spriteRange.x - i;
-        }
-        // number of sprites per line
-        int cols = verticalRead ? (rodPixel.y2 - rodPixel.y1) / spriteSize.y / spritesCut.y : (rodPixel.x2 - rodPixel.x1) / spriteSize.x / spritesCut.x;
-        if (cols <= 0) {
-            cols = 1;
-        }
-        int sum = (rodPixel.y2 - rodPixel.y1) / spriteSize.y / spritesCut.y * (rodPixel.x2 - rodPixel.x1) / spriteSize.x / spritesCut.x;
-        if (sum <= 0) {
-            sum = 1;
-        }
-        int r = i / cols % std::max(1, sum / cols);
-        int c = i % cols;
-        if (backwardRead) {
-            c = cols - 1 - c;
-        }
-        if (sshapedRead) {
-            c = (r + spriteRange.x / cols % std::max(1, sum / cols)) % 2 == 0 ? c : (cols - 1 - c);
-        }
-        int ii = i / sum;
-        int colsCrop = verticalRead ? spritesCut.y : spritesCut.x;
-        if (colsCrop <= 0) {
-            colsCrop = 1;
-        }
-        int rr = ii / colsCrop;
-        int cc = ii % colsCrop;
-        if (backwardRead) {
-            cc = colsCrop - 1 - cc;
-        }
-        r += rr * sum / cols;
-        c += cc * cols;
-        if (verticalRead) {
-            int a = r;
-            r = c;
-            c = a;
-        }
-        cropRectPixel->x1 = (int)(renderScale.x * (rodPixel.x1 + c * spriteSize.x));
-        cropRectPixel->y1 = (int)(renderScale.y * (rodPixel.y2 - (r + 1) * spriteSize.y));
-        cropRectPixel->x2 = (int)(renderScale.x * (rodPixel.x1 + (c + 1) * spriteSize.x));
-        cropRectPixel->y2 = (int)(renderScale.y * (rodPixel.y2 - r * spriteSize.y));
+            *srcWindowPixel = cell.window;
+        }
     } // SpriteSheetPlugin::getCropRectangle
 
     Clip* getSrcClip() const
@@ -351,6 +925,31 @@ private:
     Int2DParam* _repeatRange;
     IntParam* _repeatCount;
     Int2DParam* _spritesCut;
+    IntParam* _scale;
+    BooleanParam* _indexedColours;
+    IntParam* _paletteRow;
+    BooleanParam* _trimToAlpha;
+    BooleanParam* _spriteCache;
+    IntParam* _spriteCacheSize;
+    StringParam* _atlasFile;
+    StringParam* _sheetFile;
+    Clip *_paletteClip;
+    MultiThread::Mutex _paramsMutex;
+    unsigned int _paramsGeneration; // protected by _paramsMutex, incremented by resetSpriteParams
+    bool _paramsKnown; // protected by _paramsMutex, _paramsAnimated is set
+    bool _paramsAnimated; // protected by _paramsMutex, some of the sprite parameters are animated
+    SpriteSheetParams _paramsValues; // protected by _paramsMutex, the values of the parameters if none is animated
+    SpriteSheetAlphaIndex _alphaIndex;
+    MultiThread::Mutex _atlasMutex;
+    SpriteAtlasPtr _atlas; // protected by _atlasMutex, loaded outside of the render actions
+    std::string _sheetFilePath; // protected by _atlasMutex, empty if the sheet is not read from a file
+    OfxPointI _sheetFileSize; // protected by _atlasMutex
+    SpriteSheetPixelsPtr _sheetPixels; // protected by _atlasMutex, keeps the last decoded sheet alive
+    MultiThread::Mutex _indexedSheetMutex;
+    SpriteSheetIndexedSheetPtr _indexedSheet; // protected by _indexedSheetMutex
+    MultiThread::Mutex _sheetHashMutex;
+    bool _sheetHashValid; // protected by _sheetHashMutex
+    SpriteSheetHash _sheetHash; // protected by _sheetHashMutex
 };
 
 
@@ -360,6 +959,264 @@ private:
 ////////////////////////////////////////////////////////////////////////////////
 // basic plugin render function, just a skelington to instantiate templates from
 
+void
+SpriteSheetPlugin::loadFiles()
+{
+    std::string error;
+    std::string path;
+    _atlasFile->getValue(path);
+    SpriteAtlasPtr atlas;
+    if ( !path.empty() ) {
+        atlas = spriteAtlasLoad(path, &error);
+    }
+    std::string sheetPath;
+    _sheetFile->getValue(sheetPath);
+    OfxPointI sheetSize = {0, 0};
+    if ( !sheetPath.empty() && error.empty() ) {
+        spriteSheetPngSize(sheetPath, &sheetSize.x, &sheetSize.y, &error);
+    }
+    if ( !error.empty() ) {
+        // use none of the files, rather than an atlas without its sheet or a sheet without its size
+        setPersistentMessage(Message::eMessageError, "", error);
+        atlas.reset();
+        sheetPath.clear();
+        sheetSize.x = sheetSize.y = 0;
+    } else {
+        clearPersistentMessage();
+    }
+    MultiThread::AutoMutex lock(_atlasMutex);
+    _atlas = atlas;
+    if (sheetPath != _sheetFilePath) {
+        _sheetPixels.reset();
+    }
+    _sheetFilePath = sheetPath;
+    _sheetFileSize = sheetSize;
+}
+
+bool
+SpriteSheetPlugin::getSheetFileSize(OfxPointI *size)
+{
+    MultiThread::AutoMutex lock(_atlasMutex);
+    *size = _sheetFileSize;
+
+    return !_sheetFilePath.empty();
+}
+
+SpriteSheetPixelsPtr
+SpriteSheetPlugin::getSheetPixels(const OfxPointD& renderScale,
+                                  BitDepthEnum bitDepth,
+                                  int nComponents)
+{
+    std::string path;
+    {
+        MultiThread::AutoMutex lock(_atlasMutex);
+        path = _sheetFilePath;
+    }
+    if ( path.empty() ) {
+        return SpriteSheetPixelsPtr();
+    }
+    std::string error;
+    SpriteSheetPixelsPtr pixels = spriteSheetPngLoad(path, Coords::mipmapLevelFromScale(renderScale.x), (int)bitDepth, nComponents, &error);
+    if (!pixels) {
+        setPersistentMessage(Message::eMessageError, "", error);
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    MultiThread::AutoMutex lock(_atlasMutex);
+    _sheetPixels = pixels;
+
+    return pixels;
+}
+
+void
+SpriteSheetPlugin::changedParam(const InstanceChangedArgs & /*args*/,
+                                const std::string &paramName)
+{
+    // any change, including a new keyframe or expression, may change the sprite parameters
+    resetSpriteParams();
+    if ( (paramName == kParamAtlasFile) || (paramName == kParamAtlasReload) || (paramName == kParamSheetFile) ) {
+        loadFiles();
+        if (paramName != kParamAtlasFile) {
+            resetSheetIndices();
+        }
+    } else if (paramName == kParamIndexedColours) {
+        resetIndexedSheet();
+    } else if (paramName == kParamIndexRebuild) {
+        resetSheetIndices();
+    } else if (paramName == kParamSpriteCacheSize) {
+        spriteCacheSetBudget( (size_t)_spriteCacheSize->getValue() * 1024 * 1024 );
+    } else if (paramName == kParamSpriteCacheStats) {
+        const SpriteCacheStats stats = spriteCacheGetStats();
+        char msg[256];
+        std::snprintf(msg, sizeof(msg), "Sprite cache: %llu hits, %llu misses, %llu evictions, %u sprites, %.1f MB used out of %.1f MB.",
+                 stats.hits, stats.misses, stats.evictions, (unsigned)stats.entries,
+                 stats.bytes / (1024. * 1024.), stats.budget / (1024. * 1024.) );
+        sendMessage(Message::eMessageMessage, "", msg);
+    }
+}
+
+void
+SpriteSheetPlugin::changedClip(const InstanceChangedArgs & /*args*/,
+                               const std::string &clipName)
+{
+    if (clipName == kOfxImageEffectSimpleSourceClipName) {
+        resetSheetIndices();
+    }
+}
+
+void
+SpriteSheetPlugin::resetSheetIndices()
+{
+    resetIndexedSheet();
+    _alphaIndex.reset();
+    MultiThread::AutoMutex lock(_sheetHashMutex);
+    _sheetHashValid = false;
+}
+
+bool
+SpriteSheetPlugin::getSheetHash(const OfxRectI& sheetPixel,
+                                const OfxPointD& renderScale,
+                                BitDepthEnum bitDepth,
+                                int nComponents,
+                                unsigned long long *hash)
+{
+    MultiThread::AutoMutex lock(_sheetHashMutex);
+    if ( !_sheetHashValid || !_sheetHash.matches(sheetPixel, renderScale, bitDepth, nComponents) ) {
+        return false;
+    }
+    *hash = _sheetHash.hash;
+
+    return true;
+}
+
+void
+SpriteSheetPlugin::resetIndexedSheet()
+{
+    MultiThread::AutoMutex lock(_indexedSheetMutex);
+    _indexedSheet.reset();
+}
+
+SpriteSheetIndexedSheetPtr
+SpriteSheetPlugin::getIndexedSheet(const OfxRectI& sheetPixel,
+                                   const OfxPointD& renderScale,
+                                   BitDepthEnum bitDepth,
+                                   int pixelBytes)
+{
+    MultiThread::AutoMutex lock(_indexedSheetMutex);
+    if ( _indexedSheet && _indexedSheet->matches(sheetPixel, renderScale, bitDepth, pixelBytes) ) {
+        return _indexedSheet;
+    }
+
+    return SpriteSheetIndexedSheetPtr();
+}
+
+static bool
+rectContains(const OfxRectI& bounds,
+             const OfxRectI& rect)
+{
+    return (bounds.x1 <= rect.x1 && bounds.y1 <= rect.y1 &&
+            rect.x2 <= bounds.x2 && rect.y2 <= bounds.y2);
+}
+
+static int
+getPixelBytes(BitDepthEnum bitDepth,
+              int nComponents)
+{
+    return nComponents * (bitDepth == eBitDepthUByte ? 1 : (bitDepth == eBitDepthUShort ? 2 : 4));
+}
+
+// the sheet rectangle at the given render scale
+static void
+getSheetPixel(const OfxRectI& rodPixel,
+              const OfxPointD& renderScale,
+              OfxRectI *sheetPixel)
+{
+    sheetPixel->x1 = (int)std::floor(renderScale.x * rodPixel.x1);
+    sheetPixel->y1 = (int)std::floor(renderScale.y * rodPixel.y1);
+    sheetPixel->x2 = (int)std::ceil(renderScale.x * rodPixel.x2);
+    sheetPixel->y2 = (int)std::ceil(renderScale.y * rodPixel.y2);
+}
+
+void
+SpriteSheetPlugin::getSpriteParams(OfxTime time,
+                                   SpriteSheetParams *p)
+{
+    {
+        MultiThread::AutoMutex lock(_atlasMutex);
+        p->atlas = _atlas;
+    }
+    OfxPointI sheetFileSize;
+    if ( getSheetFileSize(&sheetFileSize) ) {
+        // the sheet is read from a file
+        p->rodPixel.x1 = p->rodPixel.y1 = 0;
+        p->rodPixel.x2 = sheetFileSize.x;
+        p->rodPixel.y2 = sheetFileSize.y;
+    } else {
+        // get the input format (Natron only) or the input RoD (others)
+        _srcClip->getFormat(p->rodPixel);
+    }
+    if ( OFX::Coords::rectIsEmpty(p->rodPixel) ) {
+        // no format is available, use the RoD instead
+        OfxRectD srcRoD = _srcClip->getRegionOfDefinition(time);
+        double par = _srcClip->getPixelAspectRatio();
+        const OfxPointD rs1 = {1., 1.};
+        Coords::toPixelNearest(srcRoD, rs1, par, &p->rodPixel);
+    }
+    unsigned int generation;
+    bool known;
+    {
+        MultiThread::AutoMutex lock(_paramsMutex);
+        if (_paramsKnown && !_paramsAnimated) {
+            // the values do not depend on time, and did not change since they were fetched
+            const OfxRectI rodPixel = p->rodPixel;
+            const SpriteAtlasPtr atlas = p->atlas;
+            *p = _paramsValues;
+            p->rodPixel = rodPixel;
+            p->atlas = atlas;
+
+            return;
+        }
+        generation = _paramsGeneration;
+        known = _paramsKnown;
+        p->animated = _paramsAnimated;
+    }
+    _spriteSize->getValueAtTime(time, p->spriteSize.x, p->spriteSize.y);
+    _spriteRange->getValueAtTime(time, p->spriteRange.x, p->spriteRange.y);
+    p->frameOffset = _frameOffset->getValueAtTime(time);
+    p->frameSeparation = _frameSeparation->getValueAtTime(time);
+    p->readingDirection = (ReadingDirectionEnum)_readingDirection->getValueAtTime(time);
+    p->playbackMode = (PlaybackModeEnum)_playbackMode->getValueAtTime(time);
+    p->loopOffset = _loopOffset->getValueAtTime(time);
+    _repeatRange->getValueAtTime(time, p->repeatRange.x, p->repeatRange.y);
+    p->repeatCount = _repeatCount->getValueAtTime(time);
+    _spritesCut->getValueAtTime(time, p->spritesCut.x, p->spritesCut.y);
+    p->scale = std::max(1, _scale->getValueAtTime(time));
+    if (known) {
+        return;
+    }
+    // A parameter is animating if it has keyframes, or if an expression or a link drives it.
+    // The values of the other parameters only change through changedParam, which calls resetSpriteParams.
+    p->animated = ( _spriteSize->getIsAnimating() || _spriteRange->getIsAnimating() ||
+                    _frameOffset->getIsAnimating() || _frameSeparation->getIsAnimating() ||
+                    _readingDirection->getIsAnimating() || _playbackMode->getIsAnimating() ||
+                    _loopOffset->getIsAnimating() || _repeatRange->getIsAnimating() ||
+                    _repeatCount->getIsAnimating() || _spritesCut->getIsAnimating() ||
+                    _scale->getIsAnimating() );
+    MultiThread::AutoMutex lock(_paramsMutex);
+    if (generation == _paramsGeneration) {
+        _paramsKnown = true;
+        _paramsAnimated = p->animated;
+        _paramsValues = *p;
+    }
+}
+
+void
+SpriteSheetPlugin::resetSpriteParams()
+{
+    MultiThread::AutoMutex lock(_paramsMutex);
+    ++_paramsGeneration;
+    _paramsKnown = false;
+}
+
 /* set up and run a processor */
 void
 SpriteSheetPlugin::setupAndProcess(SpriteSheetProcessorBase &processor,
@@ -382,12 +1239,161 @@ SpriteSheetPlugin::setupAndProcess(SpriteSheetProcessorBase &processor,
     }
     checkBadRenderScaleOrField(dst, args);
 # endif
-    auto_ptr<const Image> src( ( _srcClip && _srcClip->isConnected() ) ?
-                                    _srcClip->fetchImage(args.time) : 0 );
-    if ( !src.get() || !( _srcClip && _srcClip->isConnected() ) ) {
+    OfxPointI sheetFileSize;
+    const bool sheetFile = getSheetFileSize(&sheetFileSize);
+    if ( !sheetFile && !( _srcClip && _srcClip->isConnected() ) ) {
         // nothing to do
         return;
-    } else {
+    }
+
+    SpriteSheetParams p;
+    getSpriteParams(time, &p);
+
+    OfxRectI cropRectPixel;
+    OfxRectI srcWindowPixel;
+    getCropRectangle(time, args.renderScale, p, &cropRectPixel, &srcWindowPixel);
+
+    // set the images
+    processor.setDstImg( dst.get() );
+
+    // set the render window
+    processor.setRenderWindow(args.renderWindow, args.renderScale);
+
+    processor.setValues(cropRectPixel, srcWindowPixel, p.scale);
+
+    if (sheetFile) {
+        // the decoded sheet is shared, only the rows of the sprite are read
+        SpriteSheetPixelsPtr pixels = getSheetPixels(args.renderScale, _dstClip->getPixelDepth(), _dstClip->getPixelComponentCount());
+        if (!pixels) {
+            // the file was unset since getSheetFileSize
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+        const SpriteSheetPackedImage sheetImg(*pixels);
+        if ( _trimToAlpha->getValueAtTime(time) && _alphaIndex.needsBuild(p, args.renderScale) ) {
+            _alphaIndex.build(sheetImg, args.renderScale, p);
+        }
+        processor.setSrcPixels(&pixels->pixels[0], sheetImg.getBounds());
+        processor.process();
+
+        return;
+    }
+
+    auto_ptr<const Image> src;
+    SpriteSheetIndexedSheetPtr sheet;
+    std::vector<unsigned char> palette;
+    if ( _indexedColours->getValueAtTime(time) ) {
+        const BitDepthEnum bitDepth = _dstClip->getPixelDepth();
+        const int pixelBytes = getPixelBytes(bitDepth, _dstClip->getPixelComponentCount());
+        OfxRectI sheetPixel;
+        getSheetPixel(p.rodPixel, args.renderScale, &sheetPixel);
+        sheet = getIndexedSheet(sheetPixel, args.renderScale, bitDepth, pixelBytes);
+        if (!sheet) {
+            // convert the sheet, if the host gave the whole sheet
+            src.reset( _srcClip->fetchImage(time) );
+            if ( src.get() && rectContains(src->getBounds(), sheetPixel) ) {
+                std::shared_ptr<SpriteSheetIndexedSheet> newSheet = std::make_shared<SpriteSheetIndexedSheet>();
+                newSheet->bounds = sheetPixel;
+                newSheet->renderScale = args.renderScale;
+                newSheet->bitDepth = bitDepth;
+                newSheet->pixelBytes = pixelBytes;
+                if ( !buildIndexedSheet(*src, newSheet.get()) ) {
+                    // too many colours: remember it, and read the sheet directly
+                    newSheet->indices.clear();
+                    newSheet->palette.clear();
+                }
+                MultiThread::AutoMutex lock(_indexedSheetMutex);
+                _indexedSheet = newSheet;
+                sheet = newSheet;
+            }
+        }
+        if ( sheet && sheet->indices.empty() ) {
+            sheet.reset();
+        }
+        if (sheet) {
+            palette = sheet->palette;
+            if ( _paletteClip && _paletteClip->isConnected() ) {
+                auto_ptr<const Image> paletteImg( _paletteClip->fetchImage(time) );
+                if ( paletteImg.get() && (paletteImg->getPixelDepth() == bitDepth) && (paletteImg->getPixelComponentCount() == _dstClip->getPixelComponentCount()) ) {
+                    OfxRectI paletteRoDPixel;
+                    Coords::toPixelEnclosing(_paletteClip->getRegionOfDefinition(time), args.renderScale, _paletteClip->getPixelAspectRatio(), &paletteRoDPixel);
+                    swapPalette(*paletteImg, paletteRoDPixel, _paletteRow->getValueAtTime(time), pixelBytes, &palette);
+                }
+            }
+            processor.setIndexedSrc(&sheet->indices[0], sheet->bounds, &palette[0]);
+        }
+    }
+
+    if ( _trimToAlpha->getValueAtTime(time) && _alphaIndex.needsBuild(p, args.renderScale) ) {
+        // scan the sheet, if the host gave the whole sheet
+        if ( !src.get() ) {
+            src.reset( _srcClip->fetchImage(time) );
+        }
+        OfxRectI sheetPixel;
+        getSheetPixel(p.rodPixel, args.renderScale, &sheetPixel);
+        if ( src.get() && rectContains(src->getBounds(), sheetPixel) ) {
+            _alphaIndex.build(*src, args.renderScale, p);
+        }
+    }
+
+    SpriteBufferPtr sprite;
+    if ( !sheet && _spriteCache->getValueAtTime(time) ) {
+        const BitDepthEnum bitDepth = _dstClip->getPixelDepth();
+        const int nComponents = _dstClip->getPixelComponentCount();
+        const int pixelBytes = getPixelBytes(bitDepth, nComponents);
+        OfxRectI sheetPixel;
+        getSheetPixel(p.rodPixel, args.renderScale, &sheetPixel);
+        SpriteCacheKey key;
+        bool hashed = getSheetHash(sheetPixel, args.renderScale, bitDepth, nComponents, &key.sheetHash);
+        if (!hashed) {
+            // hash the sheet, if the host gave the whole sheet
+            if ( !src.get() ) {
+                src.reset( _srcClip->fetchImage(time) );
+            }
+            if ( src.get() && rectContains(src->getBounds(), sheetPixel) ) {
+                SpriteSheetHash sheetHash;
+                sheetHash.sheetPixel = sheetPixel;
+                sheetHash.renderScale = args.renderScale;
+                sheetHash.bitDepth = bitDepth;
+                sheetHash.nComponents = nComponents;
+                sheetHash.hash = hashSheet(*src, sheetPixel, pixelBytes);
+                key.sheetHash = sheetHash.hash;
+                hashed = true;
+                MultiThread::AutoMutex lock(_sheetHashMutex);
+                _sheetHash = sheetHash;
+                _sheetHashValid = true;
+            }
+        }
+        // the part of the sheet read by the processor
+        if ( hashed &&
+             Coords::rectIntersection(cropRectPixel, srcWindowPixel, &key.rect) &&
+             Coords::rectIntersection(key.rect, sheetPixel, &key.rect) ) {
+            key.bitDepth = (int)bitDepth;
+            key.nComponents = nComponents;
+            // the key holds the hash of the sheet content: a hit is copied without fetching the source
+            sprite = spriteCacheGet(key);
+            if (!sprite) {
+                if ( !src.get() ) {
+                    src.reset( _srcClip->fetchImage(time) );
+                }
+                if ( src.get() && rectContains(src->getBounds(), key.rect) ) {
+                    sprite = extractSprite(*src, key.rect, pixelBytes);
+                    spriteCacheInsert(key, sprite);
+                }
+            }
+            if (sprite) {
+                processor.setSrcPixels(&(*sprite)[0], key.rect);
+            }
+        }
+    }
+
+    if (!sheet && !sprite) {
+        if ( !src.get() ) {
+            src.reset( _srcClip->fetchImage(time) );
+        }
+        if ( !src.get() ) {
+            // nothing to do
+            return;
+        }
 #     ifndef NDEBUG
         checkBadRenderScaleOrField(src, args);
         BitDepthEnum dstBitDepth       = dst->getPixelDepth();
@@ -398,50 +1404,42 @@ SpriteSheetPlugin::setupAndProcess(SpriteSheetProcessorBase &processor,
             throwSuiteStatusException(kOfxStatFailed);
         }
 #     endif
+        processor.setSrcImg( src.get() );
     }
 
-    // set the images
-    processor.setDstImg( dst.get() );
-    processor.setSrcImg( src.get() );
-
-    // set the render window
-    processor.setRenderWindow(args.renderWindow, args.renderScale);
-
-
-    // get the input format (Natron only) or the input RoD (others)
-    OfxRectI srcRoDPixel;
-    _srcClip->getFormat(srcRoDPixel);
-    if ( OFX::Coords::rectIsEmpty(srcRoDPixel) ) {
-        // no format is available, use the RoD instead
-        OfxRectD srcRoD = _srcClip->getRegionOfDefinition(time);
-        double par = _srcClip->getPixelAspectRatio();
-        const OfxPointD rs1 = {1., 1.};
-        Coords::toPixelNearest(srcRoD, rs1, par, &srcRoDPixel);
-    }
-    OfxPointI spriteSize;
-    _spriteSize->getValueAtTime(time, spriteSize.x, spriteSize.y);
-    OfxPointI spriteRange;
-    _spriteRange->getValueAtTime(time, spriteRange.x, spriteRange.y);
-    int frameOffset = _frameOffset->getValueAtTime(time);
-    int frameSeparation = _frameSeparation->getValueAtTime(time);
-    ReadingDirectionEnum readingDirection = (ReadingDirectionEnum)_readingDirection->getValueAtTime(time);
-    PlaybackModeEnum playbackMode = (PlaybackModeEnum)_playbackMode->getValueAtTime(time);
-    int loopOffset = _loopOffset->getValueAtTime(time);
-    OfxPointI repeatRange;
-    _repeatRange->getValueAtTime(time, repeatRange.x, repeatRange.y);
-    int repeatCount = _repeatCount->getValueAtTime(time);
-
-    OfxPointI spritesCut;
-    _spritesCut->getValueAtTime(time, spritesCut.x, spritesCut.y);
-
-    OfxRectI cropRectPixel;
-    getCropRectangle(time, args.renderScale, srcRoDPixel, spriteSize, spriteRange, frameOffset, frameSeparation, readingDirection, playbackMode, loopOffset, repeatRange, repeatCount, spritesCut, &cropRectPixel);
-    processor.setValues(cropRectPixel);
-
     // Call the base class process member, this will call the derived templated process code
     processor.process();
 } // SpriteSheetPlugin::setupAndProcess
 
+bool
+SpriteSheetPlugin::needsWholeSheet(OfxTime time,
+                                   const OfxPointD& renderScale,
+                                   const SpriteSheetParams& p)
+{
+    const BitDepthEnum bitDepth = _dstClip->getPixelDepth();
+    const int nComponents = _dstClip->getPixelComponentCount();
+    OfxRectI sheetPixel;
+
+    getSheetPixel(p.rodPixel, renderScale, &sheetPixel);
+    bool indexed = false;
+    if ( _indexedColours->getValueAtTime(time) ) {
+        SpriteSheetIndexedSheetPtr sheet = getIndexedSheet(sheetPixel, renderScale, bitDepth, getPixelBytes(bitDepth, nComponents));
+        if (!sheet) {
+            return true;
+        }
+        indexed = !sheet->indices.empty();
+    }
+    if ( !indexed && _spriteCache->getValueAtTime(time) ) {
+        // the sprite cache is only used when the sheet is read directly
+        unsigned long long hash;
+        if ( !getSheetHash(sheetPixel, renderScale, bitDepth, nComponents, &hash) ) {
+            return true;
+        }
+    }
+
+    return _trimToAlpha->getValueAtTime(time) && _alphaIndex.needsBuild(p, renderScale);
+}
+
 // override the roi call
 // Required if the plugin requires a region from the inputs which is different from the rendered region of the output.
 // (this is the case here)
@@ -450,46 +1448,58 @@ SpriteSheetPlugin::getRegionsOfInterest(const RegionsOfInterestArguments &args,
                                  RegionOfInterestSetter &rois)
 {
     const double time = args.time;
-
-    // get the input format (Natron only) or the input RoD (others)
-    OfxRectI srcRoDPixel;
-    _srcClip->getFormat(srcRoDPixel);
     double par = _srcClip->getPixelAspectRatio();
-    if ( OFX::Coords::rectIsEmpty(srcRoDPixel) ) {
-        // no format is available, use the RoD instead
-        OfxRectD srcRoD = _srcClip->getRegionOfDefinition(time);
-        const OfxPointD rs1 = {1., 1.};
-        Coords::toPixelNearest(srcRoD, rs1, par, &srcRoDPixel);
-    }
-    OfxPointI spriteSize;
-    _spriteSize->getValueAtTime(time, spriteSize.x, spriteSize.y);
-    OfxPointI spriteRange;
-    _spriteRange->getValueAtTime(time, spriteRange.x, spriteRange.y);
-    int frameOffset = _frameOffset->getValueAtTime(time); 
-    int frameSeparation = _frameSeparation->getValueAtTime(time);
-    ReadingDirectionEnum readingDirection = (ReadingDirectionEnum)_readingDirection->getValueAtTime(time);
-    PlaybackModeEnum playbackMode = (PlaybackModeEnum)_playbackMode->getValueAtTime(time);
-    int loopOffset = _loopOffset->getValueAtTime(time);
-    OfxPointI repeatRange;
-    _repeatRange->getValueAtTime(time, repeatRange.x, repeatRange.y);
-    int repeatCount = _repeatCount->getValueAtTime(time);
-
-    OfxPointI spritesCut;
-    _spritesCut->getValueAtTime(time, spritesCut.x, spritesCut.y);
+
+    OfxPointI sheetFileSize;
+    if ( getSheetFileSize(&sheetFileSize) ) {
+        // the sheet is read from a file, nothing is needed from the source
+        const OfxRectD emptyRoI = {0., 0., 0., 0.};
+        rois.setRegionOfInterest(*_srcClip, emptyRoI);
+
+        return;
+    }
+
+    SpriteSheetParams p;
+    getSpriteParams(time, &p);
 
     OfxRectI cropRectPixel;
-    getCropRectangle(time, args.renderScale, srcRoDPixel, spriteSize, spriteRange, frameOffset, frameSeparation, readingDirection, playbackMode, loopOffset, repeatRange, repeatCount, spritesCut, &cropRectPixel);
+    OfxRectI srcWindowPixel;
+    getCropRectangle(time, args.renderScale, p, &cropRectPixel, &srcWindowPixel);
 
     OfxRectD cropRect;
     Coords::toCanonical(cropRectPixel, args.renderScale, par, &cropRect);
 
+    // the output is the sprite scaled up by an integer factor
     OfxRectD roi = args.regionOfInterest;
+    roi.x1 /= p.scale;
+    roi.y1 /= p.scale;
+    roi.x2 /= p.scale;
+    roi.y2 /= p.scale;
     roi.x1 += cropRect.x1;
     roi.y1 += cropRect.y1;
     roi.x2 += cropRect.x1;
     roi.y2 += cropRect.y1;
+    if (p.atlas) {
+        // only the packed frame is needed
+        OfxRectD srcWindow;
+        Coords::toCanonical(srcWindowPixel, args.renderScale, par, &srcWindow);
+        Coords::rectIntersection(roi, srcWindow, &roi);
+    }
+    if ( needsWholeSheet(time, args.renderScale, p) ) {
+        // the indices are built from the whole sheet, which is only read until they exist
+        OfxRectI sheetPixel;
+        getSheetPixel(p.rodPixel, args.renderScale, &sheetPixel);
+        OfxRectD sheet;
+        Coords::toCanonical(sheetPixel, args.renderScale, par, &sheet);
+        Coords::rectBoundingBox(roi, sheet, &roi);
+    }
 
     rois.setRegionOfInterest(*_srcClip, roi);
+
+    if ( _indexedColours->getValueAtTime(time) && _paletteClip && _paletteClip->isConnected() ) {
+        // the palette rows are counted from the top of the palette, which is needed whatever the render window
+        rois.setRegionOfInterest( *_paletteClip, _paletteClip->getRegionOfDefinition(time) );
+    }
 }
 
 bool
@@ -501,7 +1511,40 @@ SpriteSheetPlugin::getRegionOfDefinition(const RegionOfDefinitionArguments &args
     double par = _srcClip->getPixelAspectRatio();
     const OfxPointD rs1 = {1., 1.};
     OfxRectI sprite = {0, 0, 0, 0};
-    _spriteSize->getValueAtTime(time, sprite.x2, sprite.y2);
+    SpriteAtlasPtr atlas;
+    {
+        MultiThread::AutoMutex lock(_atlasMutex);
+        atlas = _atlas;
+    }
+    const bool trimToAlpha = _trimToAlpha->getValueAtTime(time);
+    if (atlas || trimToAlpha) {
+        // the size of the untrimmed sprite of the current frame
+        SpriteSheetParams p;
+        getSpriteParams(time, &p);
+        OfxRectI cropRectPixel;
+        OfxRectI srcWindowPixel;
+        getCropRectangle(time, rs1, p, &cropRectPixel, &srcWindowPixel);
+        OfxRectI bounds;
+        if ( trimToAlpha && _alphaIndex.getBounds(time, p, &bounds) ) {
+            // only the visible part of the sprite
+            sprite.x1 = bounds.x1 - cropRectPixel.x1;
+            sprite.y1 = bounds.y1 - cropRectPixel.y1;
+            sprite.x2 = bounds.x2 - cropRectPixel.x1;
+            sprite.y2 = bounds.y2 - cropRectPixel.y1;
+        } else if (atlas) {
+            sprite.x2 = cropRectPixel.x2 - cropRectPixel.x1;
+            sprite.y2 = cropRectPixel.y2 - cropRectPixel.y1;
+        } else {
+            _spriteSize->getValueAtTime(time, sprite.x2, sprite.y2);
+        }
+    } else {
+        _spriteSize->getValueAtTime(time, sprite.x2, sprite.y2);
+    }
+    const int scale = std::max(1, _scale->getValueAtTime(time));
+    sprite.x1 *= scale;
+    sprite.y1 *= scale;
+    sprite.x2 *= scale;
+    sprite.y2 *= scale;
 
     Coords::toCanonical(sprite, rs1, par, &rod);
 
@@ -565,16 +1608,34 @@ SpriteSheetPlugin::getClipPreferences(ClipPreferencesSetter &clipPreferences)
 {
 #ifdef OFX_EXTENSIONS_NATRON
     OfxRectI pixelFormat = {0, 0, 0, 0};
-    _spriteSize->getValue(pixelFormat.x2, pixelFormat.y2);
+    SpriteAtlasPtr atlas;
+    {
+        MultiThread::AutoMutex lock(_atlasMutex);
+        atlas = _atlas;
+    }
+    if (atlas) {
+        pixelFormat.x2 = atlas->maxSourceW;
+        pixelFormat.y2 = atlas->maxSourceH;
+    } else {
+        _spriteSize->getValue(pixelFormat.x2, pixelFormat.y2);
+    }
+    const int scale = std::max(1, _scale->getValue());
+    pixelFormat.x2 *= scale;
+    pixelFormat.y2 *= scale;
     if ( !Coords::rectIsEmpty(pixelFormat) ) {
         clipPreferences.setOutputFormat(pixelFormat);
     }
 #endif
+    OfxPointI sheetFileSize;
+    if ( getSheetFileSize(&sheetFileSize) ) {
+        // the colours of the sheet file are premultiplied when it is decoded
+        clipPreferences.setOutputPremultiplication(eImagePreMultiplied);
+    }
     clipPreferences.setOutputFrameVarying(true); // because output depends on the frame number
 }
 
 
-mDeclarePluginFactory(SpriteSheetPluginFactory, {ofxsThreadSuiteCheck();}, {});
+mDeclarePluginFactory(SpriteSheetPluginFactory, {ofxsThreadSuiteCheck(); spriteCacheSetBudget( (size_t)kParamSpriteCacheSizeDefault * 1024 * 1024 );}, {});
 
 void
 SpriteSheetPluginFactory::describe(ImageEffectDescriptor &desc)
@@ -624,7 +1685,7 @@ SpriteSheetPluginFactory::createInstance(OfxImageEffectHandle handle,
 
 void
 SpriteSheetPluginFactory::describeInContext(ImageEffectDescriptor &desc,
-                                     ContextEnum /*context*/)
+                                     ContextEnum context)
 {
     // Source clip only in the filter context
     // create the mandated source clip
@@ -641,6 +1702,10 @@ SpriteSheetPluginFactory::describeInContext(ImageEffectDescriptor &desc,
     srcClip->setTemporalClipAccess(false);
     srcClip->setSupportsTiles(kSupportsTiles);
     srcClip->setIsMask(false);
+    if (context == eContextGeneral) {
+        // the sheet may be read from a file instead
+        srcClip->setOptional(true);
+    }
 
     // create the mandated output clip
     ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
@@ -652,6 +1717,19 @@ SpriteSheetPluginFactory::describeInContext(ImageEffectDescriptor &desc,
     dstClip->addSupportedComponent(ePixelComponentAlpha);
     dstClip->setSupportsTiles(kSupportsTiles);
 
+    // the optional palette clip, used by the indexed colours mode
+    ClipDescriptor *paletteClip = desc.defineClip(kClipPalette);
+    paletteClip->addSupportedComponent(ePixelComponentRGBA);
+    paletteClip->addSupportedComponent(ePixelComponentRGB);
+#ifdef OFX_EXTENSIONS_NATRON
+    paletteClip->addSupportedComponent(ePixelComponentXY);
+#endif
+    paletteClip->addSupportedComponent(ePixelComponentAlpha);
+    paletteClip->setTemporalClipAccess(false);
+    paletteClip->setSupportsTiles(kSupportsTiles);
+    paletteClip->setIsMask(false);
+    paletteClip->setOptional(true);
+
     // make some pages and to things in
     PageParamDescriptor *page = desc.definePageParam("Controls");
 
@@ -777,6 +1855,114 @@ SpriteSheetPluginFactory::describeInContext(ImageEffectDescriptor &desc,
             page->addChild(*param);
         }
     }
+    {
+        IntParamDescriptor* param = desc.defineIntParam(kParamScale);
+        param->setLabelAndHint(kParamScaleLabel);
+        param->setRange(1, 64);
+        param->setDisplayRange(1, 8);
+        param->setDefault(1);
+#ifdef OFX_EXTENSIONS_NATRON
+        desc.addClipPreferencesSlaveParam(*param);
+#endif
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        StringParamDescriptor* param = desc.defineStringParam(kParamAtlasFile);
+        param->setLabelAndHint(kParamAtlasFileLabel);
+        param->setStringType(eStringTypeFilePath);
+        param->setFilePathExists(true);
+        param->setAnimates(false);
+#ifdef OFX_EXTENSIONS_NATRON
+        desc.addClipPreferencesSlaveParam(*param);
+#endif
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        StringParamDescriptor* param = desc.defineStringParam(kParamSheetFile);
+        param->setLabelAndHint(kParamSheetFileLabel);
+        param->setStringType(eStringTypeFilePath);
+        param->setFilePathExists(true);
+        param->setAnimates(false);
+#ifdef OFX_EXTENSIONS_NATRON
+        desc.addClipPreferencesSlaveParam(*param);
+#endif
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        PushButtonParamDescriptor* param = desc.definePushButtonParam(kParamAtlasReload);
+        param->setLabelAndHint(kParamAtlasReloadLabel);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamIndexedColours);
+        param->setLabelAndHint(kParamIndexedColoursLabel);
+        param->setDefault(false);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        PushButtonParamDescriptor* param = desc.definePushButtonParam(kParamIndexRebuild);
+        param->setLabelAndHint(kParamIndexRebuildLabel);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        IntParamDescriptor* param = desc.defineIntParam(kParamPaletteRow);
+        param->setLabelAndHint(kParamPaletteRowLabel);
+        param->setRange(0, INT_MAX);
+        param->setDisplayRange(0, 16);
+        param->setDefault(1);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamTrimToAlpha);
+        param->setLabelAndHint(kParamTrimToAlphaLabel);
+        param->setDefault(false);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamSpriteCache);
+        param->setLabelAndHint(kParamSpriteCacheLabel);
+        param->setDefault(false);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        IntParamDescriptor* param = desc.defineIntParam(kParamSpriteCacheSize);
+        param->setLabelAndHint(kParamSpriteCacheSizeLabel);
+        param->setRange(0, 65536);
+        param->setDisplayRange(0, 4096);
+        param->setDefault(kParamSpriteCacheSizeDefault);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        PushButtonParamDescriptor* param = desc.definePushButtonParam(kParamSpriteCacheStats);
+        param->setLabelAndHint(kParamSpriteCacheStatsLabel);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
 } // SpriteSheetPluginFactory::describeInContext
 
 static SpriteSheetPluginFactory p(kPluginIdentifier, kPluginVersionMajor, kPluginVersionMinor);
@@ -0,0 +1,515 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Sprite atlas metadata (TexturePacker / Aseprite JSON) support for the SpriteSheet plugin and the sheet packer.
+ */
+
+#include "SpriteSheetAtlas.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <map>
+#include <algorithm>
+
+#include "ofxsFileOpen.h"
+#include "tinythread.h"
+
+using std::string;
+using std::vector;
+
+namespace OFX {
+
+namespace {
+// A minimal JSON document, just enough to read the frame rectangles of an atlas.
+struct JsonValue
+{
+    enum TypeEnum
+    {
+        eTypeNull,
+        eTypeBool,
+        eTypeNumber,
+        eTypeString,
+        eTypeArray,
+        eTypeObject
+    };
+
+    TypeEnum type;
+    double number;
+    string str;
+    vector<JsonValue> items; // array items, or object values
+    vector<string> keys; // object keys, in the file order
+
+    JsonValue()
+        : type(eTypeNull)
+        , number(0.)
+    {
+    }
+
+    const JsonValue* get(const char* key) const
+    {
+        if (type != eTypeObject) {
+            return NULL;
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] == key) {
+                return &items[i];
+            }
+        }
+
+        return NULL;
+    }
+
+    int getInt(const char* key,
+               int defaultValue) const
+    {
+        const JsonValue* v = get(key);
+
+        return (v && v->type == eTypeNumber) ? (int)std::floor(v->number + 0.5) : defaultValue;
+    }
+
+    bool getBool(const char* key,
+                 bool defaultValue) const
+    {
+        const JsonValue* v = get(key);
+
+        return (v && v->type == eTypeBool) ? (v->number != 0.) : defaultValue;
+    }
+};
+
+class JsonParser
+{
+public:
+    JsonParser(const string& text)
+        : _p( text.c_str() )
+        , _end( text.c_str() + text.size() )
+    {
+    }
+
+    bool parse(JsonValue* v)
+    {
+        if ( !parseValue(v, 0) ) {
+            return false;
+        }
+        skipSpaces();
+
+        return _p == _end;
+    }
+
+private:
+    void skipSpaces()
+    {
+        while ( _p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r') ) {
+            ++_p;
+        }
+    }
+
+    bool match(const char* word)
+    {
+        const char* q = _p;
+        while (*word) {
+            if ( (q == _end) || (*q != *word) ) {
+                return false;
+            }
+            ++q;
+            ++word;
+        }
+        _p = q;
+
+        return true;
+    }
+
+    bool parseString(string* s)
+    {
+        if ( (_p == _end) || (*_p != '"') ) {
+            return false;
+        }
+        ++_p;
+        s->clear();
+        while (_p < _end && *_p != '"') {
+            if (*_p == '\\') {
+                ++_p;
+                if (_p == _end) {
+                    return false;
+                }
+                switch (*_p) {
+                case 'n': s->push_back('\n'); break;
+                case 't': s->push_back('\t'); break;
+                case 'r': s->push_back('\r'); break;
+                case 'b': s->push_back('\b'); break;
+                case 'f': s->push_back('\f'); break;
+                case 'u': {
+                    // frame names are only used for display, keep non-ASCII characters as '?'
+                    if (_end - _p < 5) {
+                        return false;
+                    }
+                    unsigned int c = (unsigned int)std::strtoul(string(_p + 1, 4).c_str(), NULL, 16);
+                    s->push_back(c < 0x80 ? (char)c : '?');
+                    _p += 4;
+                    break;
+                }
+                default: s->push_back(*_p); break;
+                }
+                ++_p;
+            } else {
+                s->push_back(*_p++);
+            }
+        }
+        if (_p == _end) {
+            return false;
+        }
+        ++_p; // closing quote
+
+        return true;
+    }
+
+    bool parseValue(JsonValue* v,
+                    int depth)
+    {
+        if (depth > 64) {
+            return false;
+        }
+        skipSpaces();
+        if (_p == _end) {
+            return false;
+        }
+        switch (*_p) {
+        case '{': {
+            v->type = JsonValue::eTypeObject;
+            ++_p;
+            skipSpaces();
+            if ( (_p < _end) && (*_p == '}') ) {
+                ++_p;
+
+                return true;
+            }
+            for (;;) {
+                skipSpaces();
+                v->keys.push_back( string() );
+                if ( !parseString(&v->keys.back()) ) {
+                    return false;
+                }
+                skipSpaces();
+                if ( (_p == _end) || (*_p != ':') ) {
+                    return false;
+                }
+                ++_p;
+                v->items.push_back( JsonValue() );
+                if ( !parseValue(&v->items.back(), depth + 1) ) {
+                    return false;
+                }
+                skipSpaces();
+                if (_p == _end) {
+                    return false;
+                }
+                if (*_p == ',') {
+                    ++_p;
+                } else if (*_p == '}') {
+                    ++_p;
+
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+        case '[': {
+            v->type = JsonValue::eTypeArray;
+            ++_p;
+            skipSpaces();
+            if ( (_p < _end) && (*_p == ']') ) {
+                ++_p;
+
+                return true;
+            }
+            for (;;) {
+                v->items.push_back( JsonValue() );
+                if ( !parseValue(&v->items.back(), depth + 1) ) {
+                    return false;
+                }
+                skipSpaces();
+                if (_p == _end) {
+                    return false;
+                }
+                if (*_p == ',') {
+                    ++_p;
+                } else if (*_p == ']') {
+                    ++_p;
+
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+        case '"':
+            v->type = JsonValue::eTypeString;
+
+            return parseString(&v->str);
+        case 't':
+            v->type = JsonValue::eTypeBool;
+            v->number = 1.;
+
+            return match("true");
+        case 'f':
+            v->type = JsonValue::eTypeBool;
+            v->number = 0.;
+
+            return match("false");
+        case 'n':
+            v->type = JsonValue::eTypeNull;
+
+            return match("null");
+        default: {
+            // strtod needs a NUL-terminated string, which the whole text is
+            char* numEnd = NULL;
+            v->type = JsonValue::eTypeNumber;
+            v->number = std::strtod(_p, &numEnd);
+            if ( (numEnd == _p) || (numEnd > _end) ) {
+                return false;
+            }
+            _p = numEnd;
+
+            return true;
+        }
+        }
+    } // parseValue
+
+    const char* _p;
+    const char* _end;
+};
+
+static bool
+readFile(const string& path,
+         string* text)
+{
+    std::FILE* f = fopen_utf8(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char buf[65536];
+    size_t n;
+    text->clear();
+    while ( ( n = std::fread(buf, 1, sizeof(buf), f) ) > 0 ) {
+        text->append(buf, n);
+    }
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+
+    return ok;
+}
+
+static bool
+parseFrame(const JsonValue& v,
+           SpriteAtlasFrame* frame,
+           string* error)
+{
+    const JsonValue* rect = v.get("frame");
+    if (!rect) {
+        *error = "frame without a \"frame\" rectangle";
+
+        return false;
+    }
+    if ( v.getBool("rotated", false) ) {
+        *error = "rotated frames are not supported, please disable rotation in the sprite packer";
+
+        return false;
+    }
+    frame->x = rect->getInt("x", 0);
+    frame->y = rect->getInt("y", 0);
+    frame->w = rect->getInt("w", 0);
+    frame->h = rect->getInt("h", 0);
+    if ( (frame->w < 0) || (frame->h < 0) ) {
+        *error = "frame with a negative size";
+
+        return false;
+    }
+    // untrimmed frames have no spriteSourceSize, or a spriteSourceSize equal to the frame size
+    const JsonValue* spriteSourceSize = v.get("spriteSourceSize");
+    frame->offsetX = spriteSourceSize ? spriteSourceSize->getInt("x", 0) : 0;
+    frame->offsetY = spriteSourceSize ? spriteSourceSize->getInt("y", 0) : 0;
+    const JsonValue* sourceSize = v.get("sourceSize");
+    frame->sourceW = sourceSize ? sourceSize->getInt("w", frame->w) : frame->w;
+    frame->sourceH = sourceSize ? sourceSize->getInt("h", frame->h) : frame->h;
+
+    return true;
+}
+
+static bool
+parseAtlas(const string& text,
+           SpriteAtlas* atlas,
+           string* error)
+{
+    JsonValue doc;
+    JsonParser parser(text);
+
+    if ( !parser.parse(&doc) ) {
+        *error = "invalid JSON";
+
+        return false;
+    }
+    const JsonValue* frames = doc.get("frames");
+    if ( !frames || ( (frames->type != JsonValue::eTypeObject) && (frames->type != JsonValue::eTypeArray) ) ) {
+        *error = "no \"frames\" object or array";
+
+        return false;
+    }
+    // both the hash ({"name": {...}, ...}) and the array ([{"filename": "name", ...}, ...]) layouts
+    // store the frames in the items, in the file order
+    atlas->frames.resize( frames->items.size() );
+    atlas->maxSourceW = 0;
+    atlas->maxSourceH = 0;
+    for (size_t i = 0; i < frames->items.size(); ++i) {
+        if ( !parseFrame(frames->items[i], &atlas->frames[i], error) ) {
+            return false;
+        }
+        atlas->maxSourceW = std::max(atlas->maxSourceW, atlas->frames[i].sourceW);
+        atlas->maxSourceH = std::max(atlas->maxSourceH, atlas->frames[i].sourceH);
+    }
+    const JsonValue* meta = doc.get("meta");
+    const JsonValue* size = meta ? meta->get("size") : NULL;
+    atlas->width = size ? size->getInt("w", 0) : 0;
+    atlas->height = size ? size->getInt("h", 0) : 0;
+
+    return true;
+}
+
+static string
+jsonString(const string& s)
+{
+    string out = "\"";
+
+    for (size_t i = 0; i < s.size(); ++i) {
+        const unsigned char c = (unsigned char)s[i];
+        if ( (c == '"') || (c == '\\') ) {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += (char)c;
+        }
+    }
+
+    return out + "\"";
+}
+
+struct AtlasCacheEntry
+{
+    long long mtime;
+    long long size;
+    SpriteAtlasPtr atlas;
+};
+
+typedef std::map<string, AtlasCacheEntry> AtlasCache;
+
+static tthread::mutex gAtlasCacheMutex;
+static AtlasCache gAtlasCache;
+} // namespace
+
+SpriteAtlasPtr
+spriteAtlasLoad(const string& path,
+                string* error)
+{
+    long long mtime = 0;
+    long long size = 0;
+
+    if ( !stat_utf8(path.c_str(), &mtime, &size) ) {
+        *error = "cannot open " + path;
+
+        return SpriteAtlasPtr();
+    }
+    {
+        tthread::lock_guard<tthread::mutex> lock(gAtlasCacheMutex);
+        AtlasCache::const_iterator it = gAtlasCache.find(path);
+        if ( (it != gAtlasCache.end()) && (it->second.mtime == mtime) && (it->second.size == size) ) {
+            return it->second.atlas;
+        }
+    }
+
+    // parse outside of the lock, other instances may be loading other files
+    string text;
+    if ( !readFile(path, &text) ) {
+        *error = "cannot read " + path;
+
+        return SpriteAtlasPtr();
+    }
+    std::shared_ptr<SpriteAtlas> atlas = std::make_shared<SpriteAtlas>();
+    string parseError;
+    if ( !parseAtlas(text, atlas.get(), &parseError) ) {
+        *error = path + ": " + parseError;
+
+        return SpriteAtlasPtr();
+    }
+
+    tthread::lock_guard<tthread::mutex> lock(gAtlasCacheMutex);
+    AtlasCacheEntry& entry = gAtlasCache[path];
+    entry.mtime = mtime;
+    entry.size = size;
+    entry.atlas = atlas;
+
+    return entry.atlas;
+} // spriteAtlasLoad
+
+bool
+spriteAtlasWrite(const string& path,
+                 const SpriteAtlas& atlas,
+                 const vector<string>& names,
+                 const string& imageName,
+                 int bitDepth,
+                 string* error)
+{
+    std::FILE* f = fopen_utf8(path.c_str(), "wb");
+
+    if (!f) {
+        *error = "cannot open " + path + " for writing";
+
+        return false;
+    }
+    std::fprintf(f, "{\"frames\": {\n");
+    for (size_t i = 0; i < atlas.frames.size(); ++i) {
+        const SpriteAtlasFrame& fr = atlas.frames[i];
+        const bool trimmed = fr.offsetX != 0 || fr.offsetY != 0 || fr.w != fr.sourceW || fr.h != fr.sourceH;
+        std::fprintf(f, "%s:\n{\n", jsonString(i < names.size() ? names[i] : string()).c_str());
+        std::fprintf(f, "\t\"frame\": {\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d},\n", fr.x, fr.y, fr.w, fr.h);
+        std::fprintf(f, "\t\"rotated\": false,\n");
+        std::fprintf(f, "\t\"trimmed\": %s,\n", trimmed ? "true" : "false");
+        std::fprintf(f, "\t\"spriteSourceSize\": {\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d},\n", fr.offsetX, fr.offsetY, fr.w, fr.h);
+        std::fprintf(f, "\t\"sourceSize\": {\"w\":%d,\"h\":%d}\n", fr.sourceW, fr.sourceH);
+        std::fprintf(f, "}%s\n", i + 1 < atlas.frames.size() ? "," : "");
+    }
+    std::fprintf(f, "},\n\"meta\": {\n");
+    std::fprintf(f, "\t\"app\": \"Miscz SpriteSheetPacker\",\n");
+    std::fprintf(f, "\t\"image\": %s,\n", jsonString(imageName).c_str());
+    std::fprintf(f, "\t\"format\": \"%s\",\n", bitDepth == 16 ? "RGBA16161616" : "RGBA8888");
+    std::fprintf(f, "\t\"size\": {\"w\":%d,\"h\":%d},\n", atlas.width, atlas.height);
+    std::fprintf(f, "\t\"scale\": \"1\"\n");
+    std::fprintf(f, "}\n}\n");
+    bool ok = !std::ferror(f);
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok) {
+        *error = "cannot write " + path;
+    }
+
+    return ok;
+} // spriteAtlasWrite
+} // namespace OFX
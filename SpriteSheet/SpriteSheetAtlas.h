@@ -0,0 +1,61 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Sprite atlas metadata (TexturePacker / Aseprite JSON) support for the SpriteSheet plugin and the sheet packer.
+ */
+
+#ifndef Misc_SpriteSheetAtlas_h
+#define Misc_SpriteSheetAtlas_h
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace OFX {
+
+// one packed frame. All coordinates are in pixels, with the origin at the top-left of the image, as in the metadata file.
+struct SpriteAtlasFrame
+{
+    int x, y, w, h;         // rectangle of the packed (possibly trimmed) frame in the sheet
+    int offsetX, offsetY;   // position of the packed frame in the untrimmed sprite
+    int sourceW, sourceH;   // size of the untrimmed sprite
+};
+
+// the compact frame index of an atlas, in the order of the metadata file
+struct SpriteAtlas
+{
+    int width, height;      // size of the sheet, or 0 if the metadata does not give it
+    int maxSourceW, maxSourceH;
+    std::vector<SpriteAtlasFrame> frames;
+};
+
+typedef std::shared_ptr<const SpriteAtlas> SpriteAtlasPtr;
+
+// Parse an atlas metadata file (TexturePacker JSON hash or array, Aseprite JSON).
+// The parsed index is cached for the whole process, and the file is only parsed again if its modification time
+// or size changed. Returns NULL and sets error if the file cannot be read or parsed.
+SpriteAtlasPtr spriteAtlasLoad(const std::string& path, std::string* error);
+
+// Write an atlas as a TexturePacker JSON hash, that spriteAtlasLoad() reads back.
+// names are the keys of the frames, in the order of the frames. bitDepth is the bit depth of the RGBA image (8 or 16).
+bool spriteAtlasWrite(const std::string& path, const SpriteAtlas& atlas, const std::vector<std::string>& names, const std::string& imageName, int bitDepth, std::string* error);
+} // namespace OFX
+
+#endif // Misc_SpriteSheetAtlas_h
@@ -0,0 +1,177 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Process-wide cache of the sprites extracted by the SpriteSheet plugin.
+ */
+
+#include "SpriteSheetCache.h"
+
+#include <cstring>
+#include <list>
+#include <map>
+
+#include "tinythread.h"
+
+namespace OFX {
+
+namespace {
+struct KeyLess
+{
+    bool operator()(const SpriteCacheKey& a,
+                    const SpriteCacheKey& b) const
+    {
+        if (a.sheetHash != b.sheetHash) {
+            return a.sheetHash < b.sheetHash;
+        }
+        const int va[] = { a.rect.x1, a.rect.y1, a.rect.x2, a.rect.y2, a.bitDepth, a.nComponents };
+        const int vb[] = { b.rect.x1, b.rect.y1, b.rect.x2, b.rect.y2, b.bitDepth, b.nComponents };
+        for (size_t k = 0; k < sizeof(va) / sizeof(va[0]); ++k) {
+            if (va[k] != vb[k]) {
+                return va[k] < vb[k];
+            }
+        }
+
+        return false;
+    }
+};
+
+struct CacheEntry
+{
+    SpriteCacheKey key;
+    SpriteBufferPtr buffer;
+};
+
+// the most recently used entry is at the front of the list
+typedef std::list<CacheEntry> CacheList;
+typedef std::map<SpriteCacheKey, CacheList::iterator, KeyLess> CacheMap;
+
+static tthread::mutex gCacheMutex;
+static CacheList gCacheList;
+static CacheMap gCacheMap;
+static size_t gCacheBytes = 0;
+static size_t gCacheBudget = 256 * 1024 * 1024;
+static unsigned long long gCacheHits = 0;
+static unsigned long long gCacheMisses = 0;
+static unsigned long long gCacheEvictions = 0;
+
+// must be called with gCacheMutex locked
+static void
+evict(size_t budget)
+{
+    while ( !gCacheList.empty() && (gCacheBytes > budget) ) {
+        const CacheEntry& lru = gCacheList.back();
+        gCacheBytes -= lru.buffer->size();
+        gCacheMap.erase(lru.key);
+        gCacheList.pop_back();
+        ++gCacheEvictions;
+    }
+}
+} // namespace
+
+unsigned long long
+spriteCacheHashSheet(const void* data,
+                     size_t size,
+                     unsigned long long seed)
+{
+    // FNV-1a on 64-bit words, with an extra shift to mix the high bits down, and a final byte loop
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned long long h = seed;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        unsigned long long w;
+        std::memcpy(&w, p + i, 8);
+        h = (h ^ w) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    for (; i < size; ++i) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+
+    return h;
+}
+
+SpriteBufferPtr
+spriteCacheGet(const SpriteCacheKey& key)
+{
+    tthread::lock_guard<tthread::mutex> lock(gCacheMutex);
+    CacheMap::iterator it = gCacheMap.find(key);
+
+    if ( it == gCacheMap.end() ) {
+        ++gCacheMisses;
+
+        return SpriteBufferPtr();
+    }
+    ++gCacheHits;
+    gCacheList.splice(gCacheList.begin(), gCacheList, it->second);
+
+    return it->second->buffer;
+}
+
+void
+spriteCacheInsert(const SpriteCacheKey& key,
+                  const SpriteBufferPtr& buffer)
+{
+    tthread::lock_guard<tthread::mutex> lock(gCacheMutex);
+
+    if ( !buffer || (buffer->size() > gCacheBudget) ) {
+        return;
+    }
+    CacheMap::iterator it = gCacheMap.find(key);
+    if ( it != gCacheMap.end() ) {
+        // another render extracted the same sprite in the meantime
+        gCacheList.splice(gCacheList.begin(), gCacheList, it->second);
+
+        return;
+    }
+    evict(gCacheBudget - buffer->size());
+    CacheEntry entry;
+    entry.key = key;
+    entry.buffer = buffer;
+    gCacheList.push_front(entry);
+    gCacheMap[key] = gCacheList.begin();
+    gCacheBytes += buffer->size();
+}
+
+void
+spriteCacheSetBudget(size_t bytes)
+{
+    tthread::lock_guard<tthread::mutex> lock(gCacheMutex);
+
+    gCacheBudget = bytes;
+    evict(gCacheBudget);
+}
+
+SpriteCacheStats
+spriteCacheGetStats()
+{
+    tthread::lock_guard<tthread::mutex> lock(gCacheMutex);
+    SpriteCacheStats stats;
+
+    stats.hits = gCacheHits;
+    stats.misses = gCacheMisses;
+    stats.evictions = gCacheEvictions;
+    stats.entries = gCacheMap.size();
+    stats.bytes = gCacheBytes;
+    stats.budget = gCacheBudget;
+
+    return stats;
+}
+} // namespace OFX
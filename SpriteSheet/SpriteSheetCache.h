@@ -0,0 +1,73 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Process-wide cache of the sprites extracted by the SpriteSheet plugin.
+ */
+
+#ifndef Misc_SpriteSheetCache_h
+#define Misc_SpriteSheetCache_h
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#include "ofxCore.h"
+
+namespace OFX {
+
+// a sprite is identified by the content of its sheet, its rectangle in pixels at the render scale, and its pixel format
+struct SpriteCacheKey
+{
+    unsigned long long sheetHash; // see spriteCacheHashSheet()
+    OfxRectI rect;
+    int bitDepth;                 // BitDepthEnum
+    int nComponents;
+};
+
+// the pixels of rect, packed row by row from rect.y1 to rect.y2
+typedef std::shared_ptr<const std::vector<unsigned char> > SpriteBufferPtr;
+
+struct SpriteCacheStats
+{
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    size_t entries;
+    size_t bytes;
+    size_t budget;
+};
+
+// hash some pixels of a sheet, to identify its content. The rows of a sheet are hashed one after the other, by passing
+// the hash of the previous rows as the seed.
+unsigned long long spriteCacheHashSheet(const void* data, size_t size, unsigned long long seed = 14695981039346656037ULL);
+
+// the cached sprite, or NULL. Counts a hit or a miss.
+SpriteBufferPtr spriteCacheGet(const SpriteCacheKey& key);
+
+// add a sprite, evicting the least recently used ones to stay within the budget
+void spriteCacheInsert(const SpriteCacheKey& key, const SpriteBufferPtr& buffer);
+
+// set the memory budget, in bytes, shared by all the instances. A budget of 0 disables the cache.
+void spriteCacheSetBudget(size_t bytes);
+
+SpriteCacheStats spriteCacheGetStats();
+} // namespace OFX
+
+#endif // Misc_SpriteSheetCache_h
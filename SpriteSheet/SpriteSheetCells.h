@@ -0,0 +1,235 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * The frame-to-sprite mapping of the SpriteSheet plugin.
+ */
+
+#ifndef Misc_SpriteSheetCells_h
+#define Misc_SpriteSheetCells_h
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "ofxCore.h"
+
+#include "SpriteSheetAtlas.h"
+#include "SpriteSheetGrid.h"
+
+namespace OFX {
+
+enum PlaybackModeEnum
+{
+    ePlaybackModeNormal,
+    ePlaybackModeNormalReverse,
+    ePlaybackModeNormalReverseMerge
+};
+
+// the modulo oprator (always returns a positive number)
+inline
+int
+mod(int a, int b)
+{
+    return a >= 0 ? a % b : ( b - std::abs ( a%b ) ) % b;
+}
+
+#define kSpriteIndexMaxPeriod 65536 // beyond this number of sprites per period, the per-sprite indexes are not built
+
+// all the parameter values the sprite cell depends on, at a given time
+struct SpriteSheetParams
+{
+    OfxRectI rodPixel; // RoD in pixel at renderscale = 1
+    OfxPointI spriteSize;
+    OfxPointI spriteRange;
+    int frameOffset;
+    int frameSeparation;
+    ReadingDirectionEnum readingDirection;
+    PlaybackModeEnum playbackMode;
+    int loopOffset;
+    OfxPointI repeatRange;
+    int repeatCount;
+    OfxPointI spritesCut;
+    int scale; // does not affect the cells
+    SpriteAtlasPtr atlas; // if set, the sprites are the atlas frames instead of the grid cells
+    bool animated; // some of the values may change over time (keyframes or expressions)
+
+    // number of sprite indices in one direction of the animation
+    int period() const
+    {
+        int n = std::abs(spriteRange.y - spriteRange.x) + 1;
+        int m = std::abs(repeatRange.y - repeatRange.x) + 1;
+        if (playbackMode == ePlaybackModeNormalReverseMerge) {
+            n -= 1;
+        }
+
+        return n + m * repeatCount;
+    }
+
+    // only the values that affect the frame-to-cell mapping (frameOffset and frameSeparation only affect the phase)
+    bool sameCells(const SpriteSheetParams& other) const
+    {
+        return (rodPixel.x1 == other.rodPixel.x1 && rodPixel.y1 == other.rodPixel.y1 &&
+                rodPixel.x2 == other.rodPixel.x2 && rodPixel.y2 == other.rodPixel.y2 &&
+                spriteSize.x == other.spriteSize.x && spriteSize.y == other.spriteSize.y &&
+                spriteRange.x == other.spriteRange.x && spriteRange.y == other.spriteRange.y &&
+                readingDirection == other.readingDirection &&
+                playbackMode == other.playbackMode &&
+                loopOffset == other.loopOffset &&
+                repeatRange.x == other.repeatRange.x && repeatRange.y == other.repeatRange.y &&
+                repeatCount == other.repeatCount &&
+                spritesCut.x == other.spritesCut.x && spritesCut.y == other.spritesCut.y &&
+                atlas == other.atlas);
+    }
+
+    // FNV-1a hash of the values compared by sameCells()
+    unsigned long long cellsHash() const
+    {
+        const int values[] = {
+            rodPixel.x1, rodPixel.y1, rodPixel.x2, rodPixel.y2,
+            spriteSize.x, spriteSize.y,
+            spriteRange.x, spriteRange.y,
+            (int)readingDirection,
+            (int)playbackMode,
+            loopOffset,
+            repeatRange.x, repeatRange.y,
+            repeatCount,
+            spritesCut.x, spritesCut.y,
+            (int)(size_t)atlas.get(), (int)( (unsigned long long)(size_t)atlas.get() >> 32 )
+        };
+        unsigned long long h = 14695981039346656037ULL;
+        for (size_t k = 0; k < sizeof(values) / sizeof(values[0]); ++k) {
+            unsigned int v = (unsigned int)values[k];
+            for (int b = 0; b < 4; ++b) {
+                h ^= (v >> (8 * b)) & 0xff;
+                h *= 1099511628211ULL;
+            }
+        }
+
+        return h;
+    }
+};
+
+// the sprite phase at a given time: index in [0, period) and whether the animation is being played backwards.
+inline
+int
+getSpritePhase(OfxTime time,
+               const SpriteSheetParams& p,
+               bool *reversed)
+{
+    const int period = p.period();
+    const int q = (int)std::floor(time) / p.frameSeparation + p.frameOffset;
+
+    *reversed = (p.playbackMode == ePlaybackModeNormalReverse || p.playbackMode == ePlaybackModeNormalReverseMerge) && mod(q / period, 2) == 1;
+
+    return mod(q, period);
+}
+
+// a sprite, in pixels at renderscale = 1
+struct SpriteCell
+{
+    OfxRectI rect;   // the rectangle of the source that maps onto the output RoD
+    OfxRectI window; // the part of the source the sprite may be read from (the packed frame of an atlas, infinite for a grid)
+};
+
+// the sprite index for a given sprite phase
+inline int
+getSpriteIndex(int phase,
+               bool reversed,
+               const SpriteSheetParams& p)
+{
+    const PlaybackModeEnum playbackMode = p.playbackMode;
+    const OfxPointI& spriteRange = p.spriteRange;
+    const OfxPointI& repeatRange = p.repeatRange;
+    const int repeatCount = p.repeatCount;
+    // number of sprites in the range
+    int n = std::abs(spriteRange.y - spriteRange.x) + 1;
+    int m = std::abs(repeatRange.y - repeatRange.x) + 1;
+    if (playbackMode == ePlaybackModeNormalReverseMerge) {
+        n -= 1;
+    }
+    // sprite index
+    int i = phase;
+    if (reversed) {
+        i = n + m * repeatCount - (playbackMode != ePlaybackModeNormalReverseMerge ? 1 : 0) - i;
+    }
+    i = mod(i + p.loopOffset, n + (playbackMode == ePlaybackModeNormalReverseMerge ? 1 : 0) + m * repeatCount);
+    int j = (i - std::min(repeatRange.x, spriteRange.y)) / m;
+    if (j < 0) {
+        j = 0;
+    }
+    i = i - std::min(j, repeatCount) * m;
+    if (spriteRange.x <= spriteRange.y) {
+        i = spriteRange.x + i;
+    } else {
+        i = spriteRange.x - i;
+    }
+
+    return i;
+}
+
+// the sprite of an atlas frame: the trimmed frame is put back at its place in the untrimmed sprite,
+// and the RoD origin is the bottom-left corner of the untrimmed sprite
+inline void
+getAtlasCell(int i,
+             const SpriteSheetParams& p,
+             SpriteCell *cell)
+{
+    if ( (i < 0) || ( i >= (int)p.atlas->frames.size() ) ) {
+        cell->rect.x1 = cell->rect.y1 = cell->rect.x2 = cell->rect.y2 = 0;
+        cell->window = cell->rect;
+
+        return;
+    }
+    const SpriteAtlasFrame& f = p.atlas->frames[i];
+    // the metadata has its origin at the top-left of the sheet
+    cell->window.x1 = p.rodPixel.x1 + f.x;
+    cell->window.y1 = p.rodPixel.y2 - (f.y + f.h);
+    cell->window.x2 = cell->window.x1 + f.w;
+    cell->window.y2 = cell->window.y1 + f.h;
+    // offset from the untrimmed sprite to the sheet
+    const int dx = cell->window.x1 - f.offsetX;
+    const int dy = cell->window.y1 - (f.sourceH - (f.offsetY + f.h));
+    cell->rect.x1 = dx;
+    cell->rect.y1 = dy;
+    cell->rect.x2 = dx + f.sourceW;
+    cell->rect.y2 = dy + f.sourceH;
+}
+
+// the sprite for a given sprite phase
+inline void
+getSpriteCell(int phase,
+              bool reversed,
+              const SpriteSheetParams& p,
+              SpriteCell *cell)
+{
+    int i = getSpriteIndex(phase, reversed, p);
+    if (p.atlas) {
+        getAtlasCell(i, p, cell);
+
+        return;
+    }
+
+    spriteSheetGridCell(i, p.readingDirection, p.rodPixel, p.spriteSize, p.spriteRange.x, p.spritesCut, &cell->rect);
+    cell->window.x1 = cell->window.y1 = kOfxFlagInfiniteMin;
+    cell->window.x2 = cell->window.y2 = kOfxFlagInfiniteMax;
+} // getSpriteCell
+} // namespace OFX
+
+#endif // Misc_SpriteSheetCells_h
@@ -0,0 +1,102 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * The uniform grid layout of a sprite sheet, shared by the SpriteSheet plugin and the sheet packer.
+ */
+
+#ifndef Misc_SpriteSheetGrid_h
+#define Misc_SpriteSheetGrid_h
+
+#include <algorithm>
+
+#include "ofxCore.h"
+
+namespace OFX {
+
+enum ReadingDirectionEnum
+{
+    eReadingDirectionHorizontalForward,
+    eReadingDirectionHorizontalBackward,
+    eReadingDirectionVerticalForward,
+    eReadingDirectionVerticalBackward,
+    eReadingDirectionHorizontalForwardS,
+    eReadingDirectionHorizontalBackwardS,
+    eReadingDirectionVerticalForwardS,
+    eReadingDirectionVerticalBackwardS
+};
+
+// The rectangle of the sprite index i in a sheet of bounds rodPixel, in pixels, with the origin at the bottom-left
+// of the sheet (the OFX orientation).
+// spriteRangeStart is the first sprite of the range (S-shaped orders alternate from the line of that sprite), and the
+// sheet is read as spritesCut.x * spritesCut.y sub-sheets, one after the other.
+inline void
+spriteSheetGridCell(int i,
+                    ReadingDirectionEnum readingDirection,
+                    const OfxRectI& rodPixel,
+                    const OfxPointI& spriteSize,
+                    int spriteRangeStart,
+                    const OfxPointI& spritesCut,
+                    OfxRectI* rect)
+{
+    bool verticalRead = (readingDirection == eReadingDirectionVerticalForward || readingDirection == eReadingDirectionVerticalBackward || readingDirection == eReadingDirectionVerticalForwardS || readingDirection == eReadingDirectionVerticalBackwardS);
+    bool backwardRead = (readingDirection == eReadingDirectionHorizontalBackward || readingDirection == eReadingDirectionVerticalBackward || readingDirection == eReadingDirectionHorizontalBackwardS || readingDirection == eReadingDirectionVerticalBackwardS);
+    bool sshapedRead = (readingDirection == eReadingDirectionHorizontalForwardS || readingDirection == eReadingDirectionHorizontalBackwardS || readingDirection == eReadingDirectionVerticalForwardS || readingDirection == eReadingDirectionVerticalBackwardS);
+    // number of sprites per line
+    int cols = verticalRead ? (rodPixel.y2 - rodPixel.y1) / spriteSize.y / spritesCut.y : (rodPixel.x2 - rodPixel.x1) / spriteSize.x / spritesCut.x;
+    if (cols <= 0) {
+        cols = 1;
+    }
+    int sum = (rodPixel.y2 - rodPixel.y1) / spriteSize.y / spritesCut.y * (rodPixel.x2 - rodPixel.x1) / spriteSize.x / spritesCut.x;
+    if (sum <= 0) {
+        sum = 1;
+    }
+    int r = i / cols % std::max(1, sum / cols);
+    int c = i % cols;
+    if (backwardRead) {
+        c = cols - 1 - c;
+    }
+    if (sshapedRead) {
+        c = (r + spriteRangeStart / cols % std::max(1, sum / cols)) % 2 == 0 ? c : (cols - 1 - c);
+    }
+    int ii = i / sum;
+    int colsCrop = verticalRead ? spritesCut.y : spritesCut.x;
+    if (colsCrop <= 0) {
+        colsCrop = 1;
+    }
+    int rr = ii / colsCrop;
+    int cc = ii % colsCrop;
+    if (backwardRead) {
+        cc = colsCrop - 1 - cc;
+    }
+    r += rr * sum / cols;
+    c += cc * cols;
+    if (verticalRead) {
+        int a = r;
+        r = c;
+        c = a;
+    }
+    rect->x1 = rodPixel.x1 + c * spriteSize.x;
+    rect->y1 = rodPixel.y2 - (r + 1) * spriteSize.y;
+    rect->x2 = rodPixel.x1 + (c + 1) * spriteSize.x;
+    rect->y2 = rodPixel.y2 - r * spriteSize.y;
+} // spriteSheetGridCell
+} // namespace OFX
+
+#endif // Misc_SpriteSheetGrid_h
@@ -0,0 +1,1358 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * PNG sprite sheets read directly from a file by the SpriteSheet plugin, decoded once and shared by all the instances,
+ * and read and written by the sheet packer.
+ */
+
+#include "SpriteSheetPng.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <algorithm>
+
+#include "ofxsImageEffect.h"
+#include "ofxsFileOpen.h"
+#include "tinythread.h"
+
+using std::string;
+using std::vector;
+
+namespace OFX {
+
+namespace {
+////////////////////////////////////////////////////////////////////////////////
+// DEFLATE (RFC 1951) decoder
+
+#define kHuffmanFastBits 9
+
+// base values and extra bits of the length and distance codes, shared by the decoder and the encoder
+static const unsigned short kLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char kLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short kDistBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char kDistExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+struct Huffman
+{
+    unsigned short count[16];   // number of codes of each length
+    unsigned short symbol[320]; // symbols, ordered by code length then value
+    short fast[1 << kHuffmanFastBits]; // (length << 9) | symbol for the codes of at most kHuffmanFastBits bits, or -1
+
+    // returns false if the code lengths are over-subscribed
+    bool build(const unsigned char* lengths,
+               int n)
+    {
+        std::fill(count, count + 16, 0);
+        for (int s = 0; s < n; ++s) {
+            ++count[lengths[s]];
+        }
+        count[0] = 0;
+        int left = 1;
+        for (int len = 1; len < 16; ++len) {
+            left = 2 * left - count[len];
+            if (left < 0) {
+                return false;
+            }
+        }
+        unsigned short offs[16];
+        offs[1] = 0;
+        for (int len = 1; len < 15; ++len) {
+            offs[len + 1] = offs[len] + count[len];
+        }
+        for (int s = 0; s < n; ++s) {
+            if (lengths[s] != 0) {
+                symbol[offs[lengths[s]]++] = (unsigned short)s;
+            }
+        }
+        // canonical codes, bit-reversed since the stream is read from the least significant bit
+        std::fill(fast, fast + (1 << kHuffmanFastBits), (short)-1);
+        int code = 0;
+        int index = 0;
+        for (int len = 1; len <= kHuffmanFastBits; ++len) {
+            for (int k = 0; k < count[len]; ++k, ++code, ++index) {
+                int reversed = 0;
+                for (int b = 0; b < len; ++b) {
+                    reversed |= ( (code >> b) & 1 ) << (len - 1 - b);
+                }
+                for (int r = reversed; r < (1 << kHuffmanFastBits); r += 1 << len) {
+                    fast[r] = (short)( (len << 9) | symbol[index] );
+                }
+            }
+            code <<= 1;
+        }
+
+        return true;
+    }
+};
+
+class Inflater
+{
+public:
+    // the output stops at maxSize bytes: a longer stream is an error
+    Inflater(const unsigned char* data,
+             size_t size,
+             size_t maxSize,
+             vector<unsigned char>* out)
+        : _p(data)
+        , _end(data + size)
+        , _bits(0)
+        , _nBits(0)
+        , _overrun(0)
+        , _maxSize(maxSize)
+        , _out(out)
+    {
+    }
+
+    bool inflate()
+    {
+        bool last;
+
+        do {
+            last = getBits(1) != 0;
+            const unsigned int type = getBits(2);
+            bool ok;
+            switch (type) {
+            case 0:
+                ok = stored();
+                break;
+            case 1:
+                ok = fixed();
+                break;
+            case 2:
+                ok = dynamic();
+                break;
+            default:
+                ok = false;
+                break;
+            }
+            if ( !ok || overrun() ) {
+                return false;
+            }
+        } while (!last);
+
+        return true;
+    }
+
+private:
+    // were some of the zeros fed past the end of the stream consumed?
+    bool overrun() const
+    {
+        return _overrun * 8 > _nBits;
+    }
+
+    void refill()
+    {
+        while (_nBits <= 56) {
+            if (_p < _end) {
+                _bits |= (unsigned long long)(*_p++) << _nBits;
+            } else {
+                // past the end of the stream: feed zeros, and remember it
+                ++_overrun;
+            }
+            _nBits += 8;
+        }
+    }
+
+    unsigned int getBits(int n)
+    {
+        if (_nBits < n) {
+            refill();
+        }
+        const unsigned int v = (unsigned int)( _bits & ( (1ULL << n) - 1 ) );
+        _bits >>= n;
+        _nBits -= n;
+
+        return v;
+    }
+
+    int decode(const Huffman& h)
+    {
+        if (_nBits < 15) {
+            refill();
+        }
+        const int entry = h.fast[_bits & ( (1 << kHuffmanFastBits) - 1 )];
+        if (entry >= 0) {
+            const int len = entry >> 9;
+            _bits >>= len;
+            _nBits -= len;
+
+            return entry & 511;
+        }
+        // longer codes, one bit at a time
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int len = 1; len < 16; ++len) {
+            code |= (int)getBits(1);
+            const int count = h.count[len];
+            if (code - count < first) {
+                return h.symbol[index + (code - first)];
+            }
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+
+        return -1;
+    }
+
+    bool stored()
+    {
+        // skip to the next byte boundary
+        getBits(_nBits & 7);
+        const unsigned int len = getBits(16);
+        const unsigned int nlen = getBits(16);
+        if ( ( len != (~nlen & 0xffff) ) || (len > _maxSize - _out->size()) ) {
+            return false;
+        }
+        for (unsigned int i = 0; i < len; ++i) {
+            _out->push_back( (unsigned char)getBits(8) );
+        }
+
+        return true;
+    }
+
+    bool codes(const Huffman& lencode,
+               const Huffman& distcode)
+    {
+        for (;;) {
+            int symbol = decode(lencode);
+            if ( (symbol < 0) || overrun() ) {
+                return false;
+            }
+            if (symbol < 256) {
+                if (_out->size() >= _maxSize) {
+                    return false;
+                }
+                _out->push_back( (unsigned char)symbol );
+            } else if (symbol == 256) {
+                return true;
+            } else {
+                symbol -= 257;
+                if (symbol >= 29) {
+                    return false;
+                }
+                const size_t len = kLengthBase[symbol] + getBits(kLengthExtra[symbol]);
+                symbol = decode(distcode);
+                if ( (symbol < 0) || (symbol >= 30) ) {
+                    return false;
+                }
+                const size_t dist = kDistBase[symbol] + getBits(kDistExtra[symbol]);
+                if ( ( dist > _out->size() ) || (len > _maxSize - _out->size()) ) {
+                    return false;
+                }
+                size_t from = _out->size() - dist;
+                for (size_t i = 0; i < len; ++i) {
+                    // the copy may overlap its own output
+                    _out->push_back( (*_out)[from + i] );
+                }
+            }
+        }
+    }
+
+    bool fixed()
+    {
+        static Huffman lencode;
+        static Huffman distcode;
+        static bool built = false;
+        static tthread::mutex builtMutex;
+        {
+            tthread::lock_guard<tthread::mutex> lock(builtMutex);
+            if (!built) {
+                unsigned char lengths[288];
+                std::fill(lengths, lengths + 144, 8);
+                std::fill(lengths + 144, lengths + 256, 9);
+                std::fill(lengths + 256, lengths + 280, 7);
+                std::fill(lengths + 280, lengths + 288, 8);
+                lencode.build(lengths, 288);
+                std::fill(lengths, lengths + 30, 5);
+                distcode.build(lengths, 30);
+                built = true;
+            }
+        }
+
+        return codes(lencode, distcode);
+    }
+
+    bool dynamic()
+    {
+        static const unsigned char order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        const int nlen = getBits(5) + 257;
+        const int ndist = getBits(5) + 1;
+        const int ncode = getBits(4) + 4;
+        if ( (nlen > 286) || (ndist > 30) ) {
+            return false;
+        }
+        unsigned char lengths[320];
+        std::fill(lengths, lengths + 19, 0);
+        for (int i = 0; i < ncode; ++i) {
+            lengths[order[i]] = (unsigned char)getBits(3);
+        }
+        Huffman lencode;
+        if ( !lencode.build(lengths, 19) ) {
+            return false;
+        }
+        int index = 0;
+        while (index < nlen + ndist) {
+            int symbol = decode(lencode);
+            if ( (symbol < 0) || overrun() ) {
+                return false;
+            }
+            if (symbol < 16) {
+                lengths[index++] = (unsigned char)symbol;
+            } else {
+                unsigned char len = 0;
+                int repeat;
+                if (symbol == 16) {
+                    if (index == 0) {
+                        return false;
+                    }
+                    len = lengths[index - 1];
+                    repeat = 3 + getBits(2);
+                } else if (symbol == 17) {
+                    repeat = 3 + getBits(3);
+                } else {
+                    repeat = 11 + getBits(7);
+                }
+                if (index + repeat > nlen + ndist) {
+                    return false;
+                }
+                while (repeat--) {
+                    lengths[index++] = len;
+                }
+            }
+        }
+        if (lengths[256] == 0) {
+            // no end-of-block code
+            return false;
+        }
+        Huffman distcode;
+        if ( !lencode.build(lengths, nlen) || !distcode.build(lengths + nlen, ndist) ) {
+            return false;
+        }
+
+        return codes(lencode, distcode);
+    }
+
+    const unsigned char* _p;
+    const unsigned char* _end;
+    unsigned long long _bits;
+    int _nBits;
+    int _overrun;
+    size_t _maxSize;
+    vector<unsigned char>* _out;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// DEFLATE encoder: greedy LZ77 matching on hash chains, coded with the fixed Huffman codes in a single block.
+// Sprite sheets are mostly made of transparent runs and repeated rows, which this handles well enough.
+
+#define kDeflateHashBits 15
+#define kDeflateWindow 32768
+#define kDeflateMaxChain 64
+
+class Deflater
+{
+public:
+    explicit Deflater(vector<unsigned char>* out)
+        : _out(out)
+        , _bits(0)
+        , _nBits(0)
+    {
+    }
+
+    void deflate(const unsigned char* data,
+                 size_t size)
+    {
+        vector<long long> head(1 << kDeflateHashBits, -1);
+        vector<long long> prev(kDeflateWindow, -1);
+
+        putBits(1, 1); // last block
+        putBits(1, 2); // fixed Huffman codes
+        size_t i = 0;
+        while (i < size) {
+            size_t bestLen = 0;
+            size_t bestDist = 0;
+            if (i + 3 <= size) {
+                const size_t maxLen = std::min( (size_t)258, size - i );
+                long long cand = head[hash(data + i)];
+                for (int chain = 0; chain < kDeflateMaxChain && cand >= 0 && i - (size_t)cand < kDeflateWindow; ++chain) {
+                    const unsigned char* a = data + cand;
+                    const unsigned char* b = data + i;
+                    size_t len = 0;
+                    while (len < maxLen && a[len] == b[len]) {
+                        ++len;
+                    }
+                    if (len > bestLen) {
+                        bestLen = len;
+                        bestDist = i - (size_t)cand;
+                        if (len == maxLen) {
+                            break;
+                        }
+                    }
+                    cand = prev[cand & (kDeflateWindow - 1)];
+                }
+            }
+            if (bestLen < 3) {
+                putLiteral(data[i]);
+                insert(data, size, i, &head, &prev);
+                ++i;
+            } else {
+                putMatch( (int)bestLen, (int)bestDist );
+                for (size_t k = 0; k < bestLen; ++k) {
+                    insert(data, size, i + k, &head, &prev);
+                }
+                i += bestLen;
+            }
+        }
+        putLiteral(256);
+        if (_nBits > 0) {
+            _out->push_back( (unsigned char)_bits );
+            _bits = 0;
+            _nBits = 0;
+        }
+    } // deflate
+
+private:
+    static unsigned int hash(const unsigned char* p)
+    {
+        return ( ( (unsigned int)p[0] << 16 | (unsigned int)p[1] << 8 | p[2] ) * 2654435761U ) >> (32 - kDeflateHashBits);
+    }
+
+    static void insert(const unsigned char* data,
+                       size_t size,
+                       size_t i,
+                       vector<long long>* head,
+                       vector<long long>* prev)
+    {
+        if (i + 3 <= size) {
+            const unsigned int h = hash(data + i);
+            (*prev)[i & (kDeflateWindow - 1)] = (*head)[h];
+            (*head)[h] = (long long)i;
+        }
+    }
+
+    void putBits(unsigned int value,
+                 int n)
+    {
+        _bits |= value << _nBits;
+        _nBits += n;
+        while (_nBits >= 8) {
+            _out->push_back( (unsigned char)_bits );
+            _bits >>= 8;
+            _nBits -= 8;
+        }
+    }
+
+    // Huffman codes are packed starting from their most significant bit
+    void putCode(unsigned int code,
+                 int len)
+    {
+        unsigned int reversed = 0;
+        for (int b = 0; b < len; ++b) {
+            reversed |= ( (code >> b) & 1 ) << (len - 1 - b);
+        }
+        putBits(reversed, len);
+    }
+
+    // the fixed literal/length code (RFC 1951, 3.2.6)
+    void putLiteral(int symbol)
+    {
+        if (symbol < 144) {
+            putCode(0x30 + symbol, 8);
+        } else if (symbol < 256) {
+            putCode(0x190 + symbol - 144, 9);
+        } else if (symbol < 280) {
+            putCode(symbol - 256, 7);
+        } else {
+            putCode(0xc0 + symbol - 280, 8);
+        }
+    }
+
+    void putMatch(int length,
+                  int distance)
+    {
+        const int l = (int)( std::upper_bound(kLengthBase, kLengthBase + 29, length) - kLengthBase ) - 1;
+        putLiteral(257 + l);
+        putBits(length - kLengthBase[l], kLengthExtra[l]);
+        const int d = (int)( std::upper_bound(kDistBase, kDistBase + 30, distance) - kDistBase ) - 1;
+        putCode(d, 5);
+        putBits(distance - kDistBase[d], kDistExtra[d]);
+    }
+
+    vector<unsigned char>* _out;
+    unsigned int _bits;
+    int _nBits;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// checksums: the CRC-32 of the PNG chunks and the Adler-32 of the zlib stream
+
+struct CrcTable
+{
+    unsigned int t[256];
+
+    CrcTable()
+    {
+        for (unsigned int n = 0; n < 256; ++n) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320U ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+    }
+};
+
+static unsigned int
+crc32(const unsigned char* data,
+      size_t size,
+      unsigned int crc)
+{
+    static const CrcTable table;
+
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.t[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+static unsigned int
+adler32(const unsigned char* data,
+        size_t size)
+{
+    unsigned int s1 = 1, s2 = 0;
+
+    for (size_t i = 0; i < size; ) {
+        // 5552 is the largest block for which s2 cannot overflow
+        const size_t end = std::min(size, i + 5552);
+        for (; i < end; ++i) {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+    }
+
+    return (s2 << 16) | s1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PNG decoder
+
+static unsigned int
+readU32(const unsigned char* p)
+{
+    return ( (unsigned int)p[0] << 24 ) | ( (unsigned int)p[1] << 16 ) | ( (unsigned int)p[2] << 8 ) | p[3];
+}
+
+static bool
+readFile(const string& path,
+         vector<unsigned char>* data)
+{
+    std::FILE* f = fopen_utf8(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    unsigned char buf[65536];
+    size_t n;
+    data->clear();
+    while ( ( n = std::fread(buf, 1, sizeof(buf), f) ) > 0 ) {
+        data->insert(data->end(), buf, buf + n);
+    }
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+
+    return ok;
+}
+
+#define kPngMaxPixels (1ULL << 28) // 2 GB of 16-bit RGBA, beyond this an image is refused before it is inflated
+#define kDeflateMaxRatio 1032 // a deflate stream cannot expand more than this: 258 bytes for a 1-bit length and a 1-bit distance
+
+static const unsigned char kPngSignature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+struct PngHeader
+{
+    int width, height;
+    int bitDepth;
+    int colorType;
+    int interlace;
+};
+
+// the Adam7 passes
+static const int passX0[7] = {0, 4, 0, 2, 0, 1, 0};
+static const int passY0[7] = {0, 0, 4, 0, 2, 0, 1};
+static const int passDx[7] = {8, 8, 4, 4, 2, 2, 1};
+static const int passDy[7] = {8, 8, 8, 4, 4, 2, 2};
+
+// the size of the filtered rows of all the passes, which is the size of the inflated image data
+static size_t
+getRawSize(const PngHeader& h,
+           int bitsPerPixel)
+{
+    if (!h.interlace) {
+        return ( ( (size_t)h.width * bitsPerPixel + 7 ) / 8 + 1 ) * h.height;
+    }
+    size_t size = 0;
+    for (int pass = 0; pass < 7; ++pass) {
+        const int w = (h.width - passX0[pass] + passDx[pass] - 1) / passDx[pass];
+        const int hh = (h.height - passY0[pass] + passDy[pass] - 1) / passDy[pass];
+        if ( (w > 0) && (hh > 0) ) {
+            size += ( ( (size_t)w * bitsPerPixel + 7 ) / 8 + 1 ) * hh;
+        }
+    }
+
+    return size;
+}
+
+static bool
+parseHeader(const unsigned char* data,
+            size_t size,
+            PngHeader* h,
+            string* error)
+{
+    if ( (size < 33) || (std::memcmp(data, kPngSignature, 8) != 0) || (std::memcmp(data + 12, "IHDR", 4) != 0) ) {
+        *error = "not a PNG file";
+
+        return false;
+    }
+    if ( ( readU32(data + 8) != 13 ) || ( ( crc32(data + 12, 17, 0xffffffffU) ^ 0xffffffffU ) != readU32(data + 29) ) ) {
+        *error = "corrupted PNG header";
+
+        return false;
+    }
+    const unsigned int w = readU32(data + 16);
+    const unsigned int hh = readU32(data + 20);
+    h->bitDepth = data[24];
+    h->colorType = data[25];
+    h->interlace = data[28];
+    if ( (w == 0) || (hh == 0) || (w > 1 << 24) || (hh > 1 << 24) ) {
+        *error = "invalid PNG size";
+
+        return false;
+    }
+    if ( (unsigned long long)w * hh > kPngMaxPixels ) {
+        *error = "PNG image too large";
+
+        return false;
+    }
+    h->width = (int)w;
+    h->height = (int)hh;
+    bool validDepth;
+    switch (h->colorType) {
+    case 0:
+        validDepth = (h->bitDepth == 1 || h->bitDepth == 2 || h->bitDepth == 4 || h->bitDepth == 8 || h->bitDepth == 16);
+        break;
+    case 3:
+        validDepth = (h->bitDepth == 1 || h->bitDepth == 2 || h->bitDepth == 4 || h->bitDepth == 8);
+        break;
+    case 2:
+    case 4:
+    case 6:
+        validDepth = (h->bitDepth == 8 || h->bitDepth == 16);
+        break;
+    default:
+        validDepth = false;
+        break;
+    }
+    if ( !validDepth || (data[26] != 0) || (data[27] != 0) || (h->interlace > 1) ) {
+        *error = "unsupported PNG format";
+
+        return false;
+    }
+
+    return true;
+}
+
+static int
+channelsOf(int colorType)
+{
+    switch (colorType) {
+    case 0:
+    case 3:
+
+        return 1;
+    case 4:
+
+        return 2;
+    case 2:
+
+        return 3;
+    default:
+
+        return 4;
+    }
+}
+
+static inline int
+paeth(int a,
+      int b,
+      int c)
+{
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+// undo the filters of a (sub)image in place, and remove the filter bytes. Returns false on an invalid filter type.
+static bool
+unfilter(unsigned char* data,
+         int width,
+         int height,
+         int bitsPerPixel,
+         vector<unsigned char>* out)
+{
+    const size_t rowBytes = ( (size_t)width * bitsPerPixel + 7 ) / 8;
+    const int bpp = std::max(1, bitsPerPixel / 8);
+
+    out->resize(rowBytes * height);
+    for (int y = 0; y < height; ++y) {
+        const unsigned char filter = data[y * (rowBytes + 1)];
+        const unsigned char* in = data + y * (rowBytes + 1) + 1;
+        unsigned char* row = &(*out)[y * rowBytes];
+        const unsigned char* prev = y > 0 ? row - rowBytes : NULL;
+        for (size_t i = 0; i < rowBytes; ++i) {
+            const int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+            const int b = prev ? prev[i] : 0;
+            const int c = (prev && i >= (size_t)bpp) ? prev[i - bpp] : 0;
+            int v = in[i];
+            switch (filter) {
+            case 0:
+                break;
+            case 1:
+                v += a;
+                break;
+            case 2:
+                v += b;
+                break;
+            case 3:
+                v += (a + b) / 2;
+                break;
+            case 4:
+                v += paeth(a, b, c);
+                break;
+            default:
+
+                return false;
+            }
+            row[i] = (unsigned char)v;
+        }
+    }
+
+    return true;
+}
+
+struct PngPalette
+{
+    unsigned short rgba[256][4];
+    bool hasColorKey;
+    unsigned short key[3]; // tRNS colour key of greyscale and RGB images, at the image bit depth
+};
+
+// convert the unfiltered rows of a (sub)image to 16-bit straight RGBA, at the given positions of the full image
+static void
+toRGBA16(const PngHeader& h,
+         const PngPalette& pal,
+         const unsigned char* rows,
+         int width,
+         int height,
+         int x0,
+         int y0,
+         int dx,
+         int dy,
+         vector<unsigned short>* rgba)
+{
+    const int channels = channelsOf(h.colorType);
+    const int bitsPerPixel = channels * h.bitDepth;
+    const size_t rowBytes = ( (size_t)width * bitsPerPixel + 7 ) / 8;
+    const unsigned int maxSample = (1U << h.bitDepth) - 1;
+
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* row = rows + y * rowBytes;
+        unsigned short* dst = &(*rgba)[( (size_t)(y0 + y * dy) * h.width + x0 ) * 4];
+        for (int x = 0; x < width; ++x, dst += 4 * dx) {
+            unsigned int s[4];
+            for (int c = 0; c < channels; ++c) {
+                if (h.bitDepth == 16) {
+                    const unsigned char* p = row + (size_t)(x * channels + c) * 2;
+                    s[c] = (p[0] << 8) | p[1];
+                } else if (h.bitDepth == 8) {
+                    s[c] = row[x * channels + c];
+                } else {
+                    const size_t bit = (size_t)x * h.bitDepth;
+                    s[c] = ( row[bit / 8] >> (8 - h.bitDepth - bit % 8) ) & maxSample;
+                }
+            }
+            switch (h.colorType) {
+            case 0: {
+                const unsigned short g = (unsigned short)(s[0] * 65535U / maxSample);
+                dst[0] = dst[1] = dst[2] = g;
+                dst[3] = (pal.hasColorKey && s[0] == pal.key[0]) ? 0 : 65535;
+                break;
+            }
+            case 2:
+                for (int c = 0; c < 3; ++c) {
+                    dst[c] = (unsigned short)(s[c] * 65535U / maxSample);
+                }
+                dst[3] = (pal.hasColorKey && s[0] == pal.key[0] && s[1] == pal.key[1] && s[2] == pal.key[2]) ? 0 : 65535;
+                break;
+            case 3:
+                std::memcpy(dst, pal.rgba[s[0] & 255], 4 * sizeof(unsigned short));
+                break;
+            case 4:
+                dst[0] = dst[1] = dst[2] = (unsigned short)(s[0] * 65535U / maxSample);
+                dst[3] = (unsigned short)(s[1] * 65535U / maxSample);
+                break;
+            default:
+                for (int c = 0; c < 4; ++c) {
+                    dst[c] = (unsigned short)(s[c] * 65535U / maxSample);
+                }
+                break;
+            }
+        }
+    }
+}
+
+// decode a PNG file to 16-bit straight RGBA, top row first
+static bool
+decodePng(const vector<unsigned char>& file,
+          int* width,
+          int* height,
+          vector<unsigned short>* rgba,
+          string* error)
+{
+    PngHeader h;
+
+    if ( !parseHeader(&file[0], file.size(), &h, error) ) {
+        return false;
+    }
+    PngPalette pal;
+    for (int i = 0; i < 256; ++i) {
+        pal.rgba[i][0] = pal.rgba[i][1] = pal.rgba[i][2] = 0;
+        pal.rgba[i][3] = 65535;
+    }
+    pal.hasColorKey = false;
+    pal.key[0] = pal.key[1] = pal.key[2] = 0;
+
+    vector<unsigned char> idat;
+    size_t pos = 8;
+    bool ended = false;
+    while (!ended && pos + 12 <= file.size()) {
+        const size_t len = readU32(&file[pos]);
+        const unsigned char* type = &file[pos + 4];
+        const unsigned char* data = &file[pos + 8];
+        if ( len > file.size() - pos - 12 ) {
+            *error = "truncated PNG file";
+
+            return false;
+        }
+        if ( ( crc32(type, len + 4, 0xffffffffU) ^ 0xffffffffU ) != readU32(data + len) ) {
+            *error = "corrupted PNG file";
+
+            return false;
+        }
+        if (std::memcmp(type, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), data, data + len);
+        } else if (std::memcmp(type, "PLTE", 4) == 0) {
+            for (size_t i = 0; i < len / 3 && i < 256; ++i) {
+                for (int c = 0; c < 3; ++c) {
+                    pal.rgba[i][c] = (unsigned short)(data[i * 3 + c] * 257);
+                }
+            }
+        } else if (std::memcmp(type, "tRNS", 4) == 0) {
+            if (h.colorType == 3) {
+                for (size_t i = 0; i < len && i < 256; ++i) {
+                    pal.rgba[i][3] = (unsigned short)(data[i] * 257);
+                }
+            } else if ( (h.colorType == 0) && (len >= 2) ) {
+                pal.hasColorKey = true;
+                pal.key[0] = (unsigned short)( (data[0] << 8) | data[1] );
+            } else if ( (h.colorType == 2) && (len >= 6) ) {
+                pal.hasColorKey = true;
+                for (int c = 0; c < 3; ++c) {
+                    pal.key[c] = (unsigned short)( (data[2 * c] << 8) | data[2 * c + 1] );
+                }
+            }
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            ended = true;
+        }
+        pos += len + 12;
+    }
+    if (!ended) {
+        *error = "truncated PNG file";
+
+        return false;
+    }
+    // zlib stream: 2 bytes of header, the deflate data, and an Adler-32 checksum
+    if ( (idat.size() < 6) || ( (idat[0] & 0x0f) != 8 ) || ( ( (idat[0] << 8) | idat[1] ) % 31 != 0 ) || (idat[1] & 0x20) ) {
+        *error = "invalid PNG image data";
+
+        return false;
+    }
+    const int bitsPerPixel = channelsOf(h.colorType) * h.bitDepth;
+    const size_t rawSize = getRawSize(h, bitsPerPixel);
+    const size_t deflateSize = idat.size() - 6;
+    if (rawSize / kDeflateMaxRatio > deflateSize) {
+        // the header announces more pixels than the image data could hold: do not allocate them
+        *error = "truncated PNG image data";
+
+        return false;
+    }
+    vector<unsigned char> raw;
+    raw.reserve(rawSize);
+    Inflater inflater(&idat[2], deflateSize, rawSize, &raw);
+    if ( !inflater.inflate() || ( adler32( raw.empty() ? NULL : &raw[0], raw.size() ) != readU32(&idat[2 + deflateSize]) ) ) {
+        *error = "corrupted PNG image data";
+
+        return false;
+    }
+
+    *width = h.width;
+    *height = h.height;
+    rgba->resize( (size_t)h.width * h.height * 4 );
+    // the Adam7 passes, or the whole image
+    const int nPasses = h.interlace ? 7 : 1;
+    size_t offset = 0;
+    vector<unsigned char> rows;
+    for (int pass = 0; pass < nPasses; ++pass) {
+        const int x0 = h.interlace ? passX0[pass] : 0;
+        const int y0 = h.interlace ? passY0[pass] : 0;
+        const int dx = h.interlace ? passDx[pass] : 1;
+        const int dy = h.interlace ? passDy[pass] : 1;
+        const int w = (h.width - x0 + dx - 1) / dx;
+        const int hh = (h.height - y0 + dy - 1) / dy;
+        if ( (w <= 0) || (hh <= 0) ) {
+            continue;
+        }
+        const size_t size = ( ( (size_t)w * bitsPerPixel + 7 ) / 8 + 1 ) * hh;
+        if ( (offset + size > raw.size()) || !unfilter(&raw[offset], w, hh, bitsPerPixel, &rows) ) {
+            *error = "corrupted PNG image data";
+
+            return false;
+        }
+        toRGBA16(h, pal, &rows[0], w, hh, x0, y0, dx, dy, rgba);
+        offset += size;
+    }
+
+    return true;
+} // decodePng
+
+// premultiply, downscale by 2^level, flip to the OFX orientation and convert to the output format
+static void
+convertSheet(const vector<unsigned short>& rgba,
+             int width,
+             int height,
+             unsigned int level,
+             SpriteSheetPixels* sheet)
+{
+    const int block = 1 << level;
+    const int w = (width + block - 1) >> level;
+    const int h = (height + block - 1) >> level;
+    const int nComponents = sheet->nComponents;
+    const int componentBytes = sheet->bitDepth == eBitDepthUByte ? 1 : (sheet->bitDepth == eBitDepthUShort ? 2 : 4);
+
+    sheet->width = w;
+    sheet->height = h;
+    sheet->pixels.resize( (size_t)w * h * nComponents * componentBytes );
+    for (int y = 0; y < h; ++y) {
+        // output row y is counted from the bottom
+        const int srcY1 = (h - 1 - y) << level;
+        const int srcY2 = std::min(height, srcY1 + block);
+        for (int x = 0; x < w; ++x) {
+            const int srcX1 = x << level;
+            const int srcX2 = std::min(width, srcX1 + block);
+            unsigned long long sum[4] = {0, 0, 0, 0};
+            for (int sy = srcY1; sy < srcY2; ++sy) {
+                const unsigned short* p = &rgba[( (size_t)sy * width + srcX1 ) * 4];
+                for (int sx = srcX1; sx < srcX2; ++sx, p += 4) {
+                    const unsigned int a = p[3];
+                    for (int c = 0; c < 3; ++c) {
+                        sum[c] += (p[c] * a + 32767) / 65535;
+                    }
+                    sum[3] += a;
+                }
+            }
+            const unsigned int n = (srcX2 - srcX1) * (srcY2 - srcY1);
+            unsigned int v[4];
+            for (int c = 0; c < 4; ++c) {
+                v[c] = (unsigned int)( (sum[c] + n / 2) / n );
+            }
+            // RGBA, RGB, XY (red and green) or Alpha
+            unsigned int out[4];
+            if (nComponents == 1) {
+                out[0] = v[3];
+            } else {
+                for (int c = 0; c < nComponents; ++c) {
+                    out[c] = v[c];
+                }
+            }
+            const size_t i = ( (size_t)y * w + x ) * nComponents;
+            for (int c = 0; c < nComponents; ++c) {
+                switch (sheet->bitDepth) {
+                case eBitDepthUByte:
+                    sheet->pixels[i + c] = (unsigned char)( (out[c] * 255 + 32767) / 65535 );
+                    break;
+                case eBitDepthUShort:
+                    ( (unsigned short*)&sheet->pixels[0] )[i + c] = (unsigned short)out[c];
+                    break;
+                default:
+                    ( (float*)&sheet->pixels[0] )[i + c] = out[c] / 65535.f;
+                    break;
+                }
+            }
+        }
+    }
+} // convertSheet
+
+////////////////////////////////////////////////////////////////////////////////
+// PNG encoder
+
+static void
+putU32(vector<unsigned char>* out,
+       unsigned int v)
+{
+    out->push_back( (unsigned char)(v >> 24) );
+    out->push_back( (unsigned char)(v >> 16) );
+    out->push_back( (unsigned char)(v >> 8) );
+    out->push_back( (unsigned char)v );
+}
+
+static void
+putChunk(vector<unsigned char>* out,
+         const char* type,
+         const unsigned char* data,
+         size_t size)
+{
+    putU32(out, (unsigned int)size);
+    const size_t start = out->size();
+    out->insert(out->end(), type, type + 4);
+    if (size > 0) {
+        out->insert(out->end(), data, data + size);
+    }
+    putU32( out, crc32(&(*out)[start], size + 4, 0xffffffffU) ^ 0xffffffffU );
+}
+
+// filter the rows, choosing for each row the filter with the smallest sum of absolute differences
+static void
+filterRows(const unsigned char* rows,
+           int width,
+           int height,
+           int bpp,
+           vector<unsigned char>* out)
+{
+    const size_t rowBytes = (size_t)width * bpp;
+    vector<unsigned char> candidate(rowBytes);
+    vector<unsigned char> best(rowBytes);
+
+    out->resize( (rowBytes + 1) * height );
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* row = rows + y * rowBytes;
+        const unsigned char* prev = y > 0 ? row - rowBytes : NULL;
+        unsigned long long bestCost = ~0ULL;
+        int bestFilter = 0;
+        for (int filter = 0; filter < 5; ++filter) {
+            unsigned long long cost = 0;
+            for (size_t i = 0; i < rowBytes; ++i) {
+                const int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+                const int b = prev ? prev[i] : 0;
+                const int c = (prev && i >= (size_t)bpp) ? prev[i - bpp] : 0;
+                int predicted;
+                switch (filter) {
+                case 0:
+                    predicted = 0;
+                    break;
+                case 1:
+                    predicted = a;
+                    break;
+                case 2:
+                    predicted = b;
+                    break;
+                case 3:
+                    predicted = (a + b) / 2;
+                    break;
+                default:
+                    predicted = paeth(a, b, c);
+                    break;
+                }
+                const unsigned char v = (unsigned char)(row[i] - predicted);
+                candidate[i] = v;
+                cost += v < 128 ? v : 256 - v;
+            }
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestFilter = filter;
+                best.swap(candidate);
+            }
+        }
+        unsigned char* dst = &(*out)[y * (rowBytes + 1)];
+        dst[0] = (unsigned char)bestFilter;
+        std::copy(best.begin(), best.end(), dst + 1);
+    }
+} // filterRows
+
+// encode 16-bit straight RGBA, top row first, to an RGBA PNG file of the given bit depth (8 or 16)
+static void
+encodePng(const vector<unsigned short>& rgba,
+          int width,
+          int height,
+          int bitDepth,
+          vector<unsigned char>* file)
+{
+    const size_t nSamples = (size_t)width * height * 4;
+    vector<unsigned char> rows(nSamples * (bitDepth == 16 ? 2 : 1));
+
+    for (size_t i = 0; i < nSamples; ++i) {
+        if (bitDepth == 16) {
+            rows[2 * i] = (unsigned char)(rgba[i] >> 8);
+            rows[2 * i + 1] = (unsigned char)rgba[i];
+        } else {
+            rows[i] = (unsigned char)( (rgba[i] * 255U + 32767) / 65535 );
+        }
+    }
+    vector<unsigned char> filtered;
+    filterRows(&rows[0], width, height, bitDepth == 16 ? 8 : 4, &filtered);
+    rows.clear();
+
+    // zlib stream: deflate, no preset dictionary, and the Adler-32 of the uncompressed data
+    vector<unsigned char> idat;
+    idat.push_back(0x78);
+    idat.push_back(0x01);
+    Deflater deflater(&idat);
+    deflater.deflate(&filtered[0], filtered.size());
+    putU32( &idat, adler32( &filtered[0], filtered.size() ) );
+
+    file->assign(kPngSignature, kPngSignature + 8);
+    vector<unsigned char> ihdr;
+    putU32(&ihdr, width);
+    putU32(&ihdr, height);
+    ihdr.push_back( (unsigned char)bitDepth );
+    ihdr.push_back(6); // RGBA
+    ihdr.push_back(0); // deflate
+    ihdr.push_back(0); // adaptive filtering
+    ihdr.push_back(0); // not interlaced
+    putChunk( file, "IHDR", &ihdr[0], ihdr.size() );
+    for (size_t i = 0; i < idat.size(); i += 1 << 20) {
+        putChunk( file, "IDAT", &idat[i], std::min( (size_t)1 << 20, idat.size() - i ) );
+    }
+    putChunk(file, "IEND", NULL, 0);
+} // encodePng
+
+struct PngCacheKey
+{
+    string path;
+    unsigned int level;
+    int bitDepth;
+    int nComponents;
+
+    bool operator<(const PngCacheKey& other) const
+    {
+        if (path != other.path) {
+            return path < other.path;
+        }
+        if (level != other.level) {
+            return level < other.level;
+        }
+        if (bitDepth != other.bitDepth) {
+            return bitDepth < other.bitDepth;
+        }
+
+        return nComponents < other.nComponents;
+    }
+};
+
+struct PngCacheEntry
+{
+    long long mtime;
+    long long size;
+    std::weak_ptr<const SpriteSheetPixels> sheet; // the users own the sheet
+};
+
+typedef std::map<PngCacheKey, PngCacheEntry> PngCache;
+
+static tthread::mutex gPngCacheMutex;
+static PngCache gPngCache;
+} // namespace
+
+bool
+spriteSheetPngSize(const string& path,
+                   int* width,
+                   int* height,
+                   string* error)
+{
+    std::FILE* f = fopen_utf8(path.c_str(), "rb");
+
+    if (!f) {
+        *error = "cannot open " + path;
+
+        return false;
+    }
+    unsigned char header[33];
+    const size_t n = std::fread(header, 1, sizeof(header), f);
+    std::fclose(f);
+    PngHeader h;
+    string parseError;
+    if ( !parseHeader(header, n, &h, &parseError) ) {
+        *error = path + ": " + parseError;
+
+        return false;
+    }
+    *width = h.width;
+    *height = h.height;
+
+    return true;
+}
+
+SpriteSheetPixelsPtr
+spriteSheetPngLoad(const string& path,
+                   unsigned int level,
+                   int bitDepth,
+                   int nComponents,
+                   string* error)
+{
+    long long mtime = 0;
+    long long size = 0;
+
+    if ( !stat_utf8(path.c_str(), &mtime, &size) ) {
+        *error = "cannot open " + path;
+
+        return SpriteSheetPixelsPtr();
+    }
+    PngCacheKey key;
+    key.path = path;
+    key.level = level;
+    key.bitDepth = bitDepth;
+    key.nComponents = nComponents;
+    {
+        tthread::lock_guard<tthread::mutex> lock(gPngCacheMutex);
+        PngCache::const_iterator it = gPngCache.find(key);
+        if ( (it != gPngCache.end()) && (it->second.mtime == mtime) && (it->second.size == size) ) {
+            SpriteSheetPixelsPtr sheet = it->second.sheet.lock();
+            if (sheet) {
+                return sheet;
+            }
+        }
+    }
+
+    // decode outside of the lock, other instances may be decoding other files
+    vector<unsigned char> file;
+    if ( !readFile(path, &file) || file.empty() ) {
+        *error = "cannot read " + path;
+
+        return SpriteSheetPixelsPtr();
+    }
+    int width, height;
+    vector<unsigned short> rgba;
+    string decodeError;
+    if ( !decodePng(file, &width, &height, &rgba, &decodeError) ) {
+        *error = path + ": " + decodeError;
+
+        return SpriteSheetPixelsPtr();
+    }
+    file.clear();
+    std::shared_ptr<SpriteSheetPixels> sheet = std::make_shared<SpriteSheetPixels>();
+    sheet->bitDepth = bitDepth;
+    sheet->nComponents = nComponents;
+    convertSheet(rgba, width, height, level, sheet.get());
+
+    tthread::lock_guard<tthread::mutex> lock(gPngCacheMutex);
+    PngCacheEntry& entry = gPngCache[key];
+    SpriteSheetPixelsPtr other = entry.sheet.lock();
+    if ( other && (entry.mtime == mtime) && (entry.size == size) ) {
+        // another render decoded the same file in the meantime: share its copy
+        return other;
+    }
+    entry.mtime = mtime;
+    entry.size = size;
+    entry.sheet = sheet;
+
+    return sheet;
+} // spriteSheetPngLoad
+
+bool
+spriteSheetPngRead(const string& path,
+                   SpriteSheetPngImage* image,
+                   string* error)
+{
+    vector<unsigned char> file;
+
+    if ( !readFile(path, &file) || file.empty() ) {
+        *error = "cannot read " + path;
+
+        return false;
+    }
+    PngHeader h;
+    string decodeError;
+    if ( !parseHeader(&file[0], file.size(), &h, &decodeError) ||
+         !decodePng(file, &image->width, &image->height, &image->rgba, &decodeError) ) {
+        *error = path + ": " + decodeError;
+
+        return false;
+    }
+    image->bitDepth = h.bitDepth == 16 ? 16 : 8;
+
+    return true;
+}
+
+bool
+spriteSheetPngWrite(const string& path,
+                    const SpriteSheetPngImage& image,
+                    string* error)
+{
+    if ( (image.width <= 0) || (image.height <= 0) || (image.rgba.size() != (size_t)image.width * image.height * 4) ) {
+        *error = path + ": invalid image";
+
+        return false;
+    }
+    vector<unsigned char> file;
+    encodePng(image.rgba, image.width, image.height, image.bitDepth == 16 ? 16 : 8, &file);
+    std::FILE* f = fopen_utf8(path.c_str(), "wb");
+    if (!f) {
+        *error = "cannot open " + path + " for writing";
+
+        return false;
+    }
+    bool ok = std::fwrite(&file[0], 1, file.size(), f) == file.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok) {
+        *error = "cannot write " + path;
+    }
+
+    return ok;
+}
+} // namespace OFX
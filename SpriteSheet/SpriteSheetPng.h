@@ -0,0 +1,70 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * PNG sprite sheets read directly from a file by the SpriteSheet plugin, decoded once and shared by all the instances,
+ * and read and written by the sheet packer.
+ */
+
+#ifndef Misc_SpriteSheetPng_h
+#define Misc_SpriteSheetPng_h
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace OFX {
+
+// a decoded sheet, in the pixel format of the output clip
+struct SpriteSheetPixels
+{
+    int width, height;      // size at the mipmap level
+    int bitDepth;           // BitDepthEnum
+    int nComponents;        // 4 (premultiplied RGBA), 3 (RGB), 2 (RG) or 1 (Alpha)
+    std::vector<unsigned char> pixels; // packed rows, bottom row first (the OFX orientation)
+};
+
+typedef std::shared_ptr<const SpriteSheetPixels> SpriteSheetPixelsPtr;
+
+// read the size of a PNG file from its header, without decoding it
+bool spriteSheetPngSize(const std::string& path, int* width, int* height, std::string* error);
+
+// Decode a PNG file, downscaled by 2^level (box filter).
+// The decoded sheet is shared by all the users that ask for the same file, level and pixel format, and freed when the
+// last one releases it. The file is only decoded again if its modification time or size changed.
+// Returns NULL and sets error if the file cannot be read or decoded.
+SpriteSheetPixelsPtr spriteSheetPngLoad(const std::string& path, unsigned int level, int bitDepth, int nComponents, std::string* error);
+
+// a PNG image as it is stored in the file, used by the sheet packer
+struct SpriteSheetPngImage
+{
+    int width, height;
+    int bitDepth;                     // 8 or 16 (lower bit depths and palettes are read as 8)
+    std::vector<unsigned short> rgba; // 16-bit straight (not premultiplied) RGBA, top row first
+};
+
+// read a PNG file, without any conversion or caching
+bool spriteSheetPngRead(const std::string& path, SpriteSheetPngImage* image, std::string* error);
+
+// write an RGBA PNG file at the bit depth of the image. 8-bit samples are rounded from the 16-bit ones, which is
+// lossless for the images read from 8-bit files.
+bool spriteSheetPngWrite(const std::string& path, const SpriteSheetPngImage& image, std::string* error);
+} // namespace OFX
+
+#endif // Misc_SpriteSheetPng_h
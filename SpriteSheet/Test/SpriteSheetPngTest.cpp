@@ -0,0 +1,550 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * SpriteSheetPngTest: check the PNG reader and writer of the SpriteSheet plugin and its packer.
+ * Images written by spriteSheetPngWrite() must be read back unchanged. Truncated and corrupted files (bad chunk CRCs,
+ * bad Adler-32, oversize IHDR, invalid Huffman code lengths, distances past the start of the window...) must be
+ * refused with an error, without reading outside of the file: build it with a memory sanitizer to check the latter.
+ * Returns 0 if all the files pass.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../SpriteSheetPng.h"
+
+using namespace OFX;
+using std::string;
+using std::vector;
+
+#define kTestFile "SpriteSheetPngTest.png"
+#define kFuzzCount 2000
+
+namespace {
+// a reproducible random number in [0,n)
+class Random
+{
+public:
+    Random()
+        : _state(0x853c49e6748fea9bULL)
+    {
+    }
+
+    unsigned int next(unsigned int n)
+    {
+        _state = _state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+        return (unsigned int)(_state >> 33) % n;
+    }
+
+private:
+    unsigned long long _state;
+};
+
+unsigned int
+crc32(const unsigned char* data,
+      size_t size)
+{
+    unsigned int crc = 0xffffffffU;
+
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; ++k) {
+            crc = (crc & 1) ? 0xedb88320U ^ (crc >> 1) : crc >> 1;
+        }
+    }
+
+    return crc ^ 0xffffffffU;
+}
+
+unsigned int
+adler32(const vector<unsigned char>& data)
+{
+    unsigned int s1 = 1, s2 = 0;
+
+    for (size_t i = 0; i < data.size(); ++i) {
+        s1 = (s1 + data[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+
+    return (s2 << 16) | s1;
+}
+
+unsigned int
+readU32(const unsigned char* p)
+{
+    return ( (unsigned int)p[0] << 24 ) | ( (unsigned int)p[1] << 16 ) | ( (unsigned int)p[2] << 8 ) | p[3];
+}
+
+void
+putU32(vector<unsigned char>* out,
+       unsigned int v)
+{
+    out->push_back( (unsigned char)(v >> 24) );
+    out->push_back( (unsigned char)(v >> 16) );
+    out->push_back( (unsigned char)(v >> 8) );
+    out->push_back( (unsigned char)v );
+}
+
+struct Chunk
+{
+    string type;
+    vector<unsigned char> data;
+};
+
+// split a PNG file into its chunks
+vector<Chunk>
+getChunks(const vector<unsigned char>& file)
+{
+    vector<Chunk> chunks;
+
+    for (size_t pos = 8; pos + 12 <= file.size(); ) {
+        const size_t len = readU32(&file[pos]);
+        Chunk chunk;
+        chunk.type.assign( (const char*)&file[pos + 4], 4 );
+        chunk.data.assign(file.begin() + pos + 8, file.begin() + pos + 8 + len);
+        chunks.push_back(chunk);
+        pos += len + 12;
+    }
+
+    return chunks;
+}
+
+// a PNG file made of the given chunks, with valid CRCs
+vector<unsigned char>
+makeFile(const vector<Chunk>& chunks)
+{
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    vector<unsigned char> file(signature, signature + 8);
+
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        putU32( &file, (unsigned int)chunks[i].data.size() );
+        const size_t start = file.size();
+        file.insert( file.end(), chunks[i].type.begin(), chunks[i].type.end() );
+        file.insert( file.end(), chunks[i].data.begin(), chunks[i].data.end() );
+        putU32( &file, crc32(&file[start], file.size() - start) );
+    }
+
+    return file;
+}
+
+// a file with a width x height 8-bit RGBA header and the given zlib stream
+vector<unsigned char>
+makeFile(unsigned int width,
+         unsigned int height,
+         const vector<unsigned char>& zlib)
+{
+    vector<Chunk> chunks(3);
+
+    chunks[0].type = "IHDR";
+    putU32(&chunks[0].data, width);
+    putU32(&chunks[0].data, height);
+    const unsigned char format[5] = {8, 6, 0, 0, 0};
+    chunks[0].data.insert(chunks[0].data.end(), format, format + 5);
+    chunks[1].type = "IDAT";
+    chunks[1].data = zlib;
+    chunks[2].type = "IEND";
+
+    return makeFile(chunks);
+}
+
+// writes the bits of a deflate stream, from the least significant one
+class BitWriter
+{
+public:
+    BitWriter()
+        : _bits(0)
+        , _nBits(0)
+    {
+    }
+
+    void putBits(unsigned int value,
+                 int n)
+    {
+        for (int b = 0; b < n; ++b) {
+            _bits |= ( (value >> b) & 1 ) << _nBits;
+            if (++_nBits == 8) {
+                flush();
+            }
+        }
+    }
+
+    // Huffman codes are packed from their most significant bit
+    void putCode(unsigned int code,
+                 int len)
+    {
+        for (int b = len - 1; b >= 0; --b) {
+            putBits( (code >> b) & 1, 1 );
+        }
+    }
+
+    // the fixed literal/length code
+    void putLiteral(int symbol)
+    {
+        if (symbol < 144) {
+            putCode(0x30 + symbol, 8);
+        } else if (symbol < 256) {
+            putCode(0x190 + symbol - 144, 9);
+        } else if (symbol < 280) {
+            putCode(symbol - 256, 7);
+        } else {
+            putCode(0xc0 + symbol - 280, 8);
+        }
+    }
+
+    // the zlib stream of the bits written so far, with the Adler-32 of the given data
+    vector<unsigned char> zlib(const vector<unsigned char>& inflated)
+    {
+        if (_nBits > 0) {
+            flush();
+        }
+        vector<unsigned char> out;
+        out.push_back(0x78);
+        out.push_back(0x01);
+        out.insert( out.end(), _bytes.begin(), _bytes.end() );
+        putU32( &out, adler32(inflated) );
+
+        return out;
+    }
+
+private:
+    void flush()
+    {
+        _bytes.push_back( (unsigned char)_bits );
+        _bits = 0;
+        _nBits = 0;
+    }
+
+    vector<unsigned char> _bytes;
+    unsigned int _bits;
+    int _nBits;
+};
+
+bool
+writeFile(const vector<unsigned char>& file)
+{
+    std::FILE* f = std::fopen(kTestFile, "wb");
+
+    if (!f) {
+        return false;
+    }
+    const bool ok = file.empty() || std::fwrite(&file[0], 1, file.size(), f) == file.size();
+
+    return (std::fclose(f) == 0) && ok;
+}
+
+bool
+readFile(vector<unsigned char>* file)
+{
+    std::FILE* f = std::fopen(kTestFile, "rb");
+
+    if (!f) {
+        return false;
+    }
+    unsigned char buf[65536];
+    size_t n;
+    file->clear();
+    while ( ( n = std::fread(buf, 1, sizeof(buf), f) ) > 0 ) {
+        file->insert(file->end(), buf, buf + n);
+    }
+    std::fclose(f);
+
+    return true;
+}
+
+// decode a file, which must fail or succeed as expected
+bool
+checkDecode(const char* name,
+            const vector<unsigned char>& file,
+            bool valid,
+            bool verbose = true)
+{
+    SpriteSheetPngImage image;
+    string error;
+
+    if ( !writeFile(file) ) {
+        std::printf("%s: cannot write %s  FAILED\n", name, kTestFile);
+
+        return false;
+    }
+    const bool decoded = spriteSheetPngRead(kTestFile, &image, &error);
+    const bool ok = (decoded == valid) && ( !decoded || (image.rgba.size() == (size_t)image.width * image.height * 4) );
+    if (verbose || !ok) {
+        std::printf( "%s: %s%s\n", name, decoded ? "decoded" : error.c_str(), ok ? "" : "  FAILED" );
+    }
+
+    return ok;
+}
+
+// write an image and read it back
+bool
+checkRoundTrip(const char* name,
+               const SpriteSheetPngImage& image,
+               vector<unsigned char>* file)
+{
+    string error;
+
+    if ( !spriteSheetPngWrite(kTestFile, image, &error) || !readFile(file) ) {
+        std::printf("%s: %s  FAILED\n", name, error.c_str());
+
+        return false;
+    }
+    SpriteSheetPngImage decoded;
+    const bool ok = spriteSheetPngRead(kTestFile, &decoded, &error) && (decoded.width == image.width) &&
+                    (decoded.height == image.height) && (decoded.bitDepth == image.bitDepth) && (decoded.rgba == image.rgba);
+    std::printf( "%s: %d bytes%s\n", name, (int)file->size(), ok ? "" : "  FAILED" );
+
+    return ok;
+}
+
+// an image with transparent runs, repeated rows and noise, like a sprite sheet
+SpriteSheetPngImage
+makeImage(int width,
+          int height,
+          int bitDepth,
+          Random& r)
+{
+    SpriteSheetPngImage image;
+
+    image.width = width;
+    image.height = height;
+    image.bitDepth = bitDepth;
+    image.rgba.resize( (size_t)width * height * 4 );
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned short* p = &image.rgba[( (size_t)y * width + x ) * 4];
+            if ( ( (x / 8 + y / 8) % 3 ) == 0 ) {
+                continue; // transparent
+            }
+            for (int c = 0; c < 4; ++c) {
+                // 8-bit images only hold the 16-bit values that they can represent exactly
+                p[c] = (y % 4 == 1) ? p[c - (int)width * 4] : (unsigned short)(bitDepth == 16 ? r.next(65536) : r.next(256) * 257);
+            }
+        }
+    }
+
+    return image;
+}
+} // namespace
+
+int
+main()
+{
+    Random r;
+    bool ok = true;
+
+    // round trips
+    vector<unsigned char> reference; // a valid file, corrupted below
+    {
+        static const int sizes[][2] = { {1, 1}, {7, 3}, {64, 64}, {300, 200} };
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            for (int bitDepth = 8; bitDepth <= 16; bitDepth += 8) {
+                char name[64];
+                std::snprintf(name, sizeof(name), "round trip %dx%d, %d bits", sizes[i][0], sizes[i][1], bitDepth);
+                vector<unsigned char> file;
+                ok = checkRoundTrip(name, makeImage(sizes[i][0], sizes[i][1], bitDepth, r), &file) && ok;
+                if ( (sizes[i][0] == 64) && (bitDepth == 8) ) {
+                    reference = file;
+                }
+            }
+        }
+    }
+    if ( reference.empty() ) {
+        std::printf("no reference file  FAILED\n");
+
+        return 1;
+    }
+
+    // every truncation of a valid file
+    {
+        bool truncatedOk = true;
+        for (size_t size = 0; size < reference.size(); ++size) {
+            char name[64];
+            std::snprintf(name, sizeof(name), "truncated to %d bytes", (int)size);
+            truncatedOk = checkDecode(name, vector<unsigned char>(reference.begin(), reference.begin() + size), false, false) && truncatedOk;
+        }
+        std::printf( "truncated files: %s\n", truncatedOk ? "refused" : "FAILED" );
+        ok = ok && truncatedOk;
+    }
+
+    const vector<Chunk> chunks = getChunks(reference);
+    size_t ihdr = 0, idat = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (chunks[i].type == "IHDR") {
+            ihdr = i;
+        } else if (chunks[i].type == "IDAT") {
+            idat = i;
+        }
+    }
+
+    // bad CRC of each chunk
+    {
+        const vector<unsigned char> file = makeFile(chunks);
+        size_t pos = 8;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            pos += chunks[i].data.size() + 8;
+            vector<unsigned char> bad = file;
+            bad[pos + 3] ^= 1;
+            const string name = "bad CRC of " + chunks[i].type;
+            ok = checkDecode(name.c_str(), bad, false) && ok;
+            pos += 4;
+        }
+    }
+
+    // bad Adler-32 of the image data
+    {
+        vector<Chunk> bad = chunks;
+        bad[idat].data.back() ^= 1;
+        ok = checkDecode("bad Adler-32", makeFile(bad), false) && ok;
+    }
+
+    // oversize IHDR: the image data of 64x64 pixels under a larger header
+    {
+        static const unsigned int sizes[][2] = { {16384, 16384}, {1 << 24, 1}, {(1 << 24) + 1, 1}, {65536, 65536}, {0, 64} };
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            vector<Chunk> bad = chunks;
+            bad[ihdr].data.clear();
+            putU32(&bad[ihdr].data, sizes[i][0]);
+            putU32(&bad[ihdr].data, sizes[i][1]);
+            bad[ihdr].data.insert(bad[ihdr].data.end(), chunks[ihdr].data.begin() + 8, chunks[ihdr].data.end());
+            char name[64];
+            std::snprintf(name, sizeof(name), "IHDR of %ux%u", sizes[i][0], sizes[i][1]);
+            ok = checkDecode(name, makeFile(bad), false) && ok;
+        }
+        vector<Chunk> bad = chunks;
+        bad[ihdr].data.push_back(0);
+        ok = checkDecode("IHDR of 14 bytes", makeFile(bad), false) && ok;
+    }
+
+    // hand-made streams of a 1x1 image: its inflated data is 5 zeros (a filter byte and RGBA)
+    const vector<unsigned char> inflated(5, 0);
+    {
+        // a literal and a match of length 4 at distance 1, in a fixed block
+        BitWriter w;
+        w.putBits(1, 1);
+        w.putBits(1, 2);
+        w.putLiteral(0);
+        w.putLiteral(258);
+        w.putCode(0, 5);
+        w.putLiteral(256);
+        ok = checkDecode( "fixed block", makeFile( 1, 1, w.zlib(inflated) ), true ) && ok;
+    }
+    {
+        // a match at distance 2 after a single byte
+        BitWriter w;
+        w.putBits(1, 1);
+        w.putBits(1, 2);
+        w.putLiteral(0);
+        w.putLiteral(257);
+        w.putCode(1, 5);
+        w.putLiteral(256);
+        ok = checkDecode( "distance past the window", makeFile( 1, 1, w.zlib(inflated) ), false ) && ok;
+    }
+    {
+        // a match longer than the image
+        BitWriter w;
+        w.putBits(1, 1);
+        w.putBits(1, 2);
+        w.putLiteral(0);
+        w.putLiteral(285);
+        w.putCode(0, 5);
+        w.putLiteral(256);
+        ok = checkDecode( "match past the image", makeFile( 1, 1, w.zlib(inflated) ), false ) && ok;
+    }
+    {
+        // a stored block, and a stored block whose length does not match its complement
+        BitWriter w;
+        w.putBits(1, 1);
+        w.putBits(0, 2);
+        w.putBits(0, 5);
+        w.putBits(5, 16);
+        w.putBits(0xfffa, 16);
+        for (int k = 0; k < 5; ++k) {
+            w.putBits(0, 8);
+        }
+        ok = checkDecode( "stored block", makeFile( 1, 1, w.zlib(inflated) ), true ) && ok;
+        BitWriter bad;
+        bad.putBits(1, 1);
+        bad.putBits(0, 2);
+        bad.putBits(0, 5);
+        bad.putBits(5, 16);
+        bad.putBits(0xfffb, 16);
+        for (int k = 0; k < 5; ++k) {
+            bad.putBits(0, 8);
+        }
+        ok = checkDecode( "stored block with a bad length", makeFile( 1, 1, bad.zlib(inflated) ), false ) && ok;
+    }
+    {
+        // dynamic blocks: the code length code is made of the lengths 0 and 1 (codes 0 and 1), except for the first
+        // stream where all its 19 codes are 1 bit long (over-subscribed)
+        static const char* names[3] = {
+            "over-subscribed code length code", "over-subscribed literal/length code", "no end-of-block code"
+        };
+        for (int i = 0; i < 3; ++i) {
+            BitWriter w;
+            w.putBits(1, 1);
+            w.putBits(2, 2);
+            w.putBits(0, 5);  // 257 literal/length codes
+            w.putBits(0, 5);  // 1 distance code
+            w.putBits(14, 4); // 18 code length codes, in the order 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1
+            for (int k = 0; k < 18; ++k) {
+                w.putBits( (i == 0 || k == 3 || k == 17) ? 1 : 0, 3 );
+            }
+            // all the literal/length codes 1 bit long, or all of them absent (including the end-of-block)
+            for (int k = 0; k < 258; ++k) {
+                w.putBits(i == 1 ? 1 : 0, 1);
+            }
+            ok = checkDecode( names[i], makeFile( 1, 1, w.zlib(inflated) ), false ) && ok;
+        }
+    }
+
+    // random corruptions of the image data, with valid CRCs: the decoder must not crash, whatever it returns
+    {
+        bool fuzzOk = true;
+        int refused = 0;
+        for (int i = 0; i < kFuzzCount; ++i) {
+            vector<Chunk> bad = chunks;
+            vector<unsigned char>& data = bad[idat].data;
+            const int n = 1 + r.next(4);
+            for (int k = 0; k < n; ++k) {
+                data[2 + r.next( (unsigned int)data.size() - 6 )] ^= (unsigned char)( 1 << r.next(8) );
+            }
+            if (r.next(2) == 0) {
+                data.resize( 2 + r.next( (unsigned int)data.size() - 2 ) );
+            }
+            SpriteSheetPngImage image;
+            string error;
+            fuzzOk = writeFile( makeFile(bad) ) && fuzzOk;
+            if ( !spriteSheetPngRead(kTestFile, &image, &error) ) {
+                ++refused;
+            } else if ( image.rgba.size() != (size_t)image.width * image.height * 4 ) {
+                fuzzOk = false;
+            }
+        }
+        std::printf("random corruptions: %d of %d refused%s\n", refused, kFuzzCount, fuzzOk ? "" : "  FAILED");
+        ok = ok && fuzzOk;
+    }
+
+    std::remove(kTestFile);
+
+    return ok ? 0 : 1;
+} // main
@@ -0,0 +1,441 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Transform3x3MotionBlurBenchmark: time the motion blur of Transform3x3Processor on a checkerboard moving through a
+ * rotation and a translation, and compare its error against the exact average of the renders of all the transforms
+ * with the error of the previous sampler, which seeded the van der Corput sequence with a hash of each pixel.
+ * The sampler must not be worse than the previous one by more than kMaxErrorRatio, and the output must be the same
+ * whatever the height of the strips the render window is split into and the number of threads.
+ * Usage: Transform3x3MotionBlurBenchmark [size] [transforms]
+ * Returns 0 if all the checks pass.
+ */
+
+#define _USE_MATH_DEFINES
+
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#include "ofxsTransform3x3Processor.h"
+#include "ofxsBenchmarkHost.h"
+
+using namespace OFX;
+
+#define kMaxErrorRatio 1.05 // the errors of the sampler may exceed those of the previous one by 5%
+#define kBlockSize 8 // the side of the blocks over which the low-frequency error is measured
+
+namespace {
+double
+elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// a checkerboard of 16-pixel squares, over a gradient in the red channel
+void
+fillSource(BenchmarkHost::Image* src)
+{
+    const OfxRectI& b = src->getBounds();
+    float* p = src->getPixelData();
+
+    for (int y = b.y1; y < b.y2; ++y) {
+        for (int x = b.x1; x < b.x2; ++x, p += 4) {
+            const float checker = ( ( (x >> 4) + (y >> 4) ) & 1 ) ? 1.f : 0.f;
+            p[0] = (float)(x - b.x1) / (b.x2 - b.x1);
+            p[1] = checker;
+            p[2] = 1.f - checker;
+            p[3] = 1.f;
+        }
+    }
+}
+
+// the inverse transforms over the shutter interval: a rotation by up to 10 degrees around the center of the image,
+// followed by a translation by up to (24,8) pixels, or only by a translation by up to 24 pixels along x
+std::vector<Matrix3x3>
+inverseMotion(const OfxRectI& bounds,
+              int n,
+              bool rotate)
+{
+    std::vector<Matrix3x3> H(n);
+    const double cx = (bounds.x1 + bounds.x2) / 2.;
+    const double cy = (bounds.y1 + bounds.y2) / 2.;
+
+    for (int t = 0; t < n; ++t) {
+        const double u = (n > 1) ? (double)t / (n - 1) : 0.;
+        const double a = rotate ? 10. * u * M_PI / 180. : 0.;
+        const double c = std::cos(a);
+        const double s = std::sin(a);
+        const double tx = 24. * u;
+        const double ty = rotate ? 8. * u : 0.;
+        // inverse of: rotate around (cx,cy), then translate by (tx,ty)
+        const double x0 = cx + tx;
+        const double y0 = cy + ty;
+        H[t] = Matrix3x3(c, s, cx - c * x0 - s * y0,
+                         -s, c, cy + s * x0 - c * y0,
+                         0., 0., 1.);
+    }
+
+    return H;
+}
+
+// The motion blur loop of Transform3x3Processor before the sample tables, for affine transforms, RGBA float images
+// and the bilinear filter: the samples of a pixel are the van der Corput sequence, from a seed that hashes x and y.
+class PreviousSamplerProcessor
+    : public ImageProcessor
+{
+public:
+    PreviousSamplerProcessor(ImageEffect& instance,
+                             const Image* srcImg,
+                             const std::vector<Matrix3x3>& invtransform,
+                             double motionblur)
+        : ImageProcessor(instance)
+        , _srcImg(srcImg)
+        , _invtransform(invtransform)
+        , _motionblur(motionblur)
+    {
+    }
+
+private:
+    struct AffineTransform
+    {
+        double Jxx, Jxy, Jyx, Jyy;
+        double fxRow, fyRow;
+    };
+
+    virtual void multiThreadProcessImages(const OfxRectI& procWindow, const OfxPointD& rs) OVERRIDE FINAL
+    {
+        unused(rs);
+        const int maxValue = 1;
+        const int nComponents = 4;
+        float tmpPix[nComponents];
+        const double maxErr2 = kTransform3x3ProcessorMotionBlurMaxError * kTransform3x3ProcessorMotionBlurMaxError;
+        const int maxIt = kTransform3x3ProcessorMotionBlurMaxIterations;
+        const size_t invtransformsize = _invtransform.size();
+        const OfxRectI& srcBounds = _srcImg->getBounds();
+        std::vector<AffineTransform> affineTransforms(invtransformsize);
+        for (size_t t = 0; t < invtransformsize; ++t) {
+            const Matrix3x3& H = _invtransform[t];
+            AffineTransform& A = affineTransforms[t];
+            assert( (H(2,0) == 0.) && (H(2,1) == 0.) && (H(2,2) == 1.) );
+            A.Jxx = H(0,0);
+            A.Jxy = H(0,1);
+            A.Jyx = H(1,0);
+            A.Jyy = H(1,1);
+        }
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            float *dstPix = (float *) _dstImg->getPixelAddress(procWindow.x1, y);
+            const double cy = (double)y + 0.5;
+            for (size_t t = 0; t < invtransformsize; ++t) {
+                const Matrix3x3& H = _invtransform[t];
+                AffineTransform& A = affineTransforms[t];
+                A.fxRow = H(0,1) * cy + H(0,2);
+                A.fyRow = H(1,1) * cy + H(1,2);
+            }
+
+            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
+                double accPix[nComponents];
+                double accPix2[nComponents];
+                double mean[nComponents];
+                for (int c = 0; c < nComponents; ++c) {
+                    accPix[c] = 0;
+                    accPix2[c] = 0;
+                    mean[c] = 0.;
+                }
+                unsigned int seed = (unsigned int)( hash(hash( x + (unsigned int)(0x10000 * _motionblur) ) + y) );
+                int sample = 0;
+                const int minsamples = kTransform3x3ProcessorMotionBlurMinIterations;
+                int maxsamples = minsamples;
+                while (sample < maxsamples) {
+                    for (; sample < maxsamples; ++sample, ++seed) {
+                        int t;
+                        if (sample < minsamples) {
+                            t = (int)( ( sample  + van_der_corput<2>(seed) ) * invtransformsize / (double)minsamples );
+                        } else {
+                            t = (int)(van_der_corput<2>(seed) * invtransformsize);
+                        }
+                        const AffineTransform& A = affineTransforms[t];
+                        const double cx = (double)x + 0.5;
+                        const double fx = A.fxRow + cx * A.Jxx;
+                        const double fy = A.fyRow + cx * A.Jyx;
+                        // the non-interior case of Transform3x3Processor::filterPixel, without blackOutside
+                        const bool xinside = (srcBounds.x1 <= fx + 0.5 && fx - 0.5 < srcBounds.x2);
+                        const bool yinside = (srcBounds.y1 <= fy + 0.5 && fy - 0.5 < srcBounds.y2);
+                        ofxsFilterInterpolate2DSuper<float, nComponents, eFilterBilinear, true>(fx, fy,
+                                                                                              xinside ? A.Jxx : 0., xinside ? A.Jxy : 0.,
+                                                                                              yinside ? A.Jyx : 0., yinside ? A.Jyy : 0.,
+                                                                                              _srcImg, false, tmpPix);
+                        for (int c = 0; c < nComponents; ++c) {
+                            accPix[c] += tmpPix[c];
+                            accPix2[c] += tmpPix[c] * tmpPix[c];
+                        }
+                    }
+                    for (int c = 0; c < nComponents; ++c) {
+                        mean[c] = accPix[c] / sample;
+                        const double var = (sample <= 1) ? (double)maxValue * maxValue : (accPix2[c] - mean[c] * mean[c] * sample) / (sample - 1);
+                        if (maxsamples < maxIt) {
+                            maxsamples = (std::max)( maxsamples, (std::min)( (int)(var / maxErr2), maxIt ) );
+                        }
+                    }
+                }
+                for (int c = 0; c < nComponents; ++c) {
+                    dstPix[c] = (float)mean[c];
+                }
+            }
+        }
+    }
+
+    template <int base>
+    static double van_der_corput(unsigned int seed)
+    {
+        double base_inv = 1.0 / ( (double)base );
+        double r = 0.0;
+
+        while (seed != 0) {
+            const int digit = seed % base;
+            r = r + ( (double)digit ) * base_inv;
+            base_inv = base_inv / ( (double)base );
+            seed = seed / base;
+        }
+
+        return r;
+    }
+
+    static unsigned int hash(unsigned int a)
+    {
+        a = (a ^ 61) ^ (a >> 16);
+        a = a + (a << 3);
+        a = a ^ (a >> 4);
+        a = a * 0x27d4eb2d;
+        a = a ^ (a >> 15);
+
+        return a;
+    }
+
+    const Image* _srcImg;
+    const std::vector<Matrix3x3>& _invtransform;
+    double _motionblur;
+};
+
+typedef Transform3x3Processor<float, 4, 1, false, eFilterBilinear, true> Processor;
+
+// render the motion blur of the transforms with Transform3x3Processor, with the render window split into strips of
+// stripHeight rows (or not split if it is 0)
+double
+render(BenchmarkHost::Effect& effect,
+       BenchmarkHost::Image* src,
+       BenchmarkHost::Image* dst,
+       const std::vector<Matrix3x3>& H,
+       double motionblur,
+       int stripHeight)
+{
+    const OfxPointD renderScale = {1., 1.};
+    const OfxRectI& bounds = dst->getBounds();
+    const int height = (stripHeight > 0) ? stripHeight : (bounds.y2 - bounds.y1);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int y = bounds.y1; y < bounds.y2; y += height) {
+        const OfxRectI strip = {bounds.x1, y, bounds.x2, (std::min)(y + height, bounds.y2)};
+        Processor processor(effect);
+        processor.setDstImg( dst->get() );
+        processor.setSrcImg( src->get() );
+        processor.setRenderWindow(strip, renderScale);
+        processor.setValues(&H[0], NULL, H.size(), false, motionblur, 1.);
+        processor.process();
+    }
+
+    return elapsedMs(start);
+}
+
+double
+renderPrevious(BenchmarkHost::Effect& effect,
+               BenchmarkHost::Image* src,
+               BenchmarkHost::Image* dst,
+               const std::vector<Matrix3x3>& H,
+               double motionblur)
+{
+    const OfxPointD renderScale = {1., 1.};
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PreviousSamplerProcessor processor(effect, src->get(), H, motionblur);
+
+    processor.setDstImg( dst->get() );
+    processor.setRenderWindow(dst->getBounds(), renderScale);
+    processor.process();
+
+    return elapsedMs(start);
+}
+
+// the exact motion blur: the average of the renders of each transform
+std::vector<double>
+renderReference(BenchmarkHost::Effect& effect,
+                BenchmarkHost::Image* src,
+                BenchmarkHost::Image* tmp,
+                const std::vector<Matrix3x3>& H)
+{
+    std::vector<double> sum(tmp->getPixels().size(), 0.);
+
+    for (size_t t = 0; t < H.size(); ++t) {
+        render(effect, src, tmp, std::vector<Matrix3x3>(1, H[t]), 0., 0);
+        for (size_t k = 0; k < sum.size(); ++k) {
+            sum[k] += tmp->getPixels()[k];
+        }
+    }
+    for (size_t k = 0; k < sum.size(); ++k) {
+        sum[k] /= H.size();
+    }
+
+    return sum;
+}
+
+// the RMS error of the pixels, and of their averages over kBlockSize x kBlockSize blocks
+void
+computeErrors(const std::vector<float>& pixels,
+              const std::vector<double>& reference,
+              const OfxRectI& bounds,
+              double* rmse,
+              double* blockRmse)
+{
+    const int width = bounds.x2 - bounds.x1;
+    const int height = bounds.y2 - bounds.y1;
+    double sum = 0.;
+    double blockSum = 0.;
+    int blocks = 0;
+
+    for (size_t k = 0; k < pixels.size(); ++k) {
+        sum += (pixels[k] - reference[k]) * (pixels[k] - reference[k]);
+    }
+    for (int by = 0; by + kBlockSize <= height; by += kBlockSize) {
+        for (int bx = 0; bx + kBlockSize <= width; bx += kBlockSize) {
+            for (int c = 0; c < 4; ++c) {
+                double d = 0.;
+                for (int y = by; y < by + kBlockSize; ++y) {
+                    for (int x = bx; x < bx + kBlockSize; ++x) {
+                        const size_t k = ( (size_t)y * width + x ) * 4 + c;
+                        d += pixels[k] - reference[k];
+                    }
+                }
+                d /= kBlockSize * kBlockSize;
+                blockSum += d * d;
+                ++blocks;
+            }
+        }
+    }
+    *rmse = std::sqrt( sum / pixels.size() );
+    *blockRmse = blocks ? std::sqrt(blockSum / blocks) : 0.;
+}
+
+// compare the sampler with the previous one, for a few amounts of motion blur
+bool
+compareSamplers(BenchmarkHost::Effect& effect,
+                BenchmarkHost::Image* src,
+                BenchmarkHost::Image* dst,
+                const std::vector<Matrix3x3>& H)
+{
+    static const double motionblurs[] = {0.5, 1., 2.};
+    const std::vector<double> reference = renderReference(effect, src, dst, H);
+    bool ok = true;
+
+    std::printf("  motionblur    time ms (prev/new)        RMSE (prev/new)     %dx%d-averaged error (prev/new)\n",
+                kBlockSize, kBlockSize);
+    for (size_t i = 0; i < sizeof(motionblurs) / sizeof(motionblurs[0]); ++i) {
+        double rmse[2], blockRmse[2];
+        const double previousMs = renderPrevious(effect, src, dst, H, motionblurs[i]);
+        computeErrors(dst->getPixels(), reference, dst->getBounds(), &rmse[0], &blockRmse[0]);
+        const double ms = render(effect, src, dst, H, motionblurs[i], 0);
+        computeErrors(dst->getPixels(), reference, dst->getBounds(), &rmse[1], &blockRmse[1]);
+        std::printf("  %10.1f  %9.1f / %-9.1f  %9.5f / %-9.5f  %9.5f / %.5f", motionblurs[i], previousMs, ms,
+                    rmse[0], rmse[1], blockRmse[0], blockRmse[1]);
+        if ( (rmse[1] > rmse[0] * kMaxErrorRatio) || (blockRmse[1] > blockRmse[0] * kMaxErrorRatio) ) {
+            std::printf("  FAILED");
+            ok = false;
+        }
+        std::printf("\n");
+    }
+
+    return ok;
+}
+
+// check that the output does not depend on how the render window is split between strips and threads
+bool
+checkSplits(BenchmarkHost::Effect& effect,
+            BenchmarkHost::Image* src,
+            BenchmarkHost::Image* dst,
+            const std::vector<Matrix3x3>& H)
+{
+    static const int stripHeights[] = {0, 1, 7, 64};
+    static const unsigned int threadCounts[] = {1, 2, 3, 8};
+    bool ok = true;
+
+    BenchmarkHost::setThreadCount(1);
+    render(effect, src, dst, H, 1., 0);
+    const std::vector<float> expected = dst->getPixels();
+    for (size_t i = 0; i < sizeof(stripHeights) / sizeof(stripHeights[0]); ++i) {
+        for (size_t j = 0; j < sizeof(threadCounts) / sizeof(threadCounts[0]); ++j) {
+            BenchmarkHost::setThreadCount(threadCounts[j]);
+            render(effect, src, dst, H, 1., stripHeights[i]);
+            const bool same = (dst->getPixels() == expected);
+            if (stripHeights[i] > 0) {
+                std::printf("  strips of %d rows", stripHeights[i]);
+            } else {
+                std::printf("  whole window");
+            }
+            std::printf(", %u threads: %s\n", threadCounts[j], same ? "same output" : "different output  FAILED");
+            ok = ok && same;
+        }
+    }
+    BenchmarkHost::setThreadCount(0);
+
+    return ok;
+}
+} // namespace
+
+int
+main(int argc,
+     char* argv[])
+{
+    const int size = (argc > 1) ? std::atoi(argv[1]) : 512;
+    const int transforms = (argc > 2) ? std::atoi(argv[2]) : 200;
+    if ( (size <= 0) || (transforms < 2) ) {
+        std::fprintf(stderr, "usage: %s [size] [transforms]\n", argv[0]);
+
+        return 1;
+    }
+    BenchmarkHost::Effect effect;
+    const OfxRectI bounds = {0, 0, size, size};
+    BenchmarkHost::Image src(bounds);
+    BenchmarkHost::Image dst(bounds);
+    fillSource(&src);
+
+    const std::vector<Matrix3x3> rotation = inverseMotion(bounds, transforms, true);
+    const std::vector<Matrix3x3> translation = inverseMotion(bounds, transforms, false);
+    std::printf("%dx%d checkerboard, %d transforms, %u threads\n", size, size, transforms, MultiThread::getNumCPUs());
+    std::printf("rotation and translation\n");
+    bool ok = compareSamplers(effect, &src, &dst, rotation);
+    ok = checkSplits(effect, &src, &dst, rotation) && ok;
+    std::printf("translation\n");
+    ok = checkSplits(effect, &src, &dst, translation) && ok;
+
+    return ok ? 0 : 1;
+} // main
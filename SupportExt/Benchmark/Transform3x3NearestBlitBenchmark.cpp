@@ -0,0 +1,203 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Transform3x3NearestBlitBenchmark: time Transform3x3Processor with the impulse filter on axis-aligned transforms of a
+ * synthetic RGBA float source (integer scales, flop, flip and offsets, on sources whose origin is at zero or
+ * negative), with the copy of the source pixels (see multiThreadProcessImagesNearestBlit) and with the generic path.
+ * Both must give bit-identical outputs, with and without blackOutside.
+ * Usage: Transform3x3NearestBlitBenchmark [width height] [threads]
+ * Without a size, the source is 1920x1080, and then 3840x2160.
+ * Returns 0 if all the outputs are identical.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "ofxsTransform3x3Processor.h"
+#include "ofxsBenchmarkHost.h"
+
+using namespace OFX;
+
+#define kRepeats 3 // the best time of kRepeats renders is reported
+
+namespace {
+double
+elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// a different value in each pixel and channel, so that any misplaced pixel changes the output
+void
+fillSource(BenchmarkHost::Image* src)
+{
+    const OfxRectI& b = src->getBounds();
+    float* p = src->getPixelData();
+    unsigned int seed = 1;
+
+    for (int y = b.y1; y < b.y2; ++y) {
+        for (int x = b.x1; x < b.x2; ++x, p += 4) {
+            seed = seed * 1664525U + 1013904223U;
+            p[0] = (float)(x - b.x1) / (b.x2 - b.x1);
+            p[1] = (float)(y - b.y1) / (b.y2 - b.y1);
+            p[2] = (seed >> 8) * (1.f / 16777216.f);
+            p[3] = 1.f;
+        }
+    }
+}
+
+// an axis-aligned transform: the output pixel (x,y) shows the source pixel (sx*x + tx, sy*y + ty), in pixel coordinates
+struct Case
+{
+    const char* name;
+    double sx, sy; // the inverse scales: negative to flop or flip, and below 1 to upscale
+    double tx, ty; // the offsets from the source origin, in pixels
+    bool relative; // the offsets are in units of the source size, to bring a flopped or flipped source back in view
+};
+
+// the best time of kRepeats renders of the whole output
+double
+render(BenchmarkHost::Effect& effect,
+       BenchmarkHost::Image* src,
+       BenchmarkHost::Image* dst,
+       const Matrix3x3& H,
+       bool blackOutside,
+       bool nearestBlit)
+{
+    const OfxPointD renderScale = {1., 1.};
+    double best = 0.;
+
+    for (int r = 0; r < kRepeats; ++r) {
+        Transform3x3Processor<float, 4, 1, false, eFilterImpulse, false> processor(effect);
+        processor.setDstImg( dst->get() );
+        processor.setSrcImg( src->get() );
+        processor.setRenderWindow(dst->getBounds(), renderScale);
+        processor.setValues(&H, NULL, 1, blackOutside, 0., 1.);
+        processor.setNearestBlit(nearestBlit);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        processor.process();
+        const double ms = elapsedMs(start);
+        best = (r == 0) ? ms : (std::min)(best, ms);
+    }
+
+    return best;
+}
+
+bool
+compare(BenchmarkHost::Effect& effect,
+        BenchmarkHost::Image* src,
+        BenchmarkHost::Image* blit,
+        BenchmarkHost::Image* generic)
+{
+    static const Case cases[] = {
+        {"identity",              1.,    1.,    0.,    0.,   false},
+        {"offset (-37,-11)",      1.,    1.,   37.,   11.,   false},
+        {"offset (1000,-600)",    1.,    1., -1000.,  600.,  false},
+        {"offset (0.5,-0.25)",    1.,    1.,   -0.5,   0.25, false},
+        {"flop",                 -1.,    1.,    1.,    0.,   true},
+        {"flip",                  1.,   -1.,    0.,    1.,   true},
+        {"flop flip",            -1.,   -1.,    1.,    1.,   true},
+        {"upscale 2",             0.5,   0.5,   0.,    0.,   false},
+        {"upscale 3 offset",      1. / 3, 1. / 3, -20.,  -7.,  false},
+        {"upscale 4 flop flip",  -0.25, -0.25,  0.5,   0.5,  true},
+        {"downscale 2",           2.,    2.,    0.,    0.,   false},
+        {"downscale 2 flop",     -2.,    2.,    1.,    0.,   true},
+    };
+    const OfxRectI& b = src->getBounds();
+    const double width = b.x2 - b.x1;
+    const double height = b.y2 - b.y1;
+    bool ok = true;
+
+    std::printf("source (%d,%d)-(%d,%d)\n", b.x1, b.y1, b.x2, b.y2);
+    std::printf("  transform               blackOutside   blit ms  generic ms   speedup\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        const Case& k = cases[i];
+        // the offsets are from the origin of the source
+        const double tx = (k.relative ? k.tx * width : k.tx) + b.x1;
+        const double ty = (k.relative ? k.ty * height : k.ty) + b.y1;
+        const Matrix3x3 H(k.sx, 0., tx,
+                          0., k.sy, ty,
+                          0., 0., 1.);
+        for (int blackOutside = 0; blackOutside <= 1; ++blackOutside) {
+            const double blitMs = render(effect, src, blit, H, blackOutside != 0, true);
+            const double genericMs = render(effect, src, generic, H, blackOutside != 0, false);
+            const bool same = ( blit->getPixels() == generic->getPixels() );
+            std::printf( "  %-22s  %-12s  %8.1f  %10.1f  %7.2fx%s\n", k.name, blackOutside ? "yes" : "no", blitMs, genericMs,
+                         genericMs / blitMs, same ? "" : "  different output  FAILED" );
+            ok = ok && same;
+        }
+    }
+
+    return ok;
+}
+
+// compare the blit and the generic path on a source at the origin, and on a source with a negative origin
+bool
+run(int width,
+    int height)
+{
+    BenchmarkHost::Effect effect;
+    const OfxRectI bounds = {0, 0, width, height};
+    const OfxRectI negativeBounds = {-width / 3, -height / 5, width - width / 3, height - height / 5};
+    BenchmarkHost::Image blit(bounds);
+    BenchmarkHost::Image generic(bounds);
+    bool ok;
+
+    std::printf("%dx%d RGBA float, %u threads\n", width, height, MultiThread::getNumCPUs());
+    {
+        BenchmarkHost::Image src(bounds);
+        fillSource(&src);
+        ok = compare(effect, &src, &blit, &generic);
+    }
+    {
+        BenchmarkHost::Image src(negativeBounds);
+        fillSource(&src);
+        ok = compare(effect, &src, &blit, &generic) && ok;
+    }
+
+    return ok;
+}
+} // namespace
+
+int
+main(int argc,
+     char* argv[])
+{
+    const int width = (argc > 2) ? std::atoi(argv[1]) : 0;
+    const int height = (argc > 2) ? std::atoi(argv[2]) : 0;
+    const int threads = (argc == 2) ? std::atoi(argv[1]) : ( (argc > 3) ? std::atoi(argv[3]) : 0 );
+    if ( ( (argc > 2) && ( (width <= 0) || (height <= 0) ) ) || (threads < 0) ) {
+        std::fprintf(stderr, "usage: %s [width height] [threads]\n", argv[0]);
+
+        return 1;
+    }
+    BenchmarkHost::setThreadCount(threads);
+    if (argc > 2) {
+        return run(width, height) ? 0 : 1;
+    }
+    bool ok = run(1920, 1080);
+    ok = run(3840, 2160) && ok;
+
+    return ok ? 0 : 1;
+} // main
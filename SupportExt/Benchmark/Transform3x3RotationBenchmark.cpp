@@ -0,0 +1,180 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Transform3x3RotationBenchmark: time Transform3x3Processor on a rotated synthetic RGBA float source, with the output
+ * processed row by row and in tiles (see Transform3x3ProcessorBase::multiThreadFunction), for a sweep of angles.
+ * The default source is 4K: run it with larger sizes to find where the tiles start to pay, which is what
+ * kTransform3x3ProcessorTileMinSourceSize is set from. Both traversals must give the same output.
+ * Usage: Transform3x3RotationBenchmark [width height] [threads]
+ */
+
+#define _USE_MATH_DEFINES
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "ofxsTransform3x3Processor.h"
+#include "ofxsBenchmarkHost.h"
+
+using namespace OFX;
+
+#define kRepeats 3 // the best time of kRepeats renders is reported
+#define kMaxDifference 1e-4 // the sources coordinates are stepped from different pixels in rows and in tiles
+
+namespace {
+double
+elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// smooth gradients, sharp edges and noise, so that all the filter taps matter
+void
+fillSource(BenchmarkHost::Image* src)
+{
+    const OfxRectI& b = src->getBounds();
+    float* p = src->getPixelData();
+    unsigned int seed = 1;
+
+    for (int y = b.y1; y < b.y2; ++y) {
+        for (int x = b.x1; x < b.x2; ++x, p += 4) {
+            seed = seed * 1664525U + 1013904223U;
+            const float noise = (seed >> 8) * (1.f / 16777216.f);
+            p[0] = (float)(x - b.x1) / (b.x2 - b.x1);
+            p[1] = ( ( (x >> 5) + (y >> 5) ) & 1 ) ? 1.f : 0.f;
+            p[2] = noise;
+            p[3] = 1.f;
+        }
+    }
+}
+
+// the inverse of a rotation by angle degrees around the center of the image, in pixel coordinates
+Matrix3x3
+inverseRotation(double angle,
+                const OfxRectI& bounds)
+{
+    const double a = angle * M_PI / 180.;
+    const double c = std::cos(a);
+    const double s = std::sin(a);
+    const double cx = (bounds.x1 + bounds.x2) / 2.;
+    const double cy = (bounds.y1 + bounds.y2) / 2.;
+
+    return Matrix3x3(c, s, cx - c * cx - s * cy,
+                     -s, c, cy + s * cx - c * cy,
+                     0., 0., 1.);
+}
+
+// the best time of kRepeats renders of the whole output, in tiles or in rows
+template <FilterEnum filter>
+double
+render(BenchmarkHost::Effect& effect,
+       BenchmarkHost::Image* src,
+       BenchmarkHost::Image* dst,
+       const Matrix3x3& H,
+       bool tiles)
+{
+    const OfxPointD renderScale = {1., 1.};
+    double best = 0.;
+
+    for (int r = 0; r < kRepeats; ++r) {
+        Transform3x3Processor<float, 4, 1, false, filter, true> processor(effect);
+        processor.setDstImg( dst->get() );
+        processor.setSrcImg( src->get() );
+        processor.setRenderWindow(dst->getBounds(), renderScale);
+        processor.setValues(&H, NULL, 1, true, 0., 1.);
+        processor.setTileMinSourceSize(tiles ? 0. : HUGE_VAL);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        processor.process();
+        const double ms = elapsedMs(start);
+        best = (r == 0) ? ms : (std::min)(best, ms);
+    }
+
+    return best;
+}
+
+template <FilterEnum filter>
+bool
+sweep(const char* name,
+      BenchmarkHost::Effect& effect,
+      BenchmarkHost::Image* src,
+      BenchmarkHost::Image* rows,
+      BenchmarkHost::Image* tiles,
+      bool defaultTiles)
+{
+    static const double angles[] = {0., 10., 30., 44., 46., 60., 80., 90., 120., 150., 180.};
+    bool ok = true;
+
+    std::printf("%s filter\n", name);
+    std::printf("  angle     rows ms    tiles ms   speedup  default\n");
+    for (size_t i = 0; i < sizeof(angles) / sizeof(angles[0]); ++i) {
+        const Matrix3x3 H = inverseRotation( angles[i], src->getBounds() );
+        const double rowsMs = render<filter>(effect, src, rows, H, false);
+        const double tilesMs = render<filter>(effect, src, tiles, H, true);
+        double maxDifference = 0.;
+        for (size_t k = 0; k < rows->getPixels().size(); ++k) {
+            maxDifference = (std::max)( maxDifference, (double)std::abs(rows->getPixels()[k] - tiles->getPixels()[k]) );
+        }
+        // the default is the tiles above the source size threshold, if the rows walk across the source rows
+        const bool acrossRows = std::abs( H(1,0) ) > std::abs( H(0,0) );
+        std::printf( "  %5.0f  %10.1f  %10.1f  %7.2fx  %s", angles[i], rowsMs, tilesMs, rowsMs / tilesMs,
+                     (defaultTiles && acrossRows) ? "tiles" : "rows" );
+        if (maxDifference > kMaxDifference) {
+            std::printf("  the outputs differ by %g  FAILED", maxDifference);
+            ok = false;
+        }
+        std::printf("\n");
+    }
+
+    return ok;
+}
+} // namespace
+
+int
+main(int argc,
+     char* argv[])
+{
+    const int width = (argc > 2) ? std::atoi(argv[1]) : 3840;
+    const int height = (argc > 2) ? std::atoi(argv[2]) : 2160;
+    const int threads = (argc == 2) ? std::atoi(argv[1]) : ( (argc > 3) ? std::atoi(argv[3]) : 0 );
+    if ( (width <= 0) || (height <= 0) || (threads < 0) ) {
+        std::fprintf(stderr, "usage: %s [width height] [threads]\n", argv[0]);
+
+        return 1;
+    }
+    BenchmarkHost::setThreadCount(threads);
+    BenchmarkHost::Effect effect;
+    const OfxRectI bounds = {0, 0, width, height};
+    BenchmarkHost::Image src(bounds);
+    BenchmarkHost::Image rows(bounds);
+    BenchmarkHost::Image tiles(bounds);
+    fillSource(&src);
+
+    const double sourceSize = (double)width * height * 4 * sizeof(float);
+    const bool defaultTiles = sourceSize >= (double)kTransform3x3ProcessorTileMinSourceSize;
+    std::printf("%dx%d RGBA float source: %.0f MB, the tile threshold is %.0f MB, %u threads\n", width, height,
+                sourceSize / (1 << 20), (double)kTransform3x3ProcessorTileMinSourceSize / (1 << 20), MultiThread::getNumCPUs());
+    bool ok = sweep<eFilterBilinear>("bilinear", effect, &src, &rows, &tiles, defaultTiles);
+    ok = sweep<eFilterCubic>("cubic", effect, &src, &rows, &tiles, defaultTiles) && ok;
+
+    return ok ? 0 : 1;
+} // main
@@ -0,0 +1,499 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * A minimal host for the benchmarks of the image processors.
+ * Only the suite functions used by the constructors of OFX::ImageEffect and OFX::Image, by
+ * OFX::ImageProcessor::process() and by ImageEffect::abort() are implemented. The properties that a host would set
+ * on an image or an effect instance are set explicitly, and the others read as zero.
+ */
+
+#include "ofxsBenchmarkHost.h"
+
+#include <cstring>
+#include <map>
+#include <string>
+
+#include "ofxCore.h"
+#include "ofxProperty.h"
+#include "ofxImageEffect.h"
+#include "ofxMultiThread.h"
+
+namespace OFX {
+namespace Private {
+extern OfxPropertySuiteV1* gPropSuite;
+extern OfxImageEffectSuiteV1* gEffectSuite;
+extern OfxMultiThreadSuiteV1* gThreadSuite;
+extern OfxMultiThreadSuiteV1* gPluginThreadSuite; // see ofxsThreadSuite.cpp
+}
+
+namespace BenchmarkHost {
+struct PropertyValue
+{
+    void* pointer;
+    std::string string;
+    double d;
+    int i;
+
+    PropertyValue()
+        : pointer(NULL)
+        , string()
+        , d(0.)
+        , i(0)
+    {
+    }
+};
+
+struct PropertySet
+{
+    std::map<std::string, std::vector<PropertyValue> > values;
+
+    OfxPropertySetHandle handle() { return (OfxPropertySetHandle)this; }
+
+    void setString(const char* name,
+                   const char* value)
+    {
+        values[name].assign( 1, PropertyValue() );
+        values[name][0].string = value;
+    }
+
+    void setIntN(const char* name,
+                 const int* value,
+                 int count)
+    {
+        values[name].assign( count, PropertyValue() );
+        for (int i = 0; i < count; ++i) {
+            values[name][i].i = value[i];
+        }
+    }
+
+    void setDoubleN(const char* name,
+                    const double* value,
+                    int count)
+    {
+        values[name].assign( count, PropertyValue() );
+        for (int i = 0; i < count; ++i) {
+            values[name][i].d = value[i];
+        }
+    }
+};
+
+namespace {
+unsigned int gThreadCount = 0;
+OfxPropertySuiteV1 gHostPropSuite;
+OfxImageEffectSuiteV1 gHostEffectSuite;
+OfxMultiThreadSuiteV1 gHostThreadSuite;
+PropertySet gEffectProps;
+
+// the value at index of a property, which is created if it does not exist
+PropertyValue&
+slot(OfxPropertySetHandle properties,
+     const char* property,
+     int index)
+{
+    std::vector<PropertyValue>& values = ( (PropertySet*)properties )->values[property];
+
+    if ( (int)values.size() <= index ) {
+        values.resize(index + 1);
+    }
+
+    return values[index];
+}
+
+// the value at index of a property, or NULL if it was not set: the caller reads zero
+const PropertyValue*
+find(OfxPropertySetHandle properties,
+     const char* property,
+     int index)
+{
+    const std::map<std::string, std::vector<PropertyValue> >& values = ( (PropertySet*)properties )->values;
+    std::map<std::string, std::vector<PropertyValue> >::const_iterator it = values.find(property);
+
+    return ( (it != values.end()) && (index < (int)it->second.size()) ) ? &it->second[index] : NULL;
+}
+
+OfxStatus
+propSetPointer(OfxPropertySetHandle properties,
+               const char* property,
+               int index,
+               void* value)
+{
+    slot(properties, property, index).pointer = value;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetString(OfxPropertySetHandle properties,
+              const char* property,
+              int index,
+              const char* value)
+{
+    slot(properties, property, index).string = value;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetDouble(OfxPropertySetHandle properties,
+              const char* property,
+              int index,
+              double value)
+{
+    slot(properties, property, index).d = value;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetInt(OfxPropertySetHandle properties,
+           const char* property,
+           int index,
+           int value)
+{
+    slot(properties, property, index).i = value;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetPointerN(OfxPropertySetHandle properties,
+                const char* property,
+                int count,
+                void* const* value)
+{
+    for (int i = 0; i < count; ++i) {
+        propSetPointer(properties, property, i, value[i]);
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetStringN(OfxPropertySetHandle properties,
+               const char* property,
+               int count,
+               const char* const* value)
+{
+    for (int i = 0; i < count; ++i) {
+        propSetString(properties, property, i, value[i]);
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetDoubleN(OfxPropertySetHandle properties,
+               const char* property,
+               int count,
+               const double* value)
+{
+    for (int i = 0; i < count; ++i) {
+        propSetDouble(properties, property, i, value[i]);
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propSetIntN(OfxPropertySetHandle properties,
+            const char* property,
+            int count,
+            const int* value)
+{
+    for (int i = 0; i < count; ++i) {
+        propSetInt(properties, property, i, value[i]);
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetPointer(OfxPropertySetHandle properties,
+               const char* property,
+               int index,
+               void** value)
+{
+    const PropertyValue* v = find(properties, property, index);
+
+    *value = v ? v->pointer : NULL;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetString(OfxPropertySetHandle properties,
+              const char* property,
+              int index,
+              char** value)
+{
+    static char empty[1] = {0};
+    const PropertyValue* v = find(properties, property, index);
+
+    *value = v ? const_cast<char*>( v->string.c_str() ) : empty;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetDouble(OfxPropertySetHandle properties,
+              const char* property,
+              int index,
+              double* value)
+{
+    const PropertyValue* v = find(properties, property, index);
+
+    *value = v ? v->d : 0.;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetInt(OfxPropertySetHandle properties,
+           const char* property,
+           int index,
+           int* value)
+{
+    const PropertyValue* v = find(properties, property, index);
+
+    *value = v ? v->i : 0;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetPointerN(OfxPropertySetHandle properties,
+                const char* property,
+                int count,
+                void** value)
+{
+    for (int i = 0; i < count; ++i) {
+        propGetPointer(properties, property, i, &value[i]);
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetStringN(OfxPropertySetHandle properties,
+               const char* property,
+               int count,
+               char** value)
+{
+    for (int i = 0; i < count; ++i) {
+        propGetString(properties, property, i, &value[i]);
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetDoubleN(OfxPropertySetHandle properties,
+               const char* property,
+               int count,
+               double* value)
+{
+    for (int i = 0; i < count; ++i) {
+        propGetDouble(properties, property, i, &value[i]);
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetIntN(OfxPropertySetHandle properties,
+            const char* property,
+            int count,
+            int* value)
+{
+    for (int i = 0; i < count; ++i) {
+        propGetInt(properties, property, i, &value[i]);
+    }
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propReset(OfxPropertySetHandle properties,
+          const char* property)
+{
+    ( (PropertySet*)properties )->values.erase(property);
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+propGetDimension(OfxPropertySetHandle properties,
+                 const char* property,
+                 int* count)
+{
+    const std::map<std::string, std::vector<PropertyValue> >& values = ( (PropertySet*)properties )->values;
+    std::map<std::string, std::vector<PropertyValue> >::const_iterator it = values.find(property);
+
+    *count = (it != values.end()) ? (int)it->second.size() : 0;
+
+    return kOfxStatOK;
+}
+
+// the effect handle is its property set
+OfxStatus
+getPropertySet(OfxImageEffectHandle imageEffect,
+               OfxPropertySetHandle* propHandle)
+{
+    *propHandle = (OfxPropertySetHandle)imageEffect;
+
+    return kOfxStatOK;
+}
+
+OfxStatus
+getParamSet(OfxImageEffectHandle /*imageEffect*/,
+            OfxParamSetHandle* paramSet)
+{
+    *paramSet = NULL;
+
+    return kOfxStatOK;
+}
+
+// the images own their pixels
+OfxStatus
+clipReleaseImage(OfxPropertySetHandle /*imageHandle*/)
+{
+    return kOfxStatOK;
+}
+
+int
+abort(OfxImageEffectHandle /*imageEffect*/)
+{
+    return 0;
+}
+
+OfxStatus
+multiThreadNumCPUs(unsigned int* nCPUs)
+{
+    if (gThreadCount == 0) {
+        return Private::gPluginThreadSuite->multiThreadNumCPUs(nCPUs);
+    }
+    *nCPUs = gThreadCount;
+
+    return kOfxStatOK;
+}
+
+OfxImageEffectHandle
+effectHandle()
+{
+    load();
+
+    return (OfxImageEffectHandle)gEffectProps.handle();
+}
+} // namespace
+
+void
+load()
+{
+    if (Private::gPropSuite == &gHostPropSuite) {
+        return;
+    }
+    std::memset( &gHostPropSuite, 0, sizeof(gHostPropSuite) );
+    gHostPropSuite.propSetPointer = propSetPointer;
+    gHostPropSuite.propSetString = propSetString;
+    gHostPropSuite.propSetDouble = propSetDouble;
+    gHostPropSuite.propSetInt = propSetInt;
+    gHostPropSuite.propSetPointerN = propSetPointerN;
+    gHostPropSuite.propSetStringN = propSetStringN;
+    gHostPropSuite.propSetDoubleN = propSetDoubleN;
+    gHostPropSuite.propSetIntN = propSetIntN;
+    gHostPropSuite.propGetPointer = propGetPointer;
+    gHostPropSuite.propGetString = propGetString;
+    gHostPropSuite.propGetDouble = propGetDouble;
+    gHostPropSuite.propGetInt = propGetInt;
+    gHostPropSuite.propGetPointerN = propGetPointerN;
+    gHostPropSuite.propGetStringN = propGetStringN;
+    gHostPropSuite.propGetDoubleN = propGetDoubleN;
+    gHostPropSuite.propGetIntN = propGetIntN;
+    gHostPropSuite.propReset = propReset;
+    gHostPropSuite.propGetDimension = propGetDimension;
+    Private::gPropSuite = &gHostPropSuite;
+
+    std::memset( &gHostEffectSuite, 0, sizeof(gHostEffectSuite) );
+    gHostEffectSuite.getPropertySet = getPropertySet;
+    gHostEffectSuite.getParamSet = getParamSet;
+    gHostEffectSuite.clipReleaseImage = clipReleaseImage;
+    gHostEffectSuite.abort = abort;
+    Private::gEffectSuite = &gHostEffectSuite;
+
+    // the plugin-side suite runs the threads, and the benchmark chooses how many
+    gHostThreadSuite = *Private::gPluginThreadSuite;
+    gHostThreadSuite.multiThreadNumCPUs = multiThreadNumCPUs;
+    Private::gThreadSuite = &gHostThreadSuite;
+
+    gEffectProps.setString(kOfxImageEffectPropContext, kOfxImageEffectContextFilter);
+}
+
+void
+setThreadCount(unsigned int n)
+{
+    gThreadCount = n;
+}
+
+Effect::Effect()
+    : OFX::ImageEffect( effectHandle() )
+{
+}
+
+Effect::~Effect()
+{
+}
+
+void
+Effect::render(const OFX::RenderArguments & /*args*/)
+{
+}
+
+Image::Image(const OfxRectI& bounds)
+    : _bounds(bounds)
+    , _pixels( (size_t)(bounds.x2 - bounds.x1) * (bounds.y2 - bounds.y1) * 4, 0.f )
+    , _props(new PropertySet)
+    , _image()
+{
+    const int b[4] = {bounds.x1, bounds.y1, bounds.x2, bounds.y2};
+    const double renderScale[2] = {1., 1.};
+    const double par = 1.;
+    const int rowBytes = (bounds.x2 - bounds.x1) * 4 * (int)sizeof(float);
+
+    load();
+    propSetPointer( _props->handle(), kOfxImagePropData, 0, getPixelData() );
+    _props->setIntN(kOfxImagePropBounds, b, 4);
+    _props->setIntN(kOfxImagePropRegionOfDefinition, b, 4);
+    _props->setIntN(kOfxImagePropRowBytes, &rowBytes, 1);
+    _props->setDoubleN(kOfxImagePropPixelAspectRatio, &par, 1);
+    _props->setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+    _props->setString(kOfxImageEffectPropComponents, kOfxImageComponentRGBA);
+    _props->setString(kOfxImageEffectPropPixelDepth, kOfxBitDepthFloat);
+    _props->setString(kOfxImageEffectPropPreMultiplication, kOfxImagePreMultiplied);
+    _props->setString(kOfxImagePropField, kOfxImageFieldNone);
+    _props->setString(kOfxImagePropUniqueIdentifier, "benchmark");
+    _image.reset( new OFX::Image( _props->handle() ) );
+}
+
+Image::~Image()
+{
+}
+} // namespace BenchmarkHost
+} // namespace OFX
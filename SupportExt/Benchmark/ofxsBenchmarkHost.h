@@ -0,0 +1,84 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * A minimal host for the benchmarks of the image processors: an effect instance without clips or parameters, RGBA
+ * float images that own their pixels, and a multithread suite whose number of threads is set by the benchmark.
+ * The processors run exactly as in a render action, through OFX::ImageProcessor::process().
+ */
+
+#ifndef openfx_supportext_ofxsBenchmarkHost_h
+#define openfx_supportext_ofxsBenchmarkHost_h
+
+#include <memory>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMacros.h"
+
+namespace OFX {
+namespace BenchmarkHost {
+struct PropertySet;
+
+// install the suites of the host, if they are not installed yet. The constructors below call it.
+void load();
+
+// set the number of threads reported by the multithread suite, or 0 for the number of CPUs
+void setThreadCount(unsigned int n);
+
+// the effect instance passed to the processors
+class Effect
+    : public OFX::ImageEffect
+{
+public:
+    Effect();
+
+    virtual ~Effect();
+
+private:
+    virtual void render(const OFX::RenderArguments & args) OVERRIDE FINAL;
+};
+
+// a premultiplied RGBA float image at render scale 1, whose pixels are zeroed
+class Image
+{
+public:
+    explicit Image(const OfxRectI& bounds);
+
+    ~Image();
+
+    OFX::Image* get() { return _image.get(); }
+
+    const OfxRectI& getBounds() const { return _bounds; }
+
+    float* getPixelData() { return _pixels.empty() ? NULL : &_pixels[0]; }
+
+    const std::vector<float>& getPixels() const { return _pixels; }
+
+private:
+    OfxRectI _bounds;
+    std::vector<float> _pixels;
+    std::unique_ptr<PropertySet> _props;
+    std::unique_ptr<OFX::Image> _image; // released before its properties
+};
+} // namespace BenchmarkHost
+} // namespace OFX
+
+#endif // openfx_supportext_ofxsBenchmarkHost_h
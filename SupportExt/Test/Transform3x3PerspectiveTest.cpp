@@ -0,0 +1,187 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; -*- */
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/NatronGitHub/openfx-supportext>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Transform3x3PerspectiveTest: check the error bound of the interpolated spans of perspective transforms.
+ * Random homographies, some of them with a horizon (z = 0) crossing the image, are applied to the rows of a 4K
+ * image in spans of several lengths. Wherever ofxsTransform3x3PerspectiveSpan() accepts a span, z must be positive
+ * over it, and the source coordinates interpolated as in Transform3x3Processor must stay within
+ * kTransform3x3ProcessorPerspectiveMaxError pixels of the exact projection.
+ * Returns 0 if all the spans pass.
+ */
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include "ofxsTransform3x3Processor.h"
+
+using namespace OFX;
+
+#define kImageWidth 3840
+#define kImageHeight 2160
+#define kHomographyCount 1000
+#define kRowCount 24
+#define kNearHorizon 64. // spans that start closer than this to the horizon, in pixels, are counted separately
+
+namespace {
+// a reproducible uniform random number in [a,b)
+class Random
+{
+public:
+    Random()
+        : _state(0x853c49e6748fea9bULL)
+    {
+    }
+
+    double uniform(double a,
+                   double b)
+    {
+        _state = _state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+        return a + (b - a) * ( (_state >> 11) * (1. / 9007199254740992.) );
+    }
+
+private:
+    unsigned long long _state;
+};
+
+// a random homography: a rotation, an anisotropic scale and a translation, with a perspective row.
+// If horizon is true, the horizon crosses the row cy at x = xHorizon.
+Matrix3x3
+randomHomography(Random& r,
+                 bool horizon,
+                 double cy,
+                 double xHorizon)
+{
+    const double angle = r.uniform(-M_PI, M_PI);
+    const double sx = std::exp( r.uniform( std::log(0.25), std::log(4.) ) );
+    const double sy = std::exp( r.uniform( std::log(0.25), std::log(4.) ) );
+    Matrix3x3 H( sx * std::cos(angle), -sx * std::sin(angle), r.uniform(-2000., 2000.),
+                 sy * std::sin(angle),  sy * std::cos(angle), r.uniform(-2000., 2000.),
+                 r.uniform(-2e-3, 2e-3), r.uniform(-2e-3, 2e-3), 1. );
+
+    if (horizon) {
+        // z = H(2,0) * x + H(2,1) * y + H(2,2) vanishes at (xHorizon, cy)
+        H(2,2) = -H(2,0) * (xHorizon + 0.5) - H(2,1) * cy;
+    }
+
+    return H;
+}
+
+struct SpanStats
+{
+    long accepted;
+    long rejected;
+    long acceptedNearHorizon;
+    long testedNearHorizon;
+    double worstError;
+    bool ok;
+};
+
+// check the spans of a row of a homography
+void
+checkRow(const Matrix3x3& H,
+         double cy,
+         int spanLength,
+         const double* xHorizon, //!< NULL if there is no horizon
+         SpanStats* stats)
+{
+    for (int x = 0; x < kImageWidth; x += spanLength) {
+        const int spanEnd = (std::min)(x + spanLength, kImageWidth);
+        if (spanEnd - x < 2) {
+            continue;
+        }
+        const bool nearHorizon = xHorizon && (std::min)( std::abs(x - *xHorizon), std::abs(spanEnd - *xHorizon) ) < kNearHorizon;
+        if (nearHorizon) {
+            ++stats->testedNearHorizon;
+        }
+        Point3D t0, t1;
+        if ( !ofxsTransform3x3PerspectiveSpan(H, cy, x, spanEnd, &t0, &t1) ) {
+            ++stats->rejected;
+            continue;
+        }
+        ++stats->accepted;
+        if (nearHorizon) {
+            ++stats->acceptedNearHorizon;
+        }
+        // the interpolation of Transform3x3Processor::processPerspectiveSpan
+        const double fx0 = t0.x / t0.z;
+        const double fy0 = t0.y / t0.z;
+        const double dfx = (t1.x / t1.z - fx0) / (spanEnd - x);
+        const double dfy = (t1.y / t1.z - fy0) / (spanEnd - x);
+        for (int i = 0; x + i <= spanEnd; ++i) {
+            const Point3D p = H * Point3D(x + i + 0.5, cy, 1.);
+            if (p.z <= 0.) {
+                std::printf("span [%d,%d) of row %g accepted with z = %g at pixel %d  FAILED\n", x, spanEnd, cy, p.z, x + i);
+                stats->ok = false;
+                break;
+            }
+            const double error = (std::max)( std::abs(fx0 + i * dfx - p.x / p.z), std::abs(fy0 + i * dfy - p.y / p.z) );
+            // allow for the rounding errors of coordinates of up to a few thousand pixels
+            const double tolerance = kTransform3x3ProcessorPerspectiveMaxError + 1e-9 * (std::max)( std::abs(p.x / p.z), std::abs(p.y / p.z) );
+            stats->worstError = (std::max)(stats->worstError, error);
+            if (error > tolerance) {
+                std::printf("span [%d,%d) of row %g deviates by %g pixels at pixel %d  FAILED\n", x, spanEnd, cy, error, x + i);
+                stats->ok = false;
+                break;
+            }
+        }
+    }
+}
+} // namespace
+
+int
+main()
+{
+    static const int spanLengths[] = {2, 4, kTransform3x3ProcessorPerspectiveSpan, 64};
+    Random r;
+    bool ok = true;
+
+    for (size_t l = 0; l < sizeof(spanLengths) / sizeof(spanLengths[0]); ++l) {
+        for (int horizon = 0; horizon < 2; ++horizon) {
+            SpanStats stats = {0, 0, 0, 0, 0., true};
+            for (int h = 0; h < kHomographyCount && stats.ok; ++h) {
+                const double cy = std::floor( r.uniform(0., kImageHeight) ) + 0.5;
+                const double xHorizon = r.uniform(0., kImageWidth);
+                const Matrix3x3 H = randomHomography(r, horizon != 0, cy, xHorizon);
+                if (horizon) {
+                    // the row of the horizon, and the rows around it
+                    for (int dy = -2; dy <= 2; ++dy) {
+                        checkRow(H, cy + dy, spanLengths[l], dy == 0 ? &xHorizon : NULL, &stats);
+                    }
+                } else {
+                    for (int row = 0; row < kRowCount; ++row) {
+                        checkRow(H, (row + 0.5) * kImageHeight / kRowCount, spanLengths[l], NULL, &stats);
+                    }
+                }
+            }
+            // the sweep must exercise both outcomes, and the horizon cases must come close to z = 0
+            const bool exercised = (stats.accepted > 0) && (stats.rejected > 0) && (!horizon || stats.testedNearHorizon > 0);
+            std::printf("span %2d, %s: %ld spans interpolated (%ld of %ld near the horizon), %ld computed exactly, worst error %.3g%s\n",
+                        spanLengths[l], horizon ? "horizon in the image" : "random", stats.accepted, stats.acceptedNearHorizon,
+                        stats.testedNearHorizon, stats.rejected, stats.worstError, (stats.ok && exercised) ? "" : "  FAILED");
+            ok = ok && stats.ok && exercised;
+        }
+    }
+
+    return ok ? 0 : 1;
+} // main
@@ -28,6 +28,8 @@
 #include <windows.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#else
+#include <sys/stat.h>
 #endif
 
 #include <fstream>
@@ -109,4 +111,34 @@ fopen_utf8(const char* path_utf8,
     return std::fopen (path_utf8, mode);
 #endif
 }
+
+// get the modification time (in seconds since the epoch) and the size of a file.
+// returns true upon success
+bool
+stat_utf8(const char* path_utf8,
+          long long* mtime,
+          long long* size)
+{
+#ifdef _WIN32
+    // on Windows stat does not accept UTF-8 paths, so we convert to wide char
+    wstring wpath = utf8_to_utf16 (path_utf8);
+    struct _stat64 st;
+    if (::_wstat64 ( wpath.c_str(), &st ) != 0) {
+        return false;
+    }
+#else
+    struct stat st;
+    if (::stat (path_utf8, &st) != 0) {
+        return false;
+    }
+#endif
+    if (mtime) {
+        *mtime = (long long)st.st_mtime;
+    }
+    if (size) {
+        *size = (long long)st.st_size;
+    }
+
+    return true;
+}
 } // namespace OFX
@@ -38,6 +38,7 @@ std::string utf16_to_utf8 (const std::wstring& str);
 bool exists_utf8(const char* path_utf8);
 int remove_utf8(const char* path_utf8);
 std::FILE* fopen_utf8(const char* path, const char* mode);
+bool stat_utf8(const char* path_utf8, long long* mtime, long long* size);
 
 } // namespace OFX
 #endif /* defined(openfx_supportext_ofxsFileOpen_h) */
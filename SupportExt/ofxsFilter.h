@@ -27,8 +27,15 @@
 
 #include <cmath>
 #include <cassert>
+#include <cstddef>
 #include <algorithm>
 
+// SSE2 is available on all x86-64 CPUs, so that it needs no runtime detection
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OFXS_FILTER_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "ofxsImageEffect.h"
 
 namespace OFX {
@@ -190,6 +197,137 @@ ofxsFilterDescribeParamsInterpolate2D(OFX::ImageEffectDescriptor &desc,
    collect(subs({B=3/2,C=-1/4},R(d)),d);
    collect(subs({B=3/2,C=-1/4},R0(d)),d);
  */
+
+// The four channels of a pixel in float, processed together with SSE2, or one after the other where it is not
+// available. The interpolation formulas below are templates, so that the same code interpolates one channel in
+// double, or the four channels of a float RGBA pixel at once.
+struct OfxsFloat4
+{
+#ifdef OFXS_FILTER_SSE2
+    __m128 v;
+
+    OfxsFloat4() : v( _mm_setzero_ps() ) {}
+
+    explicit OfxsFloat4(__m128 a) : v(a) {}
+
+    explicit OfxsFloat4(double a) : v( _mm_set1_ps( (float)a ) ) {}
+
+    explicit OfxsFloat4(const float* p) : v( _mm_loadu_ps(p) ) {}
+
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+#else
+    float v[4];
+
+    OfxsFloat4() { v[0] = v[1] = v[2] = v[3] = 0.f; }
+
+    explicit OfxsFloat4(double a) { v[0] = v[1] = v[2] = v[3] = (float)a; }
+
+    explicit OfxsFloat4(const float* p) { v[0] = p[0]; v[1] = p[1]; v[2] = p[2]; v[3] = p[3]; }
+
+    void store(float* p) const { p[0] = v[0]; p[1] = v[1]; p[2] = v[2]; p[3] = v[3]; }
+
+#endif
+};
+
+#ifdef OFXS_FILTER_SSE2
+#define OFXS_FLOAT4_OP(op, sse) \
+    inline OfxsFloat4 operator op(const OfxsFloat4& a, const OfxsFloat4& b) { return OfxsFloat4( sse(a.v, b.v) ); }
+#define OFXS_FLOAT4_FUNC(f, sse) \
+    inline OfxsFloat4 f(const OfxsFloat4& a, const OfxsFloat4& b) { return OfxsFloat4( sse(a.v, b.v) ); }
+#else
+#define OFXS_FLOAT4_OP(op, sse) \
+    inline OfxsFloat4 operator op(const OfxsFloat4& a, const OfxsFloat4& b) \
+    { OfxsFloat4 r; for (int i = 0; i < 4; ++i) { r.v[i] = a.v[i] op b.v[i]; } return r; }
+#define OFXS_FLOAT4_FUNC(f, sse) \
+    inline OfxsFloat4 f(const OfxsFloat4& a, const OfxsFloat4& b) \
+    { OfxsFloat4 r; for (int i = 0; i < 4; ++i) { r.v[i] = (std::sse)(a.v[i], b.v[i]); } return r; }
+#endif
+OFXS_FLOAT4_OP(+, _mm_add_ps)
+OFXS_FLOAT4_OP(-, _mm_sub_ps)
+OFXS_FLOAT4_OP(*, _mm_mul_ps)
+#ifdef OFXS_FILTER_SSE2
+OFXS_FLOAT4_FUNC(ofxsFloat4Min, _mm_min_ps)
+OFXS_FLOAT4_FUNC(ofxsFloat4Max, _mm_max_ps)
+#else
+OFXS_FLOAT4_FUNC(ofxsFloat4Min, min)
+OFXS_FLOAT4_FUNC(ofxsFloat4Max, max)
+#endif
+#undef OFXS_FLOAT4_OP
+#undef OFXS_FLOAT4_FUNC
+
+inline OfxsFloat4 operator -(const OfxsFloat4& a) { return OfxsFloat4() - a; }
+
+inline OfxsFloat4 operator *(double a, const OfxsFloat4& b) { return OfxsFloat4(a) * b; }
+
+inline OfxsFloat4 operator /(const OfxsFloat4& a, double b) { return a * OfxsFloat4(1. / b); }
+
+// the channels of a source pixel, or 0 outside of the image
+template <class PIX, int nComponents>
+inline OfxsFloat4
+ofxsFilterLoad4(const PIX* p)
+{
+    float v[4] = {0.f, 0.f, 0.f, 0.f};
+
+    if (p) {
+        for (int c = 0; c < nComponents && c < 4; ++c) {
+            v[c] = (float)p[c];
+        }
+    }
+
+    return OfxsFloat4(v);
+}
+
+template <>
+inline OfxsFloat4
+ofxsFilterLoad4<float, 4>(const float* p)
+{
+    return p ? OfxsFloat4(p) : OfxsFloat4();
+}
+
+// store the channels of an interpolated pixel
+template <int nComponents>
+inline void
+ofxsFilterStore4(const OfxsFloat4& I,
+                 float* tmpPix)
+{
+    float v[4];
+
+    I.store(v);
+    for (int c = 0; c < nComponents && c < 4; ++c) {
+        tmpPix[c] = v[c];
+    }
+}
+
+template <>
+inline void
+ofxsFilterStore4<4>(const OfxsFloat4& I,
+                    float* tmpPix)
+{
+    I.store(tmpPix);
+}
+
+// the float pixel formats whose channels are interpolated together
+template <class PIX, int nComponents>
+struct OfxsFilterFloat4
+{
+    static const bool value = false;
+};
+
+template <>
+struct OfxsFilterFloat4<float, 4>
+{
+    static const bool value = true;
+};
+
+inline OfxsFloat4
+ofxsFilterClampVal(const OfxsFloat4& I,
+                   const OfxsFloat4& Ic,
+                   const OfxsFloat4& In)
+{
+    return ofxsFloat4Max( ofxsFloat4Min( I, ofxsFloat4Max(Ic, In) ), ofxsFloat4Min(Ic, In) );
+}
+
 inline double
 ofxsFilterClampVal(double I,
                    double Ic,
@@ -208,23 +346,25 @@ ofxsFilterClampVal(double I,
     return I;
 }
 
+template <class T>
 inline
-double
-ofxsFilterLinear(double Ic,
-                 double In,
-                 double d)
+T
+ofxsFilterLinear(const T& Ic,
+                 const T& In,
+                 const T& d)
 {
     return Ic + d * (In - Ic);
 }
 
+template <class T>
 static inline
-double
-ofxsFilterCubic(double Ic,
-                double In,
-                double d,
+T
+ofxsFilterCubic(const T& Ic,
+                const T& In,
+                const T& d,
                 bool clamp)
 {
-    double I = Ic + d * d * ( (-3 * Ic + 3 * In ) + d * (2 * Ic - 2 * In ) );
+    T I = Ic + d * d * ( (-3 * Ic + 3 * In ) + d * (2 * Ic - 2 * In ) );
 
     if (clamp) {
         I = ofxsFilterClampVal(I, Ic, In);
@@ -233,16 +373,17 @@ ofxsFilterCubic(double Ic,
     return I;
 }
 
+template <class T>
 inline
-double
-ofxsFilterKeys(double Ip,
-               double Ic,
-               double In,
-               double Ia,
-               double d,
+T
+ofxsFilterKeys(const T& Ip,
+               const T& Ic,
+               const T& In,
+               const T& Ia,
+               const T& d,
                bool clamp)
 {
-    double I = Ic  + d * ( (-Ip + In ) + d * ( (2 * Ip - 5 * Ic + 4 * In - Ia ) + d * (-Ip + 3 * Ic - 3 * In + Ia ) ) ) / 2;
+    T I = Ic  + d * ( (-Ip + In ) + d * ( (2 * Ip - 5 * Ic + 4 * In - Ia ) + d * (-Ip + 3 * Ic - 3 * In + Ia ) ) ) / 2;
 
     if (clamp) {
         I = ofxsFilterClampVal(I, Ic, In);
@@ -251,16 +392,17 @@ ofxsFilterKeys(double Ip,
     return I;
 }
 
+template <class T>
 inline
-double
-ofxsFilterSimon(double Ip,
-                double Ic,
-                double In,
-                double Ia,
-                double d,
+T
+ofxsFilterSimon(const T& Ip,
+                const T& Ic,
+                const T& In,
+                const T& Ia,
+                const T& d,
                 bool clamp)
 {
-    double I = Ic  + d * ( (-3 * Ip + 3 * In ) + d * ( (6 * Ip - 9 * Ic + 6 * In - 3 * Ia ) + d * (-3 * Ip + 5 * Ic - 5 * In + 3 * Ia ) ) ) / 4;
+    T I = Ic  + d * ( (-3 * Ip + 3 * In ) + d * ( (6 * Ip - 9 * Ic + 6 * In - 3 * Ia ) + d * (-3 * Ip + 5 * Ic - 5 * In + 3 * Ia ) ) ) / 4;
 
     if (clamp) {
         I = ofxsFilterClampVal(I, Ic, In);
@@ -269,16 +411,17 @@ ofxsFilterSimon(double Ip,
     return I;
 }
 
+template <class T>
 inline
-double
-ofxsFilterRifman(double Ip,
-                 double Ic,
-                 double In,
-                 double Ia,
-                 double d,
+T
+ofxsFilterRifman(const T& Ip,
+                 const T& Ic,
+                 const T& In,
+                 const T& Ia,
+                 const T& d,
                  bool clamp)
 {
-    double I = Ic  + d * ( (-Ip + In ) + d * ( (2 * Ip - 2 * Ic + In - Ia ) + d * (-Ip + Ic - In + Ia ) ) );
+    T I = Ic  + d * ( (-Ip + In ) + d * ( (2 * Ip - 2 * Ic + In - Ia ) + d * (-Ip + Ic - In + Ia ) ) );
 
     if (clamp) {
         I = ofxsFilterClampVal(I, Ic, In);
@@ -287,16 +430,17 @@ ofxsFilterRifman(double Ip,
     return I;
 }
 
+template <class T>
 inline
-double
-ofxsFilterMitchell(double Ip,
-                   double Ic,
-                   double In,
-                   double Ia,
-                   double d,
+T
+ofxsFilterMitchell(const T& Ip,
+                   const T& Ic,
+                   const T& In,
+                   const T& Ia,
+                   const T& d,
                    bool clamp)
 {
-    double I = ( Ip + 16 * Ic + In + d * ( (-9 * Ip + 9 * In ) + d * ( (15 * Ip - 36 * Ic + 27 * In - 6 * Ia ) + d * (-7 * Ip + 21 * Ic - 21 * In + 7 * Ia ) ) ) ) / 18;
+    T I = ( Ip + 16 * Ic + In + d * ( (-9 * Ip + 9 * In ) + d * ( (15 * Ip - 36 * Ic + 27 * In - 6 * Ia ) + d * (-7 * Ip + 21 * Ic - 21 * In + 7 * Ia ) ) ) ) / 18;
 
     if (clamp) {
         I = ofxsFilterClampVal(I, Ic, In);
@@ -305,31 +449,33 @@ ofxsFilterMitchell(double Ip,
     return I;
 }
 
+template <class T>
 inline
-double
-ofxsFilterParzen(double Ip,
-                 double Ic,
-                 double In,
-                 double Ia,
-                 double d,
+T
+ofxsFilterParzen(const T& Ip,
+                 const T& Ic,
+                 const T& In,
+                 const T& Ia,
+                 const T& d,
                  bool /*clamp*/)
 {
-    double I = ( Ip + 4 * Ic + In + d * ( (-3 * Ip + 3 * In ) + d * ( (3 * Ip - 6 * Ic + 3 * In ) + d * (-Ip + 3 * Ic - 3 * In + Ia ) ) ) ) / 6;
+    T I = ( Ip + 4 * Ic + In + d * ( (-3 * Ip + 3 * In ) + d * ( (3 * Ip - 6 * Ic + 3 * In ) + d * (-Ip + 3 * Ic - 3 * In + Ia ) ) ) ) / 6;
 
     // clamp is not necessary for Parzen
     return I;
 }
 
+template <class T>
 inline
-double
-ofxsFilterNotch(double Ip,
-                double Ic,
-                double In,
-                double Ia,
-                double d,
+T
+ofxsFilterNotch(const T& Ip,
+                const T& Ic,
+                const T& In,
+                const T& Ia,
+                const T& d,
                 bool /*clamp*/)
 {
-    double I = ( Ip + 2 * Ic + In + d * ( (-2 * Ip + 2 * In ) + d * ( (Ip - Ic - In + Ia ) ) ) ) / 4;
+    T I = ( Ip + 2 * Ic + In + d * ( (-2 * Ip + 2 * In ) + d * ( (Ip - Ic - In + Ia ) ) ) ) / 4;
 
     // clamp is not necessary for Notch
     return I;
@@ -609,16 +755,17 @@ ofxsFilterResize2d(const PIX* a, // pointer to data start
 /////////////////////////////////////////////////
 
 
-#define OFXS_APPLY4(f, j) double I ## j = f(Ip ## j, Ic ## j, In ## j, Ia ## j, dx, clamp)
+#define OFXS_APPLY4(f, j) T I ## j = f(Ip ## j, Ic ## j, In ## j, Ia ## j, dx, clamp)
 
 #define OFXS_CUBIC2D(f)                                      \
-    inline                                           \
-    double                                                  \
-    f ## 2D (double Ipp, double Icp, double Inp, double Iap, \
-             double Ipc, double Icc, double Inc, double Iac, \
-             double Ipn, double Icn, double Inn, double Ian, \
-             double Ipa, double Ica, double Ina, double Iaa, \
-             double dx, double dy, bool clamp)               \
+    template <class T>                                      \
+    inline                                                  \
+    T                                                       \
+    f ## 2D (const T& Ipp, const T& Icp, const T& Inp, const T& Iap, \
+             const T& Ipc, const T& Icc, const T& Inc, const T& Iac, \
+             const T& Ipn, const T& Icn, const T& Inn, const T& Ian, \
+             const T& Ipa, const T& Ica, const T& Ina, const T& Iaa, \
+             const T& dx, const T& dy, bool clamp)          \
     {                                                       \
         OFXS_APPLY4(f, p); OFXS_APPLY4(f, c); OFXS_APPLY4(f, n); OFXS_APPLY4(f, a); \
         return f(Ip, Ic, In, Ia, dy, clamp);            \
@@ -642,19 +789,59 @@ ofxsGetPixComp(const PIX* p,
     return p ? p[c] : PIX();
 }
 
+// A view of the pixels of a source image, to read the taps that are known to be inside of it: their address is
+// computed from the row and pixel strides, without the bounds checks of OFX::Image::getPixelAddress. Only the
+// pixels whose footprint crosses the border of the image need those, and the clamping of the taps.
+struct OfxsFilterSourceView
+{
+    const char* data;     //!< address of the pixel at (bounds.x1, bounds.y1), or NULL
+    OfxRectI bounds;
+    ptrdiff_t rowBytes;   //!< may be negative
+    ptrdiff_t pixelBytes;
+
+    explicit OfxsFilterSourceView(const OFX::Image* img)
+        : data( (const char*)img->getPixelData() )
+        , bounds( img->getBounds() )
+        , rowBytes( img->getRowBytes() )
+        , pixelBytes( img->getPixelBytes() )
+    {
+    }
+
+    // true if all the pixels from (x1,y1) to (x2,y2) included are in the image
+    bool contains(int x1,
+                  int y1,
+                  int x2,
+                  int y2) const
+    {
+        return data && bounds.x1 <= x1 && x2 < bounds.x2 && bounds.y1 <= y1 && y2 < bounds.y2;
+    }
+
+    // the address of a pixel that is in the image
+    template <class PIX>
+    PIX* pixel(int x,
+               int y) const
+    {
+        return (PIX*)( data + (y - bounds.y1) * rowBytes + (x - bounds.x1) * pixelBytes );
+    }
+};
+
 // Macros used in ofxsFilterInterpolate2D
 #define OFXS_CLAMPXY(m) \
     m ## x = (std::max)( srcImg->getBounds().x1, (std::min)(m ## x, srcImg->getBounds().x2 - 1) ); \
     m ## y = (std::max)( srcImg->getBounds().y1, (std::min)(m ## y, srcImg->getBounds().y2 - 1) )
 
-#define OFXS_GETPIX(i, j) PIX * P ## i ## j = (PIX *)srcImg->getPixelAddress(i ## x, j ## y)
+#define OFXS_GETPIX(i, j) PIX * P ## i ## j = interior ? view.pixel<PIX>(i ## x, j ## y) : (PIX *)srcImg->getPixelAddress(i ## x, j ## y)
 
 #define OFXS_GETI(i, j)   const double I ## i ## j = ofxsGetPixComp(P ## i ## j, c)
 
+#define OFXS_GETV(i, j)   const OfxsFloat4 I ## i ## j = ofxsFilterLoad4<PIX, nComponents>(P ## i ## j)
+
 #define OFXS_GETPIX4(i)  OFXS_GETPIX(i, p); OFXS_GETPIX(i, c); OFXS_GETPIX(i, n); OFXS_GETPIX(i, a);
 
 #define OFXS_GETI4(i)    OFXS_GETI(i, p); OFXS_GETI(i, c); OFXS_GETI(i, n); OFXS_GETI(i, a);
 
+#define OFXS_GETV4(i)    OFXS_GETV(i, p); OFXS_GETV(i, c); OFXS_GETV(i, n); OFXS_GETV(i, a);
+
 
 #define OFXS_I44         Ipp, Icp, Inp, Iap, \
     Ipc, Icc, Inc, Iac, \
@@ -678,6 +865,7 @@ ofxsFilterInterpolate2D(double fx,
         return false;
     }
     bool inside = true; // return true, except if outside and black
+    const OfxsFilterSourceView view(srcImg);
     // GENERIC TRANSFORM
     // from here on, everything is generic, and should be moved to a generic transform class
     // Important: (0,0) is the *corner*, not the *center* of the first pixel (see OpenFX specs)
@@ -688,8 +876,9 @@ ofxsFilterInterpolate2D(double fx,
         // the center of pixel (0,0) has coordinates (0.5,0.5)
         int mx = (int)std::floor(fx);     // don't add 0.5
         int my = (int)std::floor(fy);     // don't add 0.5
+        const bool interior = view.contains(mx, my, mx, my);
 
-        if (!blackOutside) {
+        if (!blackOutside && !interior) {
             OFXS_CLAMPXY(m);
         }
         OFXS_GETPIX(m, m);
@@ -713,7 +902,9 @@ ofxsFilterInterpolate2D(double fx,
         int cy = (int)std::floor(fy - 0.5);
         int nx = cx + 1;
         int ny = cy + 1;
-        if (!blackOutside) {
+        // the taps of the pixels that are not near the border are read without any check
+        const bool interior = view.contains(cx, cy, nx, ny);
+        if (!blackOutside && !interior) {
             OFXS_CLAMPXY(c);
             OFXS_CLAMPXY(n);
         }
@@ -722,7 +913,17 @@ ofxsFilterInterpolate2D(double fx,
         const double dy = (std::max)( 0., (std::min)(fy - 0.5 - cy, 1.) );
 
         OFXS_GETPIX(c, c); OFXS_GETPIX(n, c); OFXS_GETPIX(c, n); OFXS_GETPIX(n, n);
-        if (Pcc || Pnc || Pcn || Pnn) {
+        if ( (Pcc || Pnc || Pcn || Pnn) && OfxsFilterFloat4<PIX, nComponents>::value ) {
+            // all the channels at once, in float
+            OFXS_GETV(c, c); OFXS_GETV(n, c); OFXS_GETV(c, n); OFXS_GETV(n, n);
+            const OfxsFloat4 dx4(dx);
+            const OfxsFloat4 dy4(dy);
+            if (filter == eFilterBilinear) {
+                ofxsFilterStore4<nComponents>(ofxsFilterLinear(ofxsFilterLinear(Icc, Inc, dx4), ofxsFilterLinear(Icn, Inn, dx4), dy4), tmpPix);
+            } else {
+                ofxsFilterStore4<nComponents>(ofxsFilterCubic(ofxsFilterCubic(Icc, Inc, dx4, clamp), ofxsFilterCubic(Icn, Inn, dx4, clamp), dy4, clamp), tmpPix);
+            }
+        } else if (Pcc || Pnc || Pcn || Pnn) {
             for (int c = 0; c < nComponents; ++c) {
                 OFXS_GETI(c, c); OFXS_GETI(n, c); OFXS_GETI(c, n); OFXS_GETI(n, n);
                 if (filter == eFilterBilinear) {
@@ -762,7 +963,9 @@ ofxsFilterInterpolate2D(double fx,
         int ny = cy + 1;
         int ax = cx + 2;
         int ay = cy + 2;
-        if (!blackOutside) {
+        // the taps of the pixels that are not near the border are read without any check
+        const bool interior = view.contains(px, py, ax, ay);
+        if (!blackOutside && !interior) {
             OFXS_CLAMPXY(c);
             OFXS_CLAMPXY(p);
             OFXS_CLAMPXY(n);
@@ -772,7 +975,37 @@ ofxsFilterInterpolate2D(double fx,
         const double dy = (std::max)( 0., (std::min)(fy - 0.5 - cy, 1.) );
 
         OFXS_GETPIX4(p); OFXS_GETPIX4(c); OFXS_GETPIX4(n); OFXS_GETPIX4(a);
-        if (Ppp || Pcp || Pnp || Pap || Ppc || Pcc || Pnc || Pac || Ppn || Pcn || Pnn || Pan || Ppa || Pca || Pna || Paa) {
+        const bool any = (Ppp || Pcp || Pnp || Pap || Ppc || Pcc || Pnc || Pac || Ppn || Pcn || Pnn || Pan || Ppa || Pca || Pna || Paa);
+        if ( any && OfxsFilterFloat4<PIX, nComponents>::value ) {
+            // all the channels at once, in float
+            OFXS_GETV4(p); OFXS_GETV4(c); OFXS_GETV4(n); OFXS_GETV4(a);
+            const OfxsFloat4 dx4(dx);
+            const OfxsFloat4 dy4(dy);
+            OfxsFloat4 I;
+            switch (filter) {
+            case eFilterKeys:
+                I = ofxsFilterKeys2D(OFXS_I44, dx4, dy4, clamp);
+                break;
+            case eFilterSimon:
+                I = ofxsFilterSimon2D(OFXS_I44, dx4, dy4, clamp);
+                break;
+            case eFilterRifman:
+                I = ofxsFilterRifman2D(OFXS_I44, dx4, dy4, clamp);
+                break;
+            case eFilterMitchell:
+                I = ofxsFilterMitchell2D(OFXS_I44, dx4, dy4, clamp);
+                break;
+            case eFilterParzen:
+                I = ofxsFilterParzen2D(OFXS_I44, dx4, dy4, false);
+                break;
+            case eFilterNotch:
+                I = ofxsFilterNotch2D(OFXS_I44, dx4, dy4, false);
+                break;
+            default:
+                assert(0);
+            }
+            ofxsFilterStore4<nComponents>(I, tmpPix);
+        } else if (any) {
             for (int c = 0; c < nComponents; ++c) {
                 //double Ipp = get(Ppp,c);, etc.
                 OFXS_GETI4(p); OFXS_GETI4(c); OFXS_GETI4(n); OFXS_GETI4(a);
@@ -818,6 +1051,186 @@ ofxsFilterInterpolate2D(double fx,
     return inside;
 } // ofxsFilterInterpolate2D
 
+// number of taps along each axis of the separable filters
+inline int
+ofxsFilterTapsCount(FilterEnum filter)
+{
+    switch (filter) {
+    case eFilterBilinear:
+    case eFilterCubic:
+
+        return 2;
+    case eFilterKeys:
+    case eFilterSimon:
+    case eFilterRifman:
+    case eFilterMitchell:
+    case eFilterParzen:
+    case eFilterNotch:
+
+        return 4;
+    default:
+
+        return 0;
+    }
+}
+
+// The taps of a separable filter along one axis, for a given source coordinate.
+// If the transform is axis-aligned, the source x only depends on the output column and the source y only depends on
+// the output row: the taps of all the columns and of all the rows can be computed once per render, and each pixel is
+// then a small dot product (see ofxsFilterInterpolate2DSeparable), instead of an evaluation of the filter polynomial
+// for each tap.
+struct OfxsFilterTaps
+{
+    int index[4];     //!< source pixel coordinate of each tap
+    bool inside[4];   //!< false if the tap is outside of the source image (i.e. black)
+    double weight[4]; //!< weight of each tap
+};
+
+// the taps of the Bilinear, Cubic and (B,C) cubic filters at coordinate f, in an image that spans [b1,b2) along that axis.
+// The result is the same as in ofxsFilterInterpolate2D.
+template <FilterEnum filter>
+void
+ofxsFilterGetTaps(double f,
+                  int b1,
+                  int b2,
+                  bool blackOutside,
+                  OfxsFilterTaps* taps)
+{
+    const int n = ofxsFilterTapsCount(filter);
+
+    assert(n > 0);
+    // the center of pixel (0,0) has coordinates (0.5,0.5)
+    const int c = (int)std::floor(f - 0.5);
+    // as in ofxsFilterInterpolate2D, the phase is relative to the center tap after clamping
+    const int cclamped = blackOutside ? c : (std::max)( b1, (std::min)(c, b2 - 1) );
+    const double d = (std::max)( 0., (std::min)(f - 0.5 - cclamped, 1.) );
+    const int ic = (n == 2) ? 0 : 1; // index of the tap before f
+    for (int k = 0; k < n; ++k) {
+        int i = c - ic + k;
+        if (!blackOutside) {
+            i = (std::max)( b1, (std::min)(i, b2 - 1) );
+        }
+        taps->index[k] = i;
+        taps->inside[k] = (b1 <= i && i < b2);
+    }
+    // the filters are linear in the pixel values: the weight of a tap is the filter of an impulse on that tap
+    for (int k = 0; k < n; ++k) {
+        const double Ip = (n == 4 && k == 0) ? 1. : 0.;
+        const double Ic = (k == ic) ? 1. : 0.;
+        const double In = (k == ic + 1) ? 1. : 0.;
+        const double Ia = (n == 4 && k == 3) ? 1. : 0.;
+        double w = 0.;
+        switch (filter) {
+        case eFilterBilinear:
+            w = ofxsFilterLinear(Ic, In, d);
+            break;
+        case eFilterCubic:
+            w = ofxsFilterCubic(Ic, In, d, false);
+            break;
+        case eFilterKeys:
+            w = ofxsFilterKeys(Ip, Ic, In, Ia, d, false);
+            break;
+        case eFilterSimon:
+            w = ofxsFilterSimon(Ip, Ic, In, Ia, d, false);
+            break;
+        case eFilterRifman:
+            w = ofxsFilterRifman(Ip, Ic, In, Ia, d, false);
+            break;
+        case eFilterMitchell:
+            w = ofxsFilterMitchell(Ip, Ic, In, Ia, d, false);
+            break;
+        case eFilterParzen:
+            w = ofxsFilterParzen(Ip, Ic, In, Ia, d, false);
+            break;
+        case eFilterNotch:
+            w = ofxsFilterNotch(Ip, Ic, In, Ia, d, false);
+            break;
+        default:
+            assert(0);
+            break;
+        }
+        taps->weight[k] = w;
+    }
+} // ofxsFilterGetTaps
+
+// Interpolation with the precomputed taps of a separable filter: the same result as ofxsFilterInterpolate2D at the
+// coordinates of the taps.
+// rows[j] is the address of the pixel at x = x1 in the source row yTaps.index[j], or NULL if that row is outside.
+// Returns false if all the taps are outside of the source image.
+template <class PIX, int nComponents, FilterEnum filter, bool clamp>
+bool
+ofxsFilterInterpolate2DSeparable(const OfxsFilterTaps& xTaps,
+                                 const OfxsFilterTaps& yTaps,
+                                 int x1,
+                                 const PIX* const* rows,
+                                 float *tmpPix) //!< destination pixel in float format
+{
+    const int n = ofxsFilterTapsCount(filter);
+    // index of the tap before the coordinate, between which and the next the result is clamped
+    const int ic = (n == 2) ? 0 : 1;
+    // Bilinear never overshoots, and Parzen and Notch are not clamped (see ofxsFilterInterpolate2D)
+    const bool clampTaps = clamp && (filter != eFilterBilinear) && (filter != eFilterParzen) && (filter != eFilterNotch);
+    const PIX* P[4][4];
+    bool any = false;
+
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            P[j][i] = (rows[j] && xTaps.inside[i]) ? rows[j] + (xTaps.index[i] - x1) * nComponents : NULL;
+            any = any || P[j][i];
+        }
+    }
+    if (!any) {
+        for (int c = 0; c < nComponents; ++c) {
+            tmpPix[c] = 0;
+        }
+
+        return false;
+    }
+    if ( OfxsFilterFloat4<PIX, nComponents>::value ) {
+        // all the channels at once, in float
+        OfxsFloat4 Irow[4];
+        for (int j = 0; j < n; ++j) {
+            OfxsFloat4 I[4];
+            for (int i = 0; i < n; ++i) {
+                I[i] = ofxsFilterLoad4<PIX, nComponents>(P[j][i]);
+            }
+            OfxsFloat4 sum = xTaps.weight[0] * I[0];
+            for (int i = 1; i < n; ++i) {
+                sum = sum + xTaps.weight[i] * I[i];
+            }
+            Irow[j] = clampTaps ? ofxsFilterClampVal(sum, I[ic], I[ic + 1]) : sum;
+        }
+        OfxsFloat4 sum = yTaps.weight[0] * Irow[0];
+        for (int j = 1; j < n; ++j) {
+            sum = sum + yTaps.weight[j] * Irow[j];
+        }
+        ofxsFilterStore4<nComponents>(clampTaps ? ofxsFilterClampVal(sum, Irow[ic], Irow[ic + 1]) : sum, tmpPix);
+
+        return true;
+    }
+    for (int c = 0; c < nComponents; ++c) {
+        double Irow[4];
+        for (int j = 0; j < n; ++j) {
+            double I[4];
+            for (int i = 0; i < n; ++i) {
+                I[i] = ofxsGetPixComp(P[j][i], c);
+            }
+            double sum = 0.;
+            for (int i = 0; i < n; ++i) {
+                sum += xTaps.weight[i] * I[i];
+            }
+            Irow[j] = clampTaps ? ofxsFilterClampVal(sum, I[ic], I[ic + 1]) : sum;
+        }
+        double sum = 0.;
+        for (int j = 0; j < n; ++j) {
+            sum += yTaps.weight[j] * Irow[j];
+        }
+        tmpPix[c] = (float)(clampTaps ? ofxsFilterClampVal(sum, Irow[ic], Irow[ic + 1]) : sum);
+    }
+
+    return true;
+} // ofxsFilterInterpolate2DSeparable
+
 /*
  * Interpolation with SuperSampling, to avoid moire artifacts when minimizing.
  *
@@ -1064,6 +1477,85 @@ ofxsFilterOutside(double x,
     return x < bounds.x1 || bounds.x2 <= x || y < bounds.y1 || bounds.y2 <= y;
 }
 
+// Supersampling for minification, around the center value already interpolated in tmpPix, e.g. by
+// ofxsFilterInterpolate2D or ofxsFilterInterpolate2DSeparable
+// note that the center of pixel (0,0) has pixel coordinates (0.5,0.5)
+template <class PIX, int nComponents, FilterEnum filter, bool clamp>
+void
+ofxsFilterSupersample(double fx,
+                      double fy,            //!< coordinates of the pixel to be interpolated in srcImg in pixel coordinates
+                      double Jxx, //!< derivative of fx over x
+                      double Jxy, //!< derivative of fx over y
+                      double Jyx, //!< derivative of fy over x
+                      double Jyy, //!< derivative of fy over y
+                      const OFX::Image *srcImg, //!< image to be transformed
+                      bool blackOutside,
+                      bool inside, //!< false if the center value is outside of srcImg
+                      float *tmpPix) //!< input: interpolated center value. output: destination pixel in float format
+{
+    if (!inside) {
+        // Center of the pixel is outside.
+        // no supersampling if we're outside (we don't want to supersample black and transparent areas)
+        // ... but we still have to check wether the entire pixel is outside
+        const OfxRectI &bounds = srcImg->getBounds();
+        // we check the four corners of the pixel
+        if ( ofxsFilterOutside(fx - Jxx * 0.5 - Jxy * 0.5, fy - Jyx * 0.5 - Jyy * 0.5, bounds) &&
+             ofxsFilterOutside(fx + Jxx * 0.5 - Jxy * 0.5, fy + Jyx * 0.5 - Jyy * 0.5, bounds) &&
+             ofxsFilterOutside(fx - Jxx * 0.5 + Jxy * 0.5, fy - Jyx * 0.5 + Jyy * 0.5, bounds) &&
+             ofxsFilterOutside(fx + Jxx * 0.5 + Jxy * 0.5, fy + Jyx * 0.5 + Jyy * 0.5, bounds) ) {
+            return;
+        }
+    }
+
+    double dx = Jxx * Jxx + Jyx * Jyx; // squared norm of the derivative over x
+    double dy = Jxy * Jxy + Jyy * Jyy; // squared norm of the derivative over x
+
+    if ( (dx <= 1.) && (dy <= 1.) ) {
+        // no minificationin either direction, means no supersampling
+        return;
+    }
+
+    // maximum scale is 4, which is 81x81 pixels for a scale factor < 1/81
+    // rather than taking sqrt(dx), we divide its log by 2
+    double sx = (dx <= 1.) ? 0. : (std::min)(std::log(dx) / ( 2 * std::log(3.) ), 4.); // scale over x as a power of 3
+    double sy = (dy <= 1.) ? 0. : (std::min)(std::log(dy) / ( 2 * std::log(3.) ), 4.); // scale over y as a power of 3
+//#define OFX_FILTER_SUPERSAMPLING_TRILINEAR
+#ifdef OFX_FILTER_SUPERSAMPLING_TRILINEAR
+    // produces artifacts
+    int isx = std::floor(sx);
+    int isy = std::floor(sy);
+    int subx = (sx > isx);
+    int suby = (sy > isy);
+
+    // we use bilinear filtering for the supersamples (except for the center point).
+    if (subx) {
+        if (suby) {
+            return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, true, true>(fx, fy, Jxx, Jxy, Jyx, Jyy, sx, sy, isx, isy, srcImg, blackOutside, tmpPix);
+        } else {
+            return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, true, false>(fx, fy, Jxx, Jxy, Jyx, Jyy, sx, sy, isx, isy, srcImg, blackOutside, tmpPix);
+        }
+    } else {
+        if (suby) {
+            return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, false, true>(fx, fy, Jxx, Jxy, Jyx, Jyy, sx, sy, isx, isy, srcImg, blackOutside, tmpPix);
+        } else {
+            return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, false, false>(fx, fy, Jxx, Jxy, Jyx, Jyy, sx, sy, isx, isy, srcImg, blackOutside, tmpPix);
+        }
+    }
+#else
+    // always use the supersampled data
+    // produces less artifacts, costs less
+    // the problem is that sx = 1.0001 is supersampled, which gives a result very different from sx=1
+    //int isx = std::ceil(sx);
+    //int isy = std::ceil(sy);
+    // This is why we prefer rounding. The jump will be at sx=sqrt(3)=1.732.
+    // This produces quicker renders too, since we supersample less.
+    int isx = (int)std::ceil(sx-0.5);
+    int isy = (int)std::ceil(sy-0.5);
+
+    return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, false, false>(fx, fy, Jxx, Jxy, Jyx, Jyy, isx, isy, isx, isy, srcImg, blackOutside, tmpPix);
+#endif
+} // ofxsFilterSupersample
+
 // Interpolation using the given filter and supersampling for minification
 // note that the center of pixel (0,0) has pixel coordinates (0.5,0.5)
 template <class PIX, int nComponents, FilterEnum filter, bool clamp>
@@ -1157,73 +1649,15 @@ ofxsFilterInterpolate2DSuper(double fx,
     // first, compute the center value
     bool inside = ofxsFilterInterpolate2D<PIX, nComponents, filter, clamp>(fx, fy, srcImg, blackOutside, tmpPix);
 
-    if (!inside) {
-        // Center of the pixel is outside.
-        // no supersampling if we're outside (we don't want to supersample black and transparent areas)
-        // ... but we still have to check wether the entire pixel is outside
-        const OfxRectI &bounds = srcImg->getBounds();
-        // we check the four corners of the pixel
-        if ( ofxsFilterOutside(fx - Jxx * 0.5 - Jxy * 0.5, fy - Jyx * 0.5 - Jyy * 0.5, bounds) &&
-             ofxsFilterOutside(fx + Jxx * 0.5 - Jxy * 0.5, fy + Jyx * 0.5 - Jyy * 0.5, bounds) &&
-             ofxsFilterOutside(fx - Jxx * 0.5 + Jxy * 0.5, fy - Jyx * 0.5 + Jyy * 0.5, bounds) &&
-             ofxsFilterOutside(fx + Jxx * 0.5 + Jxy * 0.5, fy + Jyx * 0.5 + Jyy * 0.5, bounds) ) {
-            return;
-        }
-    }
-
-    double dx = Jxx * Jxx + Jyx * Jyx; // squared norm of the derivative over x
-    double dy = Jxy * Jxy + Jyy * Jyy; // squared norm of the derivative over x
-
-    if ( (dx <= 1.) && (dy <= 1.) ) {
-        // no minificationin either direction, means no supersampling
-        return;
-    }
-
-    // maximum scale is 4, which is 81x81 pixels for a scale factor < 1/81
-    // rather than taking sqrt(dx), we divide its log by 2
-    double sx = (dx <= 1.) ? 0. : (std::min)(std::log(dx) / ( 2 * std::log(3.) ), 4.); // scale over x as a power of 3
-    double sy = (dy <= 1.) ? 0. : (std::min)(std::log(dy) / ( 2 * std::log(3.) ), 4.); // scale over y as a power of 3
-//#define OFX_FILTER_SUPERSAMPLING_TRILINEAR
-#ifdef OFX_FILTER_SUPERSAMPLING_TRILINEAR
-    // produces artifacts
-    int isx = std::floor(sx);
-    int isy = std::floor(sy);
-    int subx = (sx > isx);
-    int suby = (sy > isy);
-
-    // we use bilinear filtering for the supersamples (except for the center point).
-    if (subx) {
-        if (suby) {
-            return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, true, true>(fx, fy, Jxx, Jxy, Jyx, Jyy, sx, sy, isx, isy, srcImg, blackOutside, tmpPix);
-        } else {
-            return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, true, false>(fx, fy, Jxx, Jxy, Jyx, Jyy, sx, sy, isx, isy, srcImg, blackOutside, tmpPix);
-        }
-    } else {
-        if (suby) {
-            return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, false, true>(fx, fy, Jxx, Jxy, Jyx, Jyy, sx, sy, isx, isy, srcImg, blackOutside, tmpPix);
-        } else {
-            return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, false, false>(fx, fy, Jxx, Jxy, Jyx, Jyy, sx, sy, isx, isy, srcImg, blackOutside, tmpPix);
-        }
-    }
-#else
-    // always use the supersampled data
-    // produces less artifacts, costs less
-    // the problem is that sx = 1.0001 is supersampled, which gives a result very different from sx=1
-    //int isx = std::ceil(sx);
-    //int isy = std::ceil(sy);
-    // This is why we prefer rounding. The jump will be at sx=sqrt(3)=1.732.
-    // This produces quicker renders too, since we supersample less.
-    int isx = (int)std::ceil(sx-0.5);
-    int isy = (int)std::ceil(sy-0.5);
-
-    return ofxsFilterInterpolate2DSuperInternal<PIX, nComponents, eFilterBilinear, false, false>(fx, fy, Jxx, Jxy, Jyx, Jyy, isx, isy, isx, isy, srcImg, blackOutside, tmpPix);
-#endif
+    ofxsFilterSupersample<PIX, nComponents, filter, clamp>(fx, fy, Jxx, Jxy, Jyx, Jyy, srcImg, blackOutside, inside, tmpPix);
 } // ofxsFilterInterpolate2DSuper
 
 #undef OFXS_CLAMPXY
 #undef OFXS_GETPIX
 #undef OFXS_GETI
 #undef OFXS_GETPIX4
+#undef OFXS_GETV
+#undef OFXS_GETV4
 #undef OFXS_GETI
 #undef OFXS_I44
 
@@ -83,7 +83,10 @@ using std::string;
 // (Nuke doesn't call the action when a linked animation is changed),
 // nor on dst->getUniqueIdentifier (which is "ffffffffffffffff" on Nuke)
 
-#define kTransform3x3MotionBlurCount 1000 // number of transforms used in the motion
+#define kTransform3x3MotionBlurCount 1000 // maximum number of transforms used in the motion blur
+#define kTransform3x3MotionBlurProbeCount 9 // initial number of transforms used to measure the motion, see ofxsTransformMotionBlurLength
+#define kTransform3x3MotionBlurProbeTolerance 0.02 // relative change of the measured motion below which it has converged
+#define kTransform3x3MotionBlurDensity 4 // number of transforms per pixel of motion, for a motion blur quality of 1
 
 namespace OFX {
 Transform3x3Plugin::Transform3x3Plugin(OfxImageEffectHandle handle,
@@ -95,6 +98,7 @@ Transform3x3Plugin::Transform3x3Plugin(OfxImageEffectHandle handle,
     , _maskClip(NULL)
     , _paramsType(paramsType)
     , _invert(NULL)
+    , _exactPerspective(NULL)
     , _filter(NULL)
     , _clamp(NULL)
     , _blackOutside(NULL)
@@ -129,6 +133,10 @@ Transform3x3Plugin::Transform3x3Plugin(OfxImageEffectHandle handle,
         _clamp = fetchBooleanParam(kParamFilterClamp);
         _blackOutside = fetchBooleanParam(kParamFilterBlackOutside);
         assert(_invert && _filter && _clamp && _blackOutside);
+        if ( paramExists(kParamTransform3x3ExactPerspective) ) {
+            _exactPerspective = fetchBooleanParam(kParamTransform3x3ExactPerspective);
+            assert(_exactPerspective);
+        }
         if ( paramExists(kParamTransform3x3MotionBlur) ) {
             _motionblur = fetchDoubleParam(kParamTransform3x3MotionBlur); // GodRays may not have have _motionblur
             assert(_motionblur);
@@ -163,6 +171,82 @@ Transform3x3Plugin::~Transform3x3Plugin()
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief render for the filter */
 
+// The length of the motion blur, from the transforms of a few evenly spaced times: the longest path, in pixels, of the
+// content at the corners of canonicalRect. If the motion is affine, no pixel of that rectangle moves farther than
+// these corners. The rectangle must be the same for all the render windows of a frame, so that they all get the same
+// transforms. Returns -1 if the motion cannot be measured (infinite rect, transform that cannot be inverted, or
+// corner behind the camera).
+static double
+ofxsTransformMotionBlurLength(const OfxRectD& canonicalRect,
+                              const OfxPointD& renderScale,
+                              double par,
+                              const Matrix3x3* invtransform,
+                              size_t invtransformsize)
+{
+    if ( Coords::rectIsInfinite(canonicalRect) ) {
+        return -1.;
+    }
+    OfxRectI rect;
+    Coords::toPixelEnclosing(canonicalRect, renderScale, par, &rect);
+    double length = 0.;
+    for (int corner = 0; corner < 4; ++corner) {
+        const Point3D dstCorner( (corner & 1) ? rect.x2 : rect.x1,
+                                 (corner & 2) ? rect.y2 : rect.y1, 1. );
+        // the source point that is at that corner at the first time
+        const Point3D src = invtransform[0] * dstCorner;
+        double cornerLength = 0.;
+        double xPrev = 0., yPrev = 0.;
+        for (size_t i = 0; i < invtransformsize; ++i) {
+            Matrix3x3 transform;
+            if ( !invtransform[i].inverse(&transform) ) {
+                return -1.;
+            }
+            const Point3D p = transform * src;
+            if (p.z <= 0.) {
+                return -1.;
+            }
+            const double x = p.x / p.z;
+            const double y = p.y / p.z;
+            if (i > 0) {
+                cornerLength += std::sqrt( (x - xPrev) * (x - xPrev) + (y - yPrev) * (y - yPrev) );
+            }
+            xPrev = x;
+            yPrev = y;
+        }
+        length = (std::max)(length, cornerLength);
+    }
+
+    return length;
+}
+
+// true if the motion measured with twice as many transforms is about as long. The measured length can only grow
+// with more transforms, since they include the previous ones.
+static bool
+ofxsTransformMotionBlurConverged(double length,
+                                 double finerLength)
+{
+    return (length >= 0.) && (finerLength >= 0.) && (finerLength - length <= kTransform3x3MotionBlurProbeTolerance * finerLength);
+}
+
+// The number of transforms of the motion blur: the content must not move by more than
+// 1/(kTransform3x3MotionBlurDensity*motionblur) pixels between two consecutive transforms. The count is a multiple
+// of step, plus offset, so that the transforms used to measure the motion are among them (unless that exceeds
+// kTransform3x3MotionBlurCount), or kTransform3x3MotionBlurCount if the length is unknown.
+static size_t
+ofxsTransformMotionBlurCount(double length,
+                             double motionblur,
+                             size_t step,
+                             size_t offset)
+{
+    if (length < 0.) {
+        return kTransform3x3MotionBlurCount;
+    }
+    const double count = (std::max)(2., std::ceil(length * kTransform3x3MotionBlurDensity * motionblur) + 1.);
+    const double multiple = std::ceil( (count - offset) / step ) * step + offset;
+
+    return (size_t)( (multiple <= kTransform3x3MotionBlurCount) ? multiple : (std::min)(count, (double)kTransform3x3MotionBlurCount) );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // basic plugin render function, just a skelington to instantiate templates from
 
@@ -213,6 +297,7 @@ Transform3x3Plugin::setupAndProcess(Transform3x3ProcessorBase &processor,
         }
     }
     bool blackOutside = false;
+    bool exactPerspective = false;
     double mix = 1.;
 
     if ( !src.get() ) {
@@ -250,6 +335,9 @@ Transform3x3Plugin::setupAndProcess(Transform3x3ProcessorBase &processor,
         if (_blackOutside) {
             _blackOutside->getValueAtTime(time, blackOutside);
         }
+        if (_exactPerspective) {
+            _exactPerspective->getValueAtTime(time, exactPerspective);
+        }
         if (_masked && _mix) {
             _mix->getValueAtTime(time, mix);
         }
@@ -268,25 +356,90 @@ Transform3x3Plugin::setupAndProcess(Transform3x3ProcessorBase &processor,
         const bool fielded = args.fieldToRender == eFieldLower || args.fieldToRender == eFieldUpper;
         const double srcpixelAspectRatio = src->getPixelAspectRatio();
         const double dstpixelAspectRatio = _dstClip->getPixelAspectRatio();
+        // the motion is measured over a rectangle that is the same for all the render windows of the frame: the
+        // output RoD, or if it is infinite (e.g. a generator), the source RoD within the project extent
+        OfxRectD motionRect = _dstClip->getRegionOfDefinition(time);
+        if ( Coords::rectIsInfinite(motionRect) ) {
+            const OfxPointD projectSize = getProjectSize();
+            const OfxPointD projectOffset = getProjectOffset();
+            OfxRectD project;
+            project.x1 = projectOffset.x;
+            project.y1 = projectOffset.y;
+            project.x2 = projectOffset.x + projectSize.x;
+            project.y2 = projectOffset.y + projectSize.y;
+            if ( !Coords::rectIntersection(_srcClip->getRegionOfDefinition(time), project, &motionRect) ) {
+                motionRect = project;
+            }
+        }
         int view = 0;
 #if defined(OFX_EXTENSIONS_VEGAS) || defined(OFX_EXTENSIONS_NUKE)
         view = args.renderView;
 #endif
         if ( (shutter != 0.) && (motionblur != 0.) ) {
-            invtransformsizealloc = kTransform3x3MotionBlurCount;
-            invtransform.resize(invtransformsizealloc);
             assert(_shutteroffset);
             ShutterOffsetEnum shutteroffset = (ShutterOffsetEnum)_shutteroffset->getValueAtTime(time);
             double shuttercustomoffset;
             assert(_shuttercustomoffset);
             _shuttercustomoffset->getValueAtTime(time, shuttercustomoffset);
 
-            invtransformsize = getInverseTransforms(time, view, args.renderScale, fielded, srcpixelAspectRatio, dstpixelAspectRatio, invert, shutter, shutteroffset, shuttercustomoffset, &invtransform.front(), invtransformsizealloc);
+            // measure the motion first, to compute only as many transforms as it needs: the number of evenly spaced
+            // transforms is doubled until the measured motion converges, and the last ones are reused
+            std::vector<Matrix3x3> probes(kTransform3x3MotionBlurProbeCount);
+            invtransformsize = getInverseTransforms(time, view, args.renderScale, fielded, srcpixelAspectRatio, dstpixelAspectRatio, invert, shutter, shutteroffset, shuttercustomoffset, &probes.front(), probes.size());
+            if (invtransformsize > 1) {
+                double length = ofxsTransformMotionBlurLength(motionRect, args.renderScale, dstpixelAspectRatio, &probes.front(), probes.size());
+                bool converged = false;
+                while ( !converged && (length >= 0.) && (probes.size() * 2 - 1 <= kTransform3x3MotionBlurCount) ) {
+                    std::vector<Matrix3x3> finer(probes.size() * 2 - 1);
+                    getInverseTransforms(time, view, args.renderScale, fielded, srcpixelAspectRatio, dstpixelAspectRatio, invert, shutter, shutteroffset, shuttercustomoffset, &finer.front(), finer.size(), &probes.front(), probes.size());
+                    const double finerLength = ofxsTransformMotionBlurLength(motionRect, args.renderScale, dstpixelAspectRatio, &finer.front(), finer.size());
+                    converged = ofxsTransformMotionBlurConverged(length, finerLength);
+                    length = finerLength;
+                    probes.swap(finer);
+                }
+                invtransformsizealloc = ofxsTransformMotionBlurCount(converged ? length : -1., motionblur, probes.size() - 1, 1);
+                if (invtransformsizealloc <= probes.size()) {
+                    invtransform.swap(probes);
+                    invtransformsize = invtransform.size();
+                } else {
+                    invtransform.resize(invtransformsizealloc);
+                    invtransformsize = getInverseTransforms(time, view, args.renderScale, fielded, srcpixelAspectRatio, dstpixelAspectRatio, invert, shutter, shutteroffset, shuttercustomoffset, &invtransform.front(), invtransformsizealloc, &probes.front(), probes.size());
+                }
+            } else {
+                invtransform.swap(probes);
+            }
         } else if (directionalBlur) {
+            // measure the motion first, to compute only as many transforms as it needs: the number of evenly spaced
+            // transforms is doubled until the measured motion converges, and the last ones are reused
+            std::vector<Matrix3x3> probes;
             invtransformsizealloc = kTransform3x3MotionBlurCount;
+            if (motionblur != 0.) {
+                probes.resize(kTransform3x3MotionBlurProbeCount);
+                if (getInverseTransformsBlur(time, view, args.renderScale, fielded, srcpixelAspectRatio, dstpixelAspectRatio, invert, amountFrom, amountTo, &probes.front(), NULL, probes.size()) == probes.size()) {
+                    double length = ofxsTransformMotionBlurLength(motionRect, args.renderScale, dstpixelAspectRatio, &probes.front(), probes.size());
+                    bool converged = false;
+                    while ( !converged && (length >= 0.) && (probes.size() * 2 <= kTransform3x3MotionBlurCount) ) {
+                        std::vector<Matrix3x3> finer(probes.size() * 2);
+                        if (getInverseTransformsBlur(time, view, args.renderScale, fielded, srcpixelAspectRatio, dstpixelAspectRatio, invert, amountFrom, amountTo, &finer.front(), NULL, finer.size(), &probes.front(), probes.size()) != finer.size()) {
+                            // some transforms failed, and the others were packed
+                            probes.clear();
+                            length = -1.;
+                            break;
+                        }
+                        const double finerLength = ofxsTransformMotionBlurLength(motionRect, args.renderScale, dstpixelAspectRatio, &finer.front(), finer.size());
+                        converged = ofxsTransformMotionBlurConverged(length, finerLength);
+                        length = finerLength;
+                        probes.swap(finer);
+                    }
+                    invtransformsizealloc = ofxsTransformMotionBlurCount(converged ? length : -1., motionblur, probes.size(), 0);
+                } else {
+                    probes.clear();
+                }
+            }
             invtransform.resize(invtransformsizealloc);
             invtransformalpha.resize(invtransformsizealloc);
-            invtransformsize = getInverseTransformsBlur(time, view, args.renderScale, fielded, srcpixelAspectRatio, dstpixelAspectRatio, invert, amountFrom, amountTo, &invtransform.front(), &invtransformalpha.front(), invtransformsizealloc);
+            invtransformsize = getInverseTransformsBlur(time, view, args.renderScale, fielded, srcpixelAspectRatio, dstpixelAspectRatio, invert, amountFrom, amountTo, &invtransform.front(), &invtransformalpha.front(), invtransformsizealloc,
+                                                        probes.empty() ? NULL : &probes.front(), probes.size());
             // normalize alpha, and apply gamma
             double fading = 0.;
             if (_dirBlurFading) {
@@ -303,7 +456,9 @@ Transform3x3Plugin::setupAndProcess(Transform3x3ProcessorBase &processor,
             invtransformsizealloc = 1;
             invtransform.resize(invtransformsizealloc);
             invtransformsize = 1;
-            bool success = getInverseTransformCanonical(time, view, 1., invert, &invtransform[0]); // virtual function
+            const double amount = 1.;
+            bool success = false;
+            getInverseTransformsCanonical(&time, &amount, 1, view, invert, &invtransform[0], &success); // virtual function
             if (!success) {
                 invtransform[0](0,0) = 0.;
                 invtransform[0](0,1) = 0.;
@@ -372,6 +527,7 @@ Transform3x3Plugin::setupAndProcess(Transform3x3ProcessorBase &processor,
 
     // set the render window
     processor.setRenderWindow(args.renderWindow, args.renderScale);
+    processor.setPerspectiveSpan(exactPerspective ? 0 : kTransform3x3ProcessorPerspectiveSpan);
     assert(invtransform.size() && invtransformsize);
     processor.setValues(&invtransform.front(),
                         invtransformalpha.empty() ? 0 : &invtransformalpha.front(),
@@ -521,20 +677,46 @@ Transform3x3Plugin::transformRegion(const OfxRectD &rectFrom,
     rectTo->x2 = kOfxFlagInfiniteMin;
     rectTo->y1 = kOfxFlagInfiniteMax;
     rectTo->y2 = kOfxFlagInfiniteMin;
-    double t = range.min;
-    bool first = true;
-    bool last = !hasmotionblur; // ony one iteration if there is no motion blur
-    bool finished = false;
+    // list the times and amounts at which the corners are transformed, to compute all the transforms in one batch
+    std::vector<double> times;
+    std::vector<double> amounts;
+    {
+        double t = range.min;
+        double amount = 1.;
+        bool last = !hasmotionblur; // ony one iteration if there is no motion blur
+        int dirBlurIter = 0;
+        for (;;) {
+            times.push_back(t);
+            amounts.push_back(amountFrom + amount * (amountTo - amountFrom));
+            if (last) {
+                break;
+            }
+            if (directionalBlur) {
+                const int dirBlurIterMax = 8;
+                ++dirBlurIter;
+                amount = 1. - dirBlurIter / (double)dirBlurIterMax;
+                last = dirBlurIter == dirBlurIterMax;
+            } else {
+                t = std::floor(t * 4 + 1) / 4; // next quarter-frame
+                if (t >= range.max) {
+                    // last iteration should be done with range.max
+                    t = range.max;
+                    last = true;
+                }
+            }
+        }
+    }
+    std::vector<Matrix3x3> transforms( times.size() );
+    std::unique_ptr<bool[]> successes( new bool[times.size()] );
+    getInverseTransformsCanonical(&times.front(), &amounts.front(), times.size(), view, invert, &transforms.front(), successes.get()); // RoD is computed using the *DIRECT* transform, which is why we use !invert
+
     double expand = 0.;
-    double amount = 1.;
-    int dirBlurIter = 0;
     Point3D p_prev[4];
-    while (!finished) {
+    for (size_t k = 0; k < times.size(); ++k) {
         // compute transformed positions
         OfxRectD thisRoD;
-        Matrix3x3 transform;
-        bool success = getInverseTransformCanonical(t, view, amountFrom + amount * (amountTo - amountFrom), invert, &transform); // RoD is computed using the *DIRECT* transform, which is why we use !invert
-        if (!success) {
+        const Matrix3x3& transform = transforms[k];
+        if (!successes[k]) {
             // return infinite region
             rectTo->x1 = kOfxFlagInfiniteMin;
             rectTo->x2 = kOfxFlagInfiniteMax;
@@ -550,9 +732,7 @@ Transform3x3Plugin::transformRegion(const OfxRectD &rectFrom,
         Coords::rectBoundingBox(*rectTo, thisRoD, rectTo);
 
         // if first iteration, continue
-        if (first) {
-            first = false;
-        } else {
+        if (k > 0) {
             // compute the L-infinity distance between consecutive tested points
             expand = (std::max)( expand, std::fabs(p_prev[0].x - p[0].x) );
             expand = (std::max)( expand, std::fabs(p_prev[0].y - p[0].y) );
@@ -564,28 +744,11 @@ Transform3x3Plugin::transformRegion(const OfxRectD &rectFrom,
             expand = (std::max)( expand, std::fabs(p_prev[3].y - p[3].y) );
         }
 
-        if (last) {
-            finished = true;
-        } else {
-            // prepare for next iteration
-            p_prev[0] = p[0];
-            p_prev[1] = p[1];
-            p_prev[2] = p[2];
-            p_prev[3] = p[3];
-            if (directionalBlur) {
-                const int dirBlurIterMax = 8;
-                ++dirBlurIter;
-                amount = 1. - dirBlurIter / (double)dirBlurIterMax;
-                last = dirBlurIter == dirBlurIterMax;
-            } else {
-                t = std::floor(t * 4 + 1) / 4; // next quarter-frame
-                if (t >= range.max) {
-                    // last iteration should be done with range.max
-                    t = range.max;
-                    last = true;
-                }
-            }
-        }
+        // prepare for next iteration
+        p_prev[0] = p[0];
+        p_prev[1] = p[1];
+        p_prev[2] = p[2];
+        p_prev[3] = p[3];
     }
     // expand to take into account errors due to motion blur
     if (rectTo->x1 > kOfxFlagInfiniteMin) {
@@ -1146,7 +1309,9 @@ Transform3x3Plugin::getInverseTransforms(double time,
                                          ShutterOffsetEnum shutteroffset,
                                          double shuttercustomoffset,
                                          Matrix3x3* invtransform,
-                                         size_t invtransformsizealloc) const
+                                         size_t invtransformsizealloc,
+                                         const Matrix3x3* probes,
+                                         size_t probesize) const
 {
     OfxRangeD range;
 
@@ -1157,23 +1322,41 @@ Transform3x3Plugin::getInverseTransforms(double time,
     size_t invtransformsize = invtransformsizealloc;
     Matrix3x3 canonicalToPixel = ofxsMatCanonicalToPixel(srcpixelAspectRatio, renderscale.x, renderscale.y, fielded);
     Matrix3x3 pixelToCanonical = ofxsMatPixelToCanonical(dstpixelAspectRatio, renderscale.x, renderscale.y, fielded);
-    Matrix3x3 invtransformCanonical;
-
+    // the probes are the transforms of every k-th time, if they are evenly spaced over the same range
+    const size_t k = ( probes && (probesize > 1) && (invtransformsize > 1) && ( (invtransformsize - 1) % (probesize - 1) == 0 ) ) ?
+                     (invtransformsize - 1) / (probesize - 1) : 0;
+    std::vector<double> times;
+    times.reserve(invtransformsize);
     for (size_t i = 0; i < invtransformsize; ++i) {
-        double t = (i == 0) ? t_start : ( t_start + i * (t_end - t_start) / (double)(invtransformsizealloc - 1) );
-        bool success = getInverseTransformCanonical(t, view, 1., invert, &invtransformCanonical); // virtual function
-        if (success) {
-            invtransform[i] = canonicalToPixel * invtransformCanonical * pixelToCanonical;
+        if ( (k == 0) || (i % k != 0) ) {
+            times.push_back( (i == 0) ? t_start : ( t_start + i * (t_end - t_start) / (double)(invtransformsizealloc - 1) ) );
+        }
+    }
+    std::vector<double> amounts(times.size(), 1.);
+    std::vector<Matrix3x3> invtransformsCanonical( times.size() );
+    std::unique_ptr<bool[]> successes( new bool[times.size()] );
+    if ( !times.empty() ) {
+        getInverseTransformsCanonical(&times.front(), &amounts.front(), times.size(), view, invert, &invtransformsCanonical.front(), successes.get()); // virtual function
+    }
+    size_t computed = 0;
+    for (size_t i = 0; i < invtransformsize; ++i) {
+        if ( (k != 0) && (i % k == 0) ) {
+            invtransform[i] = probes[i / k];
         } else {
-            invtransform[i](0,0) = 0.;
-            invtransform[i](0,1) = 0.;
-            invtransform[i](0,2) = 0.;
-            invtransform[i](1,0) = 0.;
-            invtransform[i](1,1) = 0.;
-            invtransform[i](1,2) = 0.;
-            invtransform[i](2,0) = 0.;
-            invtransform[i](2,1) = 0.;
-            invtransform[i](2,2) = 1.;
+            if (successes[computed]) {
+                invtransform[i] = canonicalToPixel * invtransformsCanonical[computed] * pixelToCanonical;
+            } else {
+                invtransform[i](0,0) = 0.;
+                invtransform[i](0,1) = 0.;
+                invtransform[i](0,2) = 0.;
+                invtransform[i](1,0) = 0.;
+                invtransform[i](1,1) = 0.;
+                invtransform[i](1,2) = 0.;
+                invtransform[i](2,0) = 0.;
+                invtransform[i](2,1) = 0.;
+                invtransform[i](2,2) = 1.;
+            }
+            ++computed;
         }
         allequal = allequal && (invtransform[i](0,0) == invtransform[0](0,0) &&
                                 invtransform[i](0,1) == invtransform[0](0,1) &&
@@ -1204,24 +1387,50 @@ Transform3x3Plugin::getInverseTransformsBlur(double time,
                                              double amountTo,
                                              Matrix3x3* invtransform,
                                              double *amount,
-                                             size_t invtransformsizealloc) const
+                                             size_t invtransformsizealloc,
+                                             const Matrix3x3* probes,
+                                             size_t probesize) const
 {
     bool allequal = true;
     Matrix3x3 canonicalToPixel = ofxsMatCanonicalToPixel(srcpixelAspectRatio, renderscale.x, renderscale.y, fielded);
     Matrix3x3 pixelToCanonical = ofxsMatPixelToCanonical(dstpixelAspectRatio, renderscale.x, renderscale.y, fielded);
-    Matrix3x3 invtransformCanonical;
     size_t invtransformsize = 0;
+    std::vector<double> amounts(invtransformsizealloc);
+    // the probes are the transforms of every k-th amount, if they are evenly spaced over the same range
+    const size_t k = ( probes && (probesize > 0) && (invtransformsizealloc % probesize == 0) ) ? invtransformsizealloc / probesize : 0;
+    std::vector<double> amountsComputed;
+    amountsComputed.reserve(invtransformsizealloc);
 
     for (size_t i = 0; i < invtransformsizealloc; ++i) {
         //double a = 1. - i / (double)(invtransformsizealloc - 1); // Theoretically better
         double a = 1. - (i + 1) / (double)(invtransformsizealloc); // To be compatible with Nuke (Nuke bug?)
-        double amt = amountFrom + (amountTo - amountFrom) * a;
-        bool success = getInverseTransformCanonical(time, view, amt, invert, &invtransformCanonical); // virtual function
+        amounts[i] = amountFrom + (amountTo - amountFrom) * a;
+        if ( (k == 0) || ( (i + 1) % k != 0 ) ) {
+            amountsComputed.push_back(amounts[i]);
+        }
+    }
+    std::vector<double> times(amountsComputed.size(), time);
+    std::vector<Matrix3x3> invtransformsCanonical( amountsComputed.size() );
+    std::unique_ptr<bool[]> successes( new bool[amountsComputed.size()] );
+    if ( !amountsComputed.empty() ) {
+        getInverseTransformsCanonical(&times.front(), &amountsComputed.front(), amountsComputed.size(), view, invert, &invtransformsCanonical.front(), successes.get()); // virtual function
+    }
+    size_t computed = 0;
+    for (size_t i = 0; i < invtransformsizealloc; ++i) {
+        bool success = true;
+        if ( (k != 0) && ( (i + 1) % k == 0 ) ) {
+            invtransform[invtransformsize] = probes[(i + 1) / k - 1];
+        } else {
+            success = successes[computed];
+            if (success) {
+                invtransform[invtransformsize] = canonicalToPixel * invtransformsCanonical[computed] * pixelToCanonical;
+            }
+            ++computed;
+        }
         if (success) {
             if (amount) {
-                amount[invtransformsize] = amt;
+                amount[invtransformsize] = amounts[i];
             }
-            invtransform[invtransformsize] = canonicalToPixel * invtransformCanonical * pixelToCanonical;
             ++invtransformsize;
             allequal = allequal && (invtransform[i](0,0) == invtransform[0](0,0) &&
                                     invtransform[i](0,1) == invtransform[0](0,1) &&
@@ -1241,6 +1450,41 @@ Transform3x3Plugin::getInverseTransformsBlur(double time,
     return invtransformsize;
 }
 
+bool
+Transform3x3Plugin::getInverseTransformCanonicalFromParams(const TransformParams& /*params*/,
+                                                           size_t /*i*/,
+                                                           double /*amount*/,
+                                                           bool /*invert*/,
+                                                           Matrix3x3* /*invtransform*/) const
+{
+    // must be overridden by the plugins that override getTransformParams()
+    assert(false);
+
+    return false;
+}
+
+void
+Transform3x3Plugin::getInverseTransformsCanonical(const double* times,
+                                                  const double* amounts,
+                                                  size_t n,
+                                                  int view,
+                                                  bool invert,
+                                                  Matrix3x3* invtransforms,
+                                                  bool* success) const
+{
+    if (n == 0) {
+        return;
+    }
+    auto_ptr<TransformParams> params( getTransformParams(times, n, view) ); // virtual function
+    for (size_t i = 0; i < n; ++i) {
+        if ( params.get() ) {
+            success[i] = getInverseTransformCanonicalFromParams(*params, i, amounts[i], invert, &invtransforms[i]); // virtual function
+        } else {
+            success[i] = getInverseTransformCanonical(times[i], view, amounts[i], invert, &invtransforms[i]); // virtual function
+        }
+    }
+}
+
 // override changedParam
 void
 Transform3x3Plugin::changedParam(const InstanceChangedArgs &args,
@@ -1399,6 +1643,17 @@ Transform3x3DescribeInContextEnd(ImageEffectDescriptor &desc,
             page->addChild(*param);
         }
     }
+    // exactPerspective
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamTransform3x3ExactPerspective);
+        param->setLabel(kParamTransform3x3ExactPerspectiveLabel);
+        param->setHint(kParamTransform3x3ExactPerspectiveHint);
+        param->setDefault(false);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
     // GENERIC PARAMETERS
     //
 
@@ -37,6 +37,10 @@
 #define kParamTransform3x3InvertLabel "Invert"
 #define kParamTransform3x3InvertHint "Invert the transform."
 
+#define kParamTransform3x3ExactPerspective "exactPerspective"
+#define kParamTransform3x3ExactPerspectiveLabel "Exact Perspective"
+#define kParamTransform3x3ExactPerspectiveHint "Compute the source position of each pixel exactly when the transform has a perspective part. When unchecked, the source positions are interpolated linearly over short spans of pixels where the error stays below 1/100 pixel, which is faster."
+
 #define kParamTransform3x3MotionBlur "motionBlur"
 #define kParamTransform3x3MotionBlurLabel "Motion Blur"
 #define kParamTransform3x3MotionBlurHint "Quality of motion blur rendering. 0 disables motion blur, 1 is a good value. Increasing this slows down rendering."
@@ -99,6 +103,32 @@ public:
     /** @brief recover a transform matrix from an effect */
     virtual bool getInverseTransformCanonical(double time, int view, double amount, bool invert, OFX::Matrix3x3* invtransform) const = 0;
 
+    /** @brief the values of the parameters of the transform at a set of times, see getTransformParams() */
+    class TransformParams
+    {
+    public:
+        virtual ~TransformParams() {}
+    };
+
+    /** @brief Fetch the parameters of the transform at all the given times in one batch, so that the matrices can then
+        be computed by getInverseTransformCanonicalFromParams() without any call to the host.
+        The default returns NULL, in which case the matrices are computed by getInverseTransformCanonical().
+        The caller owns the returned object. */
+    virtual TransformParams* getTransformParams(const double* /*times*/, size_t /*n*/, int /*view*/) const
+    {
+        return NULL;
+    }
+
+    /** @brief recover the transform matrix at the i-th time of a batch returned by getTransformParams() */
+    virtual bool getInverseTransformCanonicalFromParams(const TransformParams& params, size_t i, double amount, bool invert, OFX::Matrix3x3* invtransform) const;
+
+    /** @brief Recover the transform matrices of n samples in one call, the i-th one at times[i] with amounts[i].
+        success[i] is false if the i-th matrix could not be computed.
+        The default implementation fetches the parameters with getTransformParams() and calls
+        getInverseTransformCanonicalFromParams(), or calls getInverseTransformCanonical() for each sample if the plugin
+        does not fetch its parameters in batches. */
+    virtual void getInverseTransformsCanonical(const double* times, const double* amounts, size_t n, int view, bool invert, OFX::Matrix3x3* invtransforms, bool* success) const;
+
 
     // The following functions override those is OFX::ImageEffect
 
@@ -131,6 +161,8 @@ public:
     void changedTransform(const OFX::InstanceChangedArgs &args);
 
 protected:
+    /** @brief compute the inverse transforms at invtransformsizealloc evenly spaced times of the shutter interval.
+        The probesize transforms of probes, computed by a previous call, are reused if they are among them. */
     size_t getInverseTransforms(double time,
                                 int view,
                                 OfxPointD renderscale,
@@ -142,7 +174,13 @@ protected:
                                 ShutterOffsetEnum shutteroffset,
                                 double shuttercustomoffset,
                                 OFX::Matrix3x3* invtransform,
-                                size_t invtransformsizealloc) const;
+                                size_t invtransformsizealloc,
+                                const OFX::Matrix3x3* probes = NULL,
+                                size_t probesize = 0) const;
+
+    /** @brief compute the inverse transforms at invtransformsizealloc evenly spaced amounts of the directional blur.
+        The probesize transforms of probes, computed by a previous call that returned probesize, are reused if they
+        are among them. */
 
     size_t getInverseTransformsBlur(double time,
                                     int view,
@@ -155,7 +193,9 @@ protected:
                                     double amountTo,
                                     OFX::Matrix3x3* invtransform,
                                     double* amount,
-                                    size_t invtransformsizealloc) const;
+                                    size_t invtransformsizealloc,
+                                    const OFX::Matrix3x3* probes = NULL,
+                                    size_t probesize = 0) const;
 
 private:
     /* internal render function */
@@ -188,6 +228,7 @@ protected:
     // Transform3x3-GENERIC
     Transform3x3ParamsTypeEnum _paramsType;
     OFX::BooleanParam* _invert;
+    OFX::BooleanParam* _exactPerspective;
     // GENERIC
     OFX::ChoiceParam* _filter;
     OFX::BooleanParam* _clamp;
@@ -206,6 +247,60 @@ protected:
     OFX::BooleanParam* _maskInvert;
 };
 
+/** @brief Set a field of values[i] to the value of a parameter at times[i], for a Transform3x3Plugin::TransformParams.
+    A parameter that is not animated is fetched only once. If param is NULL, the fields keep their default value. */
+template <class PARAM, class VALUES, class T>
+void
+ofxsGetValuesAtTimes(const PARAM* param,
+                     const double* times,
+                     size_t n,
+                     VALUES* values,
+                     T VALUES::* field)
+{
+    if (!param || (n == 0)) {
+        return;
+    }
+    if ( (n == 1) || !param->getIsAnimating() ) {
+        const T value = static_cast<T>( param->getValueAtTime(times[0]) );
+        for (size_t i = 0; i < n; ++i) {
+            values[i].*field = value;
+        }
+
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        // consecutive samples often share their time (e.g. the amounts of a directional blur)
+        values[i].*field = (i > 0 && times[i] == times[i - 1]) ? values[i - 1].*field : static_cast<T>( param->getValueAtTime(times[i]) );
+    }
+}
+
+/** @brief Same as above, for the element index of an array field, e.g. one of the four corners of a CornerPin. */
+template <class PARAM, class VALUES, class T, size_t N>
+void
+ofxsGetValuesAtTimes(const PARAM* param,
+                     const double* times,
+                     size_t n,
+                     VALUES* values,
+                     T (VALUES::* field)[N],
+                     size_t index)
+{
+    assert(index < N);
+    if (!param || (n == 0)) {
+        return;
+    }
+    if ( (n == 1) || !param->getIsAnimating() ) {
+        const T value = static_cast<T>( param->getValueAtTime(times[0]) );
+        for (size_t i = 0; i < n; ++i) {
+            (values[i].*field)[index] = value;
+        }
+
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        (values[i].*field)[index] = (i > 0 && times[i] == times[i - 1]) ? (values[i - 1].*field)[index] : static_cast<T>( param->getValueAtTime(times[i]) );
+    }
+}
+
 void Transform3x3Describe(OFX::ImageEffectDescriptor &desc, bool masked);
 
 OFX::PageParamDescriptor * Transform3x3DescribeInContextBegin(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum context, bool masked);
@@ -26,6 +26,8 @@
 #define MISC_TRANSFORMPROCESSOR_H
 
 #include <algorithm>
+#include <cstring>
+#include <vector>
 
 #include "ofxsProcessing.H"
 #include "ofxsMatrix2D.h"
@@ -37,8 +39,62 @@
 #define kTransform3x3ProcessorMotionBlurMaxError (_motionblur * maxValue / 1000.)
 #define kTransform3x3ProcessorMotionBlurMinIterations ( (std::max)( 13, (int)(kTransform3x3ProcessorMotionBlurMaxIterations / 3) ) )
 #define kTransform3x3ProcessorMotionBlurMaxIterations ( (int)(_motionblur * 40) )
+// side of the square table of per-pixel offsets of the motion blur samples (must be a power of two)
+#define kTransform3x3ProcessorMotionBlurOffsetsSize 64
+
+// constants for the perspective transforms: the source coordinates are computed exactly every
+// kTransform3x3ProcessorPerspectiveSpan pixels, and interpolated linearly in between if the interpolation error is
+// below kTransform3x3ProcessorPerspectiveMaxError pixels
+#define kTransform3x3ProcessorPerspectiveSpan 16
+#define kTransform3x3ProcessorPerspectiveMaxError 0.01
+
+// constants for the motion blur of translations: the transforms may deviate from an evenly spaced translation by
+// kTransform3x3ProcessorTranslationBlurMaxError pixels, the window is processed in strips of
+// kTransform3x3ProcessorTranslationBlurStripSize rows (or columns), and the tables of a strip hold at most
+// kTransform3x3ProcessorTranslationBlurMaxTableSize values (larger strips are split)
+#define kTransform3x3ProcessorTranslationBlurMaxError 0.01
+#define kTransform3x3ProcessorTranslationBlurStripSize 32
+#define kTransform3x3ProcessorTranslationBlurMaxTableSize (1 << 20)
+
+// size of the output tiles of the transforms that are not axis-aligned, and size in bytes of the smallest source
+// image processed in tiles (smaller sources stay in the last-level cache, and reading them by rows is as fast)
+#define kTransform3x3ProcessorTileSize 64
+#define kTransform3x3ProcessorTileMinSourceSize (256 << 20)
 
 namespace OFX {
+// The exact source coordinates at the centers of the pixels x0 and x1 of a row of a perspective transform.
+// Returns false if z is not positive over the span, or if interpolating linearly between both ends would deviate
+// by more than kTransform3x3ProcessorPerspectiveMaxError pixels from the exact coordinates.
+inline bool
+ofxsTransform3x3PerspectiveSpan(const OFX::Matrix3x3& H,
+                                double cy,
+                                int x0,
+                                int x1,
+                                OFX::Point3D* t0,
+                                OFX::Point3D* t1)
+{
+    const OFX::Point3D p0(x0 + 0.5, cy, 1.);
+    const OFX::Point3D p1(x1 + 0.5, cy, 1.);
+
+    *t0 = H * p0;
+    *t1 = H * p1;
+    if ( (t0->z <= 0.) || (t1->z <= 0.) ) {
+        return false;
+    }
+    // Along the row, each coordinate is (a*x + b) / (c*x + d), whose second derivative is
+    // -2c(ad - bc) / (cx + d)^3, and the chord of a function deviates from it by at most L^2/8 max|f''|.
+    // z = cx + d is linear, so that its minimum over the span is at one of its ends.
+    const double c = H(2,0);
+    const double d = H(2,1) * cy + H(2,2);
+    const double detx = H(0,0) * d - (H(0,1) * cy + H(0,2)) * c;
+    const double dety = H(1,0) * d - (H(1,1) * cy + H(1,2)) * c;
+    const double zmin = (std::min)(t0->z, t1->z);
+    const double length = x1 - x0;
+    const double maxError = length * length / 8. * 2. * std::abs(c) * (std::max)( std::abs(detx), std::abs(dety) ) / (zmin * zmin * zmin);
+
+    return maxError <= kTransform3x3ProcessorPerspectiveMaxError;
+}
+
 class Transform3x3ProcessorBase
     : public OFX::ImageProcessor
 {
@@ -52,9 +108,17 @@ protected:
     // GENERIC PARAMETERS:
     bool _blackOutside;
     double _motionblur; // quality of the motion blur. 0 means disabled
+    int _perspectiveSpan; // length of the interpolated spans of perspective transforms. 0 or 1 means exact
+    double _tileMinSourceSize; // size in bytes of the source images above which rotated transforms are processed in tiles
+    bool _nearestBlit; // axis-aligned transforms with the impulse filter copy the source pixels (see multiThreadProcessImagesNearestBlit)
     bool _domask;
     double _mix;
     bool _maskInvert;
+    // Motion blur samples: the sample s of pixel (x,y) is at frac(_motionBlurSamples[s] + offset(x,y)) in the
+    // shutter interval, where the offsets are read from a table that tiles the output. Both tables only depend on
+    // _motionblur, so that the result of a pixel does not depend on how the render window is split between threads.
+    std::vector<double> _motionBlurSamples;
+    std::vector<float> _motionBlurOffsets;
 
 public:
 
@@ -67,6 +131,9 @@ public:
         , _invtransformsize(0)
         , _blackOutside(false)
         , _motionblur(0.)
+        , _perspectiveSpan(kTransform3x3ProcessorPerspectiveSpan)
+        , _tileMinSourceSize(kTransform3x3ProcessorTileMinSourceSize)
+        , _nearestBlit(true)
         , _domask(false)
         , _mix(1.0)
         , _maskInvert(false)
@@ -95,6 +162,29 @@ public:
         _domask = v;
     }
 
+    /** @brief set the length of the spans over which the source coordinates of a perspective transform are
+        interpolated linearly (when the error stays below kTransform3x3ProcessorPerspectiveMaxError), or 0 to compute
+        them exactly at every pixel */
+    void setPerspectiveSpan(int length)
+    {
+        _perspectiveSpan = length;
+    }
+
+    /** @brief set the size in bytes of the source images above which the output of a rotated transform is processed in
+        tiles (see multiThreadFunction). The default is kTransform3x3ProcessorTileMinSourceSize: 0 always uses tiles,
+        and a size larger than the source never does. */
+    void setTileMinSourceSize(double size)
+    {
+        _tileMinSourceSize = size;
+    }
+
+    /** @brief enable the copy of the source pixels for the axis-aligned transforms with the impulse filter (the
+        default), or process them like any other transform. Both must give the same output. */
+    void setNearestBlit(bool enabled)
+    {
+        _nearestBlit = enabled;
+    }
+
     void setValues(const OFX::Matrix3x3* invtransform, //!< non-generic - must be in PIXEL coords
                    double* invtransformalpha,
                    size_t invtransformsize,
@@ -112,6 +202,145 @@ public:
         _blackOutside = blackOutside;
         _motionblur = motionblur;
         _mix = mix;
+        if (_motionblur != 0.) {
+            setupMotionBlurSamples();
+        }
+    }
+
+    /** @brief overridden from OFX::ImageProcessor.
+        When a transform is rotated by more than 45 degrees, each output row walks across the source rows rather than
+        along them. If the source is larger than the cache (kTransform3x3ProcessorTileMinSourceSize), the source rows
+        read by a row are evicted before the next row reads them again. The output is then processed in tiles of
+        kTransform3x3ProcessorTileSize pixels, in Morton order, so that the source footprint of a tile stays in the
+        cache, and the tiles are handed to the threads in turn. */
+    virtual void multiThreadFunction(unsigned int threadId,
+                                     unsigned int nThreads) OVERRIDE
+    {
+        if ( exceedsCache() && walksAcrossRows() ) {
+            return multiThreadProcessTiles(threadId, nThreads);
+        }
+        OFX::ImageProcessor::multiThreadFunction(threadId, nThreads);
+    }
+
+private:
+    // Fill the tables of motion blur samples. The samples are the van der Corput sequence, which is stratified over
+    // any power of two of consecutive samples. Each pixel shifts them by an offset from the R2 sequence
+    // (see http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/), which decorrelates
+    // neighbouring pixels into a noise with little low-frequency energy, instead of the white noise of a hash.
+    void setupMotionBlurSamples()
+    {
+        const int size = kTransform3x3ProcessorMotionBlurOffsetsSize;
+        const int nSamples = (std::max)(kTransform3x3ProcessorMotionBlurMinIterations, kTransform3x3ProcessorMotionBlurMaxIterations);
+
+        _motionBlurSamples.resize(nSamples);
+        for (int s = 0; s < nSamples; ++s) {
+            _motionBlurSamples[s] = van_der_corput<2>(s);
+        }
+        // the R2 sequence: the plastic number g is the root of g^3 = g + 1
+        const double g = 1.32471795724474602596;
+        const double a1 = 1. / g;
+        const double a2 = 1. / (g * g);
+        _motionBlurOffsets.resize(size * size);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                const double v = 0.5 + a1 * x + a2 * y;
+                _motionBlurOffsets[y * size + x] = (float)(v - std::floor(v));
+            }
+        }
+    }
+
+    // Compute the /seed/th element of the van der Corput sequence
+    // see http://en.wikipedia.org/wiki/Van_der_Corput_sequence
+    template <int base>
+    static double van_der_corput(unsigned int seed)
+    {
+        double base_inv;
+        int digit;
+        double r;
+
+        r = 0.0;
+
+        base_inv = 1.0 / ( (double)base );
+
+        while (seed != 0) {
+            digit = seed % base;
+            r = r + ( (double)digit ) * base_inv;
+            base_inv = base_inv / ( (double)base );
+            seed = seed / base;
+        }
+
+        return r;
+    }
+
+    // true if the source image is too large to stay in the cache (see setTileMinSourceSize)
+    bool exceedsCache() const
+    {
+        if (!_srcImg) {
+            return false;
+        }
+        const OfxRectI& bounds = _srcImg->getBounds();
+
+        return (double)std::abs( _srcImg->getRowBytes() ) * (bounds.y2 - bounds.y1) >= _tileMinSourceSize;
+    }
+
+    // true if, along an output row, the source coordinates of one of the transforms move faster across the source
+    // rows than along them (for perspective transforms, those of their linear part)
+    bool walksAcrossRows() const
+    {
+        for (size_t t = 0; t < _invtransformsize; ++t) {
+            const OFX::Matrix3x3& H = _invtransform[t];
+            if ( std::abs( H(1,0) ) > std::abs( H(0,0) ) ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // the coordinate of a tile given by the even bits of its Morton code
+    static unsigned int mortonDecode(unsigned int m)
+    {
+        m &= 0x55555555;
+        m = (m | (m >> 1)) & 0x33333333;
+        m = (m | (m >> 2)) & 0x0f0f0f0f;
+        m = (m | (m >> 4)) & 0x00ff00ff;
+        m = (m | (m >> 8)) & 0x0000ffff;
+
+        return m;
+    }
+
+    void multiThreadProcessTiles(unsigned int threadId,
+                                 unsigned int nThreads)
+    {
+        const int tileSize = kTransform3x3ProcessorTileSize;
+        const unsigned int nx = (unsigned int)(_renderWindow.x2 - _renderWindow.x1 + tileSize - 1) / tileSize;
+        const unsigned int ny = (unsigned int)(_renderWindow.y2 - _renderWindow.y1 + tileSize - 1) / tileSize;
+        unsigned int side = 1; // the Morton order covers a square of side a power of two
+
+        while ( (side < nx) || (side < ny) ) {
+            side *= 2;
+        }
+        unsigned int tile = 0;
+        for (unsigned int m = 0; m < side * side; ++m) {
+            const unsigned int tx = mortonDecode(m);
+            const unsigned int ty = mortonDecode(m >> 1);
+            if ( (tx >= nx) || (ty >= ny) ) {
+                continue;
+            }
+            // neighbouring tiles go to different threads, which balances the load when parts of the output are black
+            if (tile++ % nThreads != threadId) {
+                continue;
+            }
+            if ( _effect.abort() ) {
+                return;
+            }
+            OfxRectI win;
+            win.x1 = _renderWindow.x1 + tx * tileSize;
+            win.y1 = _renderWindow.y1 + ty * tileSize;
+            win.x2 = (std::min)(win.x1 + tileSize, _renderWindow.x2);
+            win.y2 = (std::min)(win.y1 + tileSize, _renderWindow.y2);
+            multiThreadProcessImages(win, _renderScale);
+        }
     }
 };
 
@@ -155,10 +384,37 @@ private:
         unused(rs);
         float tmpPix[nComponents];
         const OFX::Matrix3x3 & H = _invtransform[0];
-        const int x1 = _srcImg ? _srcImg->getBounds().x1 : 0;
-        const int x2 = _srcImg ? _srcImg->getBounds().x2 : 0;
-        const int y1 = _srcImg ? _srcImg->getBounds().y1 : 0;
-        const int y2 = _srcImg ? _srcImg->getBounds().y2 : 0;
+        if ( (filter == eFilterImpulse) && _nearestBlit && _srcImg && (!masked || !_domask) && (_mix == 1.) &&
+             (H(0,1) == 0.) && (H(1,0) == 0.) && (H(2,0) == 0.) && (H(2,1) == 0.) && (H(2,2) > 0.) ) {
+            // axis-aligned nearest neighbour: e.g. integer upscaling of pixel art, or flop/flip
+            return multiThreadProcessImagesNearestBlit(procWindow);
+        }
+        OfxRectI srcBounds = {0, 0, 0, 0};
+        if (_srcImg) {
+            srcBounds = _srcImg->getBounds();
+        }
+        // If the transform is affine, transformed.z is H(2,2) everywhere: the source coordinates are stepped from
+        // pixel to pixel, and the Jacobian is constant.
+        const bool affine = (H(2,0) == 0.) && (H(2,1) == 0.);
+        const bool affineBlack = affine && ( !_srcImg || (H(2,2) <= 0.) ); // at infinity or behind the camera
+        const double affineZ = affineBlack ? 1. : H(2,2);
+        const double Jxx = H(0,0) / affineZ;
+        const double Jxy = H(0,1) / affineZ;
+        const double Jyx = H(1,0) / affineZ;
+        const double Jyy = H(1,1) / affineZ;
+        // If the affine transform is also axis-aligned (scale and translation only), the source x only depends on the
+        // column and the source y only depends on the row: the taps and weights of the separable filters are
+        // computed once for each column, and once for each row.
+        const bool separable = ( (ofxsFilterTapsCount(filter) > 0) && affine && !affineBlack && _srcImg->getPixelData() &&
+                                 (Jxy == 0.) && (Jyx == 0.) && (procWindow.x2 > procWindow.x1) );
+        std::vector<OfxsFilterTaps> xTaps(separable ? procWindow.x2 - procWindow.x1 : 0);
+        if (separable) {
+            const OFX::Point3D transformed = H * OFX::Point3D( (double)procWindow.x1 + 0.5, (double)procWindow.y1 + 0.5, 1. );
+            double fx = transformed.x / affineZ;
+            for (size_t i = 0; i < xTaps.size(); ++i, fx += Jxx) {
+                ofxsFilterGetTaps<filter>(fx, srcBounds.x1, srcBounds.x2, _blackOutside, &xTaps[i]);
+            }
+        }
 
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
@@ -173,7 +429,111 @@ private:
             canonicalCoords.z = 1;
             canonicalCoords.y = (double)y + 0.5;
 
-            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
+            if (separable) {
+                canonicalCoords.x = (double)procWindow.x1 + 0.5;
+                OFX::Point3D transformed = H * canonicalCoords;
+                double fx = transformed.x / affineZ;
+                const double fy = transformed.y / affineZ;
+                OfxsFilterTaps yTaps;
+                ofxsFilterGetTaps<filter>(fy, srcBounds.y1, srcBounds.y2, _blackOutside, &yTaps);
+                const PIX* rows[4] = {NULL, NULL, NULL, NULL};
+                for (int j = 0; j < ofxsFilterTapsCount(filter); ++j) {
+                    if (yTaps.inside[j]) {
+                        rows[j] = (const PIX*)_srcImg->getPixelAddress(srcBounds.x1, yTaps.index[j]);
+                    }
+                }
+                // the Jacobian is zeroed outside of the source image, as in filterPixel
+                const bool yinside = (srcBounds.y1 <= fy + 0.5 && fy - 0.5 < srcBounds.y2);
+                for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents, fx += Jxx) {
+                    const bool inside = ofxsFilterInterpolate2DSeparable<PIX, nComponents, filter, clamp>(xTaps[x - procWindow.x1], yTaps, srcBounds.x1, rows, tmpPix);
+                    const bool xinside = (srcBounds.x1 <= fx + 0.5 && fx - 0.5 < srcBounds.x2);
+                    const bool black = _blackOutside && !(xinside && yinside);
+                    ofxsFilterSupersample<PIX, nComponents, filter, clamp>(fx, fy, (xinside && !black) ? Jxx : 0., 0., 0., (yinside && !black) ? Jyy : 0.,
+                                                                           _srcImg, _blackOutside, inside, tmpPix);
+                    ofxsMaskMix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
+                }
+                continue;
+            }
+
+            // the pixels of the row that are black, and those that are far enough inside to skip the tests of filterPixel
+            RowSpan spans[5];
+            int spanCount = 1;
+            spans[0].x1 = procWindow.x1;
+            spans[0].x2 = procWindow.x2;
+            spans[0].kind = eRowSpanBorder;
+            if (_srcImg && !affineBlack) {
+                spanCount = getRowSpans(H, canonicalCoords.y, procWindow.x1, procWindow.x2, srcBounds, spans);
+            }
+
+            for (int s = 0; s < spanCount; ++s) {
+                const RowSpan& span = spans[s];
+                const bool interior = (span.kind == eRowSpanInterior);
+                if (span.kind == eRowSpanOutside) {
+                    fillBlack(span.x1, span.x2, y, dstPix);
+                    dstPix += (span.x2 - span.x1) * nComponents;
+                    continue;
+                }
+
+                if (affine) {
+                    canonicalCoords.x = (double)span.x1 + 0.5;
+                    OFX::Point3D transformed = H * canonicalCoords;
+                    double fx = transformed.x / affineZ;
+                    double fy = transformed.y / affineZ;
+                    for (int x = span.x1; x < span.x2; ++x, dstPix += nComponents, fx += Jxx, fy += Jyx) {
+                        if (affineBlack) {
+                            for (int c = 0; c < nComponents; ++c) {
+                                tmpPix[c] = 0;
+                            }
+                        } else {
+                            filterPixel(fx, fy, Jxx, Jxy, Jyx, Jyy, srcBounds, interior, tmpPix);
+                        }
+                        ofxsMaskMix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
+                    }
+                    continue;
+                }
+
+                processPerspectiveSpan(span.x1, span.x2, y, interior, srcBounds, dstPix);
+                dstPix += (span.x2 - span.x1) * nComponents;
+            }
+        }
+    } // multiThreadProcessImagesNoBlur
+
+    // process the pixels [x1,x2) of row y of a perspective transform
+    void processPerspectiveSpan(int x1,
+                                int x2,
+                                int y,
+                                bool interior,
+                                const OfxRectI& srcBounds,
+                                PIX* dstPix)
+    {
+        float tmpPix[nComponents];
+        const OFX::Matrix3x3 & H = _invtransform[0];
+        OFX::Point3D canonicalCoords;
+        canonicalCoords.z = 1;
+        canonicalCoords.y = (double)y + 0.5;
+
+        for (int x = x1; x < x2;) {
+            const int spanEnd = (_perspectiveSpan > 1) ? (std::min)(x + _perspectiveSpan, x2) : x2;
+            OFX::Point3D t0, t1;
+            if ( (_perspectiveSpan > 1) && (spanEnd - x > 1) && _srcImg && ofxsTransform3x3PerspectiveSpan(H, canonicalCoords.y, x, spanEnd, &t0, &t1) ) {
+                // interpolate linearly between the exact source coordinates at both ends of the span, with the
+                // Jacobian at the start of the span
+                const double fx0 = t0.x / t0.z;
+                const double fy0 = t0.y / t0.z;
+                const double dfx = (t1.x / t1.z - fx0) / (spanEnd - x);
+                const double dfy = (t1.y / t1.z - fy0) / (spanEnd - x);
+                const double z2 = t0.z * t0.z;
+                const double Jxx = (H(0,0) * t0.z - t0.x * H(2,0)) / z2;
+                const double Jxy = (H(0,1) * t0.z - t0.x * H(2,1)) / z2;
+                const double Jyx = (H(1,0) * t0.z - t0.y * H(2,0)) / z2;
+                const double Jyy = (H(1,1) * t0.z - t0.y * H(2,1)) / z2;
+                for (int i = 0; x < spanEnd; ++x, ++i, dstPix += nComponents) {
+                    filterPixel(fx0 + i * dfx, fy0 + i * dfy, Jxx, Jxy, Jyx, Jyy, srcBounds, interior, tmpPix);
+                    ofxsMaskMix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
+                }
+                continue;
+            }
+            for (; x < spanEnd; ++x, dstPix += nComponents) {
                 // NON-GENERIC TRANSFORM
 
                 // the coordinates of the center of the pixel in canonical coordinates
@@ -188,41 +548,281 @@ private:
                 } else {
                     double fx = transformed.z != 0 ? transformed.x / transformed.z : transformed.x;
                     double fy = transformed.z != 0 ? transformed.y / transformed.z : transformed.y;
-                    if (filter == eFilterImpulse) {
-                        ofxsFilterInterpolate2D<PIX, nComponents, filter, clamp>(fx, fy, _srcImg, _blackOutside, tmpPix);
-                    } else {
-                        bool xinside = (x1 <= fx + 0.5 && fx - 0.5 < x2);
-                        bool yinside = (y1 <= fy + 0.5 && fy - 0.5 < y2);
-                        if ( _blackOutside && !(xinside && yinside) ) {
-                            xinside = yinside = false;
-                        }
-
-                        double Jxx = xinside ? (H(0,0) * transformed.z - transformed.x * H(2,0)) / (transformed.z * transformed.z) : 0.;
-                        double Jxy = xinside ? (H(0,1) * transformed.z - transformed.x * H(2,1)) / (transformed.z * transformed.z) : 0.;
-                        double Jyx = yinside ? (H(1,0) * transformed.z - transformed.y * H(2,0)) / (transformed.z * transformed.z) : 0;
-                        double Jyy = yinside ? (H(1,1) * transformed.z - transformed.y * H(2,1)) / (transformed.z * transformed.z) : 0.;
-                        ofxsFilterInterpolate2DSuper<PIX, nComponents, filter, clamp>(fx, fy, Jxx, Jxy, Jyx, Jyy, _srcImg, _blackOutside, tmpPix);
-                    }
+                    // the Jacobian is only used by the filters that are not Impulse
+                    const double z2 = transformed.z * transformed.z;
+                    filterPixel(fx, fy,
+                                (H(0,0) * transformed.z - transformed.x * H(2,0)) / z2,
+                                (H(0,1) * transformed.z - transformed.x * H(2,1)) / z2,
+                                (H(1,0) * transformed.z - transformed.y * H(2,0)) / z2,
+                                (H(1,1) * transformed.z - transformed.y * H(2,1)) / z2,
+                                srcBounds, interior, tmpPix);
                 }
 
                 ofxsMaskMix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
             }
         }
-    } // multiThreadProcessImagesNoBlur
+    } // processPerspectiveSpan
+
+    // the source pixel at (fx,fy), filtered over the footprint given by the Jacobian of the inverse transform
+    void filterPixel(double fx,
+                     double fy,
+                     double Jxx,
+                     double Jxy,
+                     double Jyx,
+                     double Jyy,
+                     const OfxRectI& srcBounds,
+                     bool interior, //!< the pixel is in an interior span, see getRowSpans
+                     float* tmpPix)
+    {
+        if (filter == eFilterImpulse) {
+            ofxsFilterInterpolate2D<PIX, nComponents, filter, clamp>(fx, fy, _srcImg, _blackOutside, tmpPix);
+
+            return;
+        }
+        if (interior) {
+            // the center of the pixel is known to be inside the source image
+            ofxsFilterInterpolate2DSuper<PIX, nComponents, filter, clamp>(fx, fy, Jxx, Jxy, Jyx, Jyy, _srcImg, _blackOutside, tmpPix);
+
+            return;
+        }
+        bool xinside = (srcBounds.x1 <= fx + 0.5 && fx - 0.5 < srcBounds.x2);
+        bool yinside = (srcBounds.y1 <= fy + 0.5 && fy - 0.5 < srcBounds.y2);
+        if ( _blackOutside && !(xinside && yinside) ) {
+            xinside = yinside = false;
+        }
+        ofxsFilterInterpolate2DSuper<PIX, nComponents, filter, clamp>(fx, fy,
+                                                                      xinside ? Jxx : 0., xinside ? Jxy : 0.,
+                                                                      yinside ? Jyx : 0., yinside ? Jyy : 0.,
+                                                                      _srcImg, _blackOutside, tmpPix);
+    }
+
+    // The spans of a row of the output, see getRowSpans
+    enum RowSpanEnum
+    {
+        eRowSpanOutside,  // black: the filter taps of its pixels are all outside of the source image, or z <= 0
+        eRowSpanBorder,   // processed with all the checks
+        eRowSpanInterior, // the centers of its pixels are inside of the source image
+    };
+
+    struct RowSpan
+    {
+        int x1, x2;
+        RowSpanEnum kind;
+    };
+
+    // The pixels of [x1,x2) in the row at canonical y = cy whose source coordinates through H are in the rectangle r
+    // (with z > 0), or only those with z > 0 if r is NULL. The result is the interval [*i1,*i2), empty if *i1 >= *i2.
+    static void getRowInterval(const OFX::Matrix3x3& H,
+                               double cy,
+                               const OfxRectD* r,
+                               int x1,
+                               int x2,
+                               int* i1,
+                               int* i2)
+    {
+        // Along the row, with u = x + 0.5, the homogeneous source coordinates X, Y, Z are linear in u, and each edge
+        // of the rectangle is a linear inequality a*u + b >= 0 where Z > 0: each one bounds u on one side.
+        const double ax = H(0,0), bx = H(0,1) * cy + H(0,2);
+        const double ay = H(1,0), by = H(1,1) * cy + H(1,2);
+        const double az = H(2,0), bz = H(2,1) * cy + H(2,2);
+        const int n = r ? 5 : 1;
+        const double a[5] = { az, r ? ax - r->x1 * az : 0., r ? r->x2 * az - ax : 0., r ? ay - r->y1 * az : 0., r ? r->y2 * az - ay : 0. };
+        const double b[5] = { bz, r ? bx - r->x1 * bz : 0., r ? r->x2 * bz - bx : 0., r ? by - r->y1 * bz : 0., r ? r->y2 * bz - by : 0. };
+        double lo = x1 + 0.5;
+        double hi = x2 - 0.5;
+
+        for (int k = 0; k < n && lo <= hi; ++k) {
+            if (a[k] > 0.) {
+                lo = (std::max)(lo, -b[k] / a[k]);
+            } else if (a[k] < 0.) {
+                hi = (std::min)(hi, -b[k] / a[k]);
+            } else if (b[k] <= 0.) {
+                hi = lo - 1.;
+            }
+        }
+        if (lo > hi) {
+            *i1 = *i2 = x1;
+
+            return;
+        }
+        *i1 = (int)std::ceil(lo - 0.5);
+        *i2 = (int)std::floor(hi - 0.5) + 1;
+    }
+
+    // Split the pixels [x1,x2) of the row at canonical y = cy into the spans that are black (if _blackOutside, or
+    // where z <= 0), those whose pixel centers are inside of the source image, and the border spans in between,
+    // which are processed with all the checks. Returns the number of spans, at most 5, from left to right.
+    int getRowSpans(const OFX::Matrix3x3& H,
+                    double cy,
+                    int x1,
+                    int x2,
+                    const OfxRectI& srcBounds,
+                    RowSpan* spans) const
+    {
+        // the source coordinates of perspective transforms may be interpolated (see ofxsTransform3x3PerspectiveSpan)
+        const double e = kTransform3x3ProcessorPerspectiveMaxError;
+        // beyond this distance from the source image, the filter taps are all outside, and filterPixel zeroes the
+        // Jacobian, so that the pixel is not supersampled either
+        const double margin = ( (filter == eFilterImpulse) ? 0. : (ofxsFilterTapsCount(filter) == 4) ? 1.5 : 0.5 ) + e;
+        const OfxRectD outer = { srcBounds.x1 - margin, srcBounds.y1 - margin, srcBounds.x2 + margin, srcBounds.y2 + margin };
+        // the pixels that are xinside and yinside in filterPixel
+        const OfxRectD inner = { srcBounds.x1 - 0.5 + e, srcBounds.y1 - 0.5 + e, srcBounds.x2 + 0.5 - e, srcBounds.y2 + 0.5 - e };
+        int o1, o2, i1, i2;
+
+        getRowInterval(H, cy, _blackOutside ? &outer : NULL, x1, x2, &o1, &o2);
+        if (o1 >= o2) {
+            spans[0].x1 = x1;
+            spans[0].x2 = x2;
+            spans[0].kind = eRowSpanOutside;
+
+            return 1;
+        }
+        // the intervals are rounded to pixels: the pixels at their ends are left to the border spans
+        o1 = (std::max)(x1, o1 - 1);
+        o2 = (std::min)(x2, o2 + 1);
+        getRowInterval(H, cy, &inner, o1, o2, &i1, &i2);
+        i1 += 1;
+        i2 -= 1;
+        if (i1 >= i2) {
+            i1 = i2 = o2;
+        }
+        const int bounds[6] = { x1, o1, i1, i2, o2, x2 };
+        const RowSpanEnum kinds[5] = { eRowSpanOutside, eRowSpanBorder, eRowSpanInterior, eRowSpanBorder, eRowSpanOutside };
+        int count = 0;
+        for (int k = 0; k < 5; ++k) {
+            if (bounds[k] < bounds[k + 1]) {
+                spans[count].x1 = bounds[k];
+                spans[count].x2 = bounds[k + 1];
+                spans[count].kind = kinds[k];
+                ++count;
+            }
+        }
+
+        return count;
+    } // getRowSpans
+
+    // write the black pixels [x1,x2) of row y, mixed with the source and masked if needed
+    void fillBlack(int x1,
+                   int x2,
+                   int y,
+                   PIX* dstPix)
+    {
+        if ( (!masked || !_domask) && (_mix == 1.) ) {
+            std::fill(dstPix, dstPix + (x2 - x1) * nComponents, PIX());
+
+            return;
+        }
+        float tmpPix[nComponents];
+        for (int c = 0; c < nComponents; ++c) {
+            tmpPix[c] = 0;
+        }
+        for (int x = x1; x < x2; ++x, dstPix += nComponents) {
+            ofxsMaskMix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
+        }
+    }
+
+    // Nearest neighbour sampling through an axis-aligned transform, without mask or mix.
+    // Each output pixel is a copy of a source pixel, the source column only depends on x and the source row only
+    // depends on y: the source columns are computed once, each source row is expanded once, and the next output rows
+    // that sample the same source row are copies of it.
+    // The source pixels are computed exactly as in multiThreadProcessImagesNoBlur, so that the result is the same.
+    void multiThreadProcessImagesNearestBlit(const OfxRectI &procWindow)
+    {
+        const OFX::Matrix3x3 & H = _invtransform[0];
+        const OfxRectI& bounds = _srcImg->getBounds();
+        const int width = procWindow.x2 - procWindow.x1;
+        const size_t rowBytes = (size_t)width * nComponents * sizeof(PIX);
+        OFX::Point3D canonicalCoords;
+
+        if (width <= 0) {
+            return;
+        }
+
+        // the source column of each output column, or -1 if it is black
+        std::vector<int> srcCol(width);
+        canonicalCoords.z = 1;
+        canonicalCoords.y = (double)procWindow.y1 + 0.5;
+        for (int x = procWindow.x1; x < procWindow.x2; ++x) {
+            canonicalCoords.x = (double)x + 0.5;
+            OFX::Point3D transformed = H * canonicalCoords;
+            int mx = (int)std::floor(transformed.x / transformed.z);
+            if (!_blackOutside) {
+                mx = (std::max)( bounds.x1, (std::min)(mx, bounds.x2 - 1) );
+            }
+            srcCol[x - procWindow.x1] = (bounds.x1 <= mx && mx < bounds.x2) ? mx - bounds.x1 : -1;
+        }
+
+        const PIX* prevDstRow = NULL;
+        int prevSrcRow = 0;
+        canonicalCoords.x = (double)procWindow.x1 + 0.5;
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            canonicalCoords.y = (double)y + 0.5;
+            OFX::Point3D transformed = H * canonicalCoords;
+            int my = (int)std::floor(transformed.y / transformed.z);
+            if (!_blackOutside) {
+                my = (std::max)( bounds.y1, (std::min)(my, bounds.y2 - 1) );
+            }
+            if (prevDstRow && my == prevSrcRow) {
+                std::memcpy(dstPix, prevDstRow, rowBytes);
+            } else if ( (my < bounds.y1) || (bounds.y2 <= my) ) {
+                std::fill(dstPix, dstPix + width * nComponents, PIX());
+            } else {
+                const PIX *srcRow = (const PIX *) _srcImg->getPixelAddress(bounds.x1, my);
+                PIX *dst = dstPix;
+                for (int i = 0; i < width; ++i, dst += nComponents) {
+                    if (srcCol[i] < 0) {
+                        std::fill(dst, dst + nComponents, PIX());
+                    } else {
+                        std::copy(srcRow + srcCol[i] * nComponents, srcRow + (srcCol[i] + 1) * nComponents, dst);
+                    }
+                }
+            }
+            prevDstRow = dstPix;
+            prevSrcRow = my;
+        }
+    } // multiThreadProcessImagesNearestBlit
 
     void multiThreadProcessImagesMotionBlur(const OfxRectI &procWindow, const OfxPointD& rs)
     {
         unused(rs);
+        TranslationBlur blur;
+        if ( getTranslationBlur(&blur) && multiThreadProcessImagesTranslationBlur(procWindow, blur) ) {
+            return;
+        }
         float tmpPix[nComponents];
         const double maxErr2 = kTransform3x3ProcessorMotionBlurMaxError * kTransform3x3ProcessorMotionBlurMaxError; // maximum expected squared error
         const int maxIt = kTransform3x3ProcessorMotionBlurMaxIterations; // maximum number of iterations
-        const int x1 = _srcImg ? _srcImg->getBounds().x1 : 0;
-        const int x2 = _srcImg ? _srcImg->getBounds().x2 : 0;
-        const int y1 = _srcImg ? _srcImg->getBounds().y1 : 0;
-        const int y2 = _srcImg ? _srcImg->getBounds().y2 : 0;
+        OfxRectI srcBounds = {0, 0, 0, 0};
+        if (_srcImg) {
+            srcBounds = _srcImg->getBounds();
+        }
+        // If all the transforms are affine, transformed.z is constant for each of them: the source coordinates are
+        // computed without any division, and the Jacobians are constant.
+        bool affine = true;
+        for (size_t t = 0; t < _invtransformsize && affine; ++t) {
+            affine = (_invtransform[t](2,0) == 0.) && (_invtransform[t](2,1) == 0.);
+        }
+        std::vector<AffineTransform> affineTransforms(affine ? _invtransformsize : 0);
+        for (size_t t = 0; t < affineTransforms.size(); ++t) {
+            const OFX::Matrix3x3& H = _invtransform[t];
+            AffineTransform& A = affineTransforms[t];
+            A.black = !_srcImg || (H(2,2) <= 0.); // at infinity or behind the camera
+            A.z = A.black ? 1. : H(2,2);
+            A.Jxx = H(0,0) / A.z;
+            A.Jxy = H(0,1) / A.z;
+            A.Jyx = H(1,0) / A.z;
+            A.Jyy = H(1,1) / A.z;
+        }
 
         // Monte Carlo integration, starting with at least 13 regularly spaced samples, and then low discrepancy
-        // samples from the van der Corput sequence.
+        // samples from the van der Corput sequence (see setupMotionBlurSamples).
+        const int offsetsMask = kTransform3x3ProcessorMotionBlurOffsetsSize - 1;
+        assert( (int)_motionBlurSamples.size() >= (std::max)(kTransform3x3ProcessorMotionBlurMinIterations, maxIt) );
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
                 break;
@@ -235,6 +835,13 @@ private:
             OFX::Point3D canonicalCoords;
             canonicalCoords.z = 1;
             canonicalCoords.y = (double)y + 0.5;
+            const float* offsetsRow = &_motionBlurOffsets[(y & offsetsMask) * kTransform3x3ProcessorMotionBlurOffsetsSize];
+            for (size_t t = 0; t < affineTransforms.size(); ++t) {
+                const OFX::Matrix3x3& H = _invtransform[t];
+                AffineTransform& A = affineTransforms[t];
+                A.fxRow = (H(0,1) * canonicalCoords.y + H(0,2)) / A.z;
+                A.fyRow = (H(1,1) * canonicalCoords.y + H(1,2)) / A.z;
+            }
 
             for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
                 double acc;
@@ -249,49 +856,57 @@ private:
                     mean[c] = 0.;
                     var[c] = (double)maxValue * maxValue;
                 }
-                unsigned int seed = (unsigned int)( hash(hash( x + (unsigned int)(0x10000 * _motionblur) ) + y) );
+                const double offset = offsetsRow[x & offsetsMask];
                 int sample = 0;
                 const int minsamples = kTransform3x3ProcessorMotionBlurMinIterations; // minimum number of samples (at most maxIt/3
                 int maxsamples = minsamples;
                 while (sample < maxsamples) {
-                    for (; sample < maxsamples; ++sample, ++seed) {
-                        //int t = 0.5*(van_der_corput<2>(seed1) + van_der_corput<3>(seed2)) * _invtransform.size();
+                    for (; sample < maxsamples; ++sample) {
+                        double u = _motionBlurSamples[sample] + offset;
+                        if (u >= 1.) {
+                            u -= 1.;
+                        }
                         int t;
                         if (sample < minsamples) {
                             // distribute the first samples evenly over the interval
-                            t = (int)( ( sample  + van_der_corput<2>(seed) ) * _invtransformsize / (double)minsamples );
+                            t = (int)( ( sample  + u ) * _invtransformsize / (double)minsamples );
                         } else {
-                            t = (int)(van_der_corput<2>(seed) * _invtransformsize);
+                            t = (int)(u * _invtransformsize);
                         }
                         // NON-GENERIC TRANSFORM
 
                         // the coordinates of the center of the pixel in canonical coordinates
                         // see http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#CanonicalCoordinates
                         canonicalCoords.x = (double)x + 0.5;
-                        const OFX::Matrix3x3& H = _invtransform[t];
-                        OFX::Point3D transformed = H * canonicalCoords;
-                        if ( !_srcImg || (transformed.z <= 0.) ) {
-                            // the back-transformed point is at infinity (==0) or behind the camera (<0)
-                            for (int c = 0; c < nComponents; ++c) {
-                                tmpPix[c] = 0;
+                        if (affine) {
+                            const AffineTransform& A = affineTransforms[t];
+                            if (A.black) {
+                                for (int c = 0; c < nComponents; ++c) {
+                                    tmpPix[c] = 0;
+                                }
+                            } else {
+                                filterPixel(A.fxRow + canonicalCoords.x * A.Jxx, A.fyRow + canonicalCoords.x * A.Jyx,
+                                            A.Jxx, A.Jxy, A.Jyx, A.Jyy, srcBounds, false, tmpPix);
                             }
                         } else {
-                            double fx = transformed.z != 0 ? transformed.x / transformed.z : transformed.x;
-                            double fy = transformed.z != 0 ? transformed.y / transformed.z : transformed.y;
-                            if (filter == eFilterImpulse) {
-                                ofxsFilterInterpolate2D<PIX, nComponents, filter, clamp>(fx, fy, _srcImg, _blackOutside, tmpPix);
-                            } else {
-                                bool xinside = (x1 <= fx + 0.5 && fx - 0.5 < x2);
-                                bool yinside = (y1 <= fy + 0.5 && fy - 0.5 < y2);
-                                if ( _blackOutside && !(xinside && yinside) ) {
-                                    xinside = yinside = false;
+                            const OFX::Matrix3x3& H = _invtransform[t];
+                            OFX::Point3D transformed = H * canonicalCoords;
+                            if ( !_srcImg || (transformed.z <= 0.) ) {
+                                // the back-transformed point is at infinity (==0) or behind the camera (<0)
+                                for (int c = 0; c < nComponents; ++c) {
+                                    tmpPix[c] = 0;
                                 }
-
-                                double Jxx = xinside ? (H(0,0) * transformed.z - transformed.x * H(2,0)) / (transformed.z * transformed.z) : 0.;
-                                double Jxy = xinside ? (H(0,1) * transformed.z - transformed.x * H(2,1)) / (transformed.z * transformed.z) : 0.;
-                                double Jyx = yinside ? (H(1,0) * transformed.z - transformed.y * H(2,0)) / (transformed.z * transformed.z) : 0;
-                                double Jyy = yinside ? (H(1,1) * transformed.z - transformed.y * H(2,1)) / (transformed.z * transformed.z) : 0.;
-                                ofxsFilterInterpolate2DSuper<PIX, nComponents, filter, clamp>(fx, fy, Jxx, Jxy, Jyx, Jyy, _srcImg, _blackOutside, tmpPix);
+                            } else {
+                                double fx = transformed.z != 0 ? transformed.x / transformed.z : transformed.x;
+                                double fy = transformed.z != 0 ? transformed.y / transformed.z : transformed.y;
+                                // the Jacobian is only used by the filters that are not Impulse
+                                const double z2 = transformed.z * transformed.z;
+                                filterPixel(fx, fy,
+                                            (H(0,0) * transformed.z - transformed.x * H(2,0)) / z2,
+                                            (H(0,1) * transformed.z - transformed.x * H(2,1)) / z2,
+                                            (H(1,0) * transformed.z - transformed.y * H(2,0)) / z2,
+                                            (H(1,1) * transformed.z - transformed.y * H(2,1)) / z2,
+                                            srcBounds, false, tmpPix);
                             }
                         }
                         if (!_invtransformalpha) {
@@ -357,39 +972,342 @@ private:
         }
     } // multiThreadProcessImagesMotionBlur
 
-    // Compute the /seed/th element of the van der Corput sequence
-    // see http://en.wikipedia.org/wiki/Van_der_Corput_sequence
-    template <int base>
-    double van_der_corput(unsigned int seed)
+    // The motion blur of a translation along one of the axes of the source image, at a constant speed (e.g. a
+    // linearly animated translate): the samples of a pixel lie evenly on a segment of a source row (or column), and
+    // their average is the integral of the interpolated row over that segment, divided by its length.
+    struct TranslationBlur
     {
-        double base_inv;
-        int digit;
-        double r;
+        bool vertical; // the motion is along the y axis of the source image, else along its x axis
+        double to;     // the displacement along that axis over the shutter interval, in source pixels
+    };
 
-        r = 0.0;
+    // Check that the transforms only differ by an evenly spaced translation along one of the axes of the source
+    // image, over at least one pixel, and that the filter does not supersample.
+    bool getTranslationBlur(TranslationBlur* blur) const
+    {
+        if ( !_srcImg || !_srcImg->getPixelData() || _invtransformalpha || (_invtransformsize < 2) ||
+             ( (filter != eFilterImpulse) && (ofxsFilterTapsCount(filter) == 0) ) ) {
+            return false;
+        }
+        const OfxRectI& bounds = _srcImg->getBounds();
+        if ( (bounds.x2 <= bounds.x1) || (bounds.y2 <= bounds.y1) ) {
+            return false;
+        }
+        const OFX::Matrix3x3& H0 = _invtransform[0];
+        const double z = H0(2,2);
+        if ( (H0(2,0) != 0.) || (H0(2,1) != 0.) || (z <= 0.) ) {
+            return false;
+        }
+        const double Jxx = H0(0,0) / z;
+        const double Jxy = H0(0,1) / z;
+        const double Jyx = H0(1,0) / z;
+        const double Jyy = H0(1,1) / z;
+        if ( (Jxx * Jxx + Jyx * Jyx > 1.) || (Jxy * Jxy + Jyy * Jyy > 1.) ) {
+            // minification (see ofxsFilterSupersample)
+            return false;
+        }
+        const OFX::Matrix3x3& Hn = _invtransform[_invtransformsize - 1];
+        const double dx = (Hn(0,2) - H0(0,2)) / z;
+        const double dy = (Hn(1,2) - H0(1,2)) / z;
+        blur->vertical = std::abs(dy) > std::abs(dx);
+        blur->to = blur->vertical ? dy : dx;
+        if (std::abs(blur->to) < 1.) {
+            return false;
+        }
+        for (size_t t = 1; t < _invtransformsize; ++t) {
+            const OFX::Matrix3x3& H = _invtransform[t];
+            if ( (H(0,0) != H0(0,0)) || (H(0,1) != H0(0,1)) || (H(1,0) != H0(1,0)) || (H(1,1) != H0(1,1)) ||
+                 (H(2,0) != 0.) || (H(2,1) != 0.) || (H(2,2) != z) ) {
+                return false;
+            }
+            const double tx = (H(0,2) - H0(0,2)) / z;
+            const double ty = (H(1,2) - H0(1,2)) / z;
+            const double along = blur->vertical ? ty : tx;
+            const double across = blur->vertical ? tx : ty;
+            if ( (std::abs(along - blur->to * t / (_invtransformsize - 1) ) > kTransform3x3ProcessorTranslationBlurMaxError) ||
+                 (std::abs(across) > kTransform3x3ProcessorTranslationBlurMaxError) ) {
+                return false;
+            }
+        }
 
-        base_inv = 1.0 / ( (double)base );
+        return true;
+    } // getTranslationBlur
 
-        while (seed != 0) {
-            digit = seed % base;
-            r = r + ( (double)digit ) * base_inv;
-            base_inv = base_inv / ( (double)base );
-            seed = seed / base;
+    // The integral of the interpolated source lines from the start of a table: the lines are interpolated linearly
+    // between the centers of their pixels (or are piecewise constant for the Impulse filter), and extended by their
+    // padding value on both sides. V holds the n values of a line, from the pixel before the table to the pixel after
+    // it, and P the integral at each of their centers (or at the start of each pixel for the Impulse filter).
+    static void integrateLine(const double* V,
+                              const double* P,
+                              int n,
+                              double s, //!< position, relative to the center (or the start) of the first value
+                              double* F)
+    {
+        const int k = (int)std::floor(s);
+        if (k < 0) {
+            for (int c = 0; c < nComponents; ++c) {
+                F[c] = V[c] * s;
+            }
+        } else if (filter == eFilterImpulse) {
+            if (k >= n) {
+                for (int c = 0; c < nComponents; ++c) {
+                    F[c] = P[n * nComponents + c] + V[(n - 1) * nComponents + c] * (s - n);
+                }
+            } else {
+                for (int c = 0; c < nComponents; ++c) {
+                    F[c] = P[k * nComponents + c] + V[k * nComponents + c] * (s - k);
+                }
+            }
+        } else if (k >= n - 1) {
+            for (int c = 0; c < nComponents; ++c) {
+                F[c] = P[(n - 1) * nComponents + c] + V[(n - 1) * nComponents + c] * ( s - (n - 1) );
+            }
+        } else {
+            const double t = s - k;
+            for (int c = 0; c < nComponents; ++c) {
+                const double v = V[k * nComponents + c];
+                F[c] = P[k * nComponents + c] + v * t + (V[(k + 1) * nComponents + c] - v) * t * t * 0.5;
+            }
         }
+    }
 
-        return r;
+    // The motion blur of a translation, see TranslationBlur. The window is processed in strips of rows, or of
+    // columns if the source lines vary faster along the output rows than along the output columns (e.g. for a
+    // vertical motion), so that the tables of a strip only hold the few source lines it needs. If the transform is
+    // rotated, the strips are also cut along their length, so that each piece crosses about as many source lines
+    // as a strip is thick.
+    // Returns false if a single pixel needs tables that are too large.
+    bool multiThreadProcessImagesTranslationBlur(const OfxRectI &procWindow,
+                                                 const TranslationBlur& blur)
+    {
+        const int size = kTransform3x3ProcessorTranslationBlurStripSize;
+        const OFX::Matrix3x3& H = _invtransform[0];
+        const int iq = blur.vertical ? 0 : 1;
+        const bool rows = std::abs( H(iq,0) ) <= std::abs( H(iq,1) );
+        // the source lines crossed by one pixel along a strip
+        const double qAlong = std::abs( H(iq, rows ? 0 : 1) / H(2,2) );
+        const int s1 = rows ? procWindow.y1 : procWindow.x1;
+        const int s2 = rows ? procWindow.y2 : procWindow.x2;
+        const int p1 = rows ? procWindow.x1 : procWindow.y1;
+        const int p2 = rows ? procWindow.x2 : procWindow.y2;
+        const int piece = (qAlong * (p2 - p1) > size) ? (std::max)(size, (int)(size / qAlong)) : (p2 - p1);
+        // the tables are reused by all the pieces
+        std::vector<double> values;
+        std::vector<double> integrals;
+
+        for (int s = s1; s < s2; s += size) {
+            for (int p = p1; p < p2; p += piece) {
+                if ( _effect.abort() ) {
+                    return true;
+                }
+                OfxRectI win;
+                if (rows) {
+                    win.x1 = p;
+                    win.x2 = (std::min)(p + piece, p2);
+                    win.y1 = s;
+                    win.y2 = (std::min)(s + size, s2);
+                } else {
+                    win.x1 = s;
+                    win.x2 = (std::min)(s + size, s2);
+                    win.y1 = p;
+                    win.y2 = (std::min)(p + piece, p2);
+                }
+                if ( !processTranslationBlurSplit(win, blur, values, integrals) ) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
     }
 
-    unsigned int hash(unsigned int a)
+    // Process a window with processTranslationBlurWindow, splitting it in halves while its tables are too large.
+    bool processTranslationBlurSplit(const OfxRectI &procWindow,
+                                     const TranslationBlur& blur,
+                                     std::vector<double>& values,
+                                     std::vector<double>& integrals)
     {
-        a = (a ^ 61) ^ (a >> 16);
-        a = a + (a << 3);
-        a = a ^ (a >> 4);
-        a = a * 0x27d4eb2d;
-        a = a ^ (a >> 15);
+        if ( processTranslationBlurWindow(procWindow, blur, values, integrals) ) {
+            return true;
+        }
+        const int w = procWindow.x2 - procWindow.x1;
+        const int h = procWindow.y2 - procWindow.y1;
+        if ( (w <= 1) && (h <= 1) ) {
+            return false;
+        }
+        OfxRectI first = procWindow;
+        OfxRectI second = procWindow;
+        if (w >= h) {
+            first.x2 = second.x1 = procWindow.x1 + w / 2;
+        } else {
+            first.y2 = second.y1 = procWindow.y1 + h / 2;
+        }
 
-        return a;
+        return ( processTranslationBlurSplit(first, blur, values, integrals) &&
+                 processTranslationBlurSplit(second, blur, values, integrals) );
     }
+
+    // The integral of each source line that the window needs is tabulated, and each pixel is the difference of two of
+    // its values, for each filter tap across the motion.
+    // Returns false, without rendering anything, if the tables would hold more than
+    // kTransform3x3ProcessorTranslationBlurMaxTableSize values.
+    bool processTranslationBlurWindow(const OfxRectI &procWindow,
+                                      const TranslationBlur& blur,
+                                      std::vector<double>& values,
+                                      std::vector<double>& integrals)
+    {
+        if ( (procWindow.x2 <= procWindow.x1) || (procWindow.y2 <= procWindow.y1) ) {
+            return true;
+        }
+        const OfxsFilterSourceView view(_srcImg);
+        const OFX::Matrix3x3& H = _invtransform[0];
+        const double z = H(2,2);
+        // the source coordinates along the motion (a) and across it (q), at the first transform
+        const int ia = blur.vertical ? 1 : 0;
+        const int iq = 1 - ia;
+        const double aX = H(ia,0) / z, aY = H(ia,1) / z, a0 = H(ia,2) / z;
+        const double qX = H(iq,0) / z, qY = H(iq,1) / z, q0 = H(iq,2) / z;
+        // the source pixels along the motion are [b1,b2), and the source lines are [l1,l2)
+        const int b1 = blur.vertical ? view.bounds.y1 : view.bounds.x1;
+        const int b2 = blur.vertical ? view.bounds.y2 : view.bounds.x2;
+        const int l1 = blur.vertical ? view.bounds.x1 : view.bounds.y1;
+        const int l2 = blur.vertical ? view.bounds.x2 : view.bounds.y2;
+        if ( (b2 <= b1) || (l2 <= l1) ) {
+            return false;
+        }
+
+        // the extent of the source coordinates over the centers of the corners of the window
+        double amin = 0., amax = 0., qmin = 0., qmax = 0.;
+        for (int corner = 0; corner < 4; ++corner) {
+            const double X = (corner & 1) ? procWindow.x2 - 0.5 : procWindow.x1 + 0.5;
+            const double Y = (corner & 2) ? procWindow.y2 - 0.5 : procWindow.y1 + 0.5;
+            const double a = aX * X + aY * Y + a0;
+            const double q = qX * X + qY * Y + q0;
+            amin = corner ? (std::min)(amin, a) : a;
+            amax = corner ? (std::max)(amax, a) : a;
+            qmin = corner ? (std::min)(qmin, q) : q;
+            qmax = corner ? (std::max)(qmax, q) : q;
+        }
+        amin += (std::min)(0., blur.to);
+        amax += (std::max)(0., blur.to);
+        // the lines [L1,L2) hold all the filter taps, and the tables cover the pixels [A1,A2) of each line
+        const int lo = (int)std::floor(qmin) - 2;
+        const int hi = (int)std::floor(qmax) + 3;
+        int L1, L2;
+        if (_blackOutside) {
+            L1 = (std::max)(lo, l1);
+            L2 = (std::min)(hi, l2);
+        } else {
+            L1 = (std::max)( l1, (std::min)(lo, l2 - 1) );
+            L2 = (std::max)( l1, (std::min)(hi - 1, l2 - 1) ) + 1;
+        }
+        const int A1 = (std::max)( b1, (std::min)( (int)std::floor(amin) - 2, b2 - 1 ) );
+        const int A2 = (std::max)( A1 + 1, (std::min)( (int)std::floor(amax) + 3, b2 ) );
+        const int n = A2 - A1 + 2; // with the padding values before and after the table
+        const int nLines = (std::max)(0, L2 - L1);
+        if ( (double)nLines * (2 * n + 1) * nComponents > kTransform3x3ProcessorTranslationBlurMaxTableSize ) {
+            return false;
+        }
+
+        values.resize( (size_t)nLines * n * nComponents );
+        integrals.resize( (size_t)nLines * (n + 1) * nComponents );
+        for (int l = L1; l < L2; ++l) {
+            double* V = &values[(size_t)(l - L1) * n * nComponents];
+            double* P = &integrals[(size_t)(l - L1) * (n + 1) * nComponents];
+            for (int i = 0; i < n; ++i) {
+                int b = A1 - 1 + i;
+                const bool inside = (b1 <= b && b < b2);
+                if (!inside && !_blackOutside) {
+                    b = (std::max)( b1, (std::min)(b, b2 - 1) );
+                }
+                const PIX* pix = (inside || !_blackOutside) ? (blur.vertical ? view.pixel<const PIX>(l, b) : view.pixel<const PIX>(b, l)) : NULL;
+                for (int c = 0; c < nComponents; ++c) {
+                    V[i * nComponents + c] = pix ? (double)pix[c] : 0.;
+                }
+            }
+            for (int c = 0; c < nComponents; ++c) {
+                P[c] = 0.;
+            }
+            for (int i = 0; i < n; ++i) {
+                for (int c = 0; c < nComponents; ++c) {
+                    const double v = V[i * nComponents + c];
+                    const double area = (filter == eFilterImpulse) ? v : ( (i + 1 < n) ? (v + V[(i + 1) * nComponents + c]) * 0.5 : v );
+                    P[(i + 1) * nComponents + c] = P[i * nComponents + c] + area;
+                }
+            }
+        }
+
+        // the position of the first value of the tables
+        const double s0 = (filter == eFilterImpulse) ? A1 - 1 : A1 - 0.5;
+        // Bilinear never overshoots, and Parzen and Notch are not clamped (see ofxsFilterInterpolate2DSeparable)
+        const bool clampTaps = clamp && (filter != eFilterImpulse) && (filter != eFilterBilinear) && (filter != eFilterParzen) && (filter != eFilterNotch);
+        const int ic = (ofxsFilterTapsCount(filter) == 2) ? 0 : 1;
+        float tmpPix[nComponents];
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            double a = aX * (procWindow.x1 + 0.5) + aY * (y + 0.5) + a0;
+            double q = qX * (procWindow.x1 + 0.5) + qY * (y + 0.5) + q0;
+            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents, a += aX, q += qX) {
+                OfxsFilterTaps taps;
+                int nTaps;
+                if (filter == eFilterImpulse) {
+                    nTaps = 1;
+                    int m = (int)std::floor(q);
+                    if (!_blackOutside) {
+                        m = (std::max)( l1, (std::min)(m, l2 - 1) );
+                    }
+                    taps.index[0] = m;
+                    taps.inside[0] = (l1 <= m && m < l2);
+                    taps.weight[0] = 1.;
+                } else {
+                    nTaps = ofxsFilterTapsCount(filter);
+                    ofxsFilterGetTaps<filter>(q, l1, l2, _blackOutside, &taps);
+                }
+                double I[4][nComponents];
+                for (int j = 0; j < nTaps; ++j) {
+                    if ( !taps.inside[j] || (taps.index[j] < L1) || (L2 <= taps.index[j]) ) {
+                        assert(!taps.inside[j]);
+                        for (int c = 0; c < nComponents; ++c) {
+                            I[j][c] = 0.;
+                        }
+                        continue;
+                    }
+                    const double* V = &values[(size_t)(taps.index[j] - L1) * n * nComponents];
+                    const double* P = &integrals[(size_t)(taps.index[j] - L1) * (n + 1) * nComponents];
+                    double F1[nComponents];
+                    double F2[nComponents];
+                    integrateLine(V, P, n, a - s0, F1);
+                    integrateLine(V, P, n, a + blur.to - s0, F2);
+                    for (int c = 0; c < nComponents; ++c) {
+                        I[j][c] = (F2[c] - F1[c]) / blur.to;
+                    }
+                }
+                for (int c = 0; c < nComponents; ++c) {
+                    double sum = 0.;
+                    for (int j = 0; j < nTaps; ++j) {
+                        sum += taps.weight[j] * I[j][c];
+                    }
+                    tmpPix[c] = (float)(clampTaps ? ofxsFilterClampVal(sum, I[ic][c], I[ic + 1][c]) : sum);
+                }
+                ofxsMaskMix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
+            }
+        }
+
+        return true;
+    } // processTranslationBlurWindow
+
+    // an affine inverse transform, divided by its constant z
+    struct AffineTransform
+    {
+        bool black; // z <= 0
+        double z;
+        double Jxx, Jxy, Jyx, Jyy;
+        double fxRow, fyRow; // the source coordinates at x = 0 on the current row
+    };
 };
 } // namespace OFX
 
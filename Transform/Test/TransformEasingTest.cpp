@@ -0,0 +1,139 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * TransformEasingTest: check the easing tables of the Transform plugin against an exact Bezier solver.
+ * Every preset curve, and some custom curves, are evaluated at kSampleCount + 1 points. The tables must stay within
+ * kMaxError of the exact curve, and be at least as accurate as findBezierY(), which they replace.
+ * Returns 0 if all the curves pass.
+ */
+
+#include <cmath>
+#include <cstdio>
+
+#include "../TransformEasing.h"
+
+using namespace OFX;
+
+#define kSampleCount 100000
+#define kMaxError 5e-6 // the tolerance of findTForX(), times the steepest slope of the presets
+
+namespace {
+// the y of the curve at x = m, with t bisected down to the last bit
+double
+exactBezierY(double m,
+             const OfxPointD& p1,
+             const OfxPointD& p2)
+{
+    double t_low = 0.;
+    double t_high = 1.;
+
+    for (;;) {
+        const double t_mid = (t_low + t_high) / 2.;
+        if ( (t_mid <= t_low) || (t_high <= t_mid) ) {
+            break;
+        }
+        if (bezierX(t_mid, p1, p2) < m) {
+            t_low = t_mid;
+        } else {
+            t_high = t_mid;
+        }
+    }
+
+    return bezierY( (t_low + t_high) / 2., p1, p2 );
+}
+
+// compare a table with the exact curve and with findBezierY(). Returns false if it fails.
+template <class TABLE>
+bool
+checkCurve(const char* name,
+           const TABLE& table,
+           const OfxPointD& p1,
+           const OfxPointD& p2)
+{
+    double tableError = 0.;
+    double directError = 0.;
+
+    for (int i = 0; i <= kSampleCount; ++i) {
+        const double m = i / (double)kSampleCount;
+        const double exact = exactBezierY(m, p1, p2);
+        tableError = std::max( tableError, std::abs(table.value(m) - exact) );
+        directError = std::max( directError, std::abs(findBezierY(m, p1, p2) - exact) );
+    }
+    const bool ok = (tableError <= kMaxError) && (tableError <= directError);
+    std::printf("%-12s table error %.3g, findBezierY error %.3g%s\n", name, tableError, directError, ok ? "" : "  FAILED");
+
+    return ok;
+}
+
+// a preset, as a table of its own
+class PresetTable
+{
+public:
+    PresetTable(const EasingPresets& presets,
+                CurveTypeEnum curveType)
+        : _presets(presets)
+        , _curveType(curveType)
+    {
+    }
+
+    double value(double m) const
+    {
+        return _presets.value(_curveType, m);
+    }
+
+private:
+    const EasingPresets& _presets;
+    CurveTypeEnum _curveType;
+};
+} // namespace
+
+int
+main()
+{
+    const EasingPresets presets;
+    bool ok = true;
+
+    for (int i = eCurveTypeDefault; i < eCurveTypeUniform; ++i) {
+        OfxPointD p1, p2;
+        getCurveValue( (CurveTypeEnum)i, &p1.x, &p1.y, &p2.x, &p2.y );
+        char name[32];
+        std::snprintf(name, sizeof(name), "preset %d", i);
+        ok = checkCurve( name, PresetTable(presets, (CurveTypeEnum)i), p1, p2 ) && ok;
+    }
+
+    // custom curves: flat ends, overshoots, and control points on the edges of the tabulable range
+    static const double custom[][4] = {
+        {0., 0., 1., 1.},
+        {0., 1., 1., 0.},
+        {1., 0., 0., 1.},
+        {0.2, -0.8, 0.8, 1.8},
+        {0.05, 0.9, 0.95, 0.1},
+        {1., 1., 1., 1.},
+    };
+    for (size_t i = 0; i < sizeof(custom) / sizeof(custom[0]); ++i) {
+        const OfxPointD p1 = { custom[i][0], custom[i][1] };
+        const OfxPointD p2 = { custom[i][2], custom[i][3] };
+        char name[32];
+        std::snprintf(name, sizeof(name), "custom %d", (int)i);
+        ok = checkCurve( name, EasingTable(p1, p2), p1, p2 ) && ok;
+    }
+
+    return ok ? 0 : 1;
+} // main
@@ -21,14 +21,17 @@
  * OFX Transform & DirBlur plugins.
  */
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include "ofxsTransform3x3.h"
 #include "ofxsTransformInteract.h"
 #include "ofxsCoords.h"
 #include "ofxsThreadSuite.h"
+#include "TransformEasing.h"
 #include "exprtk.hpp"
 
 using namespace OFX;
@@ -64,103 +67,6 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define M_E         2.71828182845904523536028747135266249   /* e              */
 #endif
 
-enum CurveTypeEnum
-{
-    eCurveTypeCustom,
-    eCurveTypeDefault,
-    eCurveTypeEase,
-    eCurveTypeEaseIn,
-    eCurveTypeEaseOut,
-    eCurveTypeQuad,
-    eCurveTypeQuadIn,
-    eCurveTypeQuadOut,
-    eCurveTypeCubic,
-    eCurveTypeCubicIn,
-    eCurveTypeCubicOut,
-    eCurveTypeQuart,
-    eCurveTypeQuartIn,
-    eCurveTypeQuartOut,
-    eCurveTypeQuint,
-    eCurveTypeQuintIn,
-    eCurveTypeQuintOut,
-    eCurveTypeExpo,
-    eCurveTypeExpoIn,
-    eCurveTypeExpoOut,
-    eCurveTypeCirc,
-    eCurveTypeCircIn,
-    eCurveTypeCircOut,
-    eCurveTypeBack,
-    eCurveTypeBackIn,
-    eCurveTypeBackOut,
-    eCurveTypeLinear,
-    eCurveTypeUniform
-};
-
-inline static void
-getCurveValue(const CurveTypeEnum curveType,
-    double* x1,
-    double* y1,
-    double* x2,
-    double* y2)
-{
-    switch (curveType) {
-    case eCurveTypeDefault:
-        *x1 = 0.50; *y1 = 0.00; *x2 = 0.50; *y2 = 1.00; break;
-    case eCurveTypeLinear:
-        *x1 = 0.00; *y1 = 0.00; *x2 = 1.00; *y2 = 1.00; break;
-    case eCurveTypeEase:
-        *x1 = 0.42; *y1 = 0.00; *x2 = 0.58; *y2 = 1.00; break;
-    case eCurveTypeEaseIn:
-        *x1 = 0.42; *y1 = 0.00; *x2 = 1.00; *y2 = 1.00; break;
-    case eCurveTypeEaseOut:
-        *x1 = 0.00; *y1 = 0.00; *x2 = 0.58; *y2 = 1.00; break;
-    case eCurveTypeQuad:
-        *x1 = 0.48; *y1 = 0.04; *x2 = 0.52; *y2 = 0.96; break;
-    case eCurveTypeQuadIn:
-        *x1 = 0.26; *y1 = 0.00; *x2 = 0.60; *y2 = 0.20; break;
-    case eCurveTypeQuadOut:
-        *x1 = 0.40; *y1 = 0.80; *x2 = 0.74; *y2 = 1.00; break;
-    case eCurveTypeCubic:
-        *x1 = 0.66; *y1 = 0.00; *x2 = 0.34; *y2 = 1.00; break;
-    case eCurveTypeCubicIn:
-        *x1 = 0.40; *y1 = 0.00; *x2 = 0.68; *y2 = 0.06; break;
-    case eCurveTypeCubicOut:
-        *x1 = 0.32; *y1 = 0.94; *x2 = 0.60; *y2 = 1.00; break;
-    case eCurveTypeQuart:
-        *x1 = 0.76; *y1 = 0.00; *x2 = 0.24; *y2 = 1.00; break;
-    case eCurveTypeQuartIn:
-        *x1 = 0.52; *y1 = 0.00; *x2 = 0.74; *y2 = 0.00; break;
-    case eCurveTypeQuartOut:
-        *x1 = 0.26; *y1 = 1.00; *x2 = 0.48; *y2 = 1.00; break;
-    case eCurveTypeQuint:
-        *x1 = 0.84; *y1 = 0.00; *x2 = 0.16; *y2 = 1.00; break;
-    case eCurveTypeQuintIn:
-        *x1 = 0.64; *y1 = 0.00; *x2 = 0.78; *y2 = 0.00; break;
-    case eCurveTypeQuintOut:
-        *x1 = 0.22; *y1 = 1.00; *x2 = 0.36; *y2 = 1.00; break;
-    case eCurveTypeExpo:
-        *x1 = 0.90; *y1 = 0.00; *x2 = 0.10; *y2 = 1.00; break;
-    case eCurveTypeExpoIn:
-        *x1 = 0.66; *y1 = 0.00; *x2 = 0.86; *y2 = 0.00; break;
-    case eCurveTypeExpoOut:
-        *x1 = 0.14; *y1 = 1.00; *x2 = 0.34; *y2 = 1.00; break;
-    case eCurveTypeCirc:
-        *x1 = 0.88; *y1 = 0.14; *x2 = 0.12; *y2 = 0.86; break;
-    case eCurveTypeCircIn:
-        *x1 = 0.54; *y1 = 0.00; *x2 = 1.00; *y2 = 0.44; break;
-    case eCurveTypeCircOut:
-        *x1 = 0.00; *y1 = 0.56; *x2 = 0.46; *y2 = 1.00; break;
-    case eCurveTypeBack:
-        *x1 = 0.68; *y1 = -0.55; *x2 = 0.27; *y2 = 1.55; break;
-    case eCurveTypeBackIn:
-        *x1 = 0.60; *y1 = -0.28; *x2 = 0.73; *y2 = 0.04; break;
-    case eCurveTypeBackOut:
-        *x1 = 0.17; *y1 = 0.89; *x2 = 0.32; *y2 = 1.27; break;
-    default:
-        break;
-    }
-}
-
 enum FrequencyUnitEnum
 {
     eFrequencyUnitHz,
@@ -236,6 +142,349 @@ convertFrequency(FrequencyUnitEnum unitInput, FrequencyUnitEnum unitOutput, cons
     if (unitInput == eFrequencyUnitHz && unitOutput == eFrequencyUnitBPM) { *f /= n; }
 }
 
+// built once when the plugin is loaded
+static const EasingPresets gEasingPresets;
+
+#define kEasingTableCacheSize 8 // number of custom easing curves kept by an instance
+
+// The tables of the custom easing curves of an instance, keyed by their control points.
+// A table is only built the second time some control points are used, so that animated control points, which are
+// different at each time, are still solved directly.
+class EasingTableCache
+{
+    typedef MultiThread::AutoMutex AutoMutex;
+
+    struct Entry
+    {
+        OfxPointD p1;
+        OfxPointD p2;
+        std::shared_ptr<const EasingTable> table; // NULL if the control points were used only once
+    };
+
+public:
+    // the table of some control points, or NULL if they cannot be tabulated or were not used before
+    std::shared_ptr<const EasingTable> table(const OfxPointD& p1,
+                                             const OfxPointD& p2)
+    {
+        std::shared_ptr<const EasingTable> table;
+        if ( !EasingTable::isTabulable(p1, p2) ) {
+            return table;
+        }
+        {
+            AutoMutex lock(_mutex);
+            std::vector<Entry>::iterator it = _entries.begin();
+            while ( it != _entries.end() &&
+                    (it->p1.x != p1.x || it->p1.y != p1.y || it->p2.x != p2.x || it->p2.y != p2.y) ) {
+                ++it;
+            }
+            if ( it == _entries.end() ) {
+                // first use: remember the control points, evicting the least recently used ones
+                if (_entries.size() >= kEasingTableCacheSize) {
+                    _entries.erase( _entries.begin() );
+                }
+                Entry entry;
+                entry.p1 = p1;
+                entry.p2 = p2;
+                _entries.push_back(entry);
+            } else {
+                Entry entry = *it;
+                _entries.erase(it);
+                if (!entry.table) {
+                    entry.table.reset( new EasingTable(p1, p2) );
+                }
+                table = entry.table;
+                _entries.push_back(entry);
+            }
+        }
+
+        return table;
+    }
+
+private:
+    MultiThread::Mutex _mutex;
+    std::vector<Entry> _entries; // the most recently used last
+};
+
+// the values of the parameters of a TransformPlugin at one time
+struct TransformValues
+{
+    TransformValues()
+        : time(0.)
+        , periodicRadius(0.)
+        , periodicRotate(0.)
+        , periodicDeform(1.)
+        , periodicBend(0.)
+        , periodicN(1)
+        , periodicInterval(1)
+        , periodicCurve(eCurveTypeDefault)
+        , periodicFrequencyUnit(eFrequencyUnitHz)
+        , periodicFrequencyBeat(eBPMTypeQuarter)
+        , periodicSymmetry(false)
+        , periodicFrequency(0.)
+        , periodicAutorotate(0.)
+        , periodicScale(1.)
+        , periodicScaleStep(0.)
+        , periodicScaleStepAnimated(false)
+        , periodicOffset(0.)
+        , periodicSkip(0.)
+        , functionFrequency(1.)
+        , functionUnit(0.5)
+        , functionRoundTrip(eRoundTripNone)
+        , functionRotate(0.)
+        , functionCurve(eCurveTypeLinear)
+        , functionSymmetry(false)
+        , scaleUniform(false)
+        , flop(false)
+        , flip(false)
+        , rotate(0.)
+        , faceToCenter(false)
+        , skewX(0.)
+        , skewY(0.)
+        , skewOrder(0)
+        , transformAmount(1.)
+    {
+        center.x = 0.;
+        center.y = 0.;
+        translate.x = 0.;
+        translate.y = 0.;
+        periodicBezierP1.x = 0.;
+        periodicBezierP1.y = 0.;
+        periodicBezierP2.x = 1.;
+        periodicBezierP2.y = 1.;
+        functionDomain.x = -1.;
+        functionDomain.y = 1.;
+        functionBezierP1.x = 0.;
+        functionBezierP1.y = 0.;
+        functionBezierP2.x = 1.;
+        functionBezierP2.y = 1.;
+        scaleParam.x = 1.;
+        scaleParam.y = 1.;
+    }
+
+    double time;
+    OfxPointD center;
+    OfxPointD translate;
+    double periodicRadius;
+    double periodicRotate;
+    double periodicDeform;
+    double periodicBend;
+    int periodicN;
+    int periodicInterval;
+    CurveTypeEnum periodicCurve;
+    FrequencyUnitEnum periodicFrequencyUnit;
+    BeatTypeEnum periodicFrequencyBeat;
+    OfxPointD periodicBezierP1;
+    OfxPointD periodicBezierP2;
+    bool periodicSymmetry;
+    double periodicFrequency;
+    double periodicAutorotate;
+    double periodicScale;
+    double periodicScaleStep;
+    bool periodicScaleStepAnimated; // the scale step is then averaged over the frames since frame 0
+    double periodicOffset;
+    double periodicSkip;
+    double functionFrequency;
+    std::string functionExpression;
+    OfxPointD functionDomain;
+    double functionUnit;
+    RoundTripEnum functionRoundTrip;
+    double functionRotate;
+    CurveTypeEnum functionCurve;
+    OfxPointD functionBezierP1;
+    OfxPointD functionBezierP2;
+    bool functionSymmetry;
+    OfxPointD scaleParam;
+    bool scaleUniform;
+    bool flop;
+    bool flip;
+    double rotate;
+    bool faceToCenter;
+    double skewX;
+    double skewY;
+    int skewOrder;
+    double transformAmount;
+};
+
+// the parameters of a TransformPlugin at a set of times, see Transform3x3Plugin::getTransformParams()
+class TransformParamsBatch
+    : public Transform3x3Plugin::TransformParams
+{
+public:
+    std::vector<TransformValues> values;
+    OfxPointD projectSize;
+    OfxPointD projectOffset;
+    double frameRate;
+};
+
+// The compiled programs of the function expression of an instance.
+// exprtk binds the variable x by reference, so that a compiled program can only be evaluated by one thread at a
+// time: each render takes an idle program from the pool, or compiles a new one, and gives it back after the
+// evaluation. The pool thus holds one program per render thread, and is flushed when the expression changes.
+class TransformExpressionCache
+{
+    typedef exprtk::symbol_table<double> symbol_table_t;
+    typedef exprtk::expression<double>   expression_t;
+    typedef exprtk::parser<double>       parser_t;
+    typedef MultiThread::AutoMutex AutoMutex;
+
+    struct Program
+    {
+        symbol_table_t constants;
+        symbol_table_t symbols;
+        expression_t expression;
+        double x;
+    };
+
+public:
+    TransformExpressionCache()
+    {
+    }
+
+    ~TransformExpressionCache()
+    {
+        flush();
+    }
+
+    // A program taken from the pool for a series of evaluations, e.g. all the motion blur samples of a render, and
+    // given back when the lease is destroyed.
+    class Lease
+    {
+    public:
+        Lease(TransformExpressionCache& cache)
+            : _cache(cache)
+            , _program(NULL)
+        {
+        }
+
+        ~Lease()
+        {
+            release();
+        }
+
+        // the value of the expression at x. An invalid expression evaluates as exprtk evaluates it.
+        double evaluate(const std::string& text,
+                        double x)
+        {
+            if ( _program && (text != _text) ) {
+                release();
+            }
+            if (!_program) {
+                _program = _cache.acquire(text);
+                _text = text;
+            }
+            _program->x = x;
+
+            return _program->expression.value();
+        }
+
+    private:
+        void release()
+        {
+            if (_program) {
+                _cache.release(_text, _program);
+                _program = NULL;
+            }
+        }
+
+        TransformExpressionCache& _cache;
+        std::string _text;
+        Program* _program;
+    };
+
+    // check that an expression compiles, for the UI
+    static bool check(const std::string& text,
+                      std::string* error)
+    {
+        Program* program = compile(text, error);
+        delete program;
+
+        return error->empty();
+    }
+
+private:
+    Program* acquire(const std::string& text)
+    {
+        {
+            AutoMutex lock(_mutex);
+            if (text != _text) {
+                flush();
+                _text = text;
+            }
+            if ( !_idle.empty() ) {
+                Program* program = _idle.back();
+                _idle.pop_back();
+
+                return program;
+            }
+        }
+
+        // compile outside of the lock, the other threads may evaluate in the meantime
+        return compile(text, NULL);
+    }
+
+    void release(const std::string& text,
+                 Program* program)
+    {
+        {
+            AutoMutex lock(_mutex);
+            if (text == _text) {
+                _idle.push_back(program);
+                program = NULL;
+            }
+        }
+        delete program; // the expression changed in the meantime
+    }
+
+    static Program* compile(const std::string& text,
+                            std::string* error)
+    {
+        Program* program = new Program;
+
+        program->x = 0.;
+        program->constants.add_constants();
+        program->symbols.add_constant("e", exprtk::details::numeric::constant::e);
+        program->expression.register_symbol_table(program->constants);
+        program->symbols.add_variable("x", program->x);
+        program->expression.register_symbol_table(program->symbols);
+        parser_t parser;
+        if ( !parser.compile(text, program->expression) && error ) {
+            *error = parser.error();
+        }
+
+        return program;
+    }
+
+    // must be called with _mutex locked
+    void flush()
+    {
+        for (std::size_t i = 0; i < _idle.size(); ++i) {
+            delete _idle[i];
+        }
+        _idle.clear();
+    }
+
+    MultiThread::Mutex _mutex;
+    std::string _text;
+    std::vector<Program*> _idle;
+};
+
+// what the samples of a batch share: the expression program, and the last table of a custom easing curve
+struct TransformBatchState
+{
+    TransformBatchState(TransformExpressionCache& expressionCache)
+        : expression(expressionCache)
+        , easingP1()
+        , easingP2()
+        , easingTable()
+    {
+    }
+
+    TransformExpressionCache::Lease expression;
+    OfxPointD easingP1;
+    OfxPointD easingP2;
+    std::shared_ptr<const EasingTable> easingTable; // the table of easingP1 and easingP2, if any
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class TransformPlugin
@@ -358,9 +607,29 @@ public:
 private:
     virtual bool isIdentity(double time) OVERRIDE FINAL;
     virtual bool getInverseTransformCanonical(double time, int view, double amount, bool invert, Matrix3x3* invtransform) const OVERRIDE FINAL;
+    virtual TransformParams* getTransformParams(const double* times, size_t n, int view) const OVERRIDE FINAL;
+    virtual bool getInverseTransformCanonicalFromParams(const TransformParams& params, size_t i, double amount, bool invert, Matrix3x3* invtransform) const OVERRIDE FINAL;
+    virtual void getInverseTransformsCanonical(const double* times, const double* amounts, size_t n, int view, bool invert, Matrix3x3* invtransforms, bool* success) const OVERRIDE FINAL;
+    bool getInverseTransformCanonicalFromBatch(const TransformParamsBatch& batch, size_t i, double amount, bool invert, TransformBatchState* state, Matrix3x3* invtransform) const;
 
     void resetCenter(double time);
 
+    // the animated parameters that are integrated over the frames since frame 0
+    enum FrameSumEnum
+    {
+        eFrameSumPeriodicFrequency = 0, // in Hz
+        eFrameSumPeriodicAutorotate,
+        eFrameSumPeriodicScaleStep,     // inverse of the step
+        eFrameSumFunctionFrequency,
+        eFrameSumCount
+    };
+
+    double ease(CurveTypeEnum curveType, double m, const OfxPointD& p1, const OfxPointD& p2, TransformBatchState* state) const;
+    double frameSumValue(FrameSumEnum sum, int frame) const;
+    bool getFrameSumFingerprint(FrameSumEnum sum, std::vector<double>* fingerprint) const;
+    double frameSum(FrameSumEnum sum, double time) const;
+    void invalidateFrameSum(FrameSumEnum sum);
+
     virtual void changedParam(const InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
     virtual void getClipPreferences(ClipPreferencesSetter& clipPreferences) OVERRIDE FINAL;
 
@@ -411,8 +680,188 @@ private:
     BooleanParam* _centerChanged;
     BooleanParam* _interactive;
     BooleanParam* _srcClipChanged; // set to true the first time the user connects src
+    mutable TransformExpressionCache _functionExpressionCache;
+    mutable EasingTableCache _customEasingTables;
+    mutable MultiThread::Mutex _frameSumsMutex;
+    mutable std::vector<double> _frameSums[eFrameSumCount]; // _frameSums[sum][n] is the sum over the frames 0 to n-1
+    mutable std::vector<double> _frameSumFingerprints[eFrameSumCount]; // the animation the sums were computed from
 };
 
+// the value at m of an easing curve, from the preset tables or from a table of the instance for custom curves
+double
+TransformPlugin::ease(CurveTypeEnum curveType,
+                      double m,
+                      const OfxPointD& p1,
+                      const OfxPointD& p2,
+                      TransformBatchState* state) const
+{
+    if ( (curveType != eCurveTypeCustom) && (curveType != eCurveTypeUniform) ) {
+        return gEasingPresets.value(curveType, m);
+    }
+    // the control points are usually the same for all the samples of a batch: only look up the cache when they change,
+    // or while there is no table for them yet
+    if ( !state->easingTable ||
+         (state->easingP1.x != p1.x) || (state->easingP1.y != p1.y) || (state->easingP2.x != p2.x) || (state->easingP2.y != p2.y) ) {
+        state->easingP1 = p1;
+        state->easingP2 = p2;
+        state->easingTable = _customEasingTables.table(p1, p2);
+    }
+
+    return state->easingTable ? state->easingTable->value(m) : findBezierY(m, p1, p2);
+}
+
+// the value of an integrated parameter at an integer frame
+double
+TransformPlugin::frameSumValue(FrameSumEnum sum,
+                               int frame) const
+{
+    switch (sum) {
+    case eFrameSumPeriodicFrequency: {
+        double f = _periodicFrequency->getValueAtTime(frame);
+        FrequencyUnitEnum periodicFrequencyUnit = eFrequencyUnitHz;
+        if (_periodicFrequencyUnit) {
+            periodicFrequencyUnit = (FrequencyUnitEnum)_periodicFrequencyUnit->getValue();
+        }
+        convertFrequency(periodicFrequencyUnit, eFrequencyUnitHz, (BeatTypeEnum)_periodicFrequencyBeat->getValueAtTime(frame), &f);
+
+        return f;
+    }
+    case eFrameSumPeriodicAutorotate:
+
+        return _periodicAutorotate->getValueAtTime(frame);
+    case eFrameSumPeriodicScaleStep: {
+        double s = _periodicScaleStep->getValueAtTime(frame);
+
+        return s != 0 ? 1 / s : 0;
+    }
+    case eFrameSumFunctionFrequency:
+
+        return _functionFrequency->getValueAtTime(frame);
+    case eFrameSumCount:
+        break;
+    }
+    assert(false);
+
+    return 0.;
+}
+
+// Append the animation of a parameter to a fingerprint: its value if it is constant, or its keyframes.
+// Returns false if the parameter is animated without keyframes (e.g. by an expression), which no fingerprint can follow.
+template <class PARAM>
+static bool
+appendAnimationFingerprint(PARAM* param,
+                           std::vector<double>* fingerprint)
+{
+    if (!param) {
+        return true;
+    }
+    const unsigned int nKeys = param->getNumKeys();
+    if (nKeys == 0) {
+        if ( param->getIsAnimating() ) {
+            return false;
+        }
+        fingerprint->push_back(0.);
+        fingerprint->push_back( (double)param->getValue() );
+
+        return true;
+    }
+    fingerprint->push_back( (double)nKeys );
+    for (unsigned int k = 0; k < nKeys; ++k) {
+        const double t = param->getKeyTime(k);
+        fingerprint->push_back(t);
+        fingerprint->push_back( (double)param->getValueAtTime(t) );
+    }
+
+    return true;
+}
+
+// The animation of the parameters an integrated parameter is computed from.
+// Returns false if it cannot be fingerprinted, in which case the sums must not be kept.
+bool
+TransformPlugin::getFrameSumFingerprint(FrameSumEnum sum,
+                                        std::vector<double>* fingerprint) const
+{
+    switch (sum) {
+    case eFrameSumPeriodicFrequency:
+
+        return ( appendAnimationFingerprint(_periodicFrequency, fingerprint) &&
+                 appendAnimationFingerprint(_periodicFrequencyUnit, fingerprint) &&
+                 appendAnimationFingerprint(_periodicFrequencyBeat, fingerprint) );
+    case eFrameSumPeriodicAutorotate:
+
+        return appendAnimationFingerprint(_periodicAutorotate, fingerprint);
+    case eFrameSumPeriodicScaleStep:
+
+        return appendAnimationFingerprint(_periodicScaleStep, fingerprint);
+    case eFrameSumFunctionFrequency:
+
+        return appendAnimationFingerprint(_functionFrequency, fingerprint);
+    case eFrameSumCount:
+        break;
+    }
+    assert(false);
+
+    return false;
+}
+
+// The sum of the values of an integrated parameter at the frames 0 to floor(time), or 0 if time is negative.
+// The prefix sums are kept from one call to the next and only extended up to the latest frame asked for, so that
+// rendering any frame costs one lookup, in the same order of summation as a loop from frame 0.
+// The host does not always call changedParam when an animation changes (e.g. a linked curve), so the sums are
+// checked against a fingerprint of the keyframes at each call. The values are fetched from the host before the lock
+// is taken, and the lock is only held to read or publish the sums.
+double
+TransformPlugin::frameSum(FrameSumEnum sum,
+                          double time) const
+{
+    if (time < 0) {
+        return 0.;
+    }
+    const std::size_t n = (std::size_t)std::floor(time) + 1;
+    std::vector<double> fingerprint;
+    const bool keep = getFrameSumFingerprint(sum, &fingerprint);
+    std::size_t start = 0; // the first frame to add
+    double total = 0.;
+    if (keep) {
+        MultiThread::AutoMutex lock(_frameSumsMutex);
+        const std::vector<double>& sums = _frameSums[sum];
+        if ( !sums.empty() && (_frameSumFingerprints[sum] == fingerprint) ) {
+            if (sums.size() > n) {
+                return sums[n];
+            }
+            start = sums.size() - 1;
+            total = sums.back();
+        }
+    }
+    std::vector<double> extension; // the sums over the frames 0 to start, ..., 0 to n-1
+    extension.reserve(n - start);
+    for (std::size_t frame = start; frame < n; ++frame) {
+        total += frameSumValue(sum, (int)frame);
+        extension.push_back(total);
+    }
+    if (keep) {
+        MultiThread::AutoMutex lock(_frameSumsMutex);
+        std::vector<double>& sums = _frameSums[sum];
+        if ( (start == 0) && ( (_frameSumFingerprints[sum] != fingerprint) || (sums.size() <= n) ) ) {
+            sums.assign(1, 0.);
+            sums.insert( sums.end(), extension.begin(), extension.end() );
+            _frameSumFingerprints[sum].swap(fingerprint);
+        } else if ( (start > 0) && (sums.size() == start + 1) && (_frameSumFingerprints[sum] == fingerprint) ) {
+            sums.insert( sums.end(), extension.begin(), extension.end() );
+        }
+    }
+
+    return total;
+} // TransformPlugin::frameSum
+
+void
+TransformPlugin::invalidateFrameSum(FrameSumEnum sum)
+{
+    MultiThread::AutoMutex lock(_frameSumsMutex);
+
+    _frameSums[sum].clear();
+}
+
 // overridden is identity
 bool
 TransformPlugin::isIdentity(double time)
@@ -511,9 +960,7 @@ TransformPlugin::isIdentity(double time)
     double functionFrequency = 1.;
     if (_functionFrequency) {
         if (_functionFrequency->getIsAnimating()) {
-            functionFrequency = 0;
-            for (int i = 0; i <= time; i++) { functionFrequency += _functionFrequency->getValueAtTime(i); }
-            functionFrequency /= std::floor(time) + 1;
+            functionFrequency = frameSum(eFrameSumFunctionFrequency, time) / (std::floor(time) + 1);
         } else { functionFrequency = _functionFrequency->getValueAtTime(time); }
     }
     std::string functionExpression = "";
@@ -562,223 +1009,196 @@ TransformPlugin::getClipPreferences(ClipPreferencesSetter& clipPreferences)
     clipPreferences.setOutputFrameVarying(true);
 }
 
-static double bezierX(double t,
-                      OfxPointD p1,
-                      OfxPointD p2) {
-    return 3 * (1 - t) * (1 - t) * t * p1.x + 3 * (1 - t) * t * t * p2.x + t * t * t;
-}
-
-static double bezierY(double t,
-                      OfxPointD p1,
-                      OfxPointD p2) {
-    return 3 * (1 - t) * (1 - t) * t * p1.y + 3 * (1 - t) * t * t * p2.y + t * t * t;
-}
-
-static double findTForX(double m,
-                        OfxPointD p1,
-                        OfxPointD p2) {
-    double t_low = 0.0;
-    double t_high = 1.0;
-    double t_mid = (t_low + t_high) / 2.0;
-
-    while ((t_high - t_low) / 2.0 > 1e-6) {
-        if (bezierX(t_mid, p1, p2) < m) {
-            t_low = t_mid;
-        }
-        else {
-            t_high = t_mid;
-        }
-        t_mid = (t_low + t_high) / 2.0;
-    }
-
-    return t_mid;
-}
-
-static double findBezierY(double m,
-                          OfxPointD p1,
-                          OfxPointD p2) {
-    double t = findTForX(m, p1, p2);
-    return bezierY(t, p1, p2);
-}
-
-bool
-TransformPlugin::getInverseTransformCanonical(double time,
-                                              int /*view*/,
-                                              double amount,
-                                              bool invert,
-                                              Matrix3x3* invtransform) const
+// fetch all the parameters of the transform at the given times, the non-animated ones only once
+Transform3x3Plugin::TransformParams*
+TransformPlugin::getTransformParams(const double* times,
+                                    size_t n,
+                                    int /*view*/) const
 {
-    // NON-GENERIC
-    OfxPointD center = { 0., 0. };
-    if (_center) {
-        _center->getValueAtTime(time, center.x, center.y);
-    }
-    OfxPointD translate = { 0., 0. };
-    if (_translate) {
-        _translate->getValueAtTime(time, translate.x, translate.y);
-    }
-    double periodicRadius = 0.;
-    if (_periodicRadius) {
-        periodicRadius = _periodicRadius->getValueAtTime(time);
-    }
-    double periodicRotate = 0.;
-    if (_periodicRotate) {
-        periodicRotate = _periodicRotate->getValueAtTime(time);
-    }
-    double periodicDeform = 1.;
-    if (_periodicDeform) {
-        periodicDeform = _periodicDeform->getValueAtTime(time);
-    }
-    double periodicBend = 0.;
-    if (_periodicBend) {
-        periodicBend = _periodicBend->getValueAtTime(time);
-    }
-    int periodicN = 1;
-    if (_periodicN) {
-        periodicN = _periodicN->getValueAtTime(time);
-    }
-    int periodicInterval = 1;
-    if (_periodicInterval) {
-        periodicInterval = _periodicInterval->getValueAtTime(time);
+    TransformParamsBatch* params = new TransformParamsBatch;
+    std::vector<TransformValues>& values = params->values;
+
+    params->projectSize = getProjectSize();
+    params->projectOffset = getProjectOffset();
+    params->frameRate = getFrameRate();
+    values.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        values[i].time = times[i];
     }
-    CurveTypeEnum periodicCurve = eCurveTypeDefault;
-    if (_periodicCurve) {
-        periodicCurve = (CurveTypeEnum)_periodicCurve->getValueAtTime(time);
+    if (n == 0) {
+        return params;
     }
-    FrequencyUnitEnum periodicFrequencyUnit = eFrequencyUnitHz;
+    TransformValues* v = &values.front();
+    // NON-GENERIC
+    ofxsGetValuesAtTimes(_center, times, n, v, &TransformValues::center);
+    ofxsGetValuesAtTimes(_translate, times, n, v, &TransformValues::translate);
+    ofxsGetValuesAtTimes(_periodicRadius, times, n, v, &TransformValues::periodicRadius);
+    ofxsGetValuesAtTimes(_periodicRotate, times, n, v, &TransformValues::periodicRotate);
+    ofxsGetValuesAtTimes(_periodicDeform, times, n, v, &TransformValues::periodicDeform);
+    ofxsGetValuesAtTimes(_periodicBend, times, n, v, &TransformValues::periodicBend);
+    ofxsGetValuesAtTimes(_periodicN, times, n, v, &TransformValues::periodicN);
+    ofxsGetValuesAtTimes(_periodicInterval, times, n, v, &TransformValues::periodicInterval);
+    ofxsGetValuesAtTimes(_periodicCurve, times, n, v, &TransformValues::periodicCurve);
     if (_periodicFrequencyUnit) {
-        periodicFrequencyUnit = (FrequencyUnitEnum)_periodicFrequencyUnit->getValue();
-    }
-    BeatTypeEnum periodicFrequencyBeat = eBPMTypeQuarter;
-    if (_periodicFrequencyBeat) {
-        periodicFrequencyBeat = (BeatTypeEnum)_periodicFrequencyBeat->getValueAtTime(time);
-    }
-    OfxPointD periodicBezierP1 = { 0., 0. };
-    if (_periodicBezierP1) {
-        _periodicBezierP1->getValueAtTime(time, periodicBezierP1.x, periodicBezierP1.y);
-    }
-    OfxPointD periodicBezierP2 = { 1., 1. };
-    if (_periodicBezierP2) {
-        _periodicBezierP2->getValueAtTime(time, periodicBezierP2.x, periodicBezierP2.y);
-    }
-    bool periodicSymmetry = false;
-    if (_periodicSymmetry) {
-        periodicSymmetry = _periodicSymmetry->getValueAtTime(time);
+        const FrequencyUnitEnum periodicFrequencyUnit = (FrequencyUnitEnum)_periodicFrequencyUnit->getValue();
+        for (size_t i = 0; i < n; ++i) {
+            values[i].periodicFrequencyUnit = periodicFrequencyUnit;
+        }
     }
-    double periodicFrequency = 0.;
+    ofxsGetValuesAtTimes(_periodicFrequencyBeat, times, n, v, &TransformValues::periodicFrequencyBeat);
+    ofxsGetValuesAtTimes(_periodicBezierP1, times, n, v, &TransformValues::periodicBezierP1);
+    ofxsGetValuesAtTimes(_periodicBezierP2, times, n, v, &TransformValues::periodicBezierP2);
+    ofxsGetValuesAtTimes(_periodicSymmetry, times, n, v, &TransformValues::periodicSymmetry);
     if (_periodicFrequency) {
         if (_periodicFrequency->getIsAnimating() || _periodicFrequencyBeat->getIsAnimating()) {
-            for (int i = 0; i <= time; i++) {
-                double f = _periodicFrequency->getValueAtTime(i);
-                convertFrequency(periodicFrequencyUnit, eFrequencyUnitHz, (BeatTypeEnum)_periodicFrequencyBeat->getValueAtTime(i), &f);
-                periodicFrequency += f;
+            for (size_t i = 0; i < n; ++i) {
+                values[i].periodicFrequency = frameSum(eFrameSumPeriodicFrequency, times[i]) / (std::floor(times[i]) + 1);
+                values[i].periodicFrequencyUnit = eFrequencyUnitHz;
             }
-            periodicFrequency /= std::floor(time) + 1;
-            periodicFrequencyUnit = eFrequencyUnitHz;
-        } else { periodicFrequency = _periodicFrequency->getValueAtTime(time); }
+        } else {
+            ofxsGetValuesAtTimes(_periodicFrequency, times, n, v, &TransformValues::periodicFrequency);
+        }
     }
-    double periodicAutorotate = 0.;
     if (_periodicAutorotate) {
         if (_periodicAutorotate->getIsAnimating()) {
-            for (int i = 0; i <= time; i++) { periodicAutorotate += _periodicAutorotate->getValueAtTime(i); }
-            periodicAutorotate /= std::floor(time) + 1;
-        } else { periodicAutorotate = _periodicAutorotate->getValueAtTime(time); }
-    }
-    double periodicScale = 1.;
-    if (_periodicScale) {
-        periodicScale = _periodicScale->getValueAtTime(time);
-    }
-    double periodicScaleStep = 0.;
-    if (_periodicScaleStep) {
-        periodicScaleStep = _periodicScaleStep->getValueAtTime(time);
-    }
-    double periodicOffset = 0.;
-    if (_periodicOffset) {
-        periodicOffset = _periodicOffset->getValueAtTime(time);
-    }
-    double periodicSkip = 0.;
-    if (_periodicSkip) {
-        periodicSkip = _periodicSkip->getValueAtTime(time);
-    }
-    double functionFrequency = 1.;
-    if (_functionFrequency) {
-        functionFrequency = _functionFrequency->getValueAtTime(time);
-    }
-    std::string functionExpression = "";
-    if (_functionExpression) {
-        functionExpression = _functionExpression->getValueAtTime(time);
-    }
-    OfxPointD functionDomain = { -1., 1. };
-    if (_functionDomain) {
-        _functionDomain->getValueAtTime(time, functionDomain.x, functionDomain.y);
-    }
-    double functionUnit = 0.5;
-    if (_functionUnit) {
-        functionUnit = _functionUnit->getValueAtTime(time);
-    }
-    RoundTripEnum functionRoundTrip = eRoundTripNone;
-    if (_functionRoundTrip) {
-        functionRoundTrip = (RoundTripEnum)_functionRoundTrip->getValueAtTime(time);
-    }
-    double functionRotate = 0.;
-    if (_functionRotate) {
-        functionRotate = _functionRotate->getValueAtTime(time);
-    }
-    CurveTypeEnum functionCurve = eCurveTypeLinear;
-    if (_functionCurve) {
-        functionCurve = (CurveTypeEnum)_functionCurve->getValueAtTime(time);
-    }
-    OfxPointD functionBezierP1 = { 0., 0. };
-    if (_functionBezierP1) {
-        _functionBezierP1->getValueAtTime(time, functionBezierP1.x, functionBezierP1.y);
-    }
-    OfxPointD functionBezierP2 = { 1., 1. };
-    if (_functionBezierP2) {
-        _functionBezierP2->getValueAtTime(time, functionBezierP2.x, functionBezierP2.y);
-    }
-    bool functionSymmetry = false;
-    if (_functionSymmetry) {
-        functionSymmetry = _functionSymmetry->getValueAtTime(time);
-    }
-    OfxPointD scaleParam = { 1., 1. };
-    if (_scale) {
-        _scale->getValueAtTime(time, scaleParam.x, scaleParam.y);
-    }
-    bool scaleUniform = false;
-    if (_scaleUniform) {
-        scaleUniform = _scaleUniform->getValueAtTime(time);
-    }
-    bool flop = false;
-    if (_flop) {
-        flop = _flop->getValueAtTime(time);
-    }
-    bool flip = false;
-    if (_flip) {
-        flip = _flip->getValueAtTime(time);
-    }
-    double rotate = 0.;
-    if (_rotate) {
-        rotate = _rotate->getValueAtTime(time);
-    }
-    bool faceToCenter = false;
-    if (_faceToCenter) {
-        faceToCenter = _faceToCenter->getValueAtTime(time);
-    }
-    double skewX = 0.;
-    if (_skewX) {
-        skewX = _skewX->getValueAtTime(time);
+            for (size_t i = 0; i < n; ++i) {
+                values[i].periodicAutorotate = frameSum(eFrameSumPeriodicAutorotate, times[i]) / (std::floor(times[i]) + 1);
+            }
+        } else {
+            ofxsGetValuesAtTimes(_periodicAutorotate, times, n, v, &TransformValues::periodicAutorotate);
+        }
     }
-    double skewY = 0.;
-    if (_skewY) {
-        skewY = _skewY->getValueAtTime(time);
+    ofxsGetValuesAtTimes(_periodicScale, times, n, v, &TransformValues::periodicScale);
+    ofxsGetValuesAtTimes(_periodicScaleStep, times, n, v, &TransformValues::periodicScaleStep);
+    if ( _periodicScaleStep && _periodicScaleStep->getIsAnimating() ) {
+        for (size_t i = 0; i < n; ++i) {
+            values[i].periodicScaleStepAnimated = true;
+        }
     }
-    int skewOrder = 0;
-    if (_skewOrder) {
-        skewOrder = _skewOrder->getValueAtTime(time);
+    ofxsGetValuesAtTimes(_periodicOffset, times, n, v, &TransformValues::periodicOffset);
+    ofxsGetValuesAtTimes(_periodicSkip, times, n, v, &TransformValues::periodicSkip);
+    ofxsGetValuesAtTimes(_functionFrequency, times, n, v, &TransformValues::functionFrequency);
+    ofxsGetValuesAtTimes(_functionExpression, times, n, v, &TransformValues::functionExpression);
+    ofxsGetValuesAtTimes(_functionDomain, times, n, v, &TransformValues::functionDomain);
+    ofxsGetValuesAtTimes(_functionUnit, times, n, v, &TransformValues::functionUnit);
+    ofxsGetValuesAtTimes(_functionRoundTrip, times, n, v, &TransformValues::functionRoundTrip);
+    ofxsGetValuesAtTimes(_functionRotate, times, n, v, &TransformValues::functionRotate);
+    ofxsGetValuesAtTimes(_functionCurve, times, n, v, &TransformValues::functionCurve);
+    ofxsGetValuesAtTimes(_functionBezierP1, times, n, v, &TransformValues::functionBezierP1);
+    ofxsGetValuesAtTimes(_functionBezierP2, times, n, v, &TransformValues::functionBezierP2);
+    ofxsGetValuesAtTimes(_functionSymmetry, times, n, v, &TransformValues::functionSymmetry);
+    ofxsGetValuesAtTimes(_scale, times, n, v, &TransformValues::scaleParam);
+    ofxsGetValuesAtTimes(_scaleUniform, times, n, v, &TransformValues::scaleUniform);
+    ofxsGetValuesAtTimes(_flop, times, n, v, &TransformValues::flop);
+    ofxsGetValuesAtTimes(_flip, times, n, v, &TransformValues::flip);
+    ofxsGetValuesAtTimes(_rotate, times, n, v, &TransformValues::rotate);
+    ofxsGetValuesAtTimes(_faceToCenter, times, n, v, &TransformValues::faceToCenter);
+    ofxsGetValuesAtTimes(_skewX, times, n, v, &TransformValues::skewX);
+    ofxsGetValuesAtTimes(_skewY, times, n, v, &TransformValues::skewY);
+    ofxsGetValuesAtTimes(_skewOrder, times, n, v, &TransformValues::skewOrder);
+    ofxsGetValuesAtTimes(_transformAmount, times, n, v, &TransformValues::transformAmount);
+
+    return params;
+} // TransformPlugin::getTransformParams
+
+bool
+TransformPlugin::getInverseTransformCanonical(double time,
+                                              int view,
+                                              double amount,
+                                              bool invert,
+                                              Matrix3x3* invtransform) const
+{
+    auto_ptr<TransformParams> params( getTransformParams(&time, 1, view) );
+
+    return getInverseTransformCanonicalFromParams(*params, 0, amount, invert, invtransform);
+}
+
+bool
+TransformPlugin::getInverseTransformCanonicalFromParams(const TransformParams& params,
+                                                        size_t i,
+                                                        double amount,
+                                                        bool invert,
+                                                        Matrix3x3* invtransform) const
+{
+    assert( dynamic_cast<const TransformParamsBatch*>(&params) );
+    TransformBatchState state(_functionExpressionCache);
+
+    return getInverseTransformCanonicalFromBatch(static_cast<const TransformParamsBatch&>(params), i, amount, invert, &state, invtransform);
+}
+
+// all the samples are computed from one fetch of the parameters, with one expression program
+void
+TransformPlugin::getInverseTransformsCanonical(const double* times,
+                                               const double* amounts,
+                                               size_t n,
+                                               int view,
+                                               bool invert,
+                                               Matrix3x3* invtransforms,
+                                               bool* success) const
+{
+    if (n == 0) {
+        return;
     }
-    if (_transformAmount) {
-        amount *= _transformAmount->getValueAtTime(time);
+    auto_ptr<TransformParams> params( getTransformParams(times, n, view) );
+    const TransformParamsBatch& batch = static_cast<const TransformParamsBatch&>(*params);
+    TransformBatchState state(_functionExpressionCache);
+    for (size_t i = 0; i < n; ++i) {
+        success[i] = getInverseTransformCanonicalFromBatch(batch, i, amounts[i], invert, &state, &invtransforms[i]);
     }
+}
+
+bool
+TransformPlugin::getInverseTransformCanonicalFromBatch(const TransformParamsBatch& batch,
+                                                       size_t i,
+                                                       double amount,
+                                                       bool invert,
+                                                       TransformBatchState* state,
+                                                       Matrix3x3* invtransform) const
+{
+    assert( i < batch.values.size() );
+    const TransformValues& values = batch.values[i];
+    const double time = values.time;
+    // NON-GENERIC
+    OfxPointD center = values.center;
+    OfxPointD translate = values.translate;
+    double periodicRadius = values.periodicRadius;
+    double periodicRotate = values.periodicRotate;
+    double periodicDeform = values.periodicDeform;
+    double periodicBend = values.periodicBend;
+    int periodicN = values.periodicN;
+    int periodicInterval = values.periodicInterval;
+    CurveTypeEnum periodicCurve = values.periodicCurve;
+    FrequencyUnitEnum periodicFrequencyUnit = values.periodicFrequencyUnit;
+    BeatTypeEnum periodicFrequencyBeat = values.periodicFrequencyBeat;
+    OfxPointD periodicBezierP1 = values.periodicBezierP1;
+    OfxPointD periodicBezierP2 = values.periodicBezierP2;
+    bool periodicSymmetry = values.periodicSymmetry;
+    double periodicFrequency = values.periodicFrequency;
+    double periodicAutorotate = values.periodicAutorotate;
+    double periodicScale = values.periodicScale;
+    double periodicScaleStep = values.periodicScaleStep;
+    double periodicOffset = values.periodicOffset;
+    double periodicSkip = values.periodicSkip;
+    double functionFrequency = values.functionFrequency;
+    const std::string& functionExpression = values.functionExpression;
+    OfxPointD functionDomain = values.functionDomain;
+    double functionUnit = values.functionUnit;
+    RoundTripEnum functionRoundTrip = values.functionRoundTrip;
+    double functionRotate = values.functionRotate;
+    CurveTypeEnum functionCurve = values.functionCurve;
+    OfxPointD functionBezierP1 = values.functionBezierP1;
+    OfxPointD functionBezierP2 = values.functionBezierP2;
+    bool functionSymmetry = values.functionSymmetry;
+    OfxPointD scaleParam = values.scaleParam;
+    bool scaleUniform = values.scaleUniform;
+    bool flop = values.flop;
+    bool flip = values.flip;
+    double rotate = values.rotate;
+    bool faceToCenter = values.faceToCenter;
+    double skewX = values.skewX;
+    double skewY = values.skewY;
+    int skewOrder = values.skewOrder;
+    amount *= values.transformAmount;
 
     OfxPointD scale = { 1., 1. };
     ofxsTransformGetScale(scaleParam, scaleUniform, flop, flip, &scale);
@@ -807,8 +1227,8 @@ TransformPlugin::getInverseTransformCanonical(double time,
     }
 
 
-    OfxPointD size = getProjectSize();
-    OfxPointD offset = getProjectOffset();
+    OfxPointD size = batch.projectSize;
+    OfxPointD offset = batch.projectOffset;
     //OfxRectD rod = _srcClip->getRegionOfDefinition(time);
     //size.x = std::abs(rod.x2 - rod.x1);
     //size.y = std::abs(rod.y2 - rod.y1);
@@ -825,7 +1245,7 @@ TransformPlugin::getInverseTransformCanonical(double time,
     } else {
         convertFrequency(periodicFrequencyUnit, eFrequencyUnitHz, periodicFrequencyBeat, &periodicFrequency);
         periodicOffset *= periodicN == 1 ? periodicInterval : periodicN;
-        periodicOffset += periodicFrequency * time / getFrameRate();
+        periodicOffset += periodicFrequency * time / batch.frameRate;
         functionOffset = periodicOffset;
         if (periodicSkip != 0.) {
             periodicOffset += std::floor(periodicOffset / periodicSkip) * periodicSkip;
@@ -841,7 +1261,7 @@ TransformPlugin::getInverseTransformCanonical(double time,
             if (isReversed) {
                 b = 1 - b;
             }
-            b = findBezierY(b, periodicBezierP1, periodicBezierP2);
+            b = ease(periodicCurve, b, periodicBezierP1, periodicBezierP2, state);
             if (isReversed) {
                 b = 1 - b;
             }
@@ -874,13 +1294,8 @@ TransformPlugin::getInverseTransformCanonical(double time,
 
         if (periodicScaleStep != 0. && periodicFrequency != 0.) {
             double f = periodicOffset * 2 / periodicScaleStep;
-            if (_periodicScaleStep->getIsAnimating()) {
-                double ff = 0;
-                for (int i = 0; i <= time; i++) {
-                    double s = _periodicScaleStep->getValueAtTime(i);
-                    ff += s != 0 ? 1 / s : 0;
-                }
-                f = periodicOffset * 2 * ff / (std::floor(time) + 1);
+            if (values.periodicScaleStepAnimated) {
+                f = periodicOffset * 2 * frameSum(eFrameSumPeriodicScaleStep, time) / (std::floor(time) + 1);
             }
             periodicScale = (periodicScale - 1) * std::abs(f - std::floor(f) + (int)f % 2 - 1) + 1;
         }
@@ -912,7 +1327,7 @@ TransformPlugin::getInverseTransformCanonical(double time,
                     if (isReversed) {
                         b = 1 - b;
                     }
-                    b = findBezierY(b, functionBezierP1, functionBezierP2);
+                    b = ease(functionCurve == eCurveTypeUniform ? periodicCurve : functionCurve, b, functionBezierP1, functionBezierP2, state);
                     if (isReversed) {
                         b = 1 - b;
                     }
@@ -925,21 +1340,8 @@ TransformPlugin::getInverseTransformCanonical(double time,
                 functionOffset = functionRoundTrip == eRoundTripNone ? (functionOffset - std::floor(functionOffset)) * l + functionDomain.x
                                                                      : (sgn < 0 ? std::min(functionDomain.x, functionDomain.y) + std::abs(dis) : std::max(functionDomain.x, functionDomain.y) - std::abs(dis));
             }
-            typedef exprtk::symbol_table<double> symbol_table_t;
-            typedef exprtk::expression<double>   expression_t;
-            typedef exprtk::parser<double>       parser_t;
-            symbol_table_t symbol_table;
-            expression_t   expression;
-            parser_t       parser;
-            symbol_table_t glbl_const_symbol_table;
-            glbl_const_symbol_table.add_constants();
-            symbol_table.add_constant("e", exprtk::details::numeric::constant::e);
-            expression.register_symbol_table(glbl_const_symbol_table);
-            symbol_table.add_variable("x", functionOffset);
-            expression.register_symbol_table(symbol_table);
-            parser.compile(functionExpression, expression);
             p = { functionOffset  *  ((functionRoundTrip == eRoundTripHorizontal || functionRoundTrip == eRoundTripBoth) && dis < 0 ? -1 : 1),
-                  expression.value() * ((functionRoundTrip == eRoundTripVertical || functionRoundTrip == eRoundTripBoth) && dis < 0 ? -1 : 1) };
+                  state->expression.evaluate(functionExpression, functionOffset) * ((functionRoundTrip == eRoundTripVertical || functionRoundTrip == eRoundTripBoth) && dis < 0 ? -1 : 1) };
             functionRotate = ofxsToRadians(functionRotate);
             p = { p.x * std::cos(functionRotate) + p.y * std::sin(functionRotate),
                   p.y * std::cos(functionRotate) - p.x * std::sin(functionRotate) };
@@ -960,7 +1362,7 @@ TransformPlugin::getInverseTransformCanonical(double time,
     }
 
     return true;
-} // TransformPlugin::getInverseTransformCanonical
+} // TransformPlugin::getInverseTransformCanonicalFromBatch
 
 void
 TransformPlugin::resetCenter(double time)
@@ -1150,6 +1552,16 @@ void
 TransformPlugin::changedParam(const InstanceChangedArgs &args,
                               const std::string &paramName)
 {
+    if ( (paramName == kParamTransformPeriodicFrequency) || (paramName == kParamTransformPeriodicFrequencyUnit) || (paramName == kParamTransformPeriodicFrequencyBeat) ) {
+        invalidateFrameSum(eFrameSumPeriodicFrequency);
+    } else if (paramName == kParamTransformPeriodicAutorotate) {
+        invalidateFrameSum(eFrameSumPeriodicAutorotate);
+    } else if (paramName == kParamTransformPeriodicScaleStep) {
+        invalidateFrameSum(eFrameSumPeriodicScaleStep);
+    } else if (paramName == kParamTransformFunctionFrequency) {
+        invalidateFrameSum(eFrameSumFunctionFrequency);
+    }
+
     if (paramName == kParamTransformResetCenterOld) {
         resetCenter(args.time);
         // Only set if necessary
@@ -1246,6 +1658,15 @@ TransformPlugin::changedParam(const InstanceChangedArgs &args,
             }
         }
         changedTransform(args);
+    } else if (paramName == kParamTransformFunctionExpression) {
+        Transform3x3Plugin::changedParam(args, paramName);
+        // report the errors once here, the renders evaluate the expression as exprtk leaves it
+        std::string functionExpression;
+        _functionExpression->getValueAtTime(args.time, functionExpression);
+        std::string error;
+        if ( !functionExpression.empty() && !TransformExpressionCache::check(functionExpression, &error) ) {
+            setPersistentMessage(Message::eMessageError, "", "Expression: " + error);
+        }
     } else if ( (paramName == kParamPremult) && (args.reason == eChangeUserEdit) ) {
         // Only set if necessary
         if (!_srcClipChanged->getValue()) {
@@ -0,0 +1,287 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/NatronGitHub/openfx-misc>,
+ * (C) 2018-2021 The Natron Developers
+ * (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-Miscz.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * The easing curves of the Transform plugin: cubic Bezier curves from (0, 0) to (1, 1), and their tables.
+ */
+
+#ifndef Misc_TransformEasing_h
+#define Misc_TransformEasing_h
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "ofxCore.h"
+
+namespace OFX {
+
+enum CurveTypeEnum
+{
+    eCurveTypeCustom,
+    eCurveTypeDefault,
+    eCurveTypeEase,
+    eCurveTypeEaseIn,
+    eCurveTypeEaseOut,
+    eCurveTypeQuad,
+    eCurveTypeQuadIn,
+    eCurveTypeQuadOut,
+    eCurveTypeCubic,
+    eCurveTypeCubicIn,
+    eCurveTypeCubicOut,
+    eCurveTypeQuart,
+    eCurveTypeQuartIn,
+    eCurveTypeQuartOut,
+    eCurveTypeQuint,
+    eCurveTypeQuintIn,
+    eCurveTypeQuintOut,
+    eCurveTypeExpo,
+    eCurveTypeExpoIn,
+    eCurveTypeExpoOut,
+    eCurveTypeCirc,
+    eCurveTypeCircIn,
+    eCurveTypeCircOut,
+    eCurveTypeBack,
+    eCurveTypeBackIn,
+    eCurveTypeBackOut,
+    eCurveTypeLinear,
+    eCurveTypeUniform
+};
+
+inline void
+getCurveValue(const CurveTypeEnum curveType,
+    double* x1,
+    double* y1,
+    double* x2,
+    double* y2)
+{
+    switch (curveType) {
+    case eCurveTypeDefault:
+        *x1 = 0.50; *y1 = 0.00; *x2 = 0.50; *y2 = 1.00; break;
+    case eCurveTypeLinear:
+        *x1 = 0.00; *y1 = 0.00; *x2 = 1.00; *y2 = 1.00; break;
+    case eCurveTypeEase:
+        *x1 = 0.42; *y1 = 0.00; *x2 = 0.58; *y2 = 1.00; break;
+    case eCurveTypeEaseIn:
+        *x1 = 0.42; *y1 = 0.00; *x2 = 1.00; *y2 = 1.00; break;
+    case eCurveTypeEaseOut:
+        *x1 = 0.00; *y1 = 0.00; *x2 = 0.58; *y2 = 1.00; break;
+    case eCurveTypeQuad:
+        *x1 = 0.48; *y1 = 0.04; *x2 = 0.52; *y2 = 0.96; break;
+    case eCurveTypeQuadIn:
+        *x1 = 0.26; *y1 = 0.00; *x2 = 0.60; *y2 = 0.20; break;
+    case eCurveTypeQuadOut:
+        *x1 = 0.40; *y1 = 0.80; *x2 = 0.74; *y2 = 1.00; break;
+    case eCurveTypeCubic:
+        *x1 = 0.66; *y1 = 0.00; *x2 = 0.34; *y2 = 1.00; break;
+    case eCurveTypeCubicIn:
+        *x1 = 0.40; *y1 = 0.00; *x2 = 0.68; *y2 = 0.06; break;
+    case eCurveTypeCubicOut:
+        *x1 = 0.32; *y1 = 0.94; *x2 = 0.60; *y2 = 1.00; break;
+    case eCurveTypeQuart:
+        *x1 = 0.76; *y1 = 0.00; *x2 = 0.24; *y2 = 1.00; break;
+    case eCurveTypeQuartIn:
+        *x1 = 0.52; *y1 = 0.00; *x2 = 0.74; *y2 = 0.00; break;
+    case eCurveTypeQuartOut:
+        *x1 = 0.26; *y1 = 1.00; *x2 = 0.48; *y2 = 1.00; break;
+    case eCurveTypeQuint:
+        *x1 = 0.84; *y1 = 0.00; *x2 = 0.16; *y2 = 1.00; break;
+    case eCurveTypeQuintIn:
+        *x1 = 0.64; *y1 = 0.00; *x2 = 0.78; *y2 = 0.00; break;
+    case eCurveTypeQuintOut:
+        *x1 = 0.22; *y1 = 1.00; *x2 = 0.36; *y2 = 1.00; break;
+    case eCurveTypeExpo:
+        *x1 = 0.90; *y1 = 0.00; *x2 = 0.10; *y2 = 1.00; break;
+    case eCurveTypeExpoIn:
+        *x1 = 0.66; *y1 = 0.00; *x2 = 0.86; *y2 = 0.00; break;
+    case eCurveTypeExpoOut:
+        *x1 = 0.14; *y1 = 1.00; *x2 = 0.34; *y2 = 1.00; break;
+    case eCurveTypeCirc:
+        *x1 = 0.88; *y1 = 0.14; *x2 = 0.12; *y2 = 0.86; break;
+    case eCurveTypeCircIn:
+        *x1 = 0.54; *y1 = 0.00; *x2 = 1.00; *y2 = 0.44; break;
+    case eCurveTypeCircOut:
+        *x1 = 0.00; *y1 = 0.56; *x2 = 0.46; *y2 = 1.00; break;
+    case eCurveTypeBack:
+        *x1 = 0.68; *y1 = -0.55; *x2 = 0.27; *y2 = 1.55; break;
+    case eCurveTypeBackIn:
+        *x1 = 0.60; *y1 = -0.28; *x2 = 0.73; *y2 = 0.04; break;
+    case eCurveTypeBackOut:
+        *x1 = 0.17; *y1 = 0.89; *x2 = 0.32; *y2 = 1.27; break;
+    default:
+        break;
+    }
+}
+
+inline double bezierX(double t,
+                      OfxPointD p1,
+                      OfxPointD p2) {
+    return 3 * (1 - t) * (1 - t) * t * p1.x + 3 * (1 - t) * t * t * p2.x + t * t * t;
+}
+
+inline double bezierY(double t,
+                      OfxPointD p1,
+                      OfxPointD p2) {
+    return 3 * (1 - t) * (1 - t) * t * p1.y + 3 * (1 - t) * t * t * p2.y + t * t * t;
+}
+
+inline double findTForX(double m,
+                        OfxPointD p1,
+                        OfxPointD p2) {
+    double t_low = 0.0;
+    double t_high = 1.0;
+    double t_mid = (t_low + t_high) / 2.0;
+
+    while ((t_high - t_low) / 2.0 > 1e-6) {
+        if (bezierX(t_mid, p1, p2) < m) {
+            t_low = t_mid;
+        }
+        else {
+            t_high = t_mid;
+        }
+        t_mid = (t_low + t_high) / 2.0;
+    }
+
+    return t_mid;
+}
+
+inline double bezierXDerivative(double t,
+                                OfxPointD p1,
+                                OfxPointD p2) {
+    return 3 * (1 - t) * (1 - t) * p1.x + 6 * (1 - t) * t * (p2.x - p1.x) + 3 * t * t * (1 - p2.x);
+}
+
+inline double findBezierY(double m,
+                          OfxPointD p1,
+                          OfxPointD p2) {
+    double t = findTForX(m, p1, p2);
+    return bezierY(t, p1, p2);
+}
+
+#define kEasingTableSize 256 // number of intervals of the tables of the easing curves
+
+// A cubic Bezier easing curve from (0, 0) to (1, 1), tabulated by the parameters t at which x(t) = k / kEasingTableSize.
+// The value at x is then found from the interpolated t by a few Newton steps (with a bisection fallback) within one
+// interval, instead of the full bisection of findTForX(), for the same or better accuracy.
+// The table is only valid if x(t) is monotonic, i.e. if the control points have an x in [0, 1].
+class EasingTable
+{
+public:
+    EasingTable(const OfxPointD& p1,
+                const OfxPointD& p2)
+        : _p1(p1)
+        , _p2(p2)
+    {
+        for (int k = 1; k < kEasingTableSize; ++k) {
+            const double m = k / (double)kEasingTableSize;
+            double t_low = 0.;
+            double t_high = 1.;
+            for (int i = 0; i < 52; ++i) {
+                const double t_mid = (t_low + t_high) / 2.;
+                if (bezierX(t_mid, _p1, _p2) < m) {
+                    t_low = t_mid;
+                } else {
+                    t_high = t_mid;
+                }
+            }
+            _t[k] = (t_low + t_high) / 2.;
+        }
+        _t[0] = 0.;
+        _t[kEasingTableSize] = 1.;
+    }
+
+    static bool isTabulable(const OfxPointD& p1,
+                            const OfxPointD& p2)
+    {
+        return 0. <= p1.x && p1.x <= 1. && 0. <= p2.x && p2.x <= 1.;
+    }
+
+    // the y of the curve at x = m
+    double value(double m) const
+    {
+        m = std::max(0., std::min(m, 1.));
+        const double pos = m * kEasingTableSize;
+        const int k = std::min( (int)pos, kEasingTableSize - 1 );
+        double t_low = _t[k];
+        double t_high = _t[k + 1];
+        double t = t_low + (t_high - t_low) * (pos - k);
+        // stop at the tolerance of findTForX()
+        for (int i = 0; i < 40 && t_high - t_low > 2e-6; ++i) {
+            const double dx = bezierX(t, _p1, _p2) - m;
+            if (dx == 0.) {
+                break;
+            }
+            if (dx < 0.) {
+                t_low = t;
+            } else {
+                t_high = t;
+            }
+            const double d = bezierXDerivative(t, _p1, _p2);
+            const double newton = d > 0. ? t - dx / d : t_low;
+            if ( (t_low < newton) && (newton < t_high) ) {
+                const bool converged = std::abs(newton - t) < 1e-9;
+                t = newton;
+                if (converged) {
+                    break;
+                }
+            } else {
+                t = (t_low + t_high) / 2.;
+            }
+        }
+
+        return bezierY(t, _p1, _p2);
+    }
+
+private:
+    OfxPointD _p1;
+    OfxPointD _p2;
+    double _t[kEasingTableSize + 1];
+};
+
+// the tables of the preset curves
+class EasingPresets
+{
+public:
+    EasingPresets()
+    {
+        for (int i = 0; i <= eCurveTypeUniform; ++i) {
+            // eCurveTypeCustom and eCurveTypeUniform have no values, and get a linear table that is never used
+            OfxPointD p1 = { 0., 0. };
+            OfxPointD p2 = { 1., 1. };
+            getCurveValue( (CurveTypeEnum)i, &p1.x, &p1.y, &p2.x, &p2.y );
+            assert( EasingTable::isTabulable(p1, p2) );
+            _tables.push_back( EasingTable(p1, p2) );
+        }
+    }
+
+    double value(CurveTypeEnum curveType,
+                 double m) const
+    {
+        assert(curveType != eCurveTypeCustom && curveType != eCurveTypeUniform);
+
+        return _tables[curveType].value(m);
+    }
+
+private:
+    std::vector<EasingTable> _tables;
+};
+} // namespace OFX
+
+#endif // Misc_TransformEasing_h